@@ -0,0 +1,1626 @@
+/**
+ * File: lfl-benchmarks.cpp
+ * -------------
+ * This program times the Lisp Flavored Logic pipeline on synthetic input.
+ * It is built like the REPL, from the sources in src/, but with its own
+ * main in place of lisp-flavored-logic-main.cpp, as in the README:
+ *
+ *   g++ -std=c++11 -O2 -pthread -I"$SPL_INCLUDE" -Isrc bench/lfl-benchmarks.cpp \
+ *       $(find src -name '*.cpp' ! -name lisp-flavored-logic-main.cpp) $SPL_SOURCES -o lfl-benchmarks
+ *
+ * where SPL_INCLUDE names the Stanford C++ library's headers and
+ * SPL_SOURCES its .cpp files. Run with --suite it prints only the phase
+ * suite, whose output keeps the same rows from one version to the next so
+ * that two runs can be compared line by line.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <iomanip>
+#include <iostream>
+#include <streambuf>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "sexpressions.h"
+#include "sexpression-parser.h"
+#include "langexpressions.h"
+#include "langexpression-parser.h"
+#include "langexpression-factory.h"
+#include "expression-arena.h"
+#include "langexpression-compiler.h"
+#include "langexpression-simplifier.h"
+#include "truth-table.h"
+#include "truth-table-sweep.h"
+#include "tseitin-encoder.h"
+#include "bdd.h"
+#include "formula-registry.h"
+#include "formula-image.h"
+#include "symbol-table.h"
+#include "batch-runner.h"
+#include "mapped-file.h"
+#include "flat-formula.h"
+#include "assignment-batch.h"
+using namespace std;
+
+static double timeSeconds(const chrono::steady_clock::time_point& start);
+static string nestedNegations(int depth);
+static string balancedConjunction(int depth);
+static void benchmarkParser(const string& name, const string& input);
+static void benchmarkParserScaling();
+static void benchmarkArena();
+static string randomFormula(int variables, int depth, mt19937& random);
+static void benchmarkCompiledEval();
+static void benchmarkTruthTable();
+static void benchmarkGlobals();
+static string nestedLets(int depth);
+static void benchmarkNestedLets();
+static void benchmarkShortCircuit();
+static string repeatedSubformulas(int levels);
+static void benchmarkHashConsing();
+static string conjunctionChain(int length);
+static void benchmarkDeepFormula(const string& name, const string& input);
+static void benchmarkDeepFormulas();
+static string flatList(int length);
+static void benchmarkLongLists();
+static void benchmarkBatchInput();
+static void benchmarkParallelBatch();
+static void benchmarkSymbolLookups();
+static void benchmarkParallelSweep();
+static string randomDimacs(int variables, int clauses, mt19937& random);
+static string dimacsToFormula(const string& dimacs);
+static void benchmarkSatSolver();
+static string pairedDisjunction(int pairs, bool reversed);
+static void benchmarkBdd();
+static string generatedFormula(int variables, int depth, mt19937& random);
+static void benchmarkSimplifier();
+static void benchmarkRegistry();
+static string letHeavyFormula(int bindings, mt19937& random);
+static string randomNormalForm(int variables, int terms, int width, bool conjunctive, mt19937& random);
+static int countLangNodes(const LangExpression *lexp);
+static void benchmarkPhases(const string& generator, int size, const string& input);
+static void benchmarkSuite();
+static void benchmarkImage();
+static string spelledFormula(const char *const spellings[], int depth, mt19937& random);
+static void benchmarkOperatorDispatch();
+static string wideConjunction(int clauses, bool nary);
+static void benchmarkWideFormulas();
+static void benchmarkFlatFormulas();
+static void benchmarkAssignmentBatches();
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && string(argv[1]) == "--suite") {
+        benchmarkSuite();
+        return 0;
+    }
+    benchmarkParserScaling();
+    benchmarkArena();
+    benchmarkCompiledEval();
+    benchmarkTruthTable();
+    benchmarkGlobals();
+    benchmarkNestedLets();
+    benchmarkShortCircuit();
+    benchmarkHashConsing();
+    benchmarkDeepFormulas();
+    benchmarkLongLists();
+    benchmarkBatchInput();
+    benchmarkParallelBatch();
+    benchmarkSymbolLookups();
+    benchmarkParallelSweep();
+    benchmarkSatSolver();
+    benchmarkBdd();
+    benchmarkSimplifier();
+    benchmarkRegistry();
+    benchmarkImage();
+    benchmarkOperatorDispatch();
+    benchmarkWideFormulas();
+    benchmarkFlatFormulas();
+    benchmarkAssignmentBatches();
+    benchmarkSuite();
+    return 0;
+}
+
+double timeSeconds(const chrono::steady_clock::time_point& start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Function: nestedNegations
+ * Usage: string input = nestedNegations(depth);
+ * -------------------------------------------
+ * Returns ((not) ((not) ... p)) nested depth levels deep.
+ */
+
+string nestedNegations(int depth) {
+    string input;
+    for (int i = 0; i < depth; i++) input += "((not) ";
+    input += "p";
+    input += string(depth, ')');
+    return input;
+}
+
+/**
+ * Function: balancedConjunction
+ * Usage: string input = balancedConjunction(depth);
+ * -------------------------------------------
+ * Returns a complete binary tree of conjunctions with 2^depth leaves.
+ */
+
+string balancedConjunction(int depth) {
+    if (depth == 0) return "p";
+    string half = balancedConjunction(depth - 1);
+    return "((and) " + half + " " + half + ")";
+}
+
+void benchmarkParser(const string& name, const string& input) {
+    int repetitions = max(1, (1 << 22) / static_cast<int>(input.size()));
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++) delete parseOneSExp(input);
+    double seconds = timeSeconds(start) / repetitions;
+    cout << left << setw(28) << name
+         << right << setw(12) << input.size() << " bytes"
+         << setw(14) << fixed << setprecision(3) << seconds * 1e3 << " ms"
+         << setw(10) << setprecision(2) << seconds * 1e9 / input.size() << " ns/byte" << endl;
+}
+
+/**
+ * Function: benchmarkParserScaling
+ * --------------------------------
+ * Parses inputs that double in size from row to row. A linear-time parser
+ * keeps the ns/byte column flat all the way up to several megabytes.
+ */
+
+void benchmarkParserScaling() {
+    cout << "S-expression parser scaling" << endl;
+    for (int depth = 250; depth <= 16000; depth *= 2)
+        benchmarkParser("nested not, depth " + to_string(depth), nestedNegations(depth));
+    for (int depth = 8; depth <= 18; depth += 2)
+        benchmarkParser("balanced and, depth " + to_string(depth), balancedConjunction(depth));
+}
+
+/**
+ * Function: benchmarkArena
+ * ------------------------
+ * Runs whole parse-lower-free cycles on many small formulas, once with
+ * heap-allocated trees and once with one arena reset after every formula.
+ */
+
+void benchmarkArena() {
+    cout << endl << "Parse, lower and free: heap vs. arena" << endl;
+    string input = balancedConjunction(5);
+    const int cycles = 20000;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < cycles; i++) {
+        SExpression *sexp = parseOneSExp(input);
+        LangExpression *lexp = parseLangExp(sexp);
+        delete lexp;
+        delete sexp;
+    }
+    double heapSeconds = timeSeconds(start);
+    ExpressionArena arena;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < cycles; i++) {
+        parseLangExp(parseOneSExp(input, &arena), &arena);
+        arena.reset();
+    }
+    double arenaSeconds = timeSeconds(start);
+    cout << fixed << setprecision(2)
+         << "heap  " << setw(10) << heapSeconds * 1e6 / cycles << " us/formula" << endl
+         << "arena " << setw(10) << arenaSeconds * 1e6 / cycles << " us/formula" << endl;
+}
+
+/**
+ * Function: randomFormula
+ * Usage: string input = randomFormula(variables, depth, random);
+ * -------------------------------------------
+ * Returns a random formula over x0 ... x(variables - 1) whose binary
+ * connectives are nested depth levels deep.
+ */
+
+string randomFormula(int variables, int depth, mt19937& random) {
+    if (depth == 0) return "x" + to_string(random() % variables);
+    static const char *operators[] = { "and", "or", "imp", "iff" };
+    string formula = "((" + string(operators[random() % 4]) + ") "
+                   + randomFormula(variables, depth - 1, random) + " "
+                   + randomFormula(variables, depth - 1, random) + ")";
+    if (random() % 4 == 0) formula = "((not) " + formula + ")";
+    return formula;
+}
+
+/**
+ * Function: benchmarkCompiledEval
+ * -------------------------------
+ * Evaluates one formula against many assignments, first by setting the
+ * variables in a LangEvaluationContext and walking the tree, then by
+ * setting slots in a FormulaState and running the compiled instructions.
+ */
+
+void benchmarkCompiledEval() {
+    cout << endl << "Repeated evaluation: tree walker vs. compiled formula" << endl;
+    mt19937 random(106);
+    const int variables = 16;
+    for (int depth = 4; depth <= 12; depth += 4) {
+        SExpression *sexp = parseOneSExp(randomFormula(variables, depth, random));
+        LangExpression *lexp = parseLangExp(sexp);
+        CompiledFormula formula(lexp);
+        int nodes = formula.getInstructions().size();
+        int assignments = max(1000, (1 << 24) / nodes);
+        vector<string> names;
+        for (int i = 0; i < variables; i++) names.push_back("x" + to_string(i));
+
+        LangEvaluationContext context;
+        int trueCount = 0;
+        auto start = chrono::steady_clock::now();
+        for (int row = 0; row < assignments; row++) {
+            for (int i = 0; i < variables; i++) context.setValue(names[i], (row >> i) & 1);
+            trueCount += lexp->eval(context);
+        }
+        double treeSeconds = timeSeconds(start);
+
+        FormulaState state = formula.newState();
+        vector<int> slotVariables;
+        for (int slot = 0; slot < formula.getSlotCount(); slot++)
+            slotVariables.push_back(stoi(formula.getSlotName(slot).substr(1)));
+        int compiledTrueCount = 0;
+        start = chrono::steady_clock::now();
+        for (int row = 0; row < assignments; row++) {
+            for (int slot = 0; slot < formula.getSlotCount(); slot++)
+                state.setValue(slot, (row >> slotVariables[slot]) & 1);
+            compiledTrueCount += formula.run(state);
+        }
+        double compiledSeconds = timeSeconds(start);
+        if (trueCount != compiledTrueCount) cout << "MISMATCH between tree and compiled results" << endl;
+        cout << fixed << setprecision(2) << setw(8) << nodes << " nodes"
+             << "   tree " << setw(8) << treeSeconds * 1e9 / (double(assignments) * nodes) << " ns/node"
+             << "   compiled " << setw(8) << compiledSeconds * 1e9 / (double(assignments) * nodes) << " ns/node" << endl;
+        delete lexp;
+        delete sexp;
+    }
+}
+
+/**
+ * Function: benchmarkTruthTable
+ * -----------------------------
+ * Counts the models of a chain formula over a growing number of variables
+ * with the bit-parallel truth-table engine.
+ */
+
+void benchmarkTruthTable() {
+    cout << endl << "Bit-parallel truth tables (" << kLanesPerBlock << " rows per block)" << endl;
+    for (int variables = 16; variables <= 28; variables += 4) {
+        string input = "x0";
+        for (int i = 1; i < variables; i++)
+            input = "((or) " + input + " ((iff) x" + to_string(i) + " ((not) x" + to_string(i - 1) + ")))";
+        SExpression *sexp = parseOneSExp(input);
+        LangExpression *lexp = parseLangExp(sexp);
+        TruthTable table(lexp);
+        auto start = chrono::steady_clock::now();
+        uint64_t models = table.countModels();
+        double seconds = timeSeconds(start);
+        cout << setw(4) << variables << " variables" << setw(14) << table.getRowCount() << " rows"
+             << setw(14) << models << " models" << fixed << setprecision(3) << setw(10) << seconds << " s"
+             << setprecision(2) << setw(10) << seconds * 1e9 / table.getRowCount() << " ns/row" << endl;
+        delete lexp;
+        delete sexp;
+    }
+}
+
+/**
+ * Function: benchmarkGlobals
+ * --------------------------
+ * Defines many globals with set, then times a formula that reads a handful
+ * of them. Lookups go through interned ids, so the cost per reference should
+ * not grow with the number of globals.
+ */
+
+void benchmarkGlobals() {
+    cout << endl << "Variable references with many globals defined" << endl;
+    for (int globals = 1000; globals <= 64000; globals *= 4) {
+        LangEvaluationContext context;
+        for (int i = 0; i < globals; i++) {
+            SExpression *sexp = parseOneSExp("((set) g" + to_string(i) + " " + to_string(i % 2) + ")");
+            LangExpression *lexp = parseLangExp(sexp);
+            lexp->eval(context);
+            delete lexp;
+            delete sexp;
+        }
+        string input = "g0";
+        for (int i = 1; i < 64; i++) input = "((or) " + input + " g" + to_string(i * (globals / 64)) + ")";
+        SExpression *sexp = parseOneSExp(input);
+        LangExpression *lexp = parseLangExp(sexp);
+        const int repetitions = 100000;
+        int trueCount = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < repetitions; i++) trueCount += lexp->eval(context);
+        double seconds = timeSeconds(start);
+        cout << setw(8) << globals << " globals" << fixed << setprecision(2)
+             << setw(10) << seconds * 1e9 / (repetitions * 64.0) << " ns/reference" << endl;
+        delete lexp;
+        delete sexp;
+    }
+}
+
+/**
+ * Function: nestedLets
+ * Usage: string input = nestedLets(depth);
+ * -------------------------------------------
+ * Returns depth nested lets that alternately bind v and one of a few other
+ * names, so that inner lets keep shadowing outer bindings of the same name.
+ */
+
+string nestedLets(int depth) {
+    string input;
+    for (int i = 0; i < depth; i++) {
+        string variable = i % 2 == 0 ? "v" : "w" + to_string(i % 7);
+        input += "((let) " + variable + " ((not) v) ";
+    }
+    input += "v";
+    input += string(depth, ')');
+    return "((let) v t " + input + ")";
+}
+
+/**
+ * Function: benchmarkNestedLets
+ * -----------------------------
+ * Evaluates 10,000-deep chains of shadowing lets, checking that every
+ * binding is restored by the time evaluation returns.
+ */
+
+void benchmarkNestedLets() {
+    cout << endl << "Nested let chains" << endl;
+    for (int depth = 1000; depth <= 10000; depth *= 10) {
+        SExpression *sexp = parseOneSExp(nestedLets(depth));
+        LangExpression *lexp = parseLangExp(sexp);
+        LangEvaluationContext context;
+        const int repetitions = 1000;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < repetitions; i++) lexp->eval(context);
+        double seconds = timeSeconds(start);
+        bool restored = !context.isDefined("v") && context.getScopeDepth() == 0;
+        cout << setw(8) << depth << " lets" << fixed << setprecision(2)
+             << setw(10) << seconds * 1e9 / (double(repetitions) * depth) << " ns/let"
+             << (restored ? "   bindings restored" : "   BINDINGS LEAKED") << endl;
+        delete lexp;
+        delete sexp;
+    }
+}
+
+/**
+ * Function: benchmarkShortCircuit
+ * -------------------------------
+ * Evaluates the same random formulas over the same assignments with strict
+ * and short-circuit evaluation, for both the tree walker and the compiled
+ * formula, and reports how many subtrees short-circuiting skipped.
+ */
+
+void benchmarkShortCircuit() {
+    cout << endl << "Strict vs. short-circuit evaluation" << endl;
+    mt19937 random(107);
+    const int variables = 16;
+    for (int depth = 8; depth <= 16; depth += 4) {
+        SExpression *sexp = parseOneSExp(randomFormula(variables, depth, random));
+        LangExpression *lexp = parseLangExp(sexp);
+        CompiledFormula formula(lexp);
+        int assignments = max(100, (1 << 22) >> depth);
+        vector<string> names;
+        for (int i = 0; i < variables; i++) names.push_back("x" + to_string(i));
+        vector<int> slotVariables;
+        for (int slot = 0; slot < formula.getSlotCount(); slot++)
+            slotVariables.push_back(stoi(formula.getSlotName(slot).substr(1)));
+        cout << setw(4) << depth << " levels" << endl;
+        for (int strict = 1; strict >= 0; strict--) {
+            LangEvaluationContext context;
+            context.setStrictEvaluation(strict);
+            int trueCount = 0;
+            auto start = chrono::steady_clock::now();
+            for (int row = 0; row < assignments; row++) {
+                for (int i = 0; i < variables; i++) context.setValue(names[i], (row >> i) & 1);
+                trueCount += lexp->eval(context);
+            }
+            double treeSeconds = timeSeconds(start);
+
+            FormulaState state = formula.newState();
+            state.setStrictEvaluation(strict);
+            int compiledTrueCount = 0;
+            start = chrono::steady_clock::now();
+            for (int row = 0; row < assignments; row++) {
+                for (int slot = 0; slot < formula.getSlotCount(); slot++)
+                    state.setValue(slot, (row >> slotVariables[slot]) & 1);
+                compiledTrueCount += formula.run(state);
+            }
+            double compiledSeconds = timeSeconds(start);
+            if (trueCount != compiledTrueCount) cout << "MISMATCH between tree and compiled results" << endl;
+            cout << (strict ? "      strict       " : "      short-circuit")
+                 << fixed << setprecision(2)
+                 << "   tree " << setw(10) << treeSeconds * 1e6 / assignments << " us/eval"
+                 << "   compiled " << setw(10) << compiledSeconds * 1e6 / assignments << " us/eval"
+                 << "   " << setprecision(1) << double(context.getSkippedSubtrees()) / assignments
+                 << " subtrees skipped/eval" << endl;
+        }
+        delete lexp;
+        delete sexp;
+    }
+}
+
+/**
+ * Function: repeatedSubformulas
+ * Usage: string input = repeatedSubformulas(levels);
+ * -------------------------------------------
+ * Returns a formula in which every level uses the previous level twice, so
+ * its text doubles with each level while it has only a few distinct
+ * subterms per level, the shape of much machine-generated input.
+ */
+
+string repeatedSubformulas(int levels) {
+    string formula = "x0";
+    for (int level = 1; level <= levels; level++) {
+        string x = "x" + to_string(level % 8);
+        string y = "x" + to_string((level + 3) % 8);
+        formula = "((iff) ((or) " + x + " " + formula + ") ((and) " + formula + " " + y + "))";
+    }
+    return formula;
+}
+
+/**
+ * Function: benchmarkHashConsing
+ * ------------------------------
+ * Compares trees with hash-consed DAGs on formulas full of repeated
+ * subterms: nodes built, bytes used, and evaluation time over a series of
+ * assignments, then batch mode with and without --hash-cons on a corpus
+ * whose formulas share most of their subterms.
+ */
+
+void benchmarkHashConsing() {
+    cout << endl << "Hash-consed DAGs vs. trees on repeated subformulas" << endl;
+    for (int levels = 8; levels <= 18; levels += 5) {
+        SExpression *sexp = parseOneSExp(repeatedSubformulas(levels));
+        ExpressionArena arena;
+        LangExpression *tree = parseLangExp(sexp, &arena);
+        LangExpressionFactory factory;
+        LangExpression *dag = parseLangExp(sexp, factory);
+        const int assignments = 64;
+        int treeTrue = 0;
+        int dagTrue = 0;
+        LangEvaluationContext context;
+        auto start = chrono::steady_clock::now();
+        for (int row = 0; row < assignments; row++) {
+            for (int i = 0; i < 8; i++) context.setValue("x" + to_string(i), (row * 37 >> i) & 1);
+            treeTrue += tree->eval(context);
+        }
+        double treeSeconds = timeSeconds(start);
+        start = chrono::steady_clock::now();
+        for (int row = 0; row < assignments; row++) {
+            for (int i = 0; i < 8; i++) context.setValue("x" + to_string(i), (row * 37 >> i) & 1);
+            dagTrue += dag->eval(context);
+        }
+        double dagSeconds = timeSeconds(start);
+        if (treeTrue != dagTrue) cout << "MISMATCH between tree and DAG results" << endl;
+        cout << setw(4) << levels << " levels" << setw(12) << factory.getRequestCount() << " tree nodes "
+             << setw(10) << arena.bytesUsed() << " bytes" << fixed << setprecision(2)
+             << setw(12) << treeSeconds * 1e6 / assignments << " us/eval" << endl
+             << "          " << setw(12) << factory.getNodeCount() << " DAG nodes  "
+             << setw(10) << factory.bytesUsed() << " bytes"
+             << setw(12) << dagSeconds * 1e6 / assignments << " us/eval" << endl;
+        delete sexp;
+    }
+    string corpus;
+    for (int i = 0; i < 8; i++) corpus += "((set) x" + to_string(i) + " " + (i % 3 == 0 ? "f" : "t") + ")\n";
+    for (int i = 0; i < 2000; i++) {
+        corpus += "((and) x" + to_string(i % 8) + " " + repeatedSubformulas(8 + i % 5) + ")\n";
+    }
+    string expected;
+    for (int hashCons = 0; hashCons <= 1; hashCons++) {
+        ostringstream out;
+        LangEvaluationContext context;
+        context.setStrictEvaluation(true);
+        BatchRunner runner(context, out, { false, false, false, hashCons == 1, 1, nullptr, nullptr });
+        auto start = chrono::steady_clock::now();
+        runner.runBuffer(corpus.data(), corpus.data() + corpus.size());
+        double seconds = timeSeconds(start);
+        if (hashCons == 0) expected = out.str();
+        cout << (hashCons ? "  batch DAGs" : " batch trees") << fixed << setprecision(2)
+             << setw(12) << runner.getFormulaCount() / seconds / 1e3 << "k formulas/s"
+             << (out.str() == expected ? "" : "   OUTPUT DIFFERS FROM TREES") << endl;
+    }
+}
+
+/**
+ * Function: conjunctionChain
+ * Usage: string input = conjunctionChain(length);
+ * -------------------------------------------
+ * Returns ((and) x0 ((and) x1 ... p)), a right-nested chain of length
+ * conjunctions over eight variables.
+ */
+
+string conjunctionChain(int length) {
+    string input;
+    for (int i = 0; i < length; i++) input += "((and) x" + to_string(i % 8) + " ";
+    input += "p";
+    input += string(length, ')');
+    return input;
+}
+
+void benchmarkDeepFormula(const string& name, const string& input) {
+    auto start = chrono::steady_clock::now();
+    SExpression *sexp = parseOneSExp(input);
+    double readSeconds = timeSeconds(start);
+    start = chrono::steady_clock::now();
+    LangExpression *lexp = parseLangExp(sexp);
+    double lowerSeconds = timeSeconds(start);
+    LangEvaluationContext context;
+    context.setValue("p", true);
+    for (int i = 0; i < 8; i++) context.setValue("x" + to_string(i), true);
+    const int repetitions = 20;
+    int trueCount = 0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++) trueCount += lexp->eval(context);
+    double evalSeconds = timeSeconds(start) / repetitions;
+    start = chrono::steady_clock::now();
+    size_t printed = lexp->toString().size() + sexp->toString().size();
+    double printSeconds = timeSeconds(start);
+    start = chrono::steady_clock::now();
+    delete lexp;
+    delete sexp;
+    double freeSeconds = timeSeconds(start);
+    cout << left << setw(28) << name << right << fixed << setprecision(2)
+         << setw(9) << readSeconds * 1e3 << " ms read"
+         << setw(9) << lowerSeconds * 1e3 << " ms lower"
+         << setw(9) << evalSeconds * 1e3 << " ms eval"
+         << setw(9) << printSeconds * 1e3 << " ms print"
+         << setw(9) << freeSeconds * 1e3 << " ms free"
+         << setw(12) << printed << " chars printed"
+         << (trueCount == 0 || trueCount == repetitions ? "" : "   INCONSISTENT RESULTS") << endl;
+}
+
+/**
+ * Function: benchmarkDeepFormulas
+ * -------------------------------
+ * Runs the whole pipeline on formulas up to 100,000 levels deep, far past
+ * what the machine stack would allow a recursive walk. Reading, lowering,
+ * evaluating, printing and freeing should each grow linearly with depth.
+ */
+
+void benchmarkDeepFormulas() {
+    cout << endl << "Deep formulas" << endl;
+    for (int depth = 1000; depth <= 100000; depth *= 10) {
+        benchmarkDeepFormula("nested not, depth " + to_string(depth), nestedNegations(depth));
+        benchmarkDeepFormula("and chain, depth " + to_string(depth), conjunctionChain(depth));
+    }
+}
+
+/**
+ * Function: flatList
+ * Usage: string input = flatList(length);
+ * -------------------------------------------
+ * Returns (x0 x1 ... ), a single list of length symbols.
+ */
+
+string flatList(int length) {
+    string input = "(";
+    for (int i = 0; i < length; i++) input += "x" + to_string(i % 8) + " ";
+    input += ")";
+    return input;
+}
+
+/**
+ * Function: benchmarkLongLists
+ * ----------------------------
+ * Walks lists of up to 100,000 elements with an SListView, converts them
+ * with toList and prints them with toString. All three should cost the
+ * same per element at every length.
+ */
+
+void benchmarkLongLists() {
+    cout << endl << "Long lists" << endl;
+    for (int length = 1000; length <= 100000; length *= 10) {
+        SExpression *list = parseOneSExp(flatList(length));
+        const int repetitions = max(1, 1000000 / length);
+        int symbols = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < repetitions; i++) {
+            for (SExpression *element : SListView(list)) symbols += element->getType() == SYMBOL;
+        }
+        double viewSeconds = timeSeconds(start) / repetitions;
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < repetitions; i++) symbols -= list->toList().size();
+        double toListSeconds = timeSeconds(start) / repetitions;
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < repetitions; i++) list->toString();
+        double toStringSeconds = timeSeconds(start) / repetitions;
+        cout << setw(8) << length << " elements" << fixed << setprecision(2)
+             << "   view " << setw(8) << viewSeconds * 1e9 / length << " ns/element"
+             << "   toList " << setw(8) << toListSeconds * 1e9 / length << " ns/element"
+             << "   toString " << setw(8) << toStringSeconds * 1e9 / length << " ns/element"
+             << (symbols == 0 ? "" : "   MISMATCH between view and toList") << endl;
+        delete list;
+    }
+}
+
+/**
+ * Class: DiscardBuffer
+ * --------------------
+ * A stream buffer that formats into a small array and throws the result
+ * away, so batch benchmarks pay for producing their output but not for
+ * storing it.
+ */
+
+class DiscardBuffer : public streambuf {
+public:
+    DiscardBuffer() {
+        setp(space, space + sizeof space);
+    }
+
+protected:
+    virtual int overflow(int ch) override {
+        setp(space, space + sizeof space);
+        return ch == EOF ? 0 : ch;
+    }
+
+private:
+    char space[4096];
+};
+
+/**
+ * Function: benchmarkBatchInput
+ * -----------------------------
+ * Writes a file of random formulas and runs it through batch mode twice,
+ * once read as a stream and once mapped into memory and lexed in place.
+ */
+
+void benchmarkBatchInput() {
+    cout << endl << "Batch input: stream vs. memory map" << endl;
+    const string path = "lfl-bench-corpus.tmp";
+    const int formulas = 500000;
+    mt19937 random(211);
+    double bytes;
+    {
+        ofstream corpus(path, ios::binary);
+        for (int i = 0; i < 8; i++) corpus << "((set) x" << i << " " << (i % 2 == 0 ? "t" : "f") << ")\n";
+        for (int i = 0; i < formulas; i++) corpus << randomFormula(8, 1 + i % 4, random) << "\n";
+        bytes = corpus.tellp();
+    }
+    DiscardBuffer discard;
+    ostream out(&discard);
+    for (int mapped = 0; mapped <= 1; mapped++) {
+        LangEvaluationContext context;
+        BatchRunner runner(context, out, { false, false, false, false, 1, nullptr, nullptr });
+        auto start = chrono::steady_clock::now();
+        if (mapped) {
+            MappedFile file(path);
+            runner.runBuffer(file.begin(), file.end());
+        } else {
+            ifstream in(path, ios::binary);
+            runner.runStream(in);
+        }
+        double seconds = timeSeconds(start);
+        cout << (mapped ? "      mapped" : "      stream") << fixed << setprecision(2)
+             << setw(12) << runner.getFormulaCount() / seconds / 1e3 << "k formulas/s"
+             << setw(10) << bytes / seconds / 1e6 << " MB/s" << endl;
+    }
+    remove(path.c_str());
+}
+
+/**
+ * Function: benchmarkParallelBatch
+ * --------------------------------
+ * Runs one in-memory corpus through batch mode on a growing number of
+ * threads and checks that every run prints exactly what the single-thread
+ * run did. The corpus sets a variable every few thousand formulas, so the
+ * barriers that keep such runs in order are part of what is measured.
+ */
+
+void benchmarkParallelBatch() {
+    cout << endl << "Parallel batch evaluation (" << thread::hardware_concurrency() << " cores)" << endl;
+    const int formulas = 400000;
+    mt19937 random(213);
+    string corpus;
+    for (int i = 0; i < formulas; i++) {
+        if (i % 5000 == 0) corpus += "((set) x" + to_string(i % 8) + " " + (i % 3 == 0 ? "t" : "f") + ")\n";
+        corpus += randomFormula(8, 2 + i % 4, random) + "\n";
+    }
+    string expected;
+    double baseSeconds = 0;
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        ostringstream out;
+        LangEvaluationContext context;
+        BatchRunner runner(context, out, { false, false, false, false, threads, nullptr, nullptr });
+        auto start = chrono::steady_clock::now();
+        runner.runBuffer(corpus.data(), corpus.data() + corpus.size());
+        double seconds = timeSeconds(start);
+        if (threads == 1) {
+            expected = out.str();
+            baseSeconds = seconds;
+        }
+        cout << setw(4) << threads << " threads" << fixed << setprecision(2)
+             << setw(12) << runner.getFormulaCount() / seconds / 1e3 << "k formulas/s"
+             << setw(8) << baseSeconds / seconds << "x"
+             << (out.str() == expected ? "" : "   OUTPUT DIFFERS FROM ONE THREAD") << endl;
+    }
+}
+
+/**
+ * Function: benchmarkSymbolLookups
+ * --------------------------------
+ * Has a growing number of threads look names up in the shared symbol
+ * table at once, the way parallel batch workers do for every symbol they
+ * parse, while each also interns a few names of its own. Since lookups
+ * take no lock, the total rate should grow with the number of cores.
+ */
+
+void benchmarkSymbolLookups() {
+    cout << endl << "Shared symbol table lookups (" << thread::hardware_concurrency() << " cores)" << endl;
+    const int names = 1000;
+    const int lookupsPerThread = 4000000;
+    vector<string> pool;
+    for (int i = 0; i < names; i++) pool.push_back("sym" + to_string(i));
+    for (const string& name : pool) globalSymbols().intern(name);
+    double baseRate = 0;
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        atomic<long> found(0);
+        vector<thread> workers;
+        auto start = chrono::steady_clock::now();
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&pool, &found, t, threads]() {
+                long hits = 0;
+                for (int i = 0; i < lookupsPerThread; i++) {
+                    const string& name = pool[(i * 7919L + t) % names];
+                    hits += globalSymbols().intern(name.data(), name.size()) != kNoSymbol;
+                    if (i % 100000 == 0) {
+                        globalSymbols().intern("new" + to_string(threads) + "-" + to_string(t) + "-" + to_string(i));
+                    }
+                }
+                found += hits;
+            });
+        }
+        for (thread& worker : workers) worker.join();
+        double seconds = timeSeconds(start);
+        double rate = double(lookupsPerThread) * threads / seconds / 1e6;
+        if (threads == 1) baseRate = rate;
+        cout << setw(4) << threads << " threads" << fixed << setprecision(2)
+             << setw(12) << rate << " M lookups/s" << setw(8) << rate / baseRate << "x"
+             << (found == long(lookupsPerThread) * threads ? "" : "   LOOKUPS FAILED") << endl;
+    }
+}
+
+/**
+ * Function: benchmarkParallelSweep
+ * --------------------------------
+ * Checks a 28-variable tautology, which has to sweep the whole table, and
+ * a contingent formula over the same variables, which stops at its first
+ * counterexample, on a growing number of threads.
+ */
+
+void benchmarkParallelSweep() {
+    cout << endl << "Parallel tautology sweep (" << thread::hardware_concurrency() << " cores)" << endl;
+    const int variables = 28;
+    string chain = "x0";
+    for (int i = 1; i < variables; i++)
+        chain = "((or) " + chain + " ((iff) x" + to_string(i) + " ((not) x" + to_string(i - 1) + ")))";
+    string tautology = "((or) " + chain + " ((not) " + chain + "))";
+    for (const string& input : { tautology, chain }) {
+        SExpression *sexp = parseOneSExp(input);
+        LangExpression *lexp = parseLangExp(sexp);
+        TruthTable table(lexp);
+        double baseSeconds = 0;
+        for (int threads = 1; threads <= 8; threads *= 2) {
+            SweepResult result = findRow(table, false, threads);
+            if (threads == 1) baseSeconds = result.seconds;
+            uint64_t rows = 0;
+            for (const SweepThreadStats& stats : result.threads) rows += stats.rows;
+            cout << (result.found ? "  contingent" : "   tautology") << setw(4) << threads << " threads"
+                 << setw(14) << rows << " rows" << fixed << setprecision(3)
+                 << setw(10) << result.seconds * 1e3 << " ms" << setprecision(2)
+                 << setw(10) << rows / result.seconds / 1e6 << " M rows/s"
+                 << setw(8) << baseSeconds / result.seconds << "x" << endl;
+        }
+        delete lexp;
+        delete sexp;
+    }
+}
+
+/**
+ * Function: randomDimacs
+ * Usage: string dimacs = randomDimacs(variables, clauses, random);
+ * -------------------------------------------
+ * Returns a uniform random 3-SAT instance in DIMACS CNF format: each
+ * clause has three distinct variables, each negated with probability 1/2.
+ */
+
+string randomDimacs(int variables, int clauses, mt19937& random) {
+    ostringstream dimacs;
+    dimacs << "p cnf " << variables << " " << clauses << "\n";
+    for (int i = 0; i < clauses; i++) {
+        int chosen[3];
+        for (int k = 0; k < 3; k++) {
+            bool repeated;
+            do {
+                chosen[k] = 1 + random() % variables;
+                repeated = false;
+                for (int j = 0; j < k; j++) repeated |= chosen[j] == chosen[k];
+            } while (repeated);
+            dimacs << (random() % 2 ? "-" : "") << chosen[k] << " ";
+        }
+        dimacs << "0\n";
+    }
+    return dimacs.str();
+}
+
+/**
+ * Function: dimacsToFormula
+ * Usage: string input = dimacsToFormula(dimacs);
+ * -------------------------------------------
+ * Converts a DIMACS CNF instance into the equivalent LFL formula, a chain
+ * of conjunctions of clauses written as chains of disjunctions, with
+ * variable n named vn. Comment and problem lines are skipped.
+ */
+
+string dimacsToFormula(const string& dimacs) {
+    istringstream in(dimacs);
+    vector<string> clauses;
+    string line;
+    while (getline(in, line)) {
+        if (line.empty() || line[0] == 'c' || line[0] == 'p') continue;
+        istringstream literals(line);
+        string clause;
+        int literal;
+        while (literals >> literal && literal != 0) {
+            string term = "v" + to_string(abs(literal));
+            if (literal < 0) term = "((not) " + term + ")";
+            clause = clause.empty() ? term : "((or) " + term + " " + clause + ")";
+        }
+        if (!clause.empty()) clauses.push_back(clause);
+    }
+    string formula = clauses.empty() ? "t" : clauses.back();
+    for (int i = static_cast<int>(clauses.size()) - 2; i >= 0; i--)
+        formula = "((and) " + clauses[i] + " " + formula + ")";
+    return formula;
+}
+
+/**
+ * Function: benchmarkSatSolver
+ * ----------------------------
+ * Solves random 3-SAT instances at the hard clause-to-variable ratio of
+ * 4.26, where about half are satisfiable, written out in DIMACS format
+ * and converted to LFL. Every model found is checked by evaluating the
+ * formula in a context it has been assigned to.
+ */
+
+void benchmarkSatSolver() {
+    cout << endl << "CDCL solver on random 3-SAT, 4.26 clauses per variable" << endl;
+    mt19937 random(215);
+    const int instances = 5;
+    for (int variables = 50; variables <= 250; variables += 50) {
+        int satisfiable = 0;
+        bool modelsHold = true;
+        uint64_t conflicts = 0;
+        double seconds = 0;
+        for (int i = 0; i < instances; i++) {
+            string input = dimacsToFormula(randomDimacs(variables, variables * 426 / 100, random));
+            SExpression *sexp = parseOneSExp(input);
+            LangExpression *lexp = parseLangExp(sexp);
+            auto start = chrono::steady_clock::now();
+            SatAnswer answer = solveFormula(lexp, true);
+            seconds += timeSeconds(start);
+            conflicts += answer.stats.conflicts;
+            if (answer.found) {
+                satisfiable++;
+                LangEvaluationContext context;
+                assignModel(answer, context);
+                modelsHold &= lexp->eval(context);
+            }
+            delete lexp;
+            delete sexp;
+        }
+        cout << setw(6) << variables << " variables" << setw(4) << satisfiable << "/" << instances << " sat"
+             << fixed << setprecision(3) << setw(10) << seconds * 1e3 / instances << " ms/instance"
+             << setw(10) << conflicts / instances << " conflicts/instance"
+             << (modelsHold ? "" : "   MODEL DOES NOT SATISFY FORMULA") << endl;
+    }
+}
+
+/**
+ * Function: pairedDisjunction
+ * Usage: string input = pairedDisjunction(pairs, false);
+ * -------------------------------------------
+ * Returns ((or) ((and) x0 y0) ((or) ((and) x1 y1) ...)) with the given
+ * number of pairs, or the same disjunction with its pairs in reverse
+ * order and each conjunction's operands swapped.
+ */
+
+string pairedDisjunction(int pairs, bool reversed) {
+    string formula;
+    for (int i = 0; i < pairs; i++) {
+        string x = "x" + to_string(i);
+        string y = "y" + to_string(i);
+        string term = reversed ? "((and) " + y + " " + x + ")" : "((and) " + x + " " + y + ")";
+        formula = formula.empty() ? term : reversed ? "((or) " + term + " " + formula + ")" : "((or) " + formula + " " + term + ")";
+    }
+    return formula;
+}
+
+/**
+ * Function: benchmarkBdd
+ * ----------------------
+ * Builds the paired disjunction under an order that interleaves each x
+ * with its y, where the diagram grows linearly, and under one with every
+ * x before every y, where it grows exponentially and the larger sizes
+ * need garbage collection. Each row checks the model count against the
+ * closed form 4^n - 3^n and the equivalence of the reversed formula.
+ */
+
+void benchmarkBdd() {
+    cout << endl << "BDD construction and equivalence, good and bad variable orders" << endl;
+    for (int pairs = 8; pairs <= 20; pairs += 4) {
+        SExpression *forwardSexp = parseOneSExp(pairedDisjunction(pairs, false));
+        SExpression *reversedSexp = parseOneSExp(pairedDisjunction(pairs, true));
+        LangExpression *forward = parseLangExp(forwardSexp);
+        LangExpression *reversed = parseLangExp(reversedSexp);
+        for (bool interleaved : { true, false }) {
+            vector<SymbolId> order;
+            for (int i = 0; i < pairs; i++) {
+                order.push_back(globalSymbols().intern("x" + to_string(i)));
+                if (interleaved) order.push_back(globalSymbols().intern("y" + to_string(i)));
+            }
+            for (int i = 0; !interleaved && i < pairs; i++) order.push_back(globalSymbols().intern("y" + to_string(i)));
+            BddManager bdd;
+            bdd.setVariableOrder(order);
+            auto start = chrono::steady_clock::now();
+            BddRef f = bdd.build(forward);
+            bdd.protect(f);
+            bool equivalent = bdd.build(reversed) == f;
+            double seconds = timeSeconds(start);
+            bool countHolds = bdd.countModels(f) == pow(4.0, pairs) - pow(3.0, pairs);
+            BddStats stats = bdd.getStats();
+            cout << setw(4) << pairs << " pairs, " << (interleaved ? "interleaved" : "   separate")
+                 << setw(10) << stats.peakNodes << " nodes" << setw(8) << stats.bytesUsed / 1024 << " KB"
+                 << setw(4) << stats.collections << " gc" << fixed << setprecision(3)
+                 << setw(11) << seconds * 1e3 << " ms" << (equivalent ? "" : "   NOT EQUIVALENT")
+                 << (countHolds ? "" : "   WRONG MODEL COUNT") << endl;
+        }
+        delete forward;
+        delete reversed;
+        delete forwardSexp;
+        delete reversedSexp;
+    }
+}
+
+/**
+ * Function: generatedFormula
+ * Usage: string input = generatedFormula(variables, depth, random);
+ * -------------------------------------------
+ * Returns a random formula like randomFormula's, but with a third of its
+ * leaves constants and with double negations and repeated operands mixed
+ * in, the way a program writing formulas out tends to leave them.
+ */
+
+string generatedFormula(int variables, int depth, mt19937& random) {
+    if (depth == 0) {
+        int leaf = random() % 6;
+        if (leaf < 2) return leaf == 0 ? "t" : "f";
+        return "x" + to_string(random() % variables);
+    }
+    static const char *operators[] = { "and", "or", "imp", "iff" };
+    string first = generatedFormula(variables, depth - 1, random);
+    string second = random() % 8 == 0 ? first : generatedFormula(variables, depth - 1, random);
+    string formula = "((" + string(operators[random() % 4]) + ") " + first + " " + second + ")";
+    if (random() % 6 == 0) formula = "((not) ((not) " + formula + "))";
+    return formula;
+}
+
+/**
+ * Function: benchmarkSimplifier
+ * -----------------------------
+ * Simplifies generated formulas and evaluates the original and the
+ * simplified tree against the same assignments, checking that they agree
+ * on every one.
+ */
+
+void benchmarkSimplifier() {
+    cout << endl << "Simplification before evaluation" << endl;
+    mt19937 random(217);
+    const int variables = 12;
+    vector<string> names;
+    for (int i = 0; i < variables; i++) names.push_back("x" + to_string(i));
+    for (int depth = 6; depth <= 14; depth += 4) {
+        SExpression *sexp = parseOneSExp(generatedFormula(variables, depth, random));
+        LangExpression *lexp = parseLangExp(sexp);
+        uint64_t removedNodes;
+        auto start = chrono::steady_clock::now();
+        LangExpression *simplified = simplifyLangExp(lexp, removedNodes);
+        double simplifySeconds = timeSeconds(start);
+        const int assignments = 1 << variables;
+        double seconds[2];
+        int trueCounts[2];
+        const LangExpression *forms[2] = { lexp, simplified };
+        for (int form = 0; form < 2; form++) {
+            LangEvaluationContext context;
+            trueCounts[form] = 0;
+            start = chrono::steady_clock::now();
+            for (int row = 0; row < assignments; row++) {
+                for (int i = 0; i < variables; i++) context.setValue(names[i], (row >> i) & 1);
+                trueCounts[form] += forms[form]->eval(context);
+            }
+            seconds[form] = timeSeconds(start);
+        }
+        cout << setw(4) << depth << " deep" << setw(10) << removedNodes << " nodes removed" << fixed << setprecision(3)
+             << setw(10) << simplifySeconds * 1e3 << " ms to simplify"
+             << setw(10) << seconds[0] * 1e3 << " ms before" << setw(10) << seconds[1] * 1e3 << " ms after"
+             << (trueCounts[0] == trueCounts[1] ? "" : "   RESULTS DIFFER") << endl;
+        delete simplified;
+        delete lexp;
+        delete sexp;
+    }
+}
+
+/**
+ * Function: benchmarkRegistry
+ * ---------------------------
+ * Registers thousands of generated formulas over a few hundred globals,
+ * then repeatedly sets one global and brings every value up to date, once
+ * by refreshing the registry and once by evaluating every formula again,
+ * checking that the two agree after each change.
+ */
+
+void benchmarkRegistry() {
+    cout << endl << "Incremental re-evaluation of registered formulas" << endl;
+    mt19937 random(1801);
+    const int variables = 400;
+    const int changes = 200;
+    vector<string> names;
+    for (int i = 0; i < variables; i++) names.push_back("x" + to_string(i));
+    for (int formulas = 1000; formulas <= 8000; formulas *= 2) {
+        LangEvaluationContext context;
+        for (int i = 0; i < variables; i++) context.setValue(names[i], random() % 2);
+        FormulaRegistry registry(context);
+        vector<SExpression *> sexps;
+        vector<LangExpression *> lexps;
+        vector<SymbolId> formulaNames;
+        for (int i = 0; i < formulas; i++) {
+            sexps.push_back(parseOneSExp(generatedFormula(variables, 6, random)));
+            lexps.push_back(parseLangExp(sexps.back()));
+            formulaNames.push_back(globalSymbols().intern("formula" + to_string(i)));
+            registry.define(formulaNames.back(), lexps.back());
+        }
+        registry.refresh();
+        double refreshSeconds = 0;
+        double evalSeconds = 0;
+        uint64_t recomputed = 0;
+        bool agree = true;
+        for (int change = 0; change < changes; change++) {
+            const string& name = names[random() % variables];
+            context.setValue(name, !context.getValue(name));
+            auto start = chrono::steady_clock::now();
+            registry.refresh();
+            refreshSeconds += timeSeconds(start);
+            recomputed += registry.getStats().recomputedNodes;
+            vector<bool> values(formulas);
+            start = chrono::steady_clock::now();
+            for (int i = 0; i < formulas; i++) values[i] = lexps[i]->eval(context);
+            evalSeconds += timeSeconds(start);
+            for (int i = 0; i < formulas; i++) {
+                if (registry.getValue(formulaNames[i]) != values[i]) agree = false;
+            }
+        }
+        cout << setw(6) << formulas << " formulas" << setw(8) << registry.getStats().liveNodes << " nodes"
+             << setw(8) << recomputed / changes << " recomputed per set" << fixed << setprecision(3)
+             << setw(10) << refreshSeconds * 1e3 / changes << " ms to refresh"
+             << setw(10) << evalSeconds * 1e3 / changes << " ms to evaluate all"
+             << (agree ? "" : "   RESULTS DIFFER") << endl;
+        for (size_t i = 0; i < lexps.size(); i++) {
+            delete lexps[i];
+            delete sexps[i];
+        }
+    }
+}
+
+/**
+ * Function: letHeavyFormula
+ * Usage: string input = letHeavyFormula(bindings, random);
+ * -------------------------------------------
+ * Returns a chain of nested lets binding a0, a1, ... in turn, each to a
+ * small formula over the globals and the names bound before it, with a
+ * body that combines the last few of them.
+ */
+
+string letHeavyFormula(int bindings, mt19937& random) {
+    static const char *operators[] = { "and", "or", "imp", "iff" };
+    string input;
+    for (int i = 0; i < bindings; i++) {
+        string earlier = i == 0 ? "x0" : "a" + to_string(random() % i);
+        string global = "x" + to_string(random() % 16);
+        input += "((let) a" + to_string(i) + " ((" + operators[random() % 4] + ") " + earlier + " " + global + ") ";
+    }
+    string body = "a" + to_string(bindings - 1);
+    for (int i = max(0, bindings - 4); i < bindings - 1; i++) body = "((and) a" + to_string(i) + " " + body + ")";
+    return input + body + string(bindings, ')');
+}
+
+/**
+ * Function: randomNormalForm
+ * Usage: string input = randomNormalForm(variables, terms, width, true, random);
+ * -------------------------------------------
+ * Returns a random formula in conjunctive normal form, a chain of
+ * conjunctions of clauses that are chains of disjunctions of width
+ * literals, or with conjunctive false the dual disjunctive normal form.
+ */
+
+string randomNormalForm(int variables, int terms, int width, bool conjunctive, mt19937& random) {
+    string outer = conjunctive ? "((and) " : "((or) ";
+    string inner = conjunctive ? "((or) " : "((and) ";
+    string input;
+    for (int i = 0; i < terms; i++) {
+        string term;
+        for (int k = 0; k < width; k++) {
+            string literal = "x" + to_string(random() % variables);
+            if (random() % 2) literal = "((not) " + literal + ")";
+            term = term.empty() ? literal : inner + literal + " " + term + ")";
+        }
+        input += i + 1 < terms ? outer + term + " " : term;
+    }
+    return input + string(terms - 1, ')');
+}
+
+/**
+ * Function: countLangNodes
+ * Usage: int nodes = countLangNodes(lexp);
+ * -------------------------------------------
+ * Returns the number of nodes in the tree, walking it with an explicit
+ * stack so that the deepest formulas can be counted too.
+ */
+
+int countLangNodes(const LangExpression *lexp) {
+    vector<const LangExpression *> stack = { lexp };
+    int nodes = 0;
+    while (!stack.empty()) {
+        const LangExpression *node = stack.back();
+        stack.pop_back();
+        nodes++;
+        switch (node->getType()) {
+        case NotEXP:
+            stack.push_back(node->getOperand());
+            break;
+        case AndEXP: case OrEXP: case ImpEXP: case IffEXP:
+            stack.push_back(node->getFirst());
+            stack.push_back(node->getSecond());
+            break;
+        case NaryAndEXP: case NaryOrEXP: case NaryIffEXP: case NaryXorEXP:
+            stack.insert(stack.end(), node->getOperands(), node->getOperands() + node->getOperandCount());
+            break;
+        case LetEXP:
+            stack.push_back(node->getBinding());
+            stack.push_back(node->getBody());
+            break;
+        case SetEXP:
+            stack.push_back(node->getBinding());
+            break;
+        default:
+            break;
+        }
+    }
+    return nodes;
+}
+
+/**
+ * Function: benchmarkPhases
+ * -------------------------
+ * Times reading, lowering, evaluating, printing and freeing one formula,
+ * each phase on its own. A sample runs every phase over enough copies of
+ * the formula to make up about a quarter of a million nodes, and each
+ * phase reports its median over the samples, in nanoseconds per node of
+ * the lowered tree. Evaluation is strict, so that every node is visited
+ * whatever the assignment.
+ */
+
+void benchmarkPhases(const string& generator, int size, const string& input) {
+    const int samples = 5;
+    const char *phases[] = { "parse", "lower", "eval", "print", "free" };
+    SExpression *probe = parseOneSExp(input);
+    LangExpression *probeLexp = parseLangExp(probe);
+    int nodes = countLangNodes(probeLexp);
+    delete probeLexp;
+    delete probe;
+    int copies = max(1, (1 << 18) / nodes);
+    LangEvaluationContext context;
+    context.setStrictEvaluation(true);
+    mt19937 random(2001);
+    for (int i = 0; i < 16; i++) context.setValue("x" + to_string(i), random() % 2);
+    context.setValue("p", true);
+    vector<double> seconds[5];
+    vector<SExpression *> sexps(copies);
+    vector<LangExpression *> lexps(copies);
+    int trueCount = 0;
+    size_t printed = 0;
+    for (int sample = 0; sample < samples; sample++) {
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < copies; i++) sexps[i] = parseOneSExp(input);
+        seconds[0].push_back(timeSeconds(start));
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < copies; i++) lexps[i] = parseLangExp(sexps[i]);
+        seconds[1].push_back(timeSeconds(start));
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < copies; i++) trueCount += lexps[i]->eval(context);
+        seconds[2].push_back(timeSeconds(start));
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < copies; i++) printed += lexps[i]->toString().size();
+        seconds[3].push_back(timeSeconds(start));
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < copies; i++) {
+            delete lexps[i];
+            delete sexps[i];
+        }
+        seconds[4].push_back(timeSeconds(start));
+    }
+    for (int phase = 0; phase < 5; phase++) {
+        sort(seconds[phase].begin(), seconds[phase].end());
+        double nanosecondsPerNode = seconds[phase][samples / 2] * 1e9 / copies / nodes;
+        cout << generator << '\t' << size << '\t' << nodes << '\t' << phases[phase] << '\t'
+             << fixed << setprecision(2) << nanosecondsPerNode << endl;
+    }
+    if (trueCount % (copies * samples) != 0 || printed == 0)
+        cout << generator << '\t' << size << '\t' << nodes << "\tINCONSISTENT RESULTS" << endl;
+}
+
+/**
+ * Function: benchmarkSuite
+ * ------------------------
+ * Runs benchmarkPhases over every generator at three sizes each. Every
+ * formula comes from a fixed seed and every row has the same five
+ * tab-separated columns, generator, size, nodes, phase and ns/node, so
+ * only the last column changes between runs of the same version.
+ */
+
+void benchmarkSuite() {
+    cout << endl << "Phase suite" << endl;
+    cout << "generator\tsize\tnodes\tphase\tns/node" << endl;
+    mt19937 random(2000);
+    for (int length = 1000; length <= 100000; length *= 10)
+        benchmarkPhases("chain", length, conjunctionChain(length));
+    for (int depth = 8; depth <= 16; depth += 4)
+        benchmarkPhases("balanced", depth, randomFormula(16, depth, random));
+    for (int bindings = 100; bindings <= 10000; bindings *= 10)
+        benchmarkPhases("lets", bindings, letHeavyFormula(bindings, random));
+    for (int clauses = 100; clauses <= 10000; clauses *= 10)
+        benchmarkPhases("cnf", clauses, randomNormalForm(16, clauses, 3, true, random));
+    for (int terms = 100; terms <= 10000; terms *= 10)
+        benchmarkPhases("dnf", terms, randomNormalForm(16, terms, 3, false, random));
+}
+
+/**
+ * Function: benchmarkImage
+ * ------------------------
+ * Compares getting a corpus of small formulas ready to evaluate by
+ * parsing its text with opening a binary image of it, then evaluates the
+ * whole corpus both from the parsed trees and in place from the image,
+ * checking that they agree.
+ */
+
+void benchmarkImage() {
+    cout << endl << "Binary formula images vs. parsing text" << endl;
+    mt19937 random(2101);
+    const string path = "lfl-benchmark.image";
+    for (int formulas = 10000; formulas <= 1000000; formulas *= 10) {
+        string corpus;
+        for (int i = 0; i < formulas; i++) corpus += randomFormula(8, 2 + i % 2, random) + "\n";
+        LangEvaluationContext context;
+        for (int i = 0; i < 8; i++) context.setValue("x" + to_string(i), random() % 2);
+        ExpressionArena arena;
+        FormulaImageWriter writer;
+        int textTrue = 0;
+        auto start = chrono::steady_clock::now();
+        size_t lineStart = 0;
+        while (lineStart < corpus.size()) {
+            size_t lineEnd = corpus.find('\n', lineStart);
+            SExpression *list = parseAllSExp(corpus.data() + lineStart, corpus.data() + lineEnd, &arena);
+            LangExpression *lexp = parseLangExp(list->getCAR(), &arena);
+            textTrue += lexp->eval(context);
+            writer.add(lexp);
+            arena.reset();
+            lineStart = lineEnd + 1;
+        }
+        double parseSeconds = timeSeconds(start);
+        writer.writeFile(path);
+        start = chrono::steady_clock::now();
+        FormulaImage *image = new FormulaImage(path);
+        double openSeconds = timeSeconds(start);
+        int imageTrue = 0;
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < image->getFormulaCount(); i++) imageTrue += image->eval(i, context);
+        double evalSeconds = timeSeconds(start);
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < image->getFormulaCount(); i++) {
+            image->load(i, &arena);
+            if (i % 1024 == 1023) arena.reset();
+        }
+        double loadSeconds = timeSeconds(start);
+        ifstream imageFile(path, ios::binary | ios::ate);
+        double imageBytes = imageFile.tellg();
+        delete image;
+        remove(path.c_str());
+        cout << setw(8) << formulas << " formulas" << fixed << setprecision(2)
+             << setw(8) << corpus.size() / 1e6 << " MB text" << setw(8) << imageBytes / 1e6 << " MB image"
+             << setw(10) << parseSeconds * 1e3 << " ms to parse and eval"
+             << setw(8) << openSeconds * 1e3 << " ms to open"
+             << setw(8) << evalSeconds * 1e3 << " ms to eval in place"
+             << setw(8) << loadSeconds * 1e3 << " ms to load trees"
+             << (textTrue == imageTrue ? "" : "   RESULTS DIFFER") << endl;
+    }
+}
+
+/**
+ * Function: spelledFormula
+ * Usage: string input = spelledFormula(spellings, depth, random);
+ * -------------------------------------------
+ * Returns a random formula over x0 ... x7 like randomFormula, but spelling
+ * not, and, or, imp and iff with the given five operator names.
+ */
+
+string spelledFormula(const char *const spellings[], int depth, mt19937& random) {
+    if (depth == 0) return "x" + to_string(random() % 8);
+    string formula = "((" + string(spellings[1 + random() % 4]) + ") "
+                   + spelledFormula(spellings, depth - 1, random) + " "
+                   + spelledFormula(spellings, depth - 1, random) + ")";
+    if (random() % 4 == 0) formula = "((" + string(spellings[0]) + ") " + formula + ")";
+    return formula;
+}
+
+/**
+ * Function: benchmarkOperatorDispatch
+ * -----------------------------------
+ * Times translating already parsed S-expressions into LangExpressions
+ * when the operators are spelled as words, as single letters, and as the
+ * symbols that take several tokens, such as [*] and <=>.
+ */
+
+void benchmarkOperatorDispatch() {
+    cout << endl << "Operator dispatch in the LangExpression parser" << endl;
+    static const char *const spellings[][5] = {
+        { "not", "and", "or", "implies", "iff" },
+        { "N", "K", "A", "C", "E" },
+        { "[-]", "[*]", "[+]", "=>", "<=>" }
+    };
+    static const char *const names[] = { "words", "letters", "multi-token" };
+    const int formulas = 2000;
+    const int rounds = 20;
+    for (int spelling = 0; spelling < 3; spelling++) {
+        mt19937 random(2201);
+        ExpressionArena sexpArena;
+        vector<SExpression *> sexps;
+        for (int i = 0; i < formulas; i++) {
+            string input = spelledFormula(spellings[spelling], 6, random);
+            sexps.push_back(parseAllSExp(input.data(), input.data() + input.size(), &sexpArena)->getCAR());
+        }
+        ExpressionArena arena;
+        long nodes = 0;
+        for (SExpression *sexp : sexps) nodes += countLangNodes(parseLangExp(sexp, &arena));
+        arena.reset();
+        auto start = chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round++) {
+            for (SExpression *sexp : sexps) parseLangExp(sexp, &arena);
+            arena.reset();
+        }
+        double seconds = timeSeconds(start);
+        cout << setw(12) << names[spelling] << fixed << setprecision(2)
+             << setw(10) << seconds * 1e9 / (nodes * rounds) << " ns/node" << endl;
+    }
+}
+
+/**
+ * Function: wideConjunction
+ * Usage: string input = wideConjunction(clauses, nary);
+ * -------------------------------------------
+ * Returns a conjunction of three-literal disjunctions over x0 ... x63,
+ * either as one n-ary and of n-ary ors or as right-nested chains of
+ * binary ones. In each clause only the last literal is an even variable,
+ * so with the even variables true and the odd ones false every literal
+ * of every clause is evaluated.
+ */
+
+string wideConjunction(int clauses, bool nary) {
+    string input = nary ? "((and)" : "";
+    for (int i = 0; i < clauses; i++) {
+        string first = "x" + to_string((2 * i + 1) % 64);
+        string second = "x" + to_string((6 * i + 3) % 64);
+        string third = "x" + to_string((4 * i + 2) % 64);
+        if (nary) {
+            input += " ((or) " + first + " " + second + " " + third + ")";
+        } else {
+            string clause = "((or) " + first + " ((or) " + second + " " + third + "))";
+            input += i + 1 < clauses ? "((and) " + clause + " " : clause;
+        }
+    }
+    input += nary ? ")" : string(clauses - 1, ')');
+    return input;
+}
+
+/**
+ * Function: benchmarkWideFormulas
+ * -------------------------------
+ * Compares wide conjunctions stored as n-ary nodes with the same formulas
+ * written as chains of binary nodes: the arena memory per clause, and
+ * the time per clause to evaluate them with eval and as compiled code.
+ */
+
+void benchmarkWideFormulas() {
+    cout << endl << "Wide formulas: n-ary vs. binary chains" << endl;
+    LangEvaluationContext context;
+    for (int i = 0; i < 64; i++) context.setValue("x" + to_string(i), i % 2 == 0);
+    for (int clauses = 1000; clauses <= 100000; clauses *= 10) {
+        for (int nary = 1; nary >= 0; nary--) {
+            SExpression *sexp = parseOneSExp(wideConjunction(clauses, nary));
+            ExpressionArena arena;
+            LangExpression *lexp = parseLangExp(sexp, &arena);
+            delete sexp;
+            double bytes = arena.bytesUsed();
+            const int repetitions = max(1, 2000000 / clauses);
+            int truths = 0;
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < repetitions; i++) truths += lexp->eval(context);
+            double evalSeconds = timeSeconds(start) / repetitions;
+            CompiledFormula compiled(lexp);
+            FormulaState state = compiled.newState();
+            for (int slot = 0; slot < compiled.getSlotCount(); slot++) {
+                state.setValue(slot, context.getValue(compiled.getSlotSymbol(slot)));
+            }
+            start = chrono::steady_clock::now();
+            for (int i = 0; i < repetitions; i++) truths += compiled.run(state);
+            double runSeconds = timeSeconds(start) / repetitions;
+            cout << setw(8) << clauses << " clauses " << (nary ? "n-ary " : "binary") << fixed << setprecision(2)
+                 << setw(10) << bytes / clauses << " bytes/clause"
+                 << setw(10) << evalSeconds * 1e9 / clauses << " ns/clause eval"
+                 << setw(10) << runSeconds * 1e9 / clauses << " ns/clause compiled"
+                 << (truths == 2 * repetitions ? "" : "   WRONG RESULT") << endl;
+        }
+    }
+}
+
+/**
+ * Function: benchmarkFlatFormulas
+ * -------------------------------
+ * Evaluates large random formulas as heap trees with eval and as flat
+ * formulas, and times the conversions between the two. Each formula is
+ * evaluated both ways under the same assignments, short-circuiting and
+ * strictly. Only the strict rows favor the flat formula; the lazy rows
+ * show how much slower it is when most of it is skipped.
+ */
+
+void benchmarkFlatFormulas() {
+    cout << endl << "Large formulas: object tree vs. flat arrays" << endl;
+    mt19937 random(124);
+    const int variables = 16;
+    LangEvaluationContext context;
+    vector<SymbolId> names;
+    for (int i = 0; i < variables; i++) names.push_back(globalSymbols().intern("x" + to_string(i)));
+    for (int depth = 10; depth <= 20; depth += 5) {
+        SExpression *sexp = parseOneSExp(randomFormula(variables, depth, random));
+        LangExpression *lexp = parseLangExp(sexp);
+        delete sexp;
+        auto start = chrono::steady_clock::now();
+        FlatFormula flat(lexp);
+        double flattenSeconds = timeSeconds(start);
+        start = chrono::steady_clock::now();
+        LangExpression *rebuilt = flat.toLangExpression();
+        double rebuildSeconds = timeSeconds(start);
+        delete rebuilt;
+        int nodes = countLangNodes(lexp);
+        const int assignments = max(4, (1 << 24) / nodes);
+        for (int strict = 0; strict <= 1; strict++) {
+            context.setStrictEvaluation(strict);
+            int treeTruths = 0;
+            start = chrono::steady_clock::now();
+            for (int row = 0; row < assignments; row++) {
+                for (int i = 0; i < variables; i++) context.setValue(names[i], (row * 40503u >> i) & 1);
+                treeTruths += lexp->eval(context);
+            }
+            double treeSeconds = timeSeconds(start);
+            int flatTruths = 0;
+            start = chrono::steady_clock::now();
+            for (int row = 0; row < assignments; row++) {
+                for (int i = 0; i < variables; i++) context.setValue(names[i], (row * 40503u >> i) & 1);
+                flatTruths += flat.eval(context);
+            }
+            double flatSeconds = timeSeconds(start);
+            cout << setw(9) << nodes << " nodes " << (strict ? "strict" : "lazy  ") << fixed << setprecision(2)
+                 << setw(8) << treeSeconds * 1e9 / (double(assignments) * nodes) << " ns/node tree"
+                 << setw(8) << flatSeconds * 1e9 / (double(assignments) * nodes) << " ns/node flat"
+                 << (treeTruths == flatTruths ? "" : "   MISMATCH") << endl;
+        }
+        cout << setw(9) << nodes << " nodes " << fixed << setprecision(2)
+             << setw(8) << double(flat.bytesUsed()) / nodes << " flat bytes/node"
+             << setw(8) << flattenSeconds * 1e9 / nodes << " ns/node to flatten"
+             << setw(8) << rebuildSeconds * 1e9 / nodes << " ns/node to rebuild" << endl;
+        delete lexp;
+    }
+    context.setStrictEvaluation(false);
+}
+
+/**
+ * Function: benchmarkAssignmentBatches
+ * ------------------------------------
+ * Evaluates one formula on a million random assignments three ways: by
+ * setting every variable in a context and calling eval for each row, by
+ * running the compiled formula for each row, and with evaluateAssignments
+ * on the whole batch at once. Also times reading the batch back from CSV
+ * and from the binary format.
+ */
+
+void benchmarkAssignmentBatches() {
+    cout << endl << "Assignment batches: per-row evaluation vs. evaluateAssignments" << endl;
+    mt19937 random(125);
+    const int variables = 16;
+    const uint64_t rows = 1 << 20;
+    AssignmentBatch batch;
+    for (int i = 0; i < variables; i++) batch.addVariable(globalSymbols().intern("x" + to_string(i)));
+    batch.setRowCount(rows);
+    for (int column = 0; column < variables; column++) {
+        for (uint64_t row = 0; row < rows; row++) batch.setValue(column, row, random() & 1);
+    }
+    for (int depth = 4; depth <= 8; depth += 4) {
+        SExpression *sexp = parseOneSExp(randomFormula(variables, depth, random));
+        LangExpression *lexp = parseLangExp(sexp);
+        delete sexp;
+        CompiledFormula formula(lexp);
+        LangEvaluationContext context;
+        context.setStrictEvaluation(true);
+        uint64_t treeTrue = 0;
+        auto start = chrono::steady_clock::now();
+        for (uint64_t row = 0; row < rows; row++) {
+            for (int column = 0; column < variables; column++)
+                context.setValue(batch.getVariable(column), batch.getValue(column, row));
+            treeTrue += lexp->eval(context);
+        }
+        double treeSeconds = timeSeconds(start);
+        FormulaState state = formula.newState();
+        state.setStrictEvaluation(true);
+        vector<int> slotColumns;
+        for (int slot = 0; slot < formula.getSlotCount(); slot++)
+            slotColumns.push_back(batch.getColumn(formula.getSlotSymbol(slot)));
+        uint64_t compiledTrue = 0;
+        start = chrono::steady_clock::now();
+        for (uint64_t row = 0; row < rows; row++) {
+            for (int slot = 0; slot < formula.getSlotCount(); slot++)
+                state.setValue(slot, batch.getValue(slotColumns[slot], row));
+            compiledTrue += formula.run(state);
+        }
+        double compiledSeconds = timeSeconds(start);
+        vector<uint64_t> results;
+        start = chrono::steady_clock::now();
+        evaluateAssignments(formula, batch, context, results);
+        double batchSeconds = timeSeconds(start);
+        uint64_t batchTrue = 0;
+        for (uint64_t row = 0; row < rows; row++) batchTrue += (results[row / 64] >> (row % 64)) & 1;
+        cout << setw(6) << formula.getInstructions().size() << " instructions" << fixed << setprecision(2)
+             << setw(9) << treeSeconds * 1e9 / rows << " ns/row eval"
+             << setw(9) << compiledSeconds * 1e9 / rows << " ns/row compiled"
+             << setw(9) << batchSeconds * 1e9 / rows << " ns/row batch"
+             << (treeTrue == compiledTrue && compiledTrue == batchTrue ? "" : "   MISMATCH") << endl;
+        delete lexp;
+    }
+    ostringstream binary;
+    batch.writeBinary(binary);
+    string binaryText = binary.str();
+    string csv;
+    for (int column = 0; column < variables; column++) csv += (column == 0 ? "" : ",") + string("x") + to_string(column);
+    csv += '\n';
+    for (uint64_t row = 0; row < rows; row++) {
+        for (int column = 0; column < variables; column++) {
+            if (column != 0) csv += ',';
+            csv += batch.getValue(column, row) ? '1' : '0';
+        }
+        csv += '\n';
+    }
+    AssignmentBatch loaded;
+    auto start = chrono::steady_clock::now();
+    loaded.readCsv(csv.data(), csv.data() + csv.size());
+    double csvSeconds = timeSeconds(start);
+    start = chrono::steady_clock::now();
+    loaded.readBinary(binaryText.data(), binaryText.data() + binaryText.size());
+    double binarySeconds = timeSeconds(start);
+    cout << fixed << setprecision(2) << setw(9) << csvSeconds * 1e9 / rows << " ns/row to read CSV"
+         << setw(9) << binarySeconds * 1e9 / rows << " ns/row to read binary" << endl;
+}
@@ -0,0 +1,388 @@
+/**
+ * File: assignment-batch.cpp
+ * -------------
+ * This file implements the assignment-batch.h interface.
+ */
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "assignment-batch.h"
+#include "truth-table.h"
+#include "mapped-file.h"
+#include "error.h"
+using namespace std;
+
+struct BatchHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t variableCount;
+    uint64_t rowCount;
+    uint64_t nameIndexOffset;
+    uint64_t namesOffset;
+    uint64_t namesLength;
+    uint64_t columnsOffset;
+};
+
+static const char kBatchMagic[8] = { 'L', 'F', 'L', 'B', 'A', 'T', 'C', 'H' };
+static const uint32_t kByteOrderMark = 0x01020304;
+
+static uint64_t columnLength(uint64_t rows);
+static uint64_t bitmapLength(uint64_t rows);
+static bool isFieldBlank(char ch);
+static void trimField(const char *& begin, const char *& end);
+static bool parseTruthValue(const char *begin, const char *end, bool& value);
+static uint64_t alignSection(uint64_t offset);
+static void writePadding(ostream& out, uint64_t from, uint64_t to);
+static bool sectionFits(uint64_t offset, uint64_t length, uint64_t size);
+static uint64_t readWord(const char *words, size_t index);
+static void damagedBatch();
+
+AssignmentBatch::AssignmentBatch() {
+    rowCount = 0;
+}
+
+int AssignmentBatch::addVariable(SymbolId variable) {
+    if (columns.count(variable) != 0)
+        error("ASSIGNMENT ERROR >> Duplicate column: " + globalSymbols().nameOf(variable));
+    int column = variables.size();
+    variables.push_back(variable);
+    columns[variable] = column;
+    words.push_back(vector<uint64_t>(columnLength(rowCount), 0));
+    return column;
+}
+
+int AssignmentBatch::getVariableCount() const {
+    return variables.size();
+}
+
+SymbolId AssignmentBatch::getVariable(int column) const {
+    return variables[column];
+}
+
+int AssignmentBatch::getColumn(SymbolId variable) const {
+    auto found = columns.find(variable);
+    return found == columns.end() ? -1 : found->second;
+}
+
+uint64_t AssignmentBatch::getRowCount() const {
+    return rowCount;
+}
+
+/**
+ * Implementation notes: setRowCount
+ * ---------------------------------
+ * Growing a column only ever adds false words. Shrinking one also clears
+ * whatever the dropped rows left behind in the words that remain, so the
+ * padding past the last row stays false.
+ */
+
+void AssignmentBatch::setRowCount(uint64_t rows) {
+    for (vector<uint64_t>& column : words) {
+        column.resize(columnLength(rows), 0);
+        if (rows >= rowCount) continue;
+        for (uint64_t w = bitmapLength(rows); w < column.size(); w++) column[w] = 0;
+        if (rows % 64 != 0) column[rows / 64] &= (uint64_t(1) << (rows % 64)) - 1;
+    }
+    rowCount = rows;
+}
+
+void AssignmentBatch::setValue(int column, uint64_t row, bool value) {
+    uint64_t bit = uint64_t(1) << (row % 64);
+    if (value) words[column][row / 64] |= bit;
+    else words[column][row / 64] &= ~bit;
+}
+
+bool AssignmentBatch::getValue(int column, uint64_t row) const {
+    return (words[column][row / 64] >> (row % 64)) & 1;
+}
+
+const uint64_t *AssignmentBatch::getColumnWords(int column) const {
+    return words[column].data();
+}
+
+/**
+ * Implementation notes: readCsv
+ * -----------------------------
+ * The text is scanned in place a line at a time. Rows are added one by
+ * one, which grows every column by a word only once per 64 rows.
+ */
+
+void AssignmentBatch::readCsv(const char *begin, const char *end) {
+    clear();
+    const char *cursor = begin;
+    uint64_t line = 0;
+    bool headerRead = false;
+    while (cursor < end) {
+        const char *lineEnd = static_cast<const char *>(memchr(cursor, '\n', end - cursor));
+        if (lineEnd == nullptr) lineEnd = end;
+        line++;
+        const char *field = cursor;
+        cursor = lineEnd + 1;
+        const char *trimmedBegin = field, *trimmedEnd = lineEnd;
+        trimField(trimmedBegin, trimmedEnd);
+        if (trimmedBegin == trimmedEnd) continue;
+        if (headerRead) setRowCount(rowCount + 1);
+        int column = 0;
+        while (true) {
+            const char *fieldEnd = static_cast<const char *>(memchr(field, ',', lineEnd - field));
+            if (fieldEnd == nullptr) fieldEnd = lineEnd;
+            const char *nameBegin = field, *nameEnd = fieldEnd;
+            trimField(nameBegin, nameEnd);
+            if (!headerRead) {
+                if (nameBegin == nameEnd)
+                    error("ASSIGNMENT ERROR >> Line " + to_string(line) + ": empty column name");
+                addVariable(globalSymbols().intern(nameBegin, nameEnd - nameBegin));
+            } else {
+                bool value;
+                if (column >= getVariableCount())
+                    error("ASSIGNMENT ERROR >> Line " + to_string(line) + ": more values than columns");
+                if (!parseTruthValue(nameBegin, nameEnd, value))
+                    error("ASSIGNMENT ERROR >> Line " + to_string(line) + ": not a truth value: "
+                          + string(nameBegin, nameEnd));
+                if (value) setValue(column, rowCount - 1, true);
+            }
+            column++;
+            if (fieldEnd == lineEnd) break;
+            field = fieldEnd + 1;
+        }
+        if (headerRead && column < getVariableCount())
+            error("ASSIGNMENT ERROR >> Line " + to_string(line) + ": fewer values than columns");
+        headerRead = true;
+    }
+    if (!headerRead) error("ASSIGNMENT ERROR >> Missing header line");
+}
+
+/**
+ * Implementation notes: readBinary
+ * --------------------------------
+ * Checks the header the way FormulaImage does, then copies every column
+ * into its own padded vector. Reads go through memcpy, since the buffer
+ * need not be aligned.
+ */
+
+void AssignmentBatch::readBinary(const char *begin, const char *end) {
+    clear();
+    uint64_t size = end - begin;
+    BatchHeader header;
+    if (size < sizeof(kBatchMagic) || memcmp(begin, kBatchMagic, sizeof(kBatchMagic)) != 0)
+        error("ASSIGNMENT ERROR >> Not an assignment batch");
+    if (size < sizeof(header)) damagedBatch();
+    memcpy(&header, begin, sizeof(header));
+    if (header.byteOrder != kByteOrderMark) error("ASSIGNMENT ERROR >> Batch was written with another byte order");
+    if (header.version != kAssignmentBatchVersion)
+        error("ASSIGNMENT ERROR >> Unsupported batch version " + to_string(header.version));
+    if (header.rowCount > ~uint64_t(0) - 63
+        || (header.variableCount != 0 && header.rowCount / 64 >= size / sizeof(uint64_t))) {
+        damagedBatch();
+    }
+    uint64_t length = bitmapLength(header.rowCount);
+    if (header.variableCount >= size / sizeof(uint64_t)
+        || !sectionFits(header.nameIndexOffset, (header.variableCount + 1) * sizeof(uint64_t), size)
+        || !sectionFits(header.namesOffset, header.namesLength, size) || header.columnsOffset > size
+        || (header.variableCount != 0
+            && length > (size - header.columnsOffset) / sizeof(uint64_t) / header.variableCount)) {
+        damagedBatch();
+    }
+    const char *nameIndex = begin + header.nameIndexOffset;
+    const char *names = begin + header.namesOffset;
+    for (uint64_t i = 0; i < header.variableCount; i++) {
+        uint64_t start = readWord(nameIndex, i);
+        uint64_t finish = readWord(nameIndex, i + 1);
+        if (start > finish || finish > header.namesLength) damagedBatch();
+        addVariable(globalSymbols().intern(names + start, finish - start));
+    }
+    setRowCount(header.rowCount);
+    if (length == 0) return;
+    for (uint64_t i = 0; i < header.variableCount; i++) {
+        memcpy(words[i].data(), begin + header.columnsOffset + i * length * sizeof(uint64_t), length * sizeof(uint64_t));
+        if (header.rowCount % 64 != 0) words[i][length - 1] &= (uint64_t(1) << (header.rowCount % 64)) - 1;
+    }
+}
+
+/**
+ * Implementation notes: readFile
+ * ------------------------------
+ * A file is mapped when it can be, and read into memory otherwise, as
+ * with a pipe or with standard input, which is named -.
+ */
+
+void AssignmentBatch::readFile(const string& path) {
+    if (path != "-") {
+        MappedFile *file = nullptr;
+        try {
+            file = new MappedFile(path);
+        } catch (ErrorException& ex) {
+            file = nullptr;
+        }
+        if (file != nullptr) {
+            try {
+                read(file->begin(), file->end());
+            } catch (ErrorException& ex) {
+                delete file;
+                throw;
+            }
+            delete file;
+            return;
+        }
+    }
+    string text;
+    if (path == "-") {
+        text.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+    } else {
+        ifstream in(path, ios::binary);
+        if (!in) error("ASSIGNMENT ERROR >> Cannot open " + path);
+        text.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    read(text.data(), text.data() + text.size());
+}
+
+void AssignmentBatch::writeBinary(ostream& out) const {
+    BatchHeader header;
+    memcpy(header.magic, kBatchMagic, sizeof(kBatchMagic));
+    header.version = kAssignmentBatchVersion;
+    header.byteOrder = kByteOrderMark;
+    header.variableCount = variables.size();
+    header.rowCount = rowCount;
+    vector<uint64_t> nameIndex = { 0 };
+    string names;
+    for (SymbolId variable : variables) {
+        names += globalSymbols().nameOf(variable);
+        nameIndex.push_back(names.size());
+    }
+    header.nameIndexOffset = alignSection(sizeof(BatchHeader));
+    header.namesOffset = header.nameIndexOffset + nameIndex.size() * sizeof(uint64_t);
+    header.namesLength = names.size();
+    header.columnsOffset = alignSection(header.namesOffset + names.size());
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    writePadding(out, sizeof(header), header.nameIndexOffset);
+    out.write(reinterpret_cast<const char *>(nameIndex.data()), nameIndex.size() * sizeof(uint64_t));
+    out.write(names.data(), names.size());
+    writePadding(out, header.namesOffset + names.size(), header.columnsOffset);
+    for (const vector<uint64_t>& column : words) {
+        out.write(reinterpret_cast<const char *>(column.data()), bitmapLength(rowCount) * sizeof(uint64_t));
+    }
+}
+
+void AssignmentBatch::writeBinaryFile(const string& path) const {
+    ofstream out(path, ios::binary | ios::trunc);
+    if (!out) error("ASSIGNMENT ERROR >> Cannot write " + path);
+    writeBinary(out);
+    out.close();
+    if (!out) error("ASSIGNMENT ERROR >> Cannot write " + path);
+}
+
+void AssignmentBatch::clear() {
+    variables.clear();
+    columns.clear();
+    words.clear();
+    rowCount = 0;
+}
+
+void AssignmentBatch::read(const char *begin, const char *end) {
+    if (static_cast<size_t>(end - begin) >= sizeof(kBatchMagic)
+        && memcmp(begin, kBatchMagic, sizeof(kBatchMagic)) == 0) {
+        readBinary(begin, end);
+    } else {
+        readCsv(begin, end);
+    }
+}
+
+/**
+ * Implementation notes: evaluateAssignments
+ * -----------------------------------------
+ * The free variables are found with findFreeSlots, as TruthTable finds
+ * them. Each block then copies the lanes of the batch columns into the
+ * workspace, fills the lanes of the variables taken from the context,
+ * and runs the formula with runLanes. The columns are padded to whole
+ * blocks, so the last block needs no special case until the results are
+ * cut back to the rows that exist.
+ */
+
+void evaluateAssignments(const CompiledFormula& formula, const AssignmentBatch& batch,
+                         const LangEvaluationContext& context, vector<uint64_t>& results) {
+    vector<int> columnSlots, columnIndexes, contextSlots;
+    for (int slot : findFreeSlots(formula)) {
+        SymbolId symbol = formula.getSlotSymbol(slot);
+        int column = batch.getColumn(symbol);
+        if (column >= 0) {
+            columnSlots.push_back(slot);
+            columnIndexes.push_back(column);
+        } else if (context.isDefined(symbol)) {
+            contextSlots.push_back(slot);
+        } else {
+            error("EVALUATION ERROR >> undefined symbol: " + formula.getSlotName(slot));
+        }
+    }
+    LaneWorkspace workspace = newLaneWorkspace(formula);
+    uint64_t rows = batch.getRowCount();
+    uint64_t blocks = (rows + kLanesPerBlock - 1) / kLanesPerBlock;
+    results.assign(blocks * kLaneWords, 0);
+    LaneBlock result;
+    for (uint64_t block = 0; block < blocks; block++) {
+        for (size_t i = 0; i < columnSlots.size(); i++) {
+            const uint64_t *lanes = batch.getColumnWords(columnIndexes[i]) + block * kLaneWords;
+            memcpy(workspace.values[columnSlots[i]].words, lanes, sizeof(LaneBlock));
+        }
+        for (int slot : contextSlots) {
+            uint64_t word = context.getValue(formula.getSlotSymbol(slot)) ? ~uint64_t(0) : 0;
+            for (int w = 0; w < kLaneWords; w++) workspace.values[slot].words[w] = word;
+        }
+        runLanes(formula, workspace, result);
+        memcpy(&results[block * kLaneWords], result.words, sizeof(LaneBlock));
+    }
+    results.resize(bitmapLength(rows));
+    if (rows % 64 != 0) results.back() &= (uint64_t(1) << (rows % 64)) - 1;
+}
+
+uint64_t columnLength(uint64_t rows) {
+    return (bitmapLength(rows) + kLaneWords - 1) / kLaneWords * kLaneWords;
+}
+
+uint64_t bitmapLength(uint64_t rows) {
+    return (rows + 63) / 64;
+}
+
+bool isFieldBlank(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\r';
+}
+
+void trimField(const char *& begin, const char *& end) {
+    while (begin < end && isFieldBlank(*begin)) begin++;
+    while (end > begin && isFieldBlank(end[-1])) end--;
+}
+
+bool parseTruthValue(const char *begin, const char *end, bool& value) {
+    size_t length = end - begin;
+    if (length == 1 && (*begin == '1' || *begin == 't')) value = true;
+    else if (length == 1 && (*begin == '0' || *begin == 'f')) value = false;
+    else if (length == 4 && memcmp(begin, "true", 4) == 0) value = true;
+    else if (length == 5 && memcmp(begin, "false", 5) == 0) value = false;
+    else return false;
+    return true;
+}
+
+uint64_t alignSection(uint64_t offset) {
+    return (offset + 7) & ~uint64_t(7);
+}
+
+void writePadding(ostream& out, uint64_t from, uint64_t to) {
+    for (uint64_t i = from; i < to; i++) out.put('\0');
+}
+
+bool sectionFits(uint64_t offset, uint64_t length, uint64_t size) {
+    return offset <= size && length <= size - offset;
+}
+
+uint64_t readWord(const char *words, size_t index) {
+    uint64_t word;
+    memcpy(&word, words + index * sizeof(uint64_t), sizeof(word));
+    return word;
+}
+
+void damagedBatch() {
+    error("ASSIGNMENT ERROR >> Batch is truncated or damaged");
+}
@@ -0,0 +1,111 @@
+/**
+ * File: assignment-batch.h
+ * -------------
+ * This interface defines a columnar batch of variable assignments and the
+ * evaluation of one compiled formula on every row of such a batch at
+ * once, with a bitmap of results, for callers that have far more
+ * assignments than formulas.
+ */
+
+#ifndef ASSIGNMENT_BATCH_H
+#define ASSIGNMENT_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "langexpressions.h"
+#include "langexpression-compiler.h"
+#include "symbol-table.h"
+
+/**
+ * Constant: kAssignmentBatchVersion
+ * ---------------------------------
+ * The version of the binary batch layout this code reads and writes.
+ */
+
+const uint32_t kAssignmentBatchVersion = 1;
+
+/**
+ * Class: AssignmentBatch
+ * ----------------------
+ * A bit matrix of variables by rows. Each variable is one column, stored
+ * as a run of 64-bit words in which bit r % 64 of word r / 64 is the
+ * variable's value in row r, so that a block of rows can be read for one
+ * variable with a few word copies. Columns are padded to whole blocks of
+ * evaluateAssignments, and the padding is always false.
+ *
+ * A batch can be read from CSV text, whose first line names the columns
+ * and whose other lines each give one row as 0 or 1, f or t, or false or
+ * true, separated by commas. Blank lines are ignored. It can also be read
+ * from and written as a binary file, which consists of a fixed header
+ * followed by three sections, each starting on an 8-byte boundary:
+ *
+ *   name index    one 64-bit offset into the names per column, and one
+ *                 more for the end of the last name
+ *   names         the column names, one after another
+ *   columns       every column in order, each as (rows + 63) / 64 words
+ *
+ * As in a formula image, the header and the words are in the byte order
+ * of the machine that wrote them, which the header records. readFile
+ * tells the two formats apart by the binary header's magic number.
+ * Malformed input raises an ASSIGNMENT ERROR.
+ */
+
+class AssignmentBatch {
+public:
+    AssignmentBatch();
+
+    int addVariable(SymbolId variable);
+    int getVariableCount() const;
+    SymbolId getVariable(int column) const;
+    int getColumn(SymbolId variable) const;
+
+    uint64_t getRowCount() const;
+    void setRowCount(uint64_t rows);
+    void setValue(int column, uint64_t row, bool value);
+    bool getValue(int column, uint64_t row) const;
+    const uint64_t *getColumnWords(int column) const;
+
+    void readCsv(const char *begin, const char *end);
+    void readBinary(const char *begin, const char *end);
+    void readFile(const std::string& path);
+    void writeBinary(std::ostream& out) const;
+    void writeBinaryFile(const std::string& path) const;
+
+private:
+    void clear();
+    void read(const char *begin, const char *end);
+
+    std::vector<SymbolId> variables;
+    std::unordered_map<SymbolId, int> columns;
+    std::vector<std::vector<uint64_t>> words;
+    uint64_t rowCount;
+};
+
+/**
+ * Function: evaluateAssignments
+ * Usage: evaluateAssignments(formula, batch, context, results);
+ * -------------------------------------------
+ * Evaluates a compiled formula on every row of a batch and leaves the
+ * values in results as a bitmap laid out like a column: bit r % 64 of
+ * results[r / 64] is the value in row r, and the bits past the last row
+ * are false. Rows are evaluated one block of kLanesPerBlock at a time
+ * with bitwise operations, as in a truth table.
+ *
+ * Each free variable of the formula takes its value in every row from
+ * the batch column of the same name, or, if the batch has no such column,
+ * from the context. A free variable defined in neither raises the error
+ * eval would raise for it, before any row is evaluated. Every operand is
+ * evaluated, as under strict evaluation, and a set changes only the rows
+ * being evaluated, never the context. Since neither the formula nor the
+ * batch is changed, any number of threads may evaluate the same formula
+ * at once.
+ */
+
+void evaluateAssignments(const CompiledFormula& formula, const AssignmentBatch& batch,
+                         const LangEvaluationContext& context, std::vector<uint64_t>& results);
+
+#endif // ASSIGNMENT_BATCH_H
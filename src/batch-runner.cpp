@@ -0,0 +1,418 @@
+/**
+ * File: batch-runner.cpp
+ * -------------
+ * This file implements the batch-runner.h interface.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "batch-runner.h"
+#include "sexpression-parser.h"
+#include "langexpression-parser.h"
+#include "langexpression-simplifier.h"
+#include "repl-commands.h"
+#include "pipeline-stats.h"
+#include "formula-image.h"
+#include "langexpression-compiler.h"
+#include "assignment-batch.h"
+#include "error.h"
+#include "strlib.h"
+using namespace std;
+
+static const size_t kReadSize = 1 << 20;
+static const size_t kPendingRecords = 16384;
+static const size_t kChunkRecords = 256;
+
+/**
+ * Class: ResultLines
+ * ------------------
+ * Collects the result lines of a run of formulas. A sequential run knows
+ * how many formulas came before it and writes each formula's number
+ * straight away. A parallel chunk does not, so it remembers where each
+ * number belongs and writeNumbered fills them in when the chunk's turn to
+ * be written comes.
+ */
+
+class ResultLines {
+public:
+    ResultLines(ostream& out, uint64_t base, bool deferred);
+    uint64_t newFormula();
+    ostream& startLine(uint64_t formula);
+    void countError();
+    uint64_t getFormulaCount() const;
+    uint64_t getErrorCount() const;
+    void writeNumbered(ostream& dest, const string& text, uint64_t base) const;
+
+private:
+    struct Mark {
+        size_t position;
+        uint64_t formula;
+    };
+    ostream& out;
+    uint64_t base;
+    bool deferred;
+    uint64_t formulas;
+    uint64_t errors;
+    vector<Mark> marks;
+};
+
+static void runRecord(const char *begin, const char *end, LangEvaluationContext& context,
+                      FormulaRegistry *registry, ExpressionArena& arena, LangExpressionFactory& factory,
+                      const BatchOptions& options, ResultLines& lines);
+static void runFormula(SExpression *sexp, LangEvaluationContext& context,
+                       FormulaRegistry *registry, ExpressionArena& arena, LangExpressionFactory& factory,
+                       const BatchOptions& options, ResultLines& lines);
+static bool isBarrier(const char *begin, const char *end);
+static bool containsBarrierWord(const char *begin, const char *end, bool joinAcrossBlanks);
+static bool isBlank(char ch);
+static bool isWordCharacter(char ch);
+
+/**
+ * Implementation notes: BatchRunner
+ * ---------------------------------
+ * Records are found by counting parentheses as the input goes by, without
+ * lexing it. A blank line also ends a record, so a formula missing its
+ * closing parentheses cannot swallow the rest of the input. Each complete
+ * record is then parsed in place with parseAllSExp. Every node of a
+ * record lives in an arena, which is reset once the record is done, so
+ * steady-state evaluation allocates nothing but arena chunks that are
+ * reused for the next record. With hashCons the formulas are made by the
+ * runner's factory instead, which keeps them for the whole run.
+ *
+ * runStream reads the input in large blocks and keeps only the unfinished
+ * record at the end of each block for the next one. The position and
+ * parenthesis depth reached inside that record are remembered as well, so
+ * a record spanning many blocks is still scanned only once.
+ *
+ * A sequential runner evaluates each record as soon as it is found. A
+ * parallel one collects records until it has enough to share out, or
+ * until the block they point into is about to be discarded, and then
+ * runs them segment by segment: the records between two barriers are cut
+ * into chunks for the pool, the chunks' output is written in order once
+ * the whole segment is done, and then the barrier runs alone. A worker
+ * copies the shared context whenever a barrier has run since it last did,
+ * and the workers' skipped-subtree counts are added into the shared
+ * context before every barrier and at the end of the run.
+ */
+
+struct BatchRunner::Worker {
+    LangEvaluationContext context;
+    ExpressionArena arena;
+    LangExpressionFactory factory;
+    uint64_t generation;
+};
+
+struct BatchRunner::Chunk {
+    Chunk(size_t first, size_t last) : first(first), last(last), lines(text, 0, true) {
+        /* Empty */
+    }
+    size_t first;
+    size_t last;
+    ostringstream text;
+    ResultLines lines;
+};
+
+BatchRunner::BatchRunner(LangEvaluationContext& context, ostream& out, const BatchOptions& options)
+    : context(context), out(out), options(options), registry(context) {
+    scannedLength = 0;
+    depth = 0;
+    lineBlank = true;
+    formulas = 0;
+    errors = 0;
+    stopped = false;
+    generation = 1;
+    if (options.threads > 1 && options.image == nullptr) {
+        pool.reset(new WorkStealingPool(options.threads));
+        for (int i = 0; i < options.threads; i++) {
+            workers.emplace_back(new Worker);
+            workers.back()->generation = 0;
+        }
+    }
+}
+
+BatchRunner::~BatchRunner() {
+    pool.reset();
+}
+
+void BatchRunner::runStream(istream& in) {
+    string buffer;
+    while (!stopped) {
+        size_t unfinished = buffer.size();
+        buffer.resize(unfinished + kReadSize);
+        in.read(&buffer[unfinished], kReadSize);
+        buffer.resize(unfinished + in.gcount());
+        bool atEnd = !in;
+        const char *begin = buffer.data();
+        const char *rest = runRecords(begin, begin + buffer.size(), atEnd);
+        if (atEnd) break;
+        buffer.erase(0, rest - begin);
+    }
+    collectWorkerCounts();
+    out.flush();
+}
+
+void BatchRunner::runBuffer(const char *begin, const char *end) {
+    runRecords(begin, end, true);
+    collectWorkerCounts();
+    out.flush();
+}
+
+uint64_t BatchRunner::getFormulaCount() const {
+    return formulas;
+}
+
+uint64_t BatchRunner::getErrorCount() const {
+    return errors;
+}
+
+bool BatchRunner::isStopped() const {
+    return stopped;
+}
+
+const char *BatchRunner::runRecords(const char *begin, const char *end, bool atEnd) {
+    const char *recordStart = begin;
+    const char *cursor = begin + scannedLength;
+    for (; cursor < end && !stopped; cursor++) {
+        char ch = *cursor;
+        if (ch == '\n') {
+            if (depth <= 0 || lineBlank) {
+                addRecord(recordStart, cursor);
+                recordStart = cursor + 1;
+                depth = 0;
+            }
+            lineBlank = true;
+        } else if (!isBlank(ch)) {
+            lineBlank = false;
+            if (ch == '(') depth++;
+            else if (ch == ')') depth--;
+        }
+    }
+    if (atEnd && !stopped) {
+        addRecord(recordStart, end);
+        recordStart = end;
+        depth = 0;
+    }
+    runPendingRecords();
+    scannedLength = cursor - recordStart;
+    return recordStart;
+}
+
+void BatchRunner::addRecord(const char *begin, const char *end) {
+    while (begin < end && isBlank(*begin)) begin++;
+    while (end > begin && isBlank(end[-1])) end--;
+    if (begin == end) return;
+    if (end - begin == 4 && memcmp(begin, "quit", 4) == 0) {
+        stopped = true;
+        return;
+    }
+    if (pool == nullptr) {
+        ResultLines lines(out, formulas, false);
+        runRecord(begin, end, context, &registry, arena, factory, options, lines);
+        formulas += lines.getFormulaCount();
+        errors += lines.getErrorCount();
+        return;
+    }
+    pending.push_back({ begin, end, isBarrier(begin, end) });
+    if (pending.size() >= kPendingRecords) runPendingRecords();
+}
+
+void BatchRunner::runPendingRecords() {
+    size_t first = 0;
+    while (first < pending.size()) {
+        size_t last = first;
+        while (last < pending.size() && !pending[last].barrier) last++;
+        runInParallel(first, last);
+        if (last < pending.size()) runAlone(pending[last]);
+        first = last + 1;
+    }
+    pending.clear();
+}
+
+void BatchRunner::runInParallel(size_t first, size_t last) {
+    if (first == last) return;
+    size_t pieces = 4 * pool->getThreadCount();
+    size_t chunkSize = max<size_t>(1, min(kChunkRecords, (last - first + pieces - 1) / pieces));
+    vector<unique_ptr<Chunk>> chunks;
+    for (size_t start = first; start < last; start += chunkSize) {
+        chunks.emplace_back(new Chunk(start, min(last, start + chunkSize)));
+        Chunk *chunk = chunks.back().get();
+        pool->submit([this, chunk](int index) {
+            Worker& worker = *workers[index];
+            if (worker.generation != generation) {
+                worker.context = context;
+                worker.context.resetSkippedSubtrees();
+                worker.generation = generation;
+            }
+            for (size_t i = chunk->first; i < chunk->last; i++) {
+                runRecord(pending[i].begin, pending[i].end, worker.context, nullptr,
+                          worker.arena, worker.factory, options, chunk->lines);
+            }
+        });
+    }
+    pool->wait();
+    for (const unique_ptr<Chunk>& chunk : chunks) {
+        chunk->lines.writeNumbered(out, chunk->text.str(), formulas);
+        formulas += chunk->lines.getFormulaCount();
+        errors += chunk->lines.getErrorCount();
+    }
+}
+
+void BatchRunner::runAlone(const Record& record) {
+    collectWorkerCounts();
+    ResultLines lines(out, formulas, false);
+    runRecord(record.begin, record.end, context, &registry, arena, factory, options, lines);
+    formulas += lines.getFormulaCount();
+    errors += lines.getErrorCount();
+    generation++;
+}
+
+void BatchRunner::collectWorkerCounts() {
+    for (const unique_ptr<Worker>& worker : workers) {
+        context.countSkippedSubtrees(worker->context.getSkippedSubtrees());
+        worker->context.resetSkippedSubtrees();
+    }
+}
+
+void runRecord(const char *begin, const char *end, LangEvaluationContext& context,
+               FormulaRegistry *registry, ExpressionArena& arena, LangExpressionFactory& factory,
+               const BatchOptions& options, ResultLines& lines) {
+    STATS_PHASE(RECORD_PHASE);
+    try {
+        SExpression *list = parseAllSExp(begin, end, &arena);
+        for (SExpression *sexp : SListView(list)) {
+            runFormula(sexp, context, registry, arena, factory, options, lines);
+        }
+    } catch (ErrorException& ex) {
+        lines.countError();
+        lines.startLine(lines.newFormula()) << "\terror\t" << ex.getMessage() << '\n';
+    }
+    arena.reset();
+}
+
+void runFormula(SExpression *sexp, LangEvaluationContext& context,
+                FormulaRegistry *registry, ExpressionArena& arena, LangExpressionFactory& factory,
+                const BatchOptions& options, ResultLines& lines) {
+    uint64_t formula = lines.newFormula();
+    try {
+        if (options.printSExp) lines.startLine(formula) << "\tsexp\t" << sexp->toString() << '\n';
+        if (isReplCommand(sexp)) {
+            if (options.image != nullptr) error("IMAGE ERROR >> A command cannot be stored in an image");
+            ostream& out = lines.startLine(formula) << "\tcommand\n";
+            runReplCommand(sexp, context, registry, out);
+            return;
+        }
+        LangExpression *lexp = options.hashCons ? parseLangExp(sexp, factory) : parseLangExp(sexp, &arena);
+        if (options.simplify) {
+            uint64_t removedNodes;
+            lexp = simplifyLangExp(lexp, removedNodes, &arena, &context);
+        }
+        if (options.printLangExp) lines.startLine(formula) << "\tlexp\t" << lexp->toString() << '\n';
+        if (options.image != nullptr) {
+            options.image->add(lexp);
+            return;
+        }
+        if (options.assignments != nullptr) {
+            CompiledFormula compiled(lexp);
+            vector<uint64_t> results;
+            evaluateAssignments(compiled, *options.assignments, context, results);
+            string values(options.assignments->getRowCount(), '0');
+            for (size_t row = 0; row < values.size(); row++) {
+                if ((results[row / 64] >> (row % 64)) & 1) values[row] = '1';
+            }
+            lines.startLine(formula) << "\trows\t" << values << '\n';
+            return;
+        }
+        bool value = lexp->eval(context);
+        lines.startLine(formula) << '\t' << boolToString(value) << '\n';
+    } catch (ErrorException& ex) {
+        lines.countError();
+        lines.startLine(formula) << "\terror\t" << ex.getMessage() << '\n';
+    }
+}
+
+/**
+ * Implementation notes: isBarrier
+ * -------------------------------
+ * Looks for the words set, solve, skipped, define and formulas anywhere
+ * in the record, without parsing it. The parser also accepts an operator
+ * spelled as a list of symbols, such as ((s e t) x true), so the record
+ * is scanned a second time with whitespace ignored. A variable that
+ * merely contains one of the words, like set-point, makes its record a
+ * barrier needlessly, which costs some parallelism but never changes a
+ * result.
+ */
+
+bool isBarrier(const char *begin, const char *end) {
+    return containsBarrierWord(begin, end, false) || containsBarrierWord(begin, end, true);
+}
+
+bool containsBarrierWord(const char *begin, const char *end, bool joinAcrossBlanks) {
+    char word[8];
+    size_t length = 0;
+    for (const char *cursor = begin; cursor <= end; cursor++) {
+        if (cursor < end && joinAcrossBlanks && isBlank(*cursor)) continue;
+        if (cursor < end && isWordCharacter(*cursor)) {
+            if (length < sizeof word) word[length] = *cursor;
+            length++;
+            continue;
+        }
+        if (length == 3 && memcmp(word, "set", 3) == 0) return true;
+        if (length == 5 && memcmp(word, "solve", 5) == 0) return true;
+        if (length == 7 && memcmp(word, "skipped", 7) == 0) return true;
+        if (length == 6 && memcmp(word, "define", 6) == 0) return true;
+        if (length == 8 && memcmp(word, "formulas", 8) == 0) return true;
+        length = 0;
+    }
+    return false;
+}
+
+bool isBlank(char ch) {
+    return isspace(static_cast<unsigned char>(ch));
+}
+
+bool isWordCharacter(char ch) {
+    return isalnum(static_cast<unsigned char>(ch));
+}
+
+ResultLines::ResultLines(ostream& out, uint64_t base, bool deferred) : out(out) {
+    this->base = base;
+    this->deferred = deferred;
+    formulas = 0;
+    errors = 0;
+}
+
+uint64_t ResultLines::newFormula() {
+    return ++formulas;
+}
+
+ostream& ResultLines::startLine(uint64_t formula) {
+    if (deferred) marks.push_back({ static_cast<size_t>(out.tellp()), formula });
+    else out << base + formula;
+    return out;
+}
+
+void ResultLines::countError() {
+    errors++;
+}
+
+uint64_t ResultLines::getFormulaCount() const {
+    return formulas;
+}
+
+uint64_t ResultLines::getErrorCount() const {
+    return errors;
+}
+
+void ResultLines::writeNumbered(ostream& dest, const string& text, uint64_t base) const {
+    size_t written = 0;
+    for (const Mark& mark : marks) {
+        dest.write(text.data() + written, mark.position - written);
+        dest << base + mark.formula;
+        written = mark.position;
+    }
+    dest.write(text.data() + written, text.size() - written);
+}
@@ -0,0 +1,140 @@
+/**
+ * File: batch-runner.h
+ * -------------
+ * This interface defines the non-interactive mode of the program, which
+ * evaluates a whole stream of formulas and writes one compact result line
+ * per formula instead of the REPL's prompts and debugging dumps.
+ */
+
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "sexpressions.h"
+#include "langexpressions.h"
+#include "expression-arena.h"
+#include "langexpression-factory.h"
+#include "formula-registry.h"
+#include "work-stealing-pool.h"
+
+class FormulaImageWriter;
+class AssignmentBatch;
+
+/**
+ * Type: BatchOptions
+ * ------------------
+ * The debugging dumps the REPL always prints are off by default in batch
+ * mode and can be turned on separately. With simplify, each formula goes
+ * through simplifyLangExp, against the context it is about to be
+ * evaluated in, so that it prints the same result, and the lexp dump shows
+ * the simplified formula. With hashCons, formulas are parsed into DAGs by
+ * a LangExpressionFactory that lasts the whole run, so a subterm repeated
+ * within a formula or across formulas is built once and, while the
+ * bindings stay the same, evaluated once; memory then grows with the
+ * number of distinct subterms rather than with the size of the input.
+ * Passes that copy a formula, such as simplification, still copy the
+ * tree the DAG stands for. With more than one thread the formulas are
+ * evaluated in parallel, with the same results and output. With an image
+ * writer, each formula is added to the writer instead of being evaluated,
+ * in order and on one thread, and only formulas that fail print a line.
+ * With an assignment batch, each formula is evaluated on every row of the
+ * batch with evaluateAssignments instead of once against the context.
+ */
+
+struct BatchOptions {
+    bool printSExp;
+    bool printLangExp;
+    bool simplify;
+    bool hashCons;
+    int threads;
+    FormulaImageWriter *image;
+    const AssignmentBatch *assignments;
+};
+
+/**
+ * Class: BatchRunner
+ * ------------------
+ * Splits its input into records and evaluates every formula in them
+ * against one context, in order. A record ends at the first newline at
+ * which all of its parentheses are closed, or at a blank line, so a
+ * formula may span several lines and one line may hold several formulas.
+ * Each formula produces lines of the form
+ *
+ *     <n>\ttrue
+ *     <n>\tfalse
+ *     <n>\trows\t<values>        with assignments, one 0 or 1 per row
+ *     <n>\terror\t<message>
+ *     <n>\tcommand              followed by the command's own output
+ *     <n>\tsexp\t<dump>         only with printSExp
+ *     <n>\tlexp\t<dump>         only with printLangExp
+ *
+ * where n counts formulas from 1. A record that fails to parse counts as
+ * one formula with an error. A record consisting of the word quit ends
+ * the run, as it ends the REPL.
+ *
+ * With several threads, records are evaluated in parallel by a pool of
+ * workers, each with its own copy of the context, and with hashCons its
+ * own factory, since the factory and the values its nodes remember are
+ * not shared between threads. Their output is written in input order. A
+ * record that may bind a variable, with set or solve, that asks for the
+ * skipped-subtree count, or that defines or lists registered formulas, is
+ * a barrier: every record before it finishes first, it runs alone against
+ * the shared context and the runner's own formula registry, and the
+ * workers then pick up the new bindings. Parallel runs therefore print
+ * exactly what a sequential run would.
+ */
+
+class BatchRunner {
+public:
+    BatchRunner(LangEvaluationContext& context, std::ostream& out, const BatchOptions& options);
+    ~BatchRunner();
+
+    void runStream(std::istream& in);
+    void runBuffer(const char *begin, const char *end);
+
+    uint64_t getFormulaCount() const;
+    uint64_t getErrorCount() const;
+    bool isStopped() const;
+
+private:
+    struct Record {
+        const char *begin;
+        const char *end;
+        bool barrier;
+    };
+    struct Worker;
+    struct Chunk;
+
+    const char *runRecords(const char *begin, const char *end, bool atEnd);
+    void addRecord(const char *begin, const char *end);
+    void runPendingRecords();
+    void runInParallel(size_t first, size_t last);
+    void runAlone(const Record& record);
+    void collectWorkerCounts();
+
+    LangEvaluationContext& context;
+    std::ostream& out;
+    BatchOptions options;
+    ExpressionArena arena;
+    LangExpressionFactory factory;
+    FormulaRegistry registry;
+    size_t scannedLength;
+    int depth;
+    bool lineBlank;
+    uint64_t formulas;
+    uint64_t errors;
+    bool stopped;
+
+    std::unique_ptr<WorkStealingPool> pool;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<Record> pending;
+    uint64_t generation;
+
+    BatchRunner(const BatchRunner&) = delete;
+    BatchRunner& operator=(const BatchRunner&) = delete;
+};
+
+#endif // BATCH_RUNNER_H
@@ -0,0 +1,455 @@
+/**
+ * File: bdd.cpp
+ * -------------
+ * This file implements the bdd.h interface.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+#include "bdd.h"
+#include "error.h"
+using namespace std;
+
+static const uint32_t kTerminalLevel = UINT32_MAX;
+static const uint32_t kFreeLevel = UINT32_MAX - 1;
+static const BddRef kNoNode = UINT32_MAX;
+static const size_t kInitialBuckets = 1024;
+static const size_t kInitialCacheSize = 4096;
+static const size_t kMaxCacheSize = size_t(1) << 22;
+static const size_t kInitialCollectThreshold = size_t(1) << 18;
+
+/**
+ * Implementation notes: BddManager
+ * --------------------------------
+ * Nodes live in one array and refer to each other by index. The unique
+ * table chains nodes with equal hashes through their next fields, and is
+ * doubled whenever it holds more than two nodes per bucket. The computed
+ * cache is direct-mapped and lossy: a new result simply overwrites
+ * whatever shared its slot. It grows along with the node count, up to a
+ * fixed limit, so small diagrams do not pay for a large cache.
+ *
+ * Collected nodes are marked free and reused before the array grows. The
+ * cache may refer to collected nodes, so it is cleared by every
+ * collection.
+ */
+
+BddManager::BddManager() {
+    nodes.push_back({ kTerminalLevel, kBddFalse, kBddFalse, kNoNode });
+    nodes.push_back({ kTerminalLevel, kBddTrue, kBddTrue, kNoNode });
+    buckets.assign(kInitialBuckets, kNoNode);
+    cache.assign(kInitialCacheSize, { kNoNode, kNoNode, kNoNode, kNoNode });
+    liveNodes = 2;
+    peakNodes = 2;
+    collectThreshold = kInitialCollectThreshold;
+    cacheLookups = 0;
+    cacheHits = 0;
+    collections = 0;
+}
+
+void BddManager::setVariableOrder(const vector<SymbolId>& order) {
+    if (!levelSymbols.empty())
+        error("BDD ERROR >> The variable order must be set before any variable is used");
+    for (SymbolId symbol : order) {
+        if (symbolLevels.count(symbol) != 0) continue;
+        symbolLevels[symbol] = levelSymbols.size();
+        levelSymbols.push_back(symbol);
+    }
+}
+
+int BddManager::getVariableCount() const {
+    return levelSymbols.size();
+}
+
+SymbolId BddManager::getVariable(int level) const {
+    return levelSymbols[level];
+}
+
+BddRef BddManager::variable(SymbolId symbol) {
+    auto found = symbolLevels.find(symbol);
+    uint32_t level;
+    if (found != symbolLevels.end()) {
+        level = found->second;
+    } else {
+        level = levelSymbols.size();
+        symbolLevels[symbol] = level;
+        levelSymbols.push_back(symbol);
+    }
+    return makeNode(level, kBddFalse, kBddTrue);
+}
+
+/**
+ * Implementation notes: ite
+ * -------------------------
+ * The standard recursive algorithm: after the terminal cases, split on
+ * the topmost variable of the three arguments and combine the results
+ * for either value of it. The recursion goes one level down the variable
+ * order at a time, so its depth is bounded by the number of variables,
+ * not by the size of any formula. The cache slot is looked up again
+ * before storing, because building the children may have resized the
+ * cache.
+ */
+
+BddRef BddManager::ite(BddRef f, BddRef g, BddRef h) {
+    if (f == kBddTrue) return g;
+    if (f == kBddFalse) return h;
+    if (g == h) return g;
+    if (g == kBddTrue && h == kBddFalse) return f;
+    if (g == f) g = kBddTrue;
+    if (h == f) h = kBddFalse;
+    cacheLookups++;
+    const CacheEntry& entry = cache[hashCache(f, g, h) & (cache.size() - 1)];
+    if (entry.f == f && entry.g == g && entry.h == h) {
+        cacheHits++;
+        return entry.result;
+    }
+    uint32_t top = min(levelOf(f), min(levelOf(g), levelOf(h)));
+    BddRef low = ite(cofactor(f, top, false), cofactor(g, top, false), cofactor(h, top, false));
+    BddRef high = ite(cofactor(f, top, true), cofactor(g, top, true), cofactor(h, top, true));
+    BddRef result = makeNode(top, low, high);
+    cache[hashCache(f, g, h) & (cache.size() - 1)] = { f, g, h, result };
+    return result;
+}
+
+BddRef BddManager::negate(BddRef f) {
+    return ite(f, kBddFalse, kBddTrue);
+}
+
+BddRef BddManager::apply(LangExpressionType type, BddRef f, BddRef g) {
+    switch (type) {
+    case AndEXP: case NaryAndEXP: return ite(f, g, kBddFalse);
+    case OrEXP: case NaryOrEXP: return ite(f, kBddTrue, g);
+    case ImpEXP: return ite(f, g, kBddTrue);
+    case IffEXP: case NaryIffEXP: return ite(f, g, negate(g));
+    case NaryXorEXP: return ite(f, negate(g), g);
+    default: error("BDD ERROR >> Not a binary connective");
+    }
+    return kBddFalse;
+}
+
+/**
+ * Implementation notes: build
+ * ---------------------------
+ * Walks the formula with the same explicit stack and the same treatment
+ * of let and set as the Tseitin encoder, with BDDs in place of literals.
+ * Nodes shared within a hash-consed DAG are built once while no binding
+ * changes in between.
+ *
+ * Garbage collection can only run where every node still needed is known,
+ * so build checks for it before each connective, with the operand stack,
+ * the current bindings and the saved ones as extra roots. The record of
+ * already-built DAG nodes refers to nodes that may be collected, so it is
+ * forgotten whenever a collection runs.
+ */
+
+BddRef BddManager::build(const LangExpression *lexp) {
+    enum Action { VISIT, COMBINE, NEGATE, BIND, UNBIND, STORE, REMEMBER };
+    struct Task {
+        Action action;
+        const LangExpression *node;
+        uint64_t version;
+    };
+    struct Built {
+        BddRef bdd;
+        uint64_t version;
+    };
+    vector<Task> tasks;
+    vector<BddRef> operands;
+    vector<BddRef> saved;
+    unordered_map<SymbolId, BddRef> bindings;
+    unordered_map<const LangExpression *, Built> built;
+    uint64_t version = 0;
+    tasks.push_back({ VISIT, lexp, 0 });
+    while (!tasks.empty()) {
+        Task task = tasks.back();
+        tasks.pop_back();
+        const LangExpression *node = task.node;
+        switch (task.action) {
+        case VISIT: {
+            auto found = built.find(node);
+            if (found != built.end() && found->second.version == version) {
+                operands.push_back(found->second.bdd);
+                break;
+            }
+            switch (node->getType()) {
+            case RefEXP: {
+                auto binding = bindings.find(node->getSymbolId());
+                operands.push_back(binding != bindings.end() ? binding->second : variable(node->getSymbolId()));
+                break;
+            }
+            case BoolEXP:
+                operands.push_back(node->getBoolValue() ? kBddTrue : kBddFalse);
+                break;
+            case NotEXP:
+                tasks.push_back({ NEGATE, node, 0 });
+                tasks.push_back({ VISIT, node->getOperand(), 0 });
+                break;
+            case AndEXP: case OrEXP: case ImpEXP: case IffEXP:
+                tasks.push_back({ REMEMBER, node, version });
+                tasks.push_back({ COMBINE, node, 0 });
+                tasks.push_back({ VISIT, node->getSecond(), 0 });
+                tasks.push_back({ VISIT, node->getFirst(), 0 });
+                break;
+            case NaryAndEXP: case NaryOrEXP: case NaryIffEXP: case NaryXorEXP:
+                tasks.push_back({ REMEMBER, node, version });
+                for (int i = node->getOperandCount() - 1; i > 0; i--) {
+                    tasks.push_back({ COMBINE, node, 0 });
+                    tasks.push_back({ VISIT, node->getOperands()[i], 0 });
+                }
+                tasks.push_back({ VISIT, node->getOperands()[0], 0 });
+                break;
+            case LetEXP:
+                tasks.push_back({ UNBIND, node, 0 });
+                tasks.push_back({ VISIT, node->getBody(), 0 });
+                tasks.push_back({ BIND, node, 0 });
+                tasks.push_back({ VISIT, node->getBinding(), 0 });
+                break;
+            case SetEXP:
+                tasks.push_back({ STORE, node, 0 });
+                tasks.push_back({ VISIT, node->getBinding(), 0 });
+                break;
+            case NullEXP:
+                error("EVALUATION ERROR >> Attempted null evaluation.");
+            }
+            break;
+        }
+        case COMBINE: {
+            if (liveNodes >= collectThreshold) {
+                vector<BddRef> extraRoots(operands.begin(), operands.end());
+                extraRoots.insert(extraRoots.end(), saved.begin(), saved.end());
+                for (const auto& binding : bindings) extraRoots.push_back(binding.second);
+                collectGarbage(extraRoots);
+                built.clear();
+            }
+            BddRef second = operands.back();
+            operands.pop_back();
+            operands.back() = apply(node->getType(), operands.back(), second);
+            break;
+        }
+        case NEGATE:
+            operands.back() = negate(operands.back());
+            break;
+        case BIND: {
+            SymbolId var = node->getVariableId();
+            auto binding = bindings.find(var);
+            saved.push_back(binding != bindings.end() ? binding->second : kNoNode);
+            bindings[var] = operands.back();
+            operands.pop_back();
+            version++;
+            break;
+        }
+        case UNBIND:
+            if (saved.back() == kNoNode) bindings.erase(node->getVariableId());
+            else bindings[node->getVariableId()] = saved.back();
+            saved.pop_back();
+            version++;
+            break;
+        case STORE:
+            bindings[node->getVariableId()] = operands.back();
+            version++;
+            break;
+        case REMEMBER:
+            if (task.version == version) built[node] = { operands.back(), version };
+            break;
+        }
+    }
+    return operands.back();
+}
+
+/**
+ * Implementation notes: countModels
+ * ---------------------------------
+ * Counts the assignments to all of the manager's variables under which f
+ * is true. A node's count covers the variables from its own level down;
+ * a child whose level is further down has every variable in between
+ * unconstrained, and each of those doubles the child's count. Counts are
+ * doubles so that diagrams over hundreds of variables cannot overflow,
+ * and are exact up to 2^53.
+ */
+
+double BddManager::countModels(BddRef f) {
+    uint32_t variableCount = levelSymbols.size();
+    auto depth = [&](BddRef node) {
+        return nodes[node].level == kTerminalLevel ? variableCount : nodes[node].level;
+    };
+    unordered_map<BddRef, double> counts;
+    counts[kBddFalse] = 0;
+    counts[kBddTrue] = 1;
+    vector<BddRef> pending;
+    pending.push_back(f);
+    while (!pending.empty()) {
+        BddRef node = pending.back();
+        if (counts.count(node) != 0) {
+            pending.pop_back();
+            continue;
+        }
+        BddRef low = nodes[node].low;
+        BddRef high = nodes[node].high;
+        bool ready = true;
+        if (counts.count(low) == 0) {
+            pending.push_back(low);
+            ready = false;
+        }
+        if (counts.count(high) == 0) {
+            pending.push_back(high);
+            ready = false;
+        }
+        if (!ready) continue;
+        uint32_t level = nodes[node].level;
+        counts[node] = ldexp(counts[low], depth(low) - level - 1) + ldexp(counts[high], depth(high) - level - 1);
+        pending.pop_back();
+    }
+    return ldexp(counts[f], depth(f));
+}
+
+/**
+ * Implementation notes: findModel
+ * -------------------------------
+ * In a reduced diagram every node other than kBddFalse leads to kBddTrue,
+ * so following any child that is not kBddFalse finds a model without
+ * backtracking. The low child is preferred, and variables not tested on
+ * the way down are false, which makes the model the one with the fewest
+ * true variables along that path.
+ */
+
+bool BddManager::findModel(BddRef f, vector<pair<SymbolId, bool>>& model) const {
+    model.clear();
+    if (f == kBddFalse) return false;
+    vector<bool> values(levelSymbols.size(), false);
+    while (f != kBddTrue) {
+        const Node& node = nodes[f];
+        bool high = node.low == kBddFalse;
+        values[node.level] = high;
+        f = high ? node.high : node.low;
+    }
+    for (size_t level = 0; level < levelSymbols.size(); level++) model.push_back({ levelSymbols[level], values[level] });
+    return true;
+}
+
+void BddManager::protect(BddRef f) {
+    roots[f]++;
+}
+
+void BddManager::release(BddRef f) {
+    auto found = roots.find(f);
+    if (found == roots.end()) error("BDD ERROR >> Releasing a node that is not protected");
+    if (--found->second == 0) roots.erase(found);
+}
+
+void BddManager::collectGarbage() {
+    collectGarbage(vector<BddRef>());
+}
+
+BddStats BddManager::getStats() const {
+    size_t bytes = nodes.capacity() * sizeof(Node) + buckets.capacity() * sizeof(BddRef)
+                 + freeNodes.capacity() * sizeof(BddRef) + cache.capacity() * sizeof(CacheEntry)
+                 + marks.capacity();
+    return { liveNodes, peakNodes, bytes, cacheLookups, cacheHits, collections };
+}
+
+BddRef BddManager::makeNode(uint32_t level, BddRef low, BddRef high) {
+    if (low == high) return low;
+    size_t bucket = hashNode(level, low, high) & (buckets.size() - 1);
+    for (BddRef node = buckets[bucket]; node != kNoNode; node = nodes[node].next) {
+        const Node& candidate = nodes[node];
+        if (candidate.level == level && candidate.low == low && candidate.high == high) return node;
+    }
+    BddRef node;
+    if (!freeNodes.empty()) {
+        node = freeNodes.back();
+        freeNodes.pop_back();
+        nodes[node] = { level, low, high, buckets[bucket] };
+    } else {
+        if (nodes.size() >= kNoNode - 1) error("BDD ERROR >> Too many nodes");
+        node = nodes.size();
+        nodes.push_back({ level, low, high, buckets[bucket] });
+    }
+    buckets[bucket] = node;
+    liveNodes++;
+    peakNodes = max(peakNodes, liveNodes);
+    if (liveNodes > 2 * buckets.size()) growUniqueTable();
+    if (liveNodes > cache.size() && cache.size() < kMaxCacheSize)
+        cache.assign(2 * cache.size(), { kNoNode, kNoNode, kNoNode, kNoNode });
+    return node;
+}
+
+uint32_t BddManager::levelOf(BddRef f) const {
+    return nodes[f].level;
+}
+
+BddRef BddManager::cofactor(BddRef f, uint32_t level, bool high) const {
+    const Node& node = nodes[f];
+    if (node.level != level) return f;
+    return high ? node.high : node.low;
+}
+
+void BddManager::growUniqueTable() {
+    buckets.assign(2 * buckets.size(), kNoNode);
+    for (BddRef node = 2; node < nodes.size(); node++) {
+        if (nodes[node].level == kFreeLevel) continue;
+        size_t bucket = hashNode(nodes[node].level, nodes[node].low, nodes[node].high) & (buckets.size() - 1);
+        nodes[node].next = buckets[bucket];
+        buckets[bucket] = node;
+    }
+}
+
+/**
+ * Implementation notes: collectGarbage
+ * ------------------------------------
+ * Marks everything reachable from the protected roots and the extra ones,
+ * frees the rest and rebuilds the unique table's chains from the nodes
+ * that remain. The next collection waits until the table has at least
+ * doubled again, so the cost of collecting stays proportional to the
+ * nodes made in between.
+ */
+
+void BddManager::collectGarbage(const vector<BddRef>& extraRoots) {
+    marks.assign(nodes.size(), 0);
+    marks[kBddFalse] = marks[kBddTrue] = 1;
+    for (const auto& root : roots) mark(root.first);
+    for (BddRef root : extraRoots) mark(root);
+    for (BddRef node = 2; node < nodes.size(); node++) {
+        if (nodes[node].level == kFreeLevel || marks[node]) continue;
+        nodes[node].level = kFreeLevel;
+        freeNodes.push_back(node);
+        liveNodes--;
+    }
+    buckets.assign(buckets.size(), kNoNode);
+    for (BddRef node = 2; node < nodes.size(); node++) {
+        if (nodes[node].level == kFreeLevel) continue;
+        size_t bucket = hashNode(nodes[node].level, nodes[node].low, nodes[node].high) & (buckets.size() - 1);
+        nodes[node].next = buckets[bucket];
+        buckets[bucket] = node;
+    }
+    cache.assign(cache.size(), { kNoNode, kNoNode, kNoNode, kNoNode });
+    collectThreshold = max(collectThreshold, 2 * liveNodes);
+    collections++;
+}
+
+void BddManager::mark(BddRef f) {
+    vector<BddRef> pending;
+    pending.push_back(f);
+    while (!pending.empty()) {
+        BddRef node = pending.back();
+        pending.pop_back();
+        if (marks[node]) continue;
+        marks[node] = 1;
+        pending.push_back(nodes[node].low);
+        pending.push_back(nodes[node].high);
+    }
+}
+
+size_t BddManager::hashNode(uint32_t level, BddRef low, BddRef high) const {
+    uint64_t hash = level * 0x9E3779B97F4A7C15ULL;
+    hash ^= low + 0x7F4A7C159E3779B9ULL + (hash << 6) + (hash >> 2);
+    hash ^= high + 0x94D049BB133111EBULL + (hash << 6) + (hash >> 2);
+    return hash ^ (hash >> 29);
+}
+
+size_t BddManager::hashCache(BddRef f, BddRef g, BddRef h) const {
+    uint64_t hash = f * 0x9E3779B97F4A7C15ULL;
+    hash ^= g * 0xC2B2AE3D27D4EB4FULL;
+    hash ^= h * 0x165667B19E3779F9ULL;
+    return hash ^ (hash >> 31);
+}
@@ -0,0 +1,128 @@
+/**
+ * File: bdd.h
+ * -------------
+ * This interface defines a package of reduced ordered binary decision
+ * diagrams. A BDD is a canonical form: under one variable order, two
+ * formulas are equivalent exactly when they build the same node, so
+ * equivalence, model counting and finding models take time proportional
+ * to the size of the diagram rather than to the size of the truth table.
+ */
+
+#ifndef BDD_H
+#define BDD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "langexpressions.h"
+#include "symbol-table.h"
+
+/**
+ * Type: BddRef
+ * ------------
+ * A node of a BddManager. The terminals are kBddFalse and kBddTrue, and
+ * every other node tests one variable and has a low child for when it is
+ * false and a high child for when it is true.
+ */
+
+typedef uint32_t BddRef;
+
+const BddRef kBddFalse = 0;
+const BddRef kBddTrue = 1;
+
+/**
+ * Type: BddStats
+ * --------------
+ * How much memory a manager uses and how hard its caches work.
+ */
+
+struct BddStats {
+    size_t liveNodes;
+    size_t peakNodes;
+    size_t bytesUsed;
+    uint64_t cacheLookups;
+    uint64_t cacheHits;
+    uint64_t collections;
+};
+
+/**
+ * Class: BddManager
+ * -----------------
+ * Owns the nodes of any number of BDDs over one variable order. Nodes are
+ * made only through a hash-based unique table, so no two nodes ever test
+ * the same variable with the same children, and every operation is built
+ * on ite (if-then-else), whose results are kept in a computed cache.
+ *
+ * Variables are ordered by setVariableOrder and then in order of first
+ * appearance. The order must be fixed before any node is built, since the
+ * size of a diagram can depend on it exponentially.
+ *
+ * Nodes that no protected root reaches are reclaimed by garbage
+ * collection, which runs between steps of build once the table has grown
+ * enough. A BddRef kept across calls to build must be protected first.
+ */
+
+class BddManager {
+public:
+    BddManager();
+
+    void setVariableOrder(const std::vector<SymbolId>& order);
+    int getVariableCount() const;
+    SymbolId getVariable(int level) const;
+
+    BddRef variable(SymbolId symbol);
+    BddRef ite(BddRef f, BddRef g, BddRef h);
+    BddRef negate(BddRef f);
+    BddRef apply(LangExpressionType type, BddRef f, BddRef g);
+    BddRef build(const LangExpression *lexp);
+
+    double countModels(BddRef f);
+    bool findModel(BddRef f, std::vector<std::pair<SymbolId, bool>>& model) const;
+
+    void protect(BddRef f);
+    void release(BddRef f);
+    void collectGarbage();
+    BddStats getStats() const;
+
+private:
+    struct Node {
+        uint32_t level;
+        BddRef low;
+        BddRef high;
+        BddRef next;
+    };
+    struct CacheEntry {
+        BddRef f, g, h, result;
+    };
+
+    BddRef makeNode(uint32_t level, BddRef low, BddRef high);
+    uint32_t levelOf(BddRef f) const;
+    BddRef cofactor(BddRef f, uint32_t level, bool high) const;
+    void growUniqueTable();
+    void collectGarbage(const std::vector<BddRef>& extraRoots);
+    void mark(BddRef f);
+    size_t hashNode(uint32_t level, BddRef low, BddRef high) const;
+    size_t hashCache(BddRef f, BddRef g, BddRef h) const;
+
+    std::vector<Node> nodes;
+    std::vector<BddRef> buckets;
+    std::vector<BddRef> freeNodes;
+    std::vector<CacheEntry> cache;
+    std::vector<uint8_t> marks;
+    std::unordered_map<BddRef, int> roots;
+    std::vector<SymbolId> levelSymbols;
+    std::unordered_map<SymbolId, uint32_t> symbolLevels;
+    size_t liveNodes;
+    size_t peakNodes;
+    size_t collectThreshold;
+    uint64_t cacheLookups;
+    uint64_t cacheHits;
+    uint64_t collections;
+
+    BddManager(const BddManager&) = delete;
+    BddManager& operator=(const BddManager&) = delete;
+};
+
+#endif // BDD_H
@@ -0,0 +1,97 @@
+/**
+ * File: expression-arena.cpp
+ * -------------
+ * This file implements the expression-arena.h interface.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include "expression-arena.h"
+using namespace std;
+
+/**
+ * Implementation notes: ExpressionArena
+ * -------------------------------------
+ * Chunks are kept in a singly linked list with the newest chunk at the
+ * front, and the cursor always points into that newest chunk. Resetting
+ * keeps the oldest chunk around so that an arena reused once per REPL line
+ * or batch formula settles into allocating nothing from the system at all.
+ * Every byte handed out counts as tree memory until the arena is reset,
+ * padding included, since the arena holds nothing but trees.
+ */
+
+ExpressionArena::ExpressionArena(size_t chunkSize) {
+    this->chunkSize = chunkSize;
+    this->chunks = nullptr;
+    this->cursor = nullptr;
+    this->limit = nullptr;
+    this->usedInFullChunks = 0;
+    this->finalizers = nullptr;
+}
+
+ExpressionArena::~ExpressionArena() {
+    runFinalizers();
+    STATS_TREE_BYTES(-static_cast<int64_t>(bytesUsed()));
+    while (chunks != nullptr) {
+        Chunk *next = chunks->next;
+        free(chunks);
+        chunks = next;
+    }
+}
+
+void *ExpressionArena::allocate(size_t size, size_t alignment) {
+    uintptr_t address = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(alignment - 1);
+    if (cursor == nullptr || address + size > reinterpret_cast<uintptr_t>(limit)) {
+        addChunk(size + alignment);
+        address = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(alignment - 1);
+    }
+    STATS_TREE_BYTES(address + size - reinterpret_cast<uintptr_t>(cursor));
+    cursor = reinterpret_cast<char *>(address + size);
+    return reinterpret_cast<void *>(address);
+}
+
+void ExpressionArena::reset() {
+    runFinalizers();
+    if (chunks == nullptr) return;
+    STATS_TREE_BYTES(-static_cast<int64_t>(bytesUsed()));
+    while (chunks->next != nullptr) {
+        Chunk *next = chunks->next;
+        free(chunks);
+        chunks = next;
+    }
+    cursor = reinterpret_cast<char *>(chunks + 1);
+    limit = cursor + chunks->size;
+    usedInFullChunks = 0;
+}
+
+size_t ExpressionArena::bytesUsed() const {
+    if (chunks == nullptr) return 0;
+    return usedInFullChunks + (cursor - reinterpret_cast<char *>(chunks + 1));
+}
+
+void ExpressionArena::addChunk(size_t minimumSize) {
+    size_t size = minimumSize > chunkSize ? minimumSize : chunkSize;
+    Chunk *chunk = static_cast<Chunk *>(malloc(sizeof(Chunk) + size));
+    if (chunk == nullptr) throw bad_alloc();
+    if (chunks != nullptr) usedInFullChunks += cursor - reinterpret_cast<char *>(chunks + 1);
+    chunk->next = chunks;
+    chunk->size = size;
+    chunks = chunk;
+    cursor = reinterpret_cast<char *>(chunk + 1);
+    limit = cursor + size;
+}
+
+void ExpressionArena::addFinalizer(void (*destroy)(void *), void *object) {
+    Finalizer *finalizer = static_cast<Finalizer *>(allocate(sizeof(Finalizer), alignof(Finalizer)));
+    finalizer->destroy = destroy;
+    finalizer->object = object;
+    finalizer->next = finalizers;
+    finalizers = finalizer;
+}
+
+void ExpressionArena::runFinalizers() {
+    for (Finalizer *finalizer = finalizers; finalizer != nullptr; finalizer = finalizer->next)
+        finalizer->destroy(finalizer->object);
+    finalizers = nullptr;
+}
@@ -0,0 +1,114 @@
+/**
+ * File: expression-arena.h
+ * -------------
+ * This interface defines a bump allocator that owns every node of the
+ * S-expression and LangExpression trees built during one parse-and-evaluate
+ * cycle, so that the whole cycle can be released at once instead of one
+ * node at a time.
+ */
+
+#ifndef EXPRESSION_ARENA_H
+#define EXPRESSION_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include "pipeline-stats.h"
+
+/**
+ * Type: ArenaFinalized
+ * --------------------
+ * Most node types hold nothing but pointers to other nodes in the same
+ * arena, so the arena never runs their destructors. A node type that owns
+ * memory outside the arena specializes this trait to true, and the arena
+ * then destroys each such node when it is reset.
+ */
+
+template <typename T>
+struct ArenaFinalized {
+    static const bool value = false;
+};
+
+/**
+ * Class: ExpressionArena
+ * ----------------------
+ * Hands out memory from large chunks by bumping a cursor. Objects made in
+ * an arena must never be deleted; they all disappear together when the
+ * arena is reset or destroyed.
+ */
+
+class ExpressionArena {
+public:
+    ExpressionArena(size_t chunkSize = 64 * 1024);
+    ~ExpressionArena();
+
+    void *allocate(size_t size, size_t alignment);
+    template <typename T, typename... Args>
+    T *make(Args&&... args);
+
+    void reset();
+    size_t bytesUsed() const;
+
+private:
+    struct Chunk {
+        Chunk *next;
+        size_t size;
+    };
+    struct Finalizer {
+        void (*destroy)(void *object);
+        void *object;
+        Finalizer *next;
+    };
+
+    ExpressionArena(const ExpressionArena&) = delete;
+    ExpressionArena& operator=(const ExpressionArena&) = delete;
+
+    void addChunk(size_t minimumSize);
+    void addFinalizer(void (*destroy)(void *), void *object);
+    void runFinalizers();
+    template <typename T>
+    static void destroy(void *object);
+
+    size_t chunkSize;
+    Chunk *chunks;
+    char *cursor;
+    char *limit;
+    size_t usedInFullChunks;
+    Finalizer *finalizers;
+};
+
+/**
+ * Function: newNode
+ * Usage: SCons *cons = newNode<SCons>(arena, car, cdr);
+ * -------------------------------------------
+ * Creates a tree node on the heap when arena is nullptr, with the usual
+ * ownership of its children, or inside the given arena otherwise. Nodes
+ * made in an arena do not own their children, since the arena frees them.
+ */
+
+template <typename T, typename... Args>
+T *newNode(ExpressionArena *arena, Args&&... args) {
+    if (arena == nullptr) {
+        T *node = new T(std::forward<Args>(args)...);
+        STATS_NODE(node);
+        return node;
+    }
+    T *node = arena->make<T>(std::forward<Args>(args)...);
+    node->setOwnsChildren(false);
+    return node;
+}
+
+template <typename T, typename... Args>
+T *ExpressionArena::make(Args&&... args) {
+    T *object = ::new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    if (ArenaFinalized<T>::value) addFinalizer(&ExpressionArena::destroy<T>, object);
+    STATS_NODE(object);
+    return object;
+}
+
+template <typename T>
+void ExpressionArena::destroy(void *object) {
+    static_cast<T *>(object)->~T();
+}
+
+#endif // EXPRESSION_ARENA_H
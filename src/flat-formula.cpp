@@ -0,0 +1,319 @@
+/**
+ * File: flat-formula.cpp
+ * -------------
+ * This file implements the flat-formula.h interface.
+ */
+
+#include <vector>
+#include "flat-formula.h"
+#include "pipeline-stats.h"
+#include "error.h"
+using namespace std;
+
+/**
+ * Implementation notes: FlatFormula
+ * ---------------------------------
+ * Flattening walks the tree with an explicit work list, the way the
+ * compiler does. Each entry either visits a subtree or adds one node, and
+ * entries are pushed in reverse so that operands are added before the
+ * node that uses them. The index of every finished subtree goes on a
+ * stack, from which the node above it takes its operands. A TEST is added
+ * before the connective it belongs to exists, so its index goes on a
+ * stack of open tests, and the connective fills in its own index when it
+ * is added. Subtrees nest, so the innermost open tests are always the
+ * ones to fill in.
+ */
+
+FlatFormula::FlatFormula(const LangExpression *lexp) {
+    struct Task {
+        const LangExpression *node;
+        FlatOpcode opcode;
+        bool visit;
+    };
+    vector<Task> tasks;
+    vector<int32_t> finished;
+    vector<int32_t> openTests;
+    tasks.push_back({lexp, FLAT_NULL, true});
+    while (!tasks.empty()) {
+        Task task = tasks.back();
+        tasks.pop_back();
+        const LangExpression *node = task.node;
+        if (!task.visit) {
+            int32_t index;
+            switch (task.opcode) {
+            case FLAT_BIND:
+                add(FLAT_BIND, finished.back(), 0, node->getVariableId());
+                continue;
+            case FLAT_AND_TEST: case FLAT_OR_TEST: case FLAT_IMP_TEST:
+                openTests.push_back(add(task.opcode, finished.back()));
+                continue;
+            case FLAT_NOT:
+                index = add(FLAT_NOT, finished.back(), finished.back());
+                finished.pop_back();
+                break;
+            case FLAT_SET:
+                index = add(FLAT_SET, finished.back(), 0, node->getVariableId());
+                finished.pop_back();
+                break;
+            case FLAT_NARY_AND: case FLAT_NARY_OR: case FLAT_NARY_IFF: case FLAT_NARY_XOR: {
+                int count = node->getOperandCount();
+                int start = operandLists.size();
+                operandLists.insert(operandLists.end(), finished.end() - count, finished.end());
+                finished.resize(finished.size() - count);
+                index = add(task.opcode, start, count);
+                if (task.opcode == FLAT_NARY_AND || task.opcode == FLAT_NARY_OR) {
+                    for (int i = 1; i < count; i++) {
+                        rights[openTests.back()] = index;
+                        openTests.pop_back();
+                    }
+                }
+                break;
+            }
+            default: {
+                int32_t right = finished.back();
+                finished.pop_back();
+                SymbolId symbol = task.opcode == FLAT_LET ? node->getVariableId() : kNoSymbol;
+                index = add(task.opcode, finished.back(), right, symbol);
+                finished.pop_back();
+                if (task.opcode == FLAT_AND || task.opcode == FLAT_OR || task.opcode == FLAT_IMP) {
+                    rights[openTests.back()] = index;
+                    openTests.pop_back();
+                }
+                break;
+            }
+            }
+            finished.push_back(index);
+            continue;
+        }
+        switch (node->getType()) {
+        case RefEXP:
+            finished.push_back(add(FLAT_REF, 0, 0, node->getSymbolId()));
+            break;
+        case BoolEXP:
+            finished.push_back(add(node->getBoolValue() ? FLAT_TRUE : FLAT_FALSE));
+            break;
+        case NullEXP:
+            finished.push_back(add(FLAT_NULL));
+            break;
+        case NotEXP:
+            tasks.push_back({node, FLAT_NOT, false});
+            tasks.push_back({node->getOperand(), FLAT_NULL, true});
+            break;
+        case AndEXP: case OrEXP: case ImpEXP: {
+            FlatOpcode opcode = static_cast<FlatOpcode>(FLAT_AND + (node->getType() - AndEXP));
+            FlatOpcode test = static_cast<FlatOpcode>(FLAT_AND_TEST + (node->getType() - AndEXP));
+            tasks.push_back({node, opcode, false});
+            tasks.push_back({node->getSecond(), FLAT_NULL, true});
+            tasks.push_back({node, test, false});
+            tasks.push_back({node->getFirst(), FLAT_NULL, true});
+            break;
+        }
+        case IffEXP:
+            tasks.push_back({node, FLAT_IFF, false});
+            tasks.push_back({node->getSecond(), FLAT_NULL, true});
+            tasks.push_back({node->getFirst(), FLAT_NULL, true});
+            break;
+        case NaryAndEXP: case NaryOrEXP: case NaryIffEXP: case NaryXorEXP: {
+            LangExpressionType type = node->getType();
+            tasks.push_back({node, static_cast<FlatOpcode>(FLAT_NARY_AND + (type - NaryAndEXP)), false});
+            for (int i = node->getOperandCount() - 1; i > 0; i--) {
+                tasks.push_back({node->getOperands()[i], FLAT_NULL, true});
+                if (type == NaryAndEXP) tasks.push_back({node, FLAT_AND_TEST, false});
+                if (type == NaryOrEXP) tasks.push_back({node, FLAT_OR_TEST, false});
+            }
+            tasks.push_back({node->getOperands()[0], FLAT_NULL, true});
+            break;
+        }
+        case LetEXP:
+            tasks.push_back({node, FLAT_LET, false});
+            tasks.push_back({node->getBody(), FLAT_NULL, true});
+            tasks.push_back({node, FLAT_BIND, false});
+            tasks.push_back({node->getBinding(), FLAT_NULL, true});
+            break;
+        case SetEXP:
+            tasks.push_back({node, FLAT_SET, false});
+            tasks.push_back({node->getBinding(), FLAT_NULL, true});
+            break;
+        }
+    }
+}
+
+int FlatFormula::getNodeCount() const {
+    return opcodes.size();
+}
+
+FlatOpcode FlatFormula::getOpcode(int node) const {
+    return static_cast<FlatOpcode>(opcodes[node]);
+}
+
+int FlatFormula::getLeft(int node) const {
+    return lefts[node];
+}
+
+int FlatFormula::getRight(int node) const {
+    return rights[node];
+}
+
+SymbolId FlatFormula::getSymbol(int node) const {
+    return symbols[node];
+}
+
+const int32_t *FlatFormula::getOperands(int node) const {
+    return operandLists.data() + lefts[node];
+}
+
+size_t FlatFormula::bytesUsed() const {
+    return opcodes.size() * sizeof(uint8_t) + lefts.size() * sizeof(int32_t)
+         + rights.size() * sizeof(int32_t) + symbols.size() * sizeof(SymbolId)
+         + operandLists.size() * sizeof(int32_t);
+}
+
+/**
+ * Implementation notes: toLangExpression
+ * --------------------------------------
+ * Since every operand comes before its node, one forward pass can build
+ * the tree from the leaves up, keeping the node made for each index until
+ * the node above it takes it. BIND and TEST entries make nothing.
+ */
+
+LangExpression *FlatFormula::toLangExpression(ExpressionArena *arena) const {
+    vector<LangExpression *> built(opcodes.size(), nullptr);
+    vector<LangExpression *> operands;
+    for (size_t i = 0; i < opcodes.size(); i++) {
+        LangExpression *left = opcodes[i] < FLAT_NARY_AND ? built[lefts[i]] : nullptr;
+        LangExpression *right = opcodes[i] < FLAT_NARY_AND ? built[rights[i]] : nullptr;
+        switch (opcodes[i]) {
+        case FLAT_FALSE: case FLAT_TRUE: built[i] = newNode<BoolExp>(arena, opcodes[i] == FLAT_TRUE); break;
+        case FLAT_REF: built[i] = newNode<RefExp>(arena, symbols[i]); break;
+        case FLAT_NOT: built[i] = newNode<NotExp>(arena, left); break;
+        case FLAT_AND: built[i] = newNode<AndExp>(arena, left, right); break;
+        case FLAT_OR: built[i] = newNode<OrExp>(arena, left, right); break;
+        case FLAT_IMP: built[i] = newNode<ImpExp>(arena, left, right); break;
+        case FLAT_IFF: built[i] = newNode<IffExp>(arena, left, right); break;
+        case FLAT_LET: built[i] = newNode<LetExp>(arena, symbols[i], left, right); break;
+        case FLAT_SET: built[i] = newNode<SetExp>(arena, symbols[i], left); break;
+        case FLAT_NULL: built[i] = newNode<NullExp>(arena); break;
+        case FLAT_NARY_AND: case FLAT_NARY_OR: case FLAT_NARY_IFF: case FLAT_NARY_XOR: {
+            operands.clear();
+            for (int k = 0; k < rights[i]; k++) operands.push_back(built[operandLists[lefts[i] + k]]);
+            LangExpressionType type = static_cast<LangExpressionType>(NaryAndEXP + (opcodes[i] - FLAT_NARY_AND));
+            built[i] = newNode<NaryExp>(arena, type, operands.data(), rights[i], arena);
+            break;
+        }
+        default: break;
+        }
+    }
+    return built.back();
+}
+
+/**
+ * Implementation notes: eval
+ * --------------------------
+ * The value of every node is kept in a byte array indexed like the nodes,
+ * so each node reads its operands' values by index and writes its own.
+ * Negation and the binary connectives, which make up most of a formula,
+ * are taken before the switch and share one branch: each is a four-bit
+ * truth table indexed by its operands' values, with a negation reading
+ * its one operand as both. A TEST that decides its connective jumps
+ * forward to the entry after it; the entries it passes over form whole
+ * subtrees, so every let among them has both its BIND and its own node
+ * passed over, and the binding stack is left as the TEST found it. The
+ * value array is kept per thread and only ever grows, so evaluating a
+ * formula allocates nothing once the largest one has been seen. Any
+ * bindings still pushed when an error escapes are popped again, so the
+ * context is left as it was found.
+ */
+
+/* Truth tables of not, and, or, imp and iff, indexed by 2 * left + right. */
+static const uint8_t kConnectiveTables[] = { 0, 0, 0, 0x1, 0x8, 0xe, 0xb, 0x9 };
+
+bool FlatFormula::eval(LangEvaluationContext& context) const {
+    STATS_PHASE(EVAL_PHASE);
+    static thread_local vector<uint8_t> valueStore;
+    if (valueStore.size() < opcodes.size()) valueStore.resize(opcodes.size());
+    uint8_t *values = valueStore.data();
+    const uint8_t *opcode = opcodes.data();
+    const int32_t *left = lefts.data();
+    const int32_t *right = rights.data();
+    const SymbolId *symbol = symbols.data();
+    const int32_t *operands = operandLists.data();
+    int count = opcodes.size();
+    int scopeDepth = context.getScopeDepth();
+    bool strict = context.isStrictEvaluation();
+    try {
+        for (int i = 0; i < count; i++) {
+            if (opcode[i] >= FLAT_NOT && opcode[i] <= FLAT_IFF) {
+                values[i] = (kConnectiveTables[opcode[i]] >> (2 * values[left[i]] + values[right[i]])) & 1;
+                continue;
+            }
+            switch (opcode[i]) {
+            case FLAT_FALSE:
+                values[i] = false;
+                break;
+            case FLAT_TRUE:
+                values[i] = true;
+                break;
+            case FLAT_REF:
+                if (!context.isDefined(symbol[i]))
+                    error("EVALUATION ERROR >> undefined symbol: " + globalSymbols().nameOf(symbol[i]));
+                values[i] = context.getValue(symbol[i]);
+                break;
+            case FLAT_LET:
+                context.popBinding();
+                values[i] = values[right[i]];
+                break;
+            case FLAT_SET:
+                context.setValue(symbol[i], values[left[i]]);
+                values[i] = values[left[i]];
+                break;
+            case FLAT_NULL:
+                error("EVALUATION ERROR >> Attempted null evaluation.");
+                break;
+            case FLAT_NARY_AND: case FLAT_NARY_OR: {
+                uint8_t unit = opcode[i] == FLAT_NARY_AND;
+                uint8_t value = unit;
+                for (int k = 0; k < right[i]; k++) {
+                    if (values[operands[left[i] + k]] != unit) value = !unit;
+                }
+                values[i] = value;
+                break;
+            }
+            case FLAT_NARY_IFF: case FLAT_NARY_XOR: {
+                uint8_t parity = opcode[i] == FLAT_NARY_IFF ? !(right[i] & 1) : 0;
+                for (int k = 0; k < right[i]; k++) parity ^= values[operands[left[i] + k]];
+                values[i] = parity;
+                break;
+            }
+            case FLAT_BIND:
+                context.pushBinding(symbol[i], values[left[i]]);
+                break;
+            case FLAT_AND_TEST:
+                if (!strict && !values[left[i]]) {
+                    values[right[i]] = false;
+                    context.countSkippedSubtrees();
+                    i = right[i];
+                }
+                break;
+            case FLAT_OR_TEST: case FLAT_IMP_TEST:
+                if (!strict && values[left[i]] == (opcode[i] == FLAT_OR_TEST)) {
+                    values[right[i]] = true;
+                    context.countSkippedSubtrees();
+                    i = right[i];
+                }
+                break;
+            }
+        }
+    } catch (ErrorException& ex) {
+        while (context.getScopeDepth() > scopeDepth) context.popBinding();
+        throw;
+    }
+    return values[count - 1];
+}
+
+int FlatFormula::add(FlatOpcode opcode, int32_t left, int32_t right, SymbolId symbol) {
+    opcodes.push_back(opcode);
+    lefts.push_back(left);
+    rights.push_back(right);
+    symbols.push_back(symbol);
+    return opcodes.size() - 1;
+}
@@ -0,0 +1,95 @@
+/**
+ * File: flat-formula.h
+ * -------------
+ * This interface defines a second representation of a LangExpression
+ * tree, as parallel arrays of opcodes, operand indexes and symbols in
+ * which every node comes after its operands. Such a formula is evaluated
+ * by one forward pass over contiguous memory rather than by following
+ * pointers from node to node, and converts to and from the object tree.
+ */
+
+#ifndef FLAT_FORMULA_H
+#define FLAT_FORMULA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "langexpressions.h"
+#include "expression-arena.h"
+#include "symbol-table.h"
+
+/**
+ * Type: FlatOpcode
+ * ----------------
+ * What one node of a flat formula does. The left and right indexes name
+ * the operands of a connective, both of them the one operand of a not,
+ * the binding and body of a let, and the binding of a set; the symbol
+ * names the variable of a reference, let or set. An n-ary connective
+ * instead keeps its operands in a shared list, with left giving where
+ * they start in it and right how many there are.
+ *
+ * Besides the nodes of the tree there are entries that only steer the
+ * pass. A BIND follows the binding of every let and enters the binding
+ * before the body is evaluated, so a let's own node only has to leave it
+ * again. A TEST follows the first operand of every and, or and imp, and
+ * every operand but the last of an n-ary and or or. Its left index is the
+ * operand just evaluated and its right index the connective; when the
+ * operand decides the result, the TEST stores it as the connective's
+ * value and the pass resumes after the connective, passing over the rest
+ * of its operands. Strict evaluation treats every TEST as a no-op.
+ */
+
+enum FlatOpcode : uint8_t {
+    FLAT_FALSE, FLAT_TRUE, FLAT_REF, FLAT_NOT,
+    FLAT_AND, FLAT_OR, FLAT_IMP, FLAT_IFF,
+    FLAT_LET, FLAT_SET, FLAT_NULL,
+    FLAT_NARY_AND, FLAT_NARY_OR, FLAT_NARY_IFF, FLAT_NARY_XOR,
+    FLAT_BIND, FLAT_AND_TEST, FLAT_OR_TEST, FLAT_IMP_TEST
+};
+
+/**
+ * Class: FlatFormula
+ * ------------------
+ * A LangExpression stored as a struct of arrays, indexed by node, in
+ * postorder, so that every operand comes before the node that uses it and
+ * the whole formula is the last node. Each subtree occupies one run of
+ * consecutive indexes, which is what lets a TEST skip one by jumping
+ * forward. A hash-consed DAG is stored as the tree it stands for, since
+ * the same subformula can mean different things under different lets.
+ *
+ * eval follows the same rules as LangExpression::eval, including strict
+ * evaluation, the skipped-subtree count and the restoring of let bindings
+ * when an error escapes. It is meant for strict evaluation, which visits
+ * every entry in order. Short-circuiting visits only a small part of a
+ * large formula, and each skip lands on memory the pass has not touched,
+ * in four arrays at once, where the tree goes back to a parent it has
+ * just left; there a flat formula is slower than the tree, by a factor of
+ * three or so at millions of nodes.
+ */
+
+class FlatFormula {
+public:
+    FlatFormula(const LangExpression *lexp);
+
+    int getNodeCount() const;
+    FlatOpcode getOpcode(int node) const;
+    int getLeft(int node) const;
+    int getRight(int node) const;
+    SymbolId getSymbol(int node) const;
+    const int32_t *getOperands(int node) const;
+    size_t bytesUsed() const;
+
+    LangExpression *toLangExpression(ExpressionArena *arena = nullptr) const;
+    bool eval(LangEvaluationContext& context) const;
+
+private:
+    int add(FlatOpcode opcode, int32_t left = 0, int32_t right = 0, SymbolId symbol = kNoSymbol);
+
+    std::vector<uint8_t> opcodes;
+    std::vector<int32_t> lefts;
+    std::vector<int32_t> rights;
+    std::vector<SymbolId> symbols;
+    std::vector<int32_t> operandLists;
+};
+
+#endif // FLAT_FORMULA_H
@@ -0,0 +1,602 @@
+/**
+ * File: formula-image.cpp
+ * -------------
+ * This file implements the formula-image.h interface.
+ */
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "formula-image.h"
+#include "pipeline-stats.h"
+#include "error.h"
+using namespace std;
+
+enum ImageOpcode : uint8_t {
+    IMAGE_FALSE, IMAGE_TRUE, IMAGE_REF, IMAGE_NOT,
+    IMAGE_AND, IMAGE_OR, IMAGE_IMP, IMAGE_IFF,
+    IMAGE_LET, IMAGE_SET, IMAGE_NULL,
+    IMAGE_NARY_AND, IMAGE_NARY_OR, IMAGE_NARY_IFF, IMAGE_NARY_XOR
+};
+
+struct ImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t formulaCount;
+    uint64_t symbolCount;
+    uint64_t formulaIndexOffset;
+    uint64_t symbolIndexOffset;
+    uint64_t namesOffset;
+    uint64_t namesLength;
+    uint64_t codeOffset;
+    uint64_t codeLength;
+};
+
+static const char kImageMagic[8] = { 'L', 'F', 'L', 'I', 'M', 'A', 'G', 'E' };
+static const uint32_t kByteOrderMark = 0x01020304;
+
+static int numberLength(uint64_t number);
+static uint64_t alignSection(uint64_t offset);
+static void writePadding(ostream& out, uint64_t from, uint64_t to);
+static bool sectionFits(uint64_t offset, uint64_t length, uint64_t size);
+static uint64_t readWord(const char *words, size_t index);
+static void damagedImage();
+
+FormulaImageWriter::FormulaImageWriter() {
+    /* Empty */
+}
+
+/**
+ * Implementation notes: add
+ * -------------------------
+ * A binary node's code starts with the length of its second operand, and
+ * an n-ary node's with its operand count and the length of all its
+ * operands together, so the lengths of all subtrees are worked out first,
+ * from the leaves up,
+ * and the code is written in a second walk from the root down. Both walks
+ * use an explicit stack, so the depth of a formula is limited only by
+ * memory.
+ */
+
+void FormulaImageWriter::add(const LangExpression *lexp) {
+    struct Task {
+        const LangExpression *node;
+        bool expanded;
+    };
+    unordered_map<const LangExpression *, uint64_t> lengths;
+    vector<Task> tasks = { { lexp, false } };
+    while (!tasks.empty()) {
+        Task task = tasks.back();
+        tasks.pop_back();
+        const LangExpression *node = task.node;
+        if (lengths.count(node) != 0) continue;
+        LangExpressionType type = node->getType();
+        if (!task.expanded) {
+            tasks.push_back({ node, true });
+            if (type == NotEXP) {
+                tasks.push_back({ node->getOperand(), false });
+            } else if (type == LetEXP) {
+                tasks.push_back({ node->getBinding(), false });
+                tasks.push_back({ node->getBody(), false });
+            } else if (type == SetEXP) {
+                tasks.push_back({ node->getBinding(), false });
+            } else if (type >= AndEXP && type <= IffEXP) {
+                tasks.push_back({ node->getFirst(), false });
+                tasks.push_back({ node->getSecond(), false });
+            } else if (type >= NaryAndEXP && type <= NaryXorEXP) {
+                for (int i = 0; i < node->getOperandCount(); i++) tasks.push_back({ node->getOperands()[i], false });
+            }
+            continue;
+        }
+        uint64_t length = 1;
+        switch (type) {
+        case RefEXP:
+            length += numberLength(symbolIndex(node->getSymbolId()));
+            break;
+        case NotEXP:
+            length += lengths[node->getOperand()];
+            break;
+        case LetEXP:
+            length += numberLength(symbolIndex(node->getVariableId()))
+                    + lengths[node->getBinding()] + lengths[node->getBody()];
+            break;
+        case SetEXP:
+            length += numberLength(symbolIndex(node->getVariableId())) + lengths[node->getBinding()];
+            break;
+        case AndEXP: case OrEXP: case ImpEXP: case IffEXP: {
+            uint64_t second = lengths[node->getSecond()];
+            length += numberLength(second) + lengths[node->getFirst()] + second;
+            break;
+        }
+        case NaryAndEXP: case NaryOrEXP: case NaryIffEXP: case NaryXorEXP: {
+            uint64_t operands = 0;
+            for (int i = 0; i < node->getOperandCount(); i++) operands += lengths[node->getOperands()[i]];
+            length += numberLength(node->getOperandCount()) + numberLength(operands) + operands;
+            break;
+        }
+        default:
+            break;
+        }
+        lengths[node] = length;
+    }
+    starts.push_back(code.size());
+    vector<const LangExpression *> pending = { lexp };
+    while (!pending.empty()) {
+        const LangExpression *node = pending.back();
+        pending.pop_back();
+        switch (node->getType()) {
+        case RefEXP:
+            code.push_back(IMAGE_REF);
+            putNumber(symbolIndex(node->getSymbolId()));
+            break;
+        case BoolEXP:
+            code.push_back(node->getBoolValue() ? IMAGE_TRUE : IMAGE_FALSE);
+            break;
+        case NotEXP:
+            code.push_back(IMAGE_NOT);
+            pending.push_back(node->getOperand());
+            break;
+        case LetEXP:
+            code.push_back(IMAGE_LET);
+            putNumber(symbolIndex(node->getVariableId()));
+            pending.push_back(node->getBody());
+            pending.push_back(node->getBinding());
+            break;
+        case SetEXP:
+            code.push_back(IMAGE_SET);
+            putNumber(symbolIndex(node->getVariableId()));
+            pending.push_back(node->getBinding());
+            break;
+        case AndEXP: case OrEXP: case ImpEXP: case IffEXP:
+            code.push_back(IMAGE_AND + (node->getType() - AndEXP));
+            putNumber(lengths[node->getSecond()]);
+            pending.push_back(node->getSecond());
+            pending.push_back(node->getFirst());
+            break;
+        case NaryAndEXP: case NaryOrEXP: case NaryIffEXP: case NaryXorEXP: {
+            uint64_t operands = 0;
+            for (int i = 0; i < node->getOperandCount(); i++) operands += lengths[node->getOperands()[i]];
+            code.push_back(IMAGE_NARY_AND + (node->getType() - NaryAndEXP));
+            putNumber(node->getOperandCount());
+            putNumber(operands);
+            for (int i = node->getOperandCount() - 1; i >= 0; i--) pending.push_back(node->getOperands()[i]);
+            break;
+        }
+        default:
+            code.push_back(IMAGE_NULL);
+            break;
+        }
+    }
+}
+
+size_t FormulaImageWriter::getFormulaCount() const {
+    return starts.size();
+}
+
+void FormulaImageWriter::write(ostream& out) const {
+    ImageHeader header;
+    memcpy(header.magic, kImageMagic, sizeof(kImageMagic));
+    header.version = kFormulaImageVersion;
+    header.byteOrder = kByteOrderMark;
+    header.formulaCount = starts.size();
+    header.symbolCount = symbols.size();
+    vector<uint64_t> formulaIndex(starts);
+    formulaIndex.push_back(code.size());
+    vector<uint64_t> symbolIndex = { 0 };
+    string names;
+    for (SymbolId symbol : symbols) {
+        names += globalSymbols().nameOf(symbol);
+        symbolIndex.push_back(names.size());
+    }
+    header.formulaIndexOffset = alignSection(sizeof(ImageHeader));
+    header.symbolIndexOffset = alignSection(header.formulaIndexOffset + formulaIndex.size() * sizeof(uint64_t));
+    header.namesOffset = header.symbolIndexOffset + symbolIndex.size() * sizeof(uint64_t);
+    header.namesLength = names.size();
+    header.codeOffset = alignSection(header.namesOffset + names.size());
+    header.codeLength = code.size();
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    writePadding(out, sizeof(header), header.formulaIndexOffset);
+    out.write(reinterpret_cast<const char *>(formulaIndex.data()), formulaIndex.size() * sizeof(uint64_t));
+    writePadding(out, header.formulaIndexOffset + formulaIndex.size() * sizeof(uint64_t), header.symbolIndexOffset);
+    out.write(reinterpret_cast<const char *>(symbolIndex.data()), symbolIndex.size() * sizeof(uint64_t));
+    out.write(names.data(), names.size());
+    writePadding(out, header.namesOffset + names.size(), header.codeOffset);
+    out.write(reinterpret_cast<const char *>(code.data()), code.size());
+}
+
+void FormulaImageWriter::writeFile(const string& path) const {
+    ofstream out(path, ios::binary | ios::trunc);
+    if (!out) error("IMAGE ERROR >> Cannot write " + path);
+    write(out);
+    out.close();
+    if (!out) error("IMAGE ERROR >> Cannot write " + path);
+}
+
+uint64_t FormulaImageWriter::symbolIndex(SymbolId symbol) {
+    auto found = symbolIndices.find(symbol);
+    if (found != symbolIndices.end()) return found->second;
+    uint64_t index = symbols.size();
+    symbols.push_back(symbol);
+    symbolIndices[symbol] = index;
+    return index;
+}
+
+void FormulaImageWriter::putNumber(uint64_t number) {
+    while (number >= 0x80) {
+        code.push_back(static_cast<uint8_t>(number | 0x80));
+        number >>= 7;
+    }
+    code.push_back(static_cast<uint8_t>(number));
+}
+
+FormulaImage::FormulaImage(const string& path) {
+    file = new MappedFile(path);
+    try {
+        open(file->begin(), file->end());
+    } catch (ErrorException& ex) {
+        delete file;
+        throw;
+    }
+}
+
+FormulaImage::FormulaImage(const char *begin, const char *end) {
+    file = nullptr;
+    open(begin, end);
+}
+
+FormulaImage::~FormulaImage() {
+    delete file;
+}
+
+size_t FormulaImage::getFormulaCount() const {
+    return formulaCount;
+}
+
+/**
+ * Implementation notes: load
+ * --------------------------
+ * Reads the code in preorder, keeping the operations whose operands are
+ * still being read on a stack, and the operands finished so far on
+ * another. Each finished node is added to the operands, and an operation
+ * that has all of its operands is built from the top of that stack and
+ * handed on in turn, so nodes are made from the leaves up without
+ * recursion. If the code turns out to be damaged, whatever was built so
+ * far is freed before the error is raised.
+ */
+
+LangExpression *FormulaImage::load(size_t index, ExpressionArena *arena) const {
+    struct Pending {
+        uint8_t opcode;
+        SymbolId symbol;
+        size_t needed;
+        size_t have;
+    };
+    size_t position, end;
+    formulaRange(index, position, end);
+    vector<Pending> pending;
+    vector<LangExpression *> operands;
+    LangExpression *node = nullptr;
+    try {
+        while (true) {
+            if (position >= end) damagedImage();
+            uint8_t opcode = code[position++];
+            SymbolId symbol = kNoSymbol;
+            switch (opcode) {
+            case IMAGE_FALSE: case IMAGE_TRUE:
+                node = newNode<BoolExp>(arena, opcode == IMAGE_TRUE);
+                break;
+            case IMAGE_REF:
+                node = newNode<RefExp>(arena, getSymbol(position, end));
+                break;
+            case IMAGE_NULL:
+                node = newNode<NullExp>(arena);
+                break;
+            case IMAGE_NOT:
+                pending.push_back({ opcode, kNoSymbol, 1, 0 });
+                continue;
+            case IMAGE_AND: case IMAGE_OR: case IMAGE_IMP: case IMAGE_IFF:
+                getNumber(position, end);
+                pending.push_back({ opcode, kNoSymbol, 2, 0 });
+                continue;
+            case IMAGE_NARY_AND: case IMAGE_NARY_OR: case IMAGE_NARY_IFF: case IMAGE_NARY_XOR: {
+                uint64_t count = getNumber(position, end);
+                if (count < 2 || count > end - position) damagedImage();
+                getNumber(position, end);
+                pending.push_back({ opcode, kNoSymbol, count, 0 });
+                continue;
+            }
+            case IMAGE_LET: case IMAGE_SET:
+                symbol = getSymbol(position, end);
+                pending.push_back({ opcode, symbol, opcode == IMAGE_LET ? 2u : 1u, 0 });
+                continue;
+            default:
+                damagedImage();
+            }
+            while (!pending.empty()) {
+                Pending& top = pending.back();
+                operands.push_back(node);
+                node = nullptr;
+                if (++top.have < top.needed) break;
+                LangExpression **first = &operands[operands.size() - top.needed];
+                switch (top.opcode) {
+                case IMAGE_NOT: node = newNode<NotExp>(arena, first[0]); break;
+                case IMAGE_AND: node = newNode<AndExp>(arena, first[0], first[1]); break;
+                case IMAGE_OR: node = newNode<OrExp>(arena, first[0], first[1]); break;
+                case IMAGE_IMP: node = newNode<ImpExp>(arena, first[0], first[1]); break;
+                case IMAGE_IFF: node = newNode<IffExp>(arena, first[0], first[1]); break;
+                case IMAGE_LET: node = newNode<LetExp>(arena, top.symbol, first[0], first[1]); break;
+                case IMAGE_SET: node = newNode<SetExp>(arena, top.symbol, first[0]); break;
+                default: {
+                    LangExpressionType type = static_cast<LangExpressionType>(NaryAndEXP + (top.opcode - IMAGE_NARY_AND));
+                    node = newNode<NaryExp>(arena, type, first, static_cast<int>(top.needed), arena);
+                    break;
+                }
+                }
+                operands.resize(operands.size() - top.needed);
+                pending.pop_back();
+            }
+            if (pending.empty()) break;
+        }
+        if (position != end) damagedImage();
+    } catch (ErrorException& ex) {
+        if (arena == nullptr) {
+            delete node;
+            for (LangExpression *operand : operands) delete operand;
+        }
+        throw;
+    }
+    return node;
+}
+
+/**
+ * Implementation notes: eval
+ * --------------------------
+ * Walks the code the way LangExpression::evalFrames walks a tree, with a
+ * frame for every operation whose operands are still being evaluated.
+ * Since the code is in preorder, the position in it moves only forward:
+ * the first operand of a connective starts right after its opcode and the
+ * second right after the first, and a first operand that decides the
+ * result is followed by a jump over the second, using the length stored
+ * with the connective. An n-ary connective's frame counts down the
+ * operands still to come and keeps where the last of them ends, which is
+ * where an operand that decides an and or an or jumps to. Any bindings
+ * still pushed when an error escapes are popped again, so the context is
+ * left as it was found.
+ */
+
+bool FormulaImage::eval(size_t index, LangEvaluationContext& context) const {
+    STATS_PHASE(EVAL_PHASE);
+    struct Frame {
+        uint8_t opcode;
+        bool firstDone;
+        bool firstValue;
+        SymbolId symbol;
+        uint64_t skip;
+        uint64_t remaining;
+    };
+    static thread_local vector<Frame> frameStack;
+    vector<Frame>& frames = frameStack;
+    size_t base = frames.size();
+    int scopeDepth = context.getScopeDepth();
+    bool strict = context.isStrictEvaluation();
+    size_t position, end;
+    formulaRange(index, position, end);
+    bool value = false;
+    try {
+        bool descend = true;
+        while (descend) {
+            while (descend) {
+                if (position >= end) damagedImage();
+                uint8_t opcode = code[position++];
+                switch (opcode) {
+                case IMAGE_FALSE: case IMAGE_TRUE:
+                    value = opcode == IMAGE_TRUE;
+                    descend = false;
+                    break;
+                case IMAGE_REF: {
+                    SymbolId symbol = getSymbol(position, end);
+                    if (!context.isDefined(symbol))
+                        error("EVALUATION ERROR >> undefined symbol: " + globalSymbols().nameOf(symbol));
+                    value = context.getValue(symbol);
+                    descend = false;
+                    break;
+                }
+                case IMAGE_NULL:
+                    error("EVALUATION ERROR >> Attempted null evaluation.");
+                    break;
+                case IMAGE_NOT:
+                    frames.push_back({ opcode, false, false, kNoSymbol, 0, 0 });
+                    break;
+                case IMAGE_AND: case IMAGE_OR: case IMAGE_IMP: case IMAGE_IFF:
+                    frames.push_back({ opcode, false, false, kNoSymbol, getNumber(position, end), 0 });
+                    break;
+                case IMAGE_NARY_AND: case IMAGE_NARY_OR: case IMAGE_NARY_IFF: case IMAGE_NARY_XOR: {
+                    uint64_t count = getNumber(position, end);
+                    uint64_t length = getNumber(position, end);
+                    if (count < 2 || length > end - position) damagedImage();
+                    frames.push_back({ opcode, false, false, kNoSymbol, position + length, count });
+                    break;
+                }
+                case IMAGE_LET: case IMAGE_SET:
+                    frames.push_back({ opcode, false, false, getSymbol(position, end), 0, 0 });
+                    break;
+                default:
+                    damagedImage();
+                }
+            }
+            while (frames.size() > base) {
+                Frame& frame = frames.back();
+                if (frame.opcode >= IMAGE_NARY_AND) {
+                    bool unit = frame.opcode == IMAGE_NARY_AND || frame.opcode == IMAGE_NARY_IFF;
+                    if (frame.opcode == IMAGE_NARY_AND || frame.opcode == IMAGE_NARY_OR) {
+                        if (!frame.firstDone) frame.firstValue = unit;
+                        if (value != unit) frame.firstValue = !unit;
+                    } else if (!frame.firstDone) {
+                        frame.firstValue = value;
+                    } else {
+                        frame.firstValue = frame.firstValue == value ? unit : !unit;
+                    }
+                    frame.firstDone = true;
+                    frame.remaining--;
+                    bool decided = frame.opcode <= IMAGE_NARY_OR && value != unit && !strict;
+                    if (decided && frame.remaining > 0) {
+                        context.countSkippedSubtrees();
+                        position = frame.skip;
+                    } else if (frame.remaining > 0) {
+                        descend = true;
+                        break;
+                    } else if (position != frame.skip) {
+                        damagedImage();
+                    }
+                    value = frame.firstValue;
+                } else if (!frame.firstDone) {
+                    frame.firstDone = true;
+                    frame.firstValue = value;
+                    switch (frame.opcode) {
+                    case IMAGE_NOT:
+                        value = !value;
+                        break;
+                    case IMAGE_AND: case IMAGE_OR: case IMAGE_IMP:
+                        if ((frame.opcode == IMAGE_OR ? value : !value) && !strict) {
+                            if (frame.skip > end - position) damagedImage();
+                            context.countSkippedSubtrees();
+                            value = frame.opcode != IMAGE_AND;
+                            position += frame.skip;
+                        } else {
+                            descend = true;
+                        }
+                        break;
+                    case IMAGE_IFF:
+                        descend = true;
+                        break;
+                    case IMAGE_LET:
+                        context.pushBinding(frame.symbol, value);
+                        descend = true;
+                        break;
+                    default:
+                        context.setValue(frame.symbol, value);
+                        break;
+                    }
+                    if (descend) break;
+                } else {
+                    switch (frame.opcode) {
+                    case IMAGE_AND: value = frame.firstValue && value; break;
+                    case IMAGE_OR: value = frame.firstValue || value; break;
+                    case IMAGE_IMP: value = !frame.firstValue || value; break;
+                    case IMAGE_IFF: value = frame.firstValue == value; break;
+                    default: context.popBinding(); break;
+                    }
+                }
+                frames.pop_back();
+            }
+        }
+        if (position != end) damagedImage();
+    } catch (ErrorException& ex) {
+        frames.resize(base);
+        while (context.getScopeDepth() > scopeDepth) context.popBinding();
+        throw;
+    }
+    return value;
+}
+
+/**
+ * Implementation notes: open
+ * --------------------------
+ * Checks that the header is one this code wrote and that every section
+ * lies inside the image, then interns the symbol names so that variables
+ * in the code can be turned into SymbolIds by indexing. Every read from
+ * the header and the indexes goes through memcpy, since a borrowed buffer
+ * need not be aligned the way a mapped file is.
+ */
+
+void FormulaImage::open(const char *begin, const char *end) {
+    uint64_t size = end - begin;
+    ImageHeader header;
+    if (size < sizeof(header)) error("IMAGE ERROR >> Not a formula image");
+    memcpy(&header, begin, sizeof(header));
+    if (memcmp(header.magic, kImageMagic, sizeof(kImageMagic)) != 0) error("IMAGE ERROR >> Not a formula image");
+    if (header.byteOrder != kByteOrderMark) error("IMAGE ERROR >> Image was written with another byte order");
+    if (header.version < kOldestFormulaImageVersion || header.version > kFormulaImageVersion)
+        error("IMAGE ERROR >> Unsupported image version " + to_string(header.version));
+    if (header.formulaCount >= size / sizeof(uint64_t) || header.symbolCount >= size / sizeof(uint64_t)
+        || !sectionFits(header.formulaIndexOffset, (header.formulaCount + 1) * sizeof(uint64_t), size)
+        || !sectionFits(header.symbolIndexOffset, (header.symbolCount + 1) * sizeof(uint64_t), size)
+        || !sectionFits(header.namesOffset, header.namesLength, size)
+        || !sectionFits(header.codeOffset, header.codeLength, size)) {
+        error("IMAGE ERROR >> Image is truncated or damaged");
+    }
+    code = reinterpret_cast<const uint8_t *>(begin + header.codeOffset);
+    codeLength = header.codeLength;
+    formulaIndex = begin + header.formulaIndexOffset;
+    formulaCount = header.formulaCount;
+    const char *symbolIndex = begin + header.symbolIndexOffset;
+    const char *names = begin + header.namesOffset;
+    symbols.clear();
+    symbols.reserve(header.symbolCount);
+    for (uint64_t i = 0; i < header.symbolCount; i++) {
+        uint64_t start = readWord(symbolIndex, i);
+        uint64_t finish = readWord(symbolIndex, i + 1);
+        if (start > finish || finish > header.namesLength) error("IMAGE ERROR >> Image is truncated or damaged");
+        symbols.push_back(globalSymbols().intern(names + start, finish - start));
+    }
+}
+
+void FormulaImage::formulaRange(size_t index, size_t& start, size_t& end) const {
+    if (index >= formulaCount) error("IMAGE ERROR >> No formula " + to_string(index) + " in image");
+    uint64_t first = readWord(formulaIndex, index);
+    uint64_t last = readWord(formulaIndex, index + 1);
+    if (first >= last || last > codeLength) damagedImage();
+    start = first;
+    end = last;
+}
+
+uint64_t FormulaImage::getNumber(size_t& position, size_t end) const {
+    uint64_t number = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (position >= end) break;
+        uint8_t byte = code[position++];
+        number |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return number;
+    }
+    damagedImage();
+    return 0;
+}
+
+SymbolId FormulaImage::getSymbol(size_t& position, size_t end) const {
+    uint64_t index = getNumber(position, end);
+    if (index >= symbols.size()) damagedImage();
+    return symbols[index];
+}
+
+int numberLength(uint64_t number) {
+    int length = 1;
+    while (number >= 0x80) {
+        number >>= 7;
+        length++;
+    }
+    return length;
+}
+
+uint64_t alignSection(uint64_t offset) {
+    return (offset + 7) & ~uint64_t(7);
+}
+
+void writePadding(ostream& out, uint64_t from, uint64_t to) {
+    for (uint64_t i = from; i < to; i++) out.put('\0');
+}
+
+bool sectionFits(uint64_t offset, uint64_t length, uint64_t size) {
+    return offset <= size && length <= size - offset;
+}
+
+uint64_t readWord(const char *words, size_t index) {
+    uint64_t word;
+    memcpy(&word, words + index * sizeof(uint64_t), sizeof(word));
+    return word;
+}
+
+void damagedImage() {
+    error("IMAGE ERROR >> Formula code is damaged");
+}
@@ -0,0 +1,124 @@
+/**
+ * File: formula-image.h
+ * -------------
+ * This interface defines a compact binary image of parsed formulas that
+ * can be written once and then mapped straight into memory on later runs,
+ * so that a corpus that never changes is not read and parsed again every
+ * time it is used.
+ */
+
+#ifndef FORMULA_IMAGE_H
+#define FORMULA_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "langexpressions.h"
+#include "expression-arena.h"
+#include "mapped-file.h"
+#include "symbol-table.h"
+
+/**
+ * Constant: kFormulaImageVersion
+ * ------------------------------
+ * The version of the image layout this code writes. It reads that version
+ * and every one back to kOldestFormulaImageVersion; version 1 is version
+ * 2 without the n-ary connectives. Images of any other version are
+ * refused rather than guessed at.
+ */
+
+const uint32_t kFormulaImageVersion = 2;
+const uint32_t kOldestFormulaImageVersion = 1;
+
+/**
+ * Class: FormulaImageWriter
+ * -------------------------
+ * Collects formulas and writes them out as one image. An image consists
+ * of a fixed header followed by four sections, each starting on an 8-byte
+ * boundary:
+ *
+ *   formula index    one 64-bit offset into the code per formula, and
+ *                    one more for the end of the last formula
+ *   symbol index     one 64-bit offset into the names per symbol, and
+ *                    one more for the end of the last name
+ *   names            the symbol names, one after another
+ *   code             every formula as a stream of opcodes in preorder
+ *
+ * In the code each node is one opcode byte, followed for a variable by
+ * its index in the image's own symbol table, for and, or, imp and iff
+ * by the length of the second operand's code, so that an evaluator can
+ * step over it, and for an n-ary connective by its operand count and the
+ * length of all its operands' code. Numbers are written as base-128
+ * varints. The header and
+ * the indexes are in the byte order of the machine that wrote them, which
+ * the header records so that a reader on another machine can refuse them.
+ * A hash-consed DAG is written out as the tree it stands for.
+ */
+
+class FormulaImageWriter {
+public:
+    FormulaImageWriter();
+
+    void add(const LangExpression *lexp);
+    size_t getFormulaCount() const;
+    void write(std::ostream& out) const;
+    void writeFile(const std::string& path) const;
+
+private:
+    uint64_t symbolIndex(SymbolId symbol);
+    void putNumber(uint64_t number);
+
+    std::vector<uint8_t> code;
+    std::vector<uint64_t> starts;
+    std::vector<SymbolId> symbols;
+    std::unordered_map<SymbolId, uint64_t> symbolIndices;
+
+    FormulaImageWriter(const FormulaImageWriter&) = delete;
+    FormulaImageWriter& operator=(const FormulaImageWriter&) = delete;
+};
+
+/**
+ * Class: FormulaImage
+ * -------------------
+ * A read-only view of an image, either mapped from a file or borrowed
+ * from a buffer that must outlive it. Opening an image checks its header
+ * and interns its symbol names, and reads nothing else, so it costs the
+ * same however many formulas the image holds. Each formula can then be
+ * rebuilt as a tree with load, or evaluated in place with eval, which
+ * follows the same rules as LangExpression::eval, including strict
+ * evaluation and the skipped-subtree count, without building anything.
+ * Damaged images raise an IMAGE ERROR when they are opened or when the
+ * damaged formula is read.
+ */
+
+class FormulaImage {
+public:
+    FormulaImage(const std::string& path);
+    FormulaImage(const char *begin, const char *end);
+    ~FormulaImage();
+
+    size_t getFormulaCount() const;
+    LangExpression *load(size_t index, ExpressionArena *arena = nullptr) const;
+    bool eval(size_t index, LangEvaluationContext& context) const;
+
+private:
+    void open(const char *begin, const char *end);
+    void formulaRange(size_t index, size_t& start, size_t& end) const;
+    uint64_t getNumber(size_t& position, size_t end) const;
+    SymbolId getSymbol(size_t& position, size_t end) const;
+
+    MappedFile *file;
+    const uint8_t *code;
+    size_t codeLength;
+    const char *formulaIndex;
+    size_t formulaCount;
+    std::vector<SymbolId> symbols;
+
+    FormulaImage(const FormulaImage&) = delete;
+    FormulaImage& operator=(const FormulaImage&) = delete;
+};
+
+#endif // FORMULA_IMAGE_H
@@ -0,0 +1,446 @@
+/**
+ * File: formula-registry.cpp
+ * -------------
+ * This file implements the formula-registry.h interface.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "formula-registry.h"
+#include "error.h"
+using namespace std;
+
+static const uint32_t kNoNode = UINT32_MAX;
+static const uint32_t kFalseNode = 0;
+static const uint32_t kTrueNode = 1;
+
+/**
+ * Implementation notes: FormulaRegistry
+ * -------------------------------------
+ * Nodes are numbered in the order they are made, and a node is always
+ * made after its operands, so numbering order is an order from the leaves
+ * up. A refresh keeps the nodes waiting to be recomputed in a min-heap of
+ * those numbers, which therefore hands out every node after all of its
+ * operands that were waiting too, so no node is ever recomputed twice in
+ * one refresh.
+ *
+ * Each node counts the formulas and live nodes that use it. A node whose
+ * count drops to zero is dead: it keeps its place in the graph, but its
+ * value is left to go stale, and is recomputed when a new formula makes
+ * it live again. The two constants are made live for good.
+ */
+
+FormulaRegistry::FormulaRegistry(const LangEvaluationContext& context) : context(context) {
+    nodes.push_back({ BoolEXP, kNoNode, kNoNode, kNoSymbol, 1, FALSE_VALUE, kNoSymbol, false });
+    nodes.push_back({ BoolEXP, kNoNode, kNoNode, kNoSymbol, 1, TRUE_VALUE, kNoSymbol, false });
+    parents.resize(2);
+    liveNodes = 2;
+    seenEpoch = context.getBindingEpoch();
+    seenStrict = context.isStrictEvaluation();
+    changedVariables = 0;
+    recomputedNodes = 0;
+}
+
+/**
+ * Implementation notes: define
+ * ----------------------------
+ * The graph is brought up to date before the new formula is added, so
+ * that the nodes it shares with other formulas already hold the right
+ * values and only its own new or revived nodes need computing. A formula
+ * that replaces another under the same name is made live before the old
+ * one is released, so the nodes they share are never dead in between.
+ */
+
+void FormulaRegistry::define(SymbolId name, const LangExpression *lexp) {
+    update();
+    uint32_t root = build(lexp);
+    retain(root);
+    auto found = formulas.find(name);
+    if (found != formulas.end()) {
+        vector<SymbolId>& names = rootNames[found->second];
+        names.erase(find(names.begin(), names.end(), name));
+        if (names.empty()) rootNames.erase(found->second);
+        release(found->second);
+        found->second = root;
+    } else {
+        formulas[name] = root;
+        formulaOrder.push_back(name);
+    }
+    rootNames[root].push_back(name);
+}
+
+bool FormulaRegistry::remove(SymbolId name) {
+    auto found = formulas.find(name);
+    if (found == formulas.end()) return false;
+    vector<SymbolId>& names = rootNames[found->second];
+    names.erase(find(names.begin(), names.end(), name));
+    if (names.empty()) rootNames.erase(found->second);
+    release(found->second);
+    formulas.erase(found);
+    formulaOrder.erase(find(formulaOrder.begin(), formulaOrder.end(), name));
+    return true;
+}
+
+bool FormulaRegistry::contains(SymbolId name) const {
+    return formulas.count(name) != 0;
+}
+
+int FormulaRegistry::getFormulaCount() const {
+    return formulaOrder.size();
+}
+
+SymbolId FormulaRegistry::getFormulaName(int index) const {
+    return formulaOrder[index];
+}
+
+/**
+ * Implementation notes: refresh
+ * -----------------------------
+ * Changes found by the refreshes that other methods make along the way
+ * are collected until refresh is called, so that none are lost. A formula
+ * is reported once even if it changed more than once in that time. The
+ * statistics count only the work of the refresh itself.
+ */
+
+vector<SymbolId> FormulaRegistry::refresh() {
+    changedVariables = 0;
+    recomputedNodes = 0;
+    update();
+    vector<SymbolId> names;
+    unordered_set<SymbolId> reported;
+    for (SymbolId name : changed) {
+        if (formulas.count(name) != 0 && reported.insert(name).second) names.push_back(name);
+    }
+    changed.clear();
+    return names;
+}
+
+bool FormulaRegistry::isDefined(SymbolId name) {
+    update();
+    return nodes[lookup(name)].state != UNDEFINED_VALUE;
+}
+
+bool FormulaRegistry::getValue(SymbolId name) {
+    update();
+    const Node& root = nodes[lookup(name)];
+    if (root.state == UNDEFINED_VALUE)
+        error("EVALUATION ERROR >> undefined symbol: " + globalSymbols().nameOf(root.undefined));
+    return root.state == TRUE_VALUE;
+}
+
+SymbolId FormulaRegistry::getUndefinedVariable(SymbolId name) {
+    update();
+    const Node& root = nodes[lookup(name)];
+    return root.state == UNDEFINED_VALUE ? root.undefined : kNoSymbol;
+}
+
+RegistryStats FormulaRegistry::getStats() const {
+    return { formulas.size(), nodes.size(), liveNodes, changedVariables, recomputedNodes };
+}
+
+/**
+ * Implementation notes: build
+ * ---------------------------
+ * Walks the formula with an explicit stack, like the Tseitin encoder, and
+ * inlines let the same way: while a let's body is being built, its
+ * variable stands for the node its binding was built into. The let itself
+ * still gets a node, whose value is its body's, so that a binding that
+ * cannot be evaluated makes the let undefined even where the body does
+ * not use it, as it does for eval.
+ *
+ * An n-ary connective becomes a chain of binary nodes nested to the
+ * right, so that an and or an or whose first operands decide it is not
+ * made undefined by a later one, just as eval would never reach it. An
+ * xor becomes a chain of negated iffs.
+ */
+
+uint32_t FormulaRegistry::build(const LangExpression *lexp) {
+    enum Action { VISIT, COMBINE, NEGATE, BIND, UNBIND };
+    struct Task {
+        Action action;
+        const LangExpression *node;
+    };
+    vector<Task> tasks;
+    vector<uint32_t> operands;
+    vector<uint32_t> saved;
+    unordered_map<SymbolId, uint32_t> bindings;
+    tasks.push_back({ VISIT, lexp });
+    while (!tasks.empty()) {
+        Task task = tasks.back();
+        tasks.pop_back();
+        const LangExpression *node = task.node;
+        switch (task.action) {
+        case VISIT:
+            switch (node->getType()) {
+            case RefEXP: {
+                auto binding = bindings.find(node->getSymbolId());
+                operands.push_back(binding != bindings.end() ? binding->second : makeVariable(node->getSymbolId()));
+                break;
+            }
+            case BoolEXP:
+                operands.push_back(node->getBoolValue() ? kTrueNode : kFalseNode);
+                break;
+            case NotEXP:
+                tasks.push_back({ NEGATE, node });
+                tasks.push_back({ VISIT, node->getOperand() });
+                break;
+            case AndEXP: case OrEXP: case ImpEXP: case IffEXP:
+                tasks.push_back({ COMBINE, node });
+                tasks.push_back({ VISIT, node->getSecond() });
+                tasks.push_back({ VISIT, node->getFirst() });
+                break;
+            case NaryAndEXP: case NaryOrEXP: case NaryIffEXP: case NaryXorEXP:
+                for (int i = 1; i < node->getOperandCount(); i++) tasks.push_back({ COMBINE, node });
+                for (int i = node->getOperandCount() - 1; i >= 0; i--) {
+                    tasks.push_back({ VISIT, node->getOperands()[i] });
+                }
+                break;
+            case LetEXP:
+                tasks.push_back({ UNBIND, node });
+                tasks.push_back({ VISIT, node->getBody() });
+                tasks.push_back({ BIND, node });
+                tasks.push_back({ VISIT, node->getBinding() });
+                break;
+            case SetEXP:
+                error("REGISTRY ERROR >> A registered formula cannot contain set");
+            case NullEXP:
+                error("EVALUATION ERROR >> Attempted null evaluation.");
+            }
+            break;
+        case COMBINE: {
+            uint32_t second = operands.back();
+            operands.pop_back();
+            LangExpressionType type = node->getType();
+            if (type == NaryAndEXP) type = AndEXP;
+            else if (type == NaryOrEXP) type = OrEXP;
+            else if (type == NaryIffEXP || type == NaryXorEXP) type = IffEXP;
+            operands.back() = makeNode(type, operands.back(), second);
+            if (node->getType() == NaryXorEXP) operands.back() = makeNode(NotEXP, operands.back(), kNoNode);
+            break;
+        }
+        case NEGATE:
+            operands.back() = makeNode(NotEXP, operands.back(), kNoNode);
+            break;
+        case BIND: {
+            SymbolId var = node->getVariableId();
+            auto binding = bindings.find(var);
+            saved.push_back(binding != bindings.end() ? binding->second : kNoNode);
+            bindings[var] = operands.back();
+            operands.pop_back();
+            break;
+        }
+        case UNBIND: {
+            SymbolId var = node->getVariableId();
+            operands.back() = makeNode(LetEXP, bindings[var], operands.back());
+            if (saved.back() == kNoNode) bindings.erase(var);
+            else bindings[var] = saved.back();
+            saved.pop_back();
+            break;
+        }
+        }
+    }
+    return operands.back();
+}
+
+uint32_t FormulaRegistry::makeNode(LangExpressionType type, uint32_t first, uint32_t second) {
+    NodeKey key = { type, first, second };
+    auto found = unique.find(key);
+    if (found != unique.end()) return found->second;
+    uint32_t index = nodes.size();
+    nodes.push_back({ type, first, second, kNoSymbol, 0, UNDEFINED_VALUE, kNoSymbol, false });
+    parents.emplace_back();
+    parents[first].push_back(index);
+    if (second != kNoNode && second != first) parents[second].push_back(index);
+    unique[key] = index;
+    return index;
+}
+
+uint32_t FormulaRegistry::makeVariable(SymbolId symbol) {
+    NodeKey key = { RefEXP, static_cast<uint32_t>(symbol), kNoNode };
+    auto found = unique.find(key);
+    if (found != unique.end()) return found->second;
+    uint32_t index = nodes.size();
+    nodes.push_back({ RefEXP, kNoNode, kNoNode, symbol, 0, UNDEFINED_VALUE, symbol, false });
+    parents.emplace_back();
+    variables.push_back(index);
+    unique[key] = index;
+    return index;
+}
+
+/**
+ * Implementation notes: retain
+ * ----------------------------
+ * Counts one more use of the node. A node that was dead makes its
+ * operands live first, with an explicit stack, and is then recomputed
+ * from them.
+ */
+
+void FormulaRegistry::retain(uint32_t root) {
+    vector<pair<uint32_t, bool>> pending;
+    pending.push_back({ root, false });
+    while (!pending.empty()) {
+        uint32_t index = pending.back().first;
+        bool operandsLive = pending.back().second;
+        pending.pop_back();
+        if (operandsLive) {
+            recompute(index);
+            continue;
+        }
+        if (nodes[index].refs++ > 0) continue;
+        liveNodes++;
+        pending.push_back({ index, true });
+        if (nodes[index].second != kNoNode) pending.push_back({ nodes[index].second, false });
+        if (nodes[index].first != kNoNode) pending.push_back({ nodes[index].first, false });
+    }
+}
+
+void FormulaRegistry::release(uint32_t root) {
+    vector<uint32_t> pending;
+    pending.push_back(root);
+    while (!pending.empty()) {
+        uint32_t index = pending.back();
+        pending.pop_back();
+        if (--nodes[index].refs > 0) continue;
+        liveNodes--;
+        if (nodes[index].first != kNoNode) pending.push_back(nodes[index].first);
+        if (nodes[index].second != kNoNode) pending.push_back(nodes[index].second);
+    }
+}
+
+/**
+ * Implementation notes: update
+ * ----------------------------
+ * Nothing can have changed while the context's binding epoch stays the
+ * same. Otherwise every live global is compared with the context, and
+ * the ones that changed start the propagation. When the context switches
+ * between strict and short-circuit evaluation, every live node is queued
+ * instead, since any of them may now come out differently.
+ */
+
+void FormulaRegistry::update() {
+    bool strict = context.isStrictEvaluation();
+    if (context.getBindingEpoch() == seenEpoch && strict == seenStrict) return;
+    if (strict != seenStrict) {
+        for (uint32_t index = 2; index < nodes.size(); index++) {
+            if (nodes[index].refs == 0) continue;
+            nodes[index].queued = true;
+            queue.push_back(index);
+        }
+    } else {
+        for (uint32_t index : variables) {
+            if (nodes[index].refs == 0 || !recompute(index)) continue;
+            changedVariables++;
+            noteChange(index);
+        }
+    }
+    while (!queue.empty()) {
+        pop_heap(queue.begin(), queue.end(), greater<uint32_t>());
+        uint32_t index = queue.back();
+        queue.pop_back();
+        nodes[index].queued = false;
+        if (nodes[index].refs == 0) continue;
+        recomputedNodes++;
+        if (recompute(index)) noteChange(index);
+    }
+    seenEpoch = context.getBindingEpoch();
+    seenStrict = strict;
+}
+
+/**
+ * Implementation notes: recompute
+ * -------------------------------
+ * Computes the node's value from its operands' cached values, the way
+ * eval would from theirs, and returns whether it changed. An undefined
+ * operand makes the result undefined exactly when eval would have reached
+ * it and failed, and the result remembers which global was missing.
+ */
+
+bool FormulaRegistry::recompute(uint32_t index) {
+    Node& node = nodes[index];
+    State state = UNDEFINED_VALUE;
+    SymbolId undefined = kNoSymbol;
+    switch (node.type) {
+    case BoolEXP:
+        return false;
+    case RefEXP:
+        if (context.isDefined(node.symbol)) state = context.getValue(node.symbol) ? TRUE_VALUE : FALSE_VALUE;
+        else undefined = node.symbol;
+        break;
+    case NotEXP: {
+        const Node& operand = nodes[node.first];
+        if (operand.state == UNDEFINED_VALUE) undefined = operand.undefined;
+        else state = operand.state == TRUE_VALUE ? FALSE_VALUE : TRUE_VALUE;
+        break;
+    }
+    case LetEXP: {
+        const Node& binding = nodes[node.first];
+        const Node& body = nodes[node.second];
+        if (binding.state == UNDEFINED_VALUE) undefined = binding.undefined;
+        else if (body.state == UNDEFINED_VALUE) undefined = body.undefined;
+        else state = body.state;
+        break;
+    }
+    default: {
+        const Node& first = nodes[node.first];
+        const Node& second = nodes[node.second];
+        bool decided = (node.type == AndEXP && first.state == FALSE_VALUE)
+                    || (node.type == OrEXP && first.state == TRUE_VALUE)
+                    || (node.type == ImpEXP && first.state == FALSE_VALUE);
+        if (first.state == UNDEFINED_VALUE) {
+            undefined = first.undefined;
+        } else if (decided && !context.isStrictEvaluation()) {
+            state = node.type == AndEXP ? FALSE_VALUE : TRUE_VALUE;
+        } else if (second.state == UNDEFINED_VALUE) {
+            undefined = second.undefined;
+        } else {
+            bool a = first.state == TRUE_VALUE;
+            bool b = second.state == TRUE_VALUE;
+            bool value;
+            switch (node.type) {
+            case AndEXP: value = a && b; break;
+            case OrEXP: value = a || b; break;
+            case ImpEXP: value = !a || b; break;
+            default: value = a == b; break;
+            }
+            state = value ? TRUE_VALUE : FALSE_VALUE;
+        }
+        break;
+    }
+    }
+    bool changedValue = state != node.state || (state == UNDEFINED_VALUE && undefined != node.undefined);
+    node.state = state;
+    node.undefined = undefined;
+    return changedValue;
+}
+
+void FormulaRegistry::noteChange(uint32_t index) {
+    auto names = rootNames.find(index);
+    if (names != rootNames.end()) changed.insert(changed.end(), names->second.begin(), names->second.end());
+    for (uint32_t parent : parents[index]) {
+        if (nodes[parent].queued || nodes[parent].refs == 0) continue;
+        nodes[parent].queued = true;
+        queue.push_back(parent);
+        push_heap(queue.begin(), queue.end(), greater<uint32_t>());
+    }
+}
+
+uint32_t FormulaRegistry::lookup(SymbolId name) const {
+    auto found = formulas.find(name);
+    if (found == formulas.end())
+        error("REGISTRY ERROR >> No formula is named " + globalSymbols().nameOf(name));
+    return found->second;
+}
+
+bool FormulaRegistry::NodeKey::operator==(const NodeKey& other) const {
+    return type == other.type && first == other.first && second == other.second;
+}
+
+size_t FormulaRegistry::NodeKeyHash::operator()(const NodeKey& key) const {
+    uint64_t hash = key.type * 0x9E3779B97F4A7C15ULL;
+    hash ^= key.first + 0x7F4A7C159E3779B9ULL + (hash << 6) + (hash >> 2);
+    hash ^= key.second + 0x94D049BB133111EBULL + (hash << 6) + (hash >> 2);
+    return hash;
+}
@@ -0,0 +1,132 @@
+/**
+ * File: formula-registry.h
+ * -------------
+ * This interface defines a registry of named formulas that stay resident
+ * and keep their values up to date as the global variables they read are
+ * changed by set, recomputing only what a change can affect.
+ */
+
+#ifndef FORMULA_REGISTRY_H
+#define FORMULA_REGISTRY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "langexpressions.h"
+#include "symbol-table.h"
+
+/**
+ * Type: RegistryStats
+ * -------------------
+ * The size of a registry, and how much work its last refresh did: how
+ * many global variables it found changed and how many nodes it had to
+ * recompute because of them.
+ */
+
+struct RegistryStats {
+    size_t formulas;
+    size_t nodes;
+    size_t liveNodes;
+    uint64_t changedVariables;
+    uint64_t recomputedNodes;
+};
+
+/**
+ * Class: FormulaRegistry
+ * ----------------------
+ * Holds named formulas over the global variables of one context, each
+ * compiled into a shared graph of nodes that caches its value. Identical
+ * subformulas are one node, whichever formulas they occur in. A let is
+ * inlined, so a reference to a let variable is an edge to its binding's
+ * node, and the only leaves are constants and global variables; the let
+ * keeps a node of its own that is undefined when its binding is.
+ *
+ * The registry notices changes when it is refreshed, which every method
+ * that reports a value does first, and refresh returns the names of the
+ * formulas whose values have changed since it was last called. A refresh
+ * compares each global the formulas read with the value it was last
+ * computed from, and then recomputes the nodes above the globals that
+ * changed, in order from the leaves up, stopping along any path where a
+ * node's value comes out the same as before. The cost of a refresh is
+ * thus one comparison per global plus the nodes whose inputs actually
+ * changed, however many formulas there are.
+ *
+ * Values follow the context's evaluation rules: and, or and imp ignore
+ * their second operand when the first decides, unless the context is
+ * strict, and a formula that reaches an unset global is undefined rather
+ * than false. Registered formulas may not contain set, since a formula
+ * that changes the globals could not be kept up to date by watching them.
+ * Nodes no formula uses any more are kept but not recomputed, and are
+ * brought up to date again if a new formula shares them.
+ */
+
+class FormulaRegistry {
+public:
+    FormulaRegistry(const LangEvaluationContext& context);
+
+    void define(SymbolId name, const LangExpression *lexp);
+    bool remove(SymbolId name);
+    bool contains(SymbolId name) const;
+    int getFormulaCount() const;
+    SymbolId getFormulaName(int index) const;
+
+    std::vector<SymbolId> refresh();
+    bool isDefined(SymbolId name);
+    bool getValue(SymbolId name);
+    SymbolId getUndefinedVariable(SymbolId name);
+    RegistryStats getStats() const;
+
+private:
+    enum State : uint8_t { FALSE_VALUE, TRUE_VALUE, UNDEFINED_VALUE };
+    struct Node {
+        LangExpressionType type;
+        uint32_t first;
+        uint32_t second;
+        SymbolId symbol;
+        int refs;
+        State state;
+        SymbolId undefined;
+        bool queued;
+    };
+    struct NodeKey {
+        LangExpressionType type;
+        uint32_t first;
+        uint32_t second;
+        bool operator==(const NodeKey& other) const;
+    };
+    struct NodeKeyHash {
+        size_t operator()(const NodeKey& key) const;
+    };
+
+    uint32_t build(const LangExpression *lexp);
+    uint32_t makeNode(LangExpressionType type, uint32_t first, uint32_t second);
+    uint32_t makeVariable(SymbolId symbol);
+    void retain(uint32_t root);
+    void release(uint32_t root);
+    void update();
+    bool recompute(uint32_t index);
+    void noteChange(uint32_t index);
+    uint32_t lookup(SymbolId name) const;
+
+    const LangEvaluationContext& context;
+    std::vector<Node> nodes;
+    std::vector<std::vector<uint32_t>> parents;
+    std::unordered_map<NodeKey, uint32_t, NodeKeyHash> unique;
+    std::vector<uint32_t> variables;
+    std::unordered_map<SymbolId, uint32_t> formulas;
+    std::vector<SymbolId> formulaOrder;
+    std::unordered_map<uint32_t, std::vector<SymbolId>> rootNames;
+    std::vector<uint32_t> queue;
+    std::vector<SymbolId> changed;
+    size_t liveNodes;
+    uint64_t seenEpoch;
+    bool seenStrict;
+    uint64_t changedVariables;
+    uint64_t recomputedNodes;
+
+    FormulaRegistry(const FormulaRegistry&) = delete;
+    FormulaRegistry& operator=(const FormulaRegistry&) = delete;
+};
+
+#endif // FORMULA_REGISTRY_H
@@ -0,0 +1,371 @@
+/**
+ * File: langexpression-compiler.cpp
+ * -------------
+ * This file implements the langexpression-compiler.h interface.
+ */
+
+#include <string>
+#include <vector>
+#include "langexpression-compiler.h"
+#include "error.h"
+using namespace std;
+
+/**
+ * Implementation notes: FormulaState
+ * ----------------------------------
+ * Slot values and definedness are kept as bytes in two parallel arrays so
+ * the interpreter can index them directly.
+ */
+
+void FormulaState::setValue(int slot, bool value) {
+    values[slot] = value;
+    defined[slot] = true;
+}
+
+bool FormulaState::getValue(int slot) const {
+    return values[slot];
+}
+
+void FormulaState::clearValue(int slot) {
+    values[slot] = false;
+    defined[slot] = false;
+}
+
+bool FormulaState::isDefined(int slot) const {
+    return defined[slot];
+}
+
+void FormulaState::setStrictEvaluation(bool strict) {
+    this->strict = strict;
+}
+
+bool FormulaState::isStrictEvaluation() const {
+    return strict;
+}
+
+uint64_t FormulaState::getSkippedSubtrees() const {
+    return skippedSubtrees;
+}
+
+/**
+ * Implementation notes: CompiledFormula
+ * -------------------------------------
+ * The compiler walks the tree with an explicit work list instead of
+ * recursion. Each entry either visits a subtree or emits one instruction,
+ * and entries are pushed in reverse so that they come off the list in
+ * program order: operands first, then the operator that combines them.
+ * A let becomes <binding> BIND <body> UNBIND, where BIND saves the slot's
+ * previous contents and UNBIND restores them, so shadowed bindings come
+ * back intact when the let ends. A binary and, or or imp becomes
+ * <first> SKIP <second> OP. Jump targets are not known when the SKIP is
+ * emitted, so its index goes on a stack of open jumps, and a patch task
+ * queued after the OP fills in the target once the OP has been emitted.
+ * Subtrees nest, so the innermost open jump is always the one to patch.
+ * An n-ary and or or folds its operands with the binary opcode, with a
+ * SKIP after every operand but the last, as
+ * <1> SKIP <2> OP SKIP <3> OP ... SKIP <n> OP, and queues one patch per
+ * SKIP, so that each of them jumps to the end of the whole connective.
+ * An n-ary iff folds its operands with IFF, and an xor with IFF and NOT.
+ */
+
+CompiledFormula::CompiledFormula(const LangExpression *lexp) {
+    struct Task {
+        const LangExpression *node;
+        LangOpcode opcode;
+        int operand;
+        bool patchesJump;
+    };
+    vector<Task> tasks;
+    vector<int> openJumps;
+    tasks.push_back({lexp, FAIL_OP, 0, false});
+    int stackDepth = 0;
+    int savedDepth = 0;
+    maxStackDepth = 0;
+    maxSavedDepth = 0;
+    while (!tasks.empty()) {
+        Task task = tasks.back();
+        tasks.pop_back();
+        if (task.patchesJump) {
+            instructions[openJumps.back()].operand = instructions.size();
+            openJumps.pop_back();
+            continue;
+        }
+        if (task.node == nullptr) {
+            if (task.opcode == AND_SKIP || task.opcode == OR_SKIP || task.opcode == IMP_SKIP) {
+                openJumps.push_back(instructions.size());
+                emit(task.opcode);
+                continue;
+            }
+            emit(task.opcode, task.operand);
+            if (task.opcode == BIND_SLOT) {
+                stackDepth--;
+                savedDepth++;
+                if (savedDepth > maxSavedDepth) maxSavedDepth = savedDepth;
+            } else if (task.opcode == UNBIND_SLOT) {
+                savedDepth--;
+            } else if (task.opcode != NOT_OP && task.opcode != STORE_SLOT) {
+                stackDepth--;
+            }
+            continue;
+        }
+        const LangExpression *node = task.node;
+        switch (node->getType()) {
+        case RefEXP:
+            emit(LOAD_SLOT, slotFor(node->getSymbolId()));
+            stackDepth++;
+            break;
+        case BoolEXP:
+            emit(node->getBoolValue() ? PUSH_TRUE : PUSH_FALSE);
+            stackDepth++;
+            break;
+        case NotEXP:
+            tasks.push_back({nullptr, NOT_OP, 0, false});
+            tasks.push_back({node->getOperand(), FAIL_OP, 0, false});
+            break;
+        case AndEXP: case OrEXP: case ImpEXP: {
+            LangOpcode opcode = node->getType() == AndEXP ? AND_OP
+                              : node->getType() == OrEXP ? OR_OP : IMP_OP;
+            LangOpcode skip = node->getType() == AndEXP ? AND_SKIP
+                            : node->getType() == OrEXP ? OR_SKIP : IMP_SKIP;
+            tasks.push_back({nullptr, FAIL_OP, 0, true});
+            tasks.push_back({nullptr, opcode, 0, false});
+            tasks.push_back({node->getSecond(), FAIL_OP, 0, false});
+            tasks.push_back({nullptr, skip, 0, false});
+            tasks.push_back({node->getFirst(), FAIL_OP, 0, false});
+            break;
+        }
+        case IffEXP:
+            tasks.push_back({nullptr, IFF_OP, 0, false});
+            tasks.push_back({node->getSecond(), FAIL_OP, 0, false});
+            tasks.push_back({node->getFirst(), FAIL_OP, 0, false});
+            break;
+        case NaryAndEXP: case NaryOrEXP: case NaryIffEXP: case NaryXorEXP: {
+            LangExpressionType type = node->getType();
+            LangOpcode opcode = type == NaryAndEXP ? AND_OP : type == NaryOrEXP ? OR_OP : IFF_OP;
+            bool skips = type == NaryAndEXP || type == NaryOrEXP;
+            int count = node->getOperandCount();
+            if (skips) {
+                for (int i = 1; i < count; i++) tasks.push_back({nullptr, FAIL_OP, 0, true});
+            }
+            for (int i = count - 1; i > 0; i--) {
+                if (type == NaryXorEXP) tasks.push_back({nullptr, NOT_OP, 0, false});
+                tasks.push_back({nullptr, opcode, 0, false});
+                tasks.push_back({node->getOperands()[i], FAIL_OP, 0, false});
+                if (skips) tasks.push_back({nullptr, type == NaryAndEXP ? AND_SKIP : OR_SKIP, 0, false});
+            }
+            tasks.push_back({node->getOperands()[0], FAIL_OP, 0, false});
+            break;
+        }
+        case LetEXP: {
+            int slot = slotFor(node->getVariableId());
+            tasks.push_back({nullptr, UNBIND_SLOT, slot, false});
+            tasks.push_back({node->getBody(), FAIL_OP, 0, false});
+            tasks.push_back({nullptr, BIND_SLOT, slot, false});
+            tasks.push_back({node->getBinding(), FAIL_OP, 0, false});
+            break;
+        }
+        case SetEXP: {
+            int slot = slotFor(node->getVariableId());
+            storedSlots[slot] = true;
+            tasks.push_back({nullptr, STORE_SLOT, slot, false});
+            tasks.push_back({node->getBinding(), FAIL_OP, 0, false});
+            break;
+        }
+        case NullEXP:
+            emit(FAIL_OP);
+            stackDepth++;
+            break;
+        }
+        if (stackDepth > maxStackDepth) maxStackDepth = stackDepth;
+    }
+}
+
+int CompiledFormula::getSlotCount() const {
+    return slotSymbols.size();
+}
+
+string CompiledFormula::getSlotName(int slot) const {
+    return globalSymbols().nameOf(slotSymbols[slot]);
+}
+
+SymbolId CompiledFormula::getSlotSymbol(int slot) const {
+    return slotSymbols[slot];
+}
+
+int CompiledFormula::getSlot(const string& name) const {
+    SymbolId symbol = globalSymbols().lookup(name);
+    return slotsBySymbol.containsKey(symbol) ? slotsBySymbol.get(symbol) : -1;
+}
+
+const vector<LangInstruction>& CompiledFormula::getInstructions() const {
+    return instructions;
+}
+
+int CompiledFormula::getMaxStackDepth() const {
+    return maxStackDepth;
+}
+
+int CompiledFormula::getMaxBindingDepth() const {
+    return maxSavedDepth;
+}
+
+FormulaState CompiledFormula::newState() const {
+    FormulaState state;
+    state.values.assign(slotSymbols.size(), false);
+    state.defined.assign(slotSymbols.size(), false);
+    state.stack.assign(maxStackDepth, false);
+    state.saved.assign(2 * maxSavedDepth, 0);
+    return state;
+}
+
+/**
+ * Implementation notes: run
+ * -------------------------
+ * The interpreter is a single loop over the instruction array with a byte
+ * stack. Each BIND pushes the slot number and its old contents onto the
+ * saved stack, which lets an evaluation error unwind every open let before
+ * it propagates, so no let binding outlives a failed run. A taken SKIP
+ * jumps straight to the instruction after the connective. The instructions
+ * it passes over form one whole subtree, so the binding stack is left just
+ * as the SKIP found it.
+ */
+
+bool CompiledFormula::run(FormulaState& state) const {
+    if (state.values.size() < static_cast<size_t>(slotSymbols.size())) {
+        state.values.resize(slotSymbols.size(), false);
+        state.defined.resize(slotSymbols.size(), false);
+    }
+    if (state.stack.size() < static_cast<size_t>(maxStackDepth)) state.stack.resize(maxStackDepth);
+    if (state.saved.size() < static_cast<size_t>(2 * maxSavedDepth)) state.saved.resize(2 * maxSavedDepth);
+    uint8_t *values = state.values.data();
+    uint8_t *defined = state.defined.data();
+    uint8_t *stack = state.stack.data();
+    int32_t *saved = state.saved.data();
+    const LangInstruction *program = instructions.data();
+    int programSize = instructions.size();
+    bool strict = state.strict;
+    int top = 0;
+    int savedTop = 0;
+    for (int pc = 0; pc < programSize; pc++) {
+        const LangInstruction& instruction = program[pc];
+        int slot = instruction.operand;
+        switch (instruction.opcode) {
+        case PUSH_FALSE:
+            stack[top++] = false;
+            break;
+        case PUSH_TRUE:
+            stack[top++] = true;
+            break;
+        case LOAD_SLOT:
+            if (!defined[slot]) {
+                unwindBindings(state, savedTop);
+                error("EVALUATION ERROR >> undefined symbol: " + getSlotName(slot));
+            }
+            stack[top++] = values[slot];
+            break;
+        case NOT_OP:
+            stack[top - 1] = !stack[top - 1];
+            break;
+        case AND_OP:
+            top--;
+            stack[top - 1] = stack[top - 1] & stack[top];
+            break;
+        case OR_OP:
+            top--;
+            stack[top - 1] = stack[top - 1] | stack[top];
+            break;
+        case IMP_OP:
+            top--;
+            stack[top - 1] = (!stack[top - 1]) | stack[top];
+            break;
+        case IFF_OP:
+            top--;
+            stack[top - 1] = stack[top - 1] == stack[top];
+            break;
+        case BIND_SLOT:
+            saved[savedTop++] = slot;
+            saved[savedTop++] = (defined[slot] << 1) | values[slot];
+            values[slot] = stack[--top];
+            defined[slot] = true;
+            break;
+        case UNBIND_SLOT:
+            savedTop -= 2;
+            values[slot] = saved[savedTop + 1] & 1;
+            defined[slot] = saved[savedTop + 1] >> 1;
+            break;
+        case STORE_SLOT:
+            values[slot] = stack[top - 1];
+            defined[slot] = true;
+            break;
+        case AND_SKIP:
+            if (!strict && !stack[top - 1]) {
+                state.skippedSubtrees++;
+                pc = instruction.operand - 1;
+            }
+            break;
+        case OR_SKIP:
+            if (!strict && stack[top - 1]) {
+                state.skippedSubtrees++;
+                pc = instruction.operand - 1;
+            }
+            break;
+        case IMP_SKIP:
+            if (!strict && !stack[top - 1]) {
+                stack[top - 1] = true;
+                state.skippedSubtrees++;
+                pc = instruction.operand - 1;
+            }
+            break;
+        case FAIL_OP:
+            unwindBindings(state, savedTop);
+            error("EVALUATION ERROR >> Attempted null evaluation.");
+        }
+    }
+    return stack[0];
+}
+
+bool CompiledFormula::eval(LangEvaluationContext& context) const {
+    FormulaState state = newState();
+    state.setStrictEvaluation(context.isStrictEvaluation());
+    for (int slot = 0; slot < getSlotCount(); slot++) {
+        if (context.isDefined(slotSymbols[slot])) state.setValue(slot, context.getValue(slotSymbols[slot]));
+    }
+    bool value;
+    try {
+        value = run(state);
+    } catch (ErrorException& ex) {
+        storeGlobals(state, context);
+        throw;
+    }
+    storeGlobals(state, context);
+    return value;
+}
+
+void CompiledFormula::storeGlobals(const FormulaState& state, LangEvaluationContext& context) const {
+    context.countSkippedSubtrees(state.skippedSubtrees);
+    for (int slot = 0; slot < getSlotCount(); slot++) {
+        if (storedSlots[slot] && state.isDefined(slot)) context.setValue(slotSymbols[slot], state.getValue(slot));
+    }
+}
+
+void CompiledFormula::unwindBindings(FormulaState& state, int savedTop) {
+    while (savedTop > 0) {
+        savedTop -= 2;
+        int slot = state.saved[savedTop];
+        state.values[slot] = state.saved[savedTop + 1] & 1;
+        state.defined[slot] = state.saved[savedTop + 1] >> 1;
+    }
+}
+
+int CompiledFormula::slotFor(SymbolId symbol) {
+    if (slotsBySymbol.containsKey(symbol)) return slotsBySymbol.get(symbol);
+    int slot = slotSymbols.size();
+    slotSymbols.push_back(symbol);
+    storedSlots.push_back(false);
+    slotsBySymbol.put(symbol, slot);
+    return slot;
+}
+
+void CompiledFormula::emit(LangOpcode opcode, int operand) {
+    instructions.push_back({opcode, operand});
+}
@@ -0,0 +1,115 @@
+/**
+ * File: langexpression-compiler.h
+ * -------------
+ * This interface defines a compiler that lowers a LangExpression tree into
+ * a flat array of stack-machine instructions over integer variable slots,
+ * together with the interpreter loop that runs it. A formula compiled once
+ * can then be evaluated against many assignments without virtual dispatch
+ * or string lookups.
+ */
+
+#ifndef LANGEXPRESSION_COMPILER_H
+#define LANGEXPRESSION_COMPILER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "langexpressions.h"
+#include "symbol-table.h"
+#include "hashmap.h"
+
+enum LangOpcode : uint8_t {
+    PUSH_FALSE, PUSH_TRUE, LOAD_SLOT,
+    NOT_OP, AND_OP, OR_OP, IMP_OP, IFF_OP,
+    BIND_SLOT, UNBIND_SLOT, STORE_SLOT, FAIL_OP,
+    AND_SKIP, OR_SKIP, IMP_SKIP
+};
+
+/**
+ * Type: LangInstruction
+ * ---------------------
+ * One instruction of a compiled formula. The operand is the variable slot
+ * for LOAD_SLOT, BIND_SLOT, UNBIND_SLOT and STORE_SLOT, the index of the
+ * instruction to jump to for the SKIP opcodes, and unused otherwise.
+ *
+ * Each SKIP follows the first operand of the matching connective, or in
+ * an n-ary and or or every operand but the last. When the value on top of
+ * the stack decides the result, it replaces that value with the result
+ * and jumps past the rest of the connective. Strict evaluation treats
+ * every SKIP as a no-op.
+ */
+
+struct LangInstruction {
+    LangOpcode opcode;
+    int32_t operand;
+};
+
+/**
+ * Class: FormulaState
+ * -------------------
+ * The mutable half of an evaluation: the value and definedness of every
+ * slot, plus scratch stacks for the interpreter. One state can be reused
+ * across any number of runs of the same formula. Like an evaluation context,
+ * it short-circuits unless set to strict evaluation and counts the subtrees
+ * skipped over all its runs.
+ */
+
+class FormulaState {
+public:
+    void setValue(int slot, bool value);
+    bool getValue(int slot) const;
+    void clearValue(int slot);
+    bool isDefined(int slot) const;
+
+    void setStrictEvaluation(bool strict);
+    bool isStrictEvaluation() const;
+    uint64_t getSkippedSubtrees() const;
+
+private:
+    friend class CompiledFormula;
+    bool strict = false;
+    uint64_t skippedSubtrees = 0;
+    std::vector<uint8_t> values;
+    std::vector<uint8_t> defined;
+    std::vector<uint8_t> stack;
+    std::vector<int32_t> saved;
+};
+
+/**
+ * Class: CompiledFormula
+ * ----------------------
+ * The result of compiling a LangExpression. Each distinct variable name in
+ * the formula, whether free, let-bound or set, is assigned one slot.
+ */
+
+class CompiledFormula {
+public:
+    CompiledFormula(const LangExpression *lexp);
+
+    int getSlotCount() const;
+    std::string getSlotName(int slot) const;
+    SymbolId getSlotSymbol(int slot) const;
+    int getSlot(const std::string& name) const;
+    const std::vector<LangInstruction>& getInstructions() const;
+    int getMaxStackDepth() const;
+    int getMaxBindingDepth() const;
+
+    FormulaState newState() const;
+    bool run(FormulaState& state) const;
+    bool eval(LangEvaluationContext& context) const;
+
+private:
+    int slotFor(SymbolId symbol);
+    void emit(LangOpcode opcode, int operand = 0);
+    void storeGlobals(const FormulaState& state, LangEvaluationContext& context) const;
+    static void unwindBindings(FormulaState& state, int savedTop);
+
+    std::vector<LangInstruction> instructions;
+    std::vector<SymbolId> slotSymbols;
+    HashMap<SymbolId, int> slotsBySymbol;
+    std::vector<bool> storedSlots;
+    int maxStackDepth;
+    int maxSavedDepth;
+};
+
+#endif // LANGEXPRESSION_COMPILER_H
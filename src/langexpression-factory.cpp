@@ -0,0 +1,153 @@
+/**
+ * File: langexpression-factory.cpp
+ * -------------
+ * This file implements the langexpression-factory.h interface.
+ */
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "langexpression-factory.h"
+#include "error.h"
+using namespace std;
+
+/**
+ * Implementation notes: LangExpressionFactory
+ * -------------------------------------------
+ * A node is identified by its type and up to three words: the symbol or
+ * boolean value of a leaf, or the addresses of its children and the bound
+ * variable. Because children are themselves shared, comparing child
+ * addresses is the same as comparing child structure, so a lookup costs
+ * one hash of three words no matter how large the subterms are. An n-ary
+ * node has any number of children, so it is looked up in a table of its
+ * own by its type and the addresses of all of them.
+ */
+
+LangExpressionFactory::LangExpressionFactory() {
+    requests = 0;
+}
+
+LangExpression *LangExpressionFactory::makeRef(SymbolId symbol) {
+    NodeKey key = { RefEXP, symbol, 0, 0 };
+    LangExpression *node = find(key);
+    return node != nullptr ? node : share(key, arena.make<RefExp>(symbol));
+}
+
+LangExpression *LangExpressionFactory::makeBool(bool value) {
+    NodeKey key = { BoolEXP, value, 0, 0 };
+    LangExpression *node = find(key);
+    return node != nullptr ? node : share(key, arena.make<BoolExp>(value));
+}
+
+LangExpression *LangExpressionFactory::makeNot(LangExpression *operand) {
+    NodeKey key = { NotEXP, reinterpret_cast<intptr_t>(operand), 0, 0 };
+    LangExpression *node = find(key);
+    return node != nullptr ? node : share(key, arena.make<NotExp>(operand));
+}
+
+LangExpression *LangExpressionFactory::makeBinary(LangExpressionType type,
+                                                  LangExpression *first,
+                                                  LangExpression *second) {
+    NodeKey key = { type, reinterpret_cast<intptr_t>(first), reinterpret_cast<intptr_t>(second), 0 };
+    LangExpression *node = find(key);
+    if (node != nullptr) return node;
+    switch (type) {
+    case AndEXP: return share(key, arena.make<AndExp>(first, second));
+    case OrEXP: return share(key, arena.make<OrExp>(first, second));
+    case ImpEXP: return share(key, arena.make<ImpExp>(first, second));
+    case IffEXP: return share(key, arena.make<IffExp>(first, second));
+    default:
+        error("makeBinary: Illegal LangExpression type.");
+        return nullptr;
+    }
+}
+
+LangExpression *LangExpressionFactory::makeNary(LangExpressionType type,
+                                                LangExpression *const operands[], int count) {
+    requests++;
+    NaryKey key = { type, vector<LangExpression *>(operands, operands + count) };
+    auto entry = naryNodes.find(key);
+    if (entry != naryNodes.end()) return entry->second;
+    LangExpression *node = arena.make<NaryExp>(type, operands, count, &arena);
+    node->setOwnsChildren(false);
+    node->setHashConsed(true);
+    naryNodes.emplace(move(key), node);
+    return node;
+}
+
+LangExpression *LangExpressionFactory::makeLet(SymbolId variable,
+                                               LangExpression *binding,
+                                               LangExpression *body) {
+    NodeKey key = { LetEXP, variable, reinterpret_cast<intptr_t>(binding), reinterpret_cast<intptr_t>(body) };
+    LangExpression *node = find(key);
+    return node != nullptr ? node : share(key, arena.make<LetExp>(variable, binding, body));
+}
+
+LangExpression *LangExpressionFactory::makeSet(SymbolId variable, LangExpression *binding) {
+    NodeKey key = { SetEXP, variable, reinterpret_cast<intptr_t>(binding), 0 };
+    LangExpression *node = find(key);
+    return node != nullptr ? node : share(key, arena.make<SetExp>(variable, binding));
+}
+
+LangExpression *LangExpressionFactory::makeNull() {
+    NodeKey key = { NullEXP, 0, 0, 0 };
+    LangExpression *node = find(key);
+    return node != nullptr ? node : share(key, arena.make<NullExp>());
+}
+
+int LangExpressionFactory::getNodeCount() const {
+    return nodes.size() + naryNodes.size();
+}
+
+uint64_t LangExpressionFactory::getRequestCount() const {
+    return requests;
+}
+
+size_t LangExpressionFactory::bytesUsed() const {
+    return arena.bytesUsed();
+}
+
+void LangExpressionFactory::clear() {
+    nodes.clear();
+    naryNodes.clear();
+    arena.reset();
+    requests = 0;
+}
+
+LangExpression *LangExpressionFactory::find(const NodeKey& key) {
+    requests++;
+    auto entry = nodes.find(key);
+    return entry != nodes.end() ? entry->second : nullptr;
+}
+
+LangExpression *LangExpressionFactory::share(const NodeKey& key, LangExpression *node) {
+    node->setOwnsChildren(false);
+    node->setHashConsed(true);
+    nodes[key] = node;
+    return node;
+}
+
+bool LangExpressionFactory::NodeKey::operator==(const NodeKey& other) const {
+    return type == other.type && first == other.first
+            && second == other.second && third == other.third;
+}
+
+size_t LangExpressionFactory::NodeKeyHash::operator()(const NodeKey& key) const {
+    uint64_t hash = key.type;
+    hash = hash * 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(key.first);
+    hash = hash * 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(key.second);
+    hash = hash * 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(key.third);
+    return hash ^ (hash >> 29);
+}
+
+bool LangExpressionFactory::NaryKey::operator==(const NaryKey& other) const {
+    return type == other.type && operands == other.operands;
+}
+
+size_t LangExpressionFactory::NaryKeyHash::operator()(const NaryKey& key) const {
+    uint64_t hash = key.type;
+    for (LangExpression *operand : key.operands) {
+        hash = hash * 0x9E3779B97F4A7C15ull ^ reinterpret_cast<uint64_t>(operand);
+    }
+    return hash ^ (hash >> 29);
+}
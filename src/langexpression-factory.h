@@ -0,0 +1,80 @@
+/**
+ * File: langexpression-factory.h
+ * -------------
+ * This interface defines a hash-consing factory for LangExpressions. The
+ * factory hands out one shared node for every structurally distinct
+ * subterm, so a formula that repeats the same subformula thousands of
+ * times is stored as a DAG whose size is the number of distinct subterms.
+ */
+
+#ifndef LANGEXPRESSION_FACTORY_H
+#define LANGEXPRESSION_FACTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "langexpressions.h"
+#include "expression-arena.h"
+#include "symbol-table.h"
+
+/**
+ * Class: LangExpressionFactory
+ * ----------------------------
+ * Makes hash-consed LangExpressions. Asking twice for the same operator
+ * over the same children returns the same node, which therefore may have
+ * any number of parents. Every node lives in the factory's own arena and
+ * none of them owns its children: the nodes must never be deleted, and
+ * all of them are released together when the factory is cleared or
+ * destroyed. Children passed to the factory must have come from it too.
+ */
+
+class LangExpressionFactory {
+public:
+    LangExpressionFactory();
+
+    LangExpression *makeRef(SymbolId symbol);
+    LangExpression *makeBool(bool value);
+    LangExpression *makeNot(LangExpression *operand);
+    LangExpression *makeBinary(LangExpressionType type, LangExpression *first, LangExpression *second);
+    LangExpression *makeNary(LangExpressionType type, LangExpression *const operands[], int count);
+    LangExpression *makeLet(SymbolId variable, LangExpression *binding, LangExpression *body);
+    LangExpression *makeSet(SymbolId variable, LangExpression *binding);
+    LangExpression *makeNull();
+
+    int getNodeCount() const;
+    uint64_t getRequestCount() const;
+    size_t bytesUsed() const;
+    void clear();
+
+private:
+    struct NodeKey {
+        LangExpressionType type;
+        intptr_t first, second, third;
+        bool operator==(const NodeKey& other) const;
+    };
+    struct NodeKeyHash {
+        size_t operator()(const NodeKey& key) const;
+    };
+    struct NaryKey {
+        LangExpressionType type;
+        std::vector<LangExpression *> operands;
+        bool operator==(const NaryKey& other) const;
+    };
+    struct NaryKeyHash {
+        size_t operator()(const NaryKey& key) const;
+    };
+
+    LangExpressionFactory(const LangExpressionFactory&) = delete;
+    LangExpressionFactory& operator=(const LangExpressionFactory&) = delete;
+
+    LangExpression *find(const NodeKey& key);
+    LangExpression *share(const NodeKey& key, LangExpression *node);
+
+    ExpressionArena arena;
+    std::unordered_map<NodeKey, LangExpression *, NodeKeyHash> nodes;
+    std::unordered_map<NaryKey, LangExpression *, NaryKeyHash> naryNodes;
+    uint64_t requests;
+};
+
+#endif // LANGEXPRESSION_FACTORY_H
@@ -5,123 +5,380 @@
  */
 
 
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <vector>
 #include "error.h"
-#include "linkedlist.h"
 #include "langexpressions.h"
 #include "langexpression-parser.h"
+#include "pipeline-stats.h"
+#include "symbol-table.h"
 using namespace std;
 
-static LangExpression *readLE(SExpression *inputSExp);
-static LangExpression *readLEList(LinkedList<SExpression *> SExpList);
-static bool operationIsNot(const string& operation);
-static bool operationIsAnd(const string& operation);
-static bool operationIsOr(const string& operation);
-static bool operationIsImp(const string& operation);
-static bool operationIsIff(const string& operation);
-static bool operationIsSet(const string& operation);
-static bool operationIsLet(const string& operation);
-
-LangExpression *parseLangExp(SExpression *inputSExp) {
-    LangExpression *lexp = readLE(inputSExp);
+/**
+ * Type: NodeSource
+ * ----------------
+ * Where readLE gets its nodes from: the hash-consing factory when there is
+ * one, and otherwise the heap or the arena, as newNode decides.
+ */
+
+struct NodeSource {
+    ExpressionArena *arena;
+    LangExpressionFactory *factory;
+};
+
+/**
+ * Type: ReadTask
+ * --------------
+ * One step of readLE. A task with an S-expression translates it; a task
+ * without one builds a node of the given type from the translations of
+ * its operands, which are by then on top of the result stack. For an
+ * n-ary connective, operands says how many of them there are.
+ */
+
+struct ReadTask {
+    SExpression *sexp;
+    LangExpressionType type;
+    SymbolId variable;
+    int operands;
+};
+
+static LangExpression *readLE(SExpression *inputSExp, const NodeSource& nodes);
+static void readLEList(SExpression *list, vector<ReadTask>& tasks,
+                       vector<LangExpression *>& results, const NodeSource& nodes);
+static int countListTerms(SExpression *list, SExpression *terms[], int maxTerms);
+static LangExpression *buildLE(const ReadTask& task, vector<LangExpression *>& results, const NodeSource& nodes);
+static LangExpression *makeBool(const NodeSource& nodes, bool value);
+static LangExpression *makeRef(const NodeSource& nodes, SymbolId symbol);
+static LangExpression *makeNot(const NodeSource& nodes, LangExpression *operand);
+static LangExpression *makeBinary(const NodeSource& nodes, LangExpressionType type,
+                                  LangExpression *first, LangExpression *second);
+static LangExpression *makeNary(const NodeSource& nodes, LangExpressionType type,
+                                LangExpression *const operands[], int count);
+static LangExpression *makeLet(const NodeSource& nodes, SymbolId variable,
+                               LangExpression *binding, LangExpression *body);
+static LangExpression *makeSet(const NodeSource& nodes, SymbolId variable, LangExpression *binding);
+static LangExpression *makeNull(const NodeSource& nodes);
+static const LangOperator *readOperator(SExpression *operatorList);
+static string operatorName(SExpression *operatorList);
+static vector<LangOperator>& operatorTable();
+static vector<LangOperator> builtinOperatorTable();
+static void addOperator(vector<LangOperator>& table, const string& name, LangOperator op);
+
+/**
+ * Constant: kBuiltinOperators
+ * ---------------------------
+ * The operators the parser knows before any are registered.
+ */
+
+struct OperatorName {
+    const char *name;
+    LangOperator op;
+};
+
+static const OperatorName kBuiltinOperators[] = {
+    { "not", { NotEXP, false } }, { "N", { NotEXP, false } }, { "~", { NotEXP, false } },
+    { "[-]", { NotEXP, false } }, { "!", { NotEXP, false } },
+    { "and", { AndEXP, false } }, { "K", { AndEXP, false } }, { "&", { AndEXP, false } },
+    { "[*]", { AndEXP, false } },
+    { "or", { OrEXP, false } }, { "A", { OrEXP, false } }, { "||", { OrEXP, false } },
+    { "[+]", { OrEXP, false } },
+    { "implies", { ImpEXP, false } }, { "imp", { ImpEXP, false } }, { "C", { ImpEXP, false } },
+    { "=>", { ImpEXP, false } },
+    { "iff", { IffEXP, false } }, { "E", { IffEXP, false } }, { "<=>", { IffEXP, false } },
+    { "nand", { AndEXP, true } }, { "D", { AndEXP, true } },
+    { "nor", { OrEXP, true } },
+    { "xor", { IffEXP, true } }, { "J", { IffEXP, true } },
+    { "set", { SetEXP, false } },
+    { "let", { LetEXP, false } }
+};
+
+LangExpression *parseLangExp(SExpression *inputSExp, ExpressionArena *arena) {
+    STATS_PHASE(LANGEXP_PARSE_PHASE);
+    LangExpression *lexp = readLE(inputSExp, { arena, nullptr });
     return lexp;
 }
 
-LangExpression *readLE(SExpression *inputSExp) {
-    LangExpression *lexp = new NullExp();
-    if (inputSExp->getType() == SExpressionType::TRUE) return new BoolExp(true);
-    if (inputSExp->getType() == SExpressionType::FALSE) return new BoolExp(false);
-    if (inputSExp->getType() == SExpressionType::CONSTANT) {
-        if (inputSExp->getConstantValue() == 1.0) return new BoolExp(true);
-        if (inputSExp->getConstantValue() == 0.0) return new BoolExp(false);
+LangExpression *parseLangExp(SExpression *inputSExp, LangExpressionFactory& factory) {
+    STATS_PHASE(LANGEXP_PARSE_PHASE);
+    return readLE(inputSExp, { nullptr, &factory });
+}
+
+/**
+ * Implementation notes: readLE
+ * ----------------------------
+ * The translation runs from a stack of tasks instead of recursing, so the
+ * nesting depth of the input is limited only by memory. Translating an
+ * operation pushes a build task for it and then translate tasks for its
+ * operands, which therefore run last operand first, as the calls in the
+ * old recursive translator did. That keeps each tree laid out in memory
+ * the way it always was, which matters to evaluation speed on large
+ * formulas. The build task pops the operands back off the result stack.
+ * If the input turns out to be malformed, heap-allocated results already
+ * built are deleted before the error propagates. The two stacks are kept
+ * per thread and reused from one call to the next.
+ */
+
+LangExpression *readLE(SExpression *inputSExp, const NodeSource& nodes) {
+    static thread_local vector<ReadTask> taskStack;
+    static thread_local vector<LangExpression *> resultStack;
+    vector<ReadTask>& tasks = taskStack;
+    vector<LangExpression *>& results = resultStack;
+    tasks.clear();
+    results.clear();
+    tasks.push_back({inputSExp, NullEXP, kNoSymbol, 0});
+    try {
+        while (!tasks.empty()) {
+            ReadTask task = tasks.back();
+            tasks.pop_back();
+            SExpression *sexp = task.sexp;
+            if (sexp == nullptr) {
+                results.push_back(buildLE(task, results, nodes));
+            } else if (sexp->getType() == SExpressionType::TRUE) {
+                results.push_back(makeBool(nodes, true));
+            } else if (sexp->getType() == SExpressionType::FALSE) {
+                results.push_back(makeBool(nodes, false));
+            } else if (sexp->getType() == SExpressionType::CONSTANT && sexp->getConstantValue() == 1.0) {
+                results.push_back(makeBool(nodes, true));
+            } else if (sexp->getType() == SExpressionType::CONSTANT && sexp->getConstantValue() == 0.0) {
+                results.push_back(makeBool(nodes, false));
+            } else if (sexp->getType() == SExpressionType::SYMBOL) {
+                results.push_back(makeRef(nodes, sexp->getSymbolId()));
+            } else if (sexp->getType() == SExpressionType::CONS) {
+                readLEList(sexp, tasks, results, nodes);
+            } else {
+                results.push_back(makeNull(nodes));
+            }
+        }
+    } catch (ErrorException& ex) {
+        if (nodes.arena == nullptr && nodes.factory == nullptr) {
+            for (LangExpression *result : results) delete result;
+        }
+        throw;
     }
-    if (inputSExp->getType() == SExpressionType::SYMBOL) return new RefExp(inputSExp->getSymbolName());
-    if (inputSExp->getType() == SExpressionType::CONS) return readLEList(inputSExp->toList());
-    return lexp;
+    return results.back();
 }
 
-LangExpression *readLEList(LinkedList<SExpression *> SExpList) {
-    LangExpression *lexp = new NullExp();
-    SExpression *firstTerm = SExpList.removeFront();
+/**
+ * Implementation notes: readLEList
+ * --------------------------------
+ * The operator is looked up once, and how many terms the list has then
+ * decides whether it fits. An operator that is negated gets a NotEXP
+ * build task underneath its own, so the negation is built last. An and,
+ * or or iff with more than two terms becomes one n-ary node, whose terms
+ * are read a second time from the list to queue them all.
+ */
+
+void readLEList(SExpression *list, vector<ReadTask>& tasks,
+                vector<LangExpression *>& results, const NodeSource& nodes) {
+    SExpression *terms[4];
+    int numTerms = countListTerms(list, terms, 4) - 1;
+    SExpression *firstTerm = terms[0];
     if (firstTerm->getType() == SExpressionType::CONS) {
-        if (SExpList.isEmpty()) return readLE(firstTerm);
-        string operation;
-        LinkedList<SExpression *> firstTermComponents = firstTerm->toList();
-        for (const SExpression *component : firstTermComponents) {
-            if (component->getType() != SExpressionType::SYMBOL)
-                error("LangExpression PARSE ERROR >> Invalid operator component");
-            operation += component->getSymbolName();
+        if (numTerms == 0) {
+            tasks.push_back({firstTerm, NullEXP, kNoSymbol, 0});
+            return;
         }
-        int numTerms = SExpList.size();
-        if (numTerms == 1) {
-            SExpression *SExpToNegate = SExpList.removeFront();
-            if (operationIsNot(operation)) return new NotExp(readLE(SExpToNegate));
-            else error("LangExpression PARSE ERROR >> Incorrect number of terms provided for operation " + operation);
+        const LangOperator *op = readOperator(firstTerm);
+        if (numTerms > 3 && op == nullptr) error("LangExpression PARSE ERROR >> Unknown operator provided: " + operatorName(firstTerm));
+        LangExpressionType type = op == nullptr ? NullEXP : op->type;
+        bool binary = type >= AndEXP && type <= IffEXP;
+        bool nary = numTerms > 2 && (type == AndEXP || type == OrEXP || type == IffEXP);
+        bool named = numTerms > 1 && terms[1]->getType() == SExpressionType::SYMBOL;
+        bool fits = (numTerms == 1 && type == NotEXP)
+                 || (numTerms == 2 && (binary || (type == SetEXP && named)))
+                 || (numTerms == 3 && type == LetEXP && named)
+                 || nary;
+        if (!fits) {
+            error("LangExpression PARSE ERROR >> Incorrect number of terms provided for operation "
+                  + operatorName(firstTerm));
         }
-        else if (numTerms == 2) {
-            SExpression *SExpFirst = SExpList.removeFront();
-            SExpression *SExpSecond = SExpList.removeFront();
-            if (operationIsAnd(operation)) return new AndExp(readLE(SExpFirst), readLE(SExpSecond));
-            else if (operationIsOr(operation)) return new OrExp(readLE(SExpFirst), readLE(SExpSecond));
-            else if (operationIsImp(operation)) return new ImpExp(readLE(SExpFirst), readLE(SExpSecond));
-            else if (operationIsIff(operation)) return new IffExp(readLE(SExpFirst), readLE(SExpSecond));
-            else if (operationIsSet(operation) && SExpFirst->getType() == SExpressionType::SYMBOL)
-                return new SetExp(SExpFirst->getSymbolName(), readLE(SExpSecond));
-            else error("LangExpression PARSE ERROR >> Incorrect number of terms provided for operation " + operation);
+        if (nary) {
+            bool exclusive = type == IffEXP && op->negated;
+            if (op->negated && !exclusive) tasks.push_back({nullptr, NotEXP, kNoSymbol, 0});
+            tasks.push_back({nullptr, exclusive ? NaryXorEXP
+                                      : type == AndEXP ? NaryAndEXP
+                                      : type == OrEXP ? NaryOrEXP : NaryIffEXP, kNoSymbol, numTerms});
+            bool first = true;
+            for (SExpression *term : SListView(list)) {
+                if (!first) tasks.push_back({term, NullEXP, kNoSymbol, 0});
+                first = false;
+            }
+            return;
         }
-        else if (numTerms == 3) {
-            SExpression *SExpVar = SExpList.removeFront();
-            SExpression *SExpBind = SExpList.removeFront();
-            SExpression *SExpBody = SExpList.removeFront();
-            if (operationIsLet(operation) && SExpVar->getType() == SExpressionType::SYMBOL)
-                return new LetExp(SExpVar->getSymbolName(), readLE(SExpBind), readLE(SExpBody));
-            else error("LangExpression PARSE ERROR >> Incorrect number of terms provided for operation " + operation);
+        if (op->negated) tasks.push_back({nullptr, NotEXP, kNoSymbol, 0});
+        if (type == NotEXP) {
+            tasks.push_back({nullptr, NotEXP, kNoSymbol, 0});
+            tasks.push_back({terms[1], NullEXP, kNoSymbol, 0});
+        } else if (type == SetEXP) {
+            tasks.push_back({nullptr, SetEXP, terms[1]->getSymbolId(), 0});
+            tasks.push_back({terms[2], NullEXP, kNoSymbol, 0});
+        } else if (type == LetEXP) {
+            tasks.push_back({nullptr, LetEXP, terms[1]->getSymbolId(), 0});
+            tasks.push_back({terms[2], NullEXP, kNoSymbol, 0});
+            tasks.push_back({terms[3], NullEXP, kNoSymbol, 0});
+        } else {
+            tasks.push_back({nullptr, type, kNoSymbol, 0});
+            tasks.push_back({terms[1], NullEXP, kNoSymbol, 0});
+            tasks.push_back({terms[2], NullEXP, kNoSymbol, 0});
         }
-        else error("LangExpression PARSE ERROR >> Unknown operator provided: " + operation);
+        return;
+    }
+    results.push_back(makeNull(nodes));
+}
+
+/**
+ * Implementation notes: countListTerms
+ * ------------------------------------
+ * Stores the first maxTerms elements of a list in terms and returns the
+ * length of the whole list. Reading the elements through an SListView
+ * avoids copying every list into a LinkedList just to look at its first
+ * few elements.
+ */
+
+int countListTerms(SExpression *list, SExpression *terms[], int maxTerms) {
+    int numTerms = 0;
+    for (SExpression *term : SListView(list)) {
+        if (numTerms < maxTerms) terms[numTerms] = term;
+        numTerms++;
+    }
+    return numTerms;
+}
+
+LangExpression *buildLE(const ReadTask& task, vector<LangExpression *>& results, const NodeSource& nodes) {
+    if (task.operands > 0) {
+        vector<LangExpression *>::iterator operands = results.end() - task.operands;
+        reverse(operands, results.end());
+        LangExpression *nary = makeNary(nodes, task.type, &*operands, task.operands);
+        results.erase(operands, results.end());
+        return nary;
+    }
+    LangExpression *last = results.back();
+    results.pop_back();
+    if (task.type == NotEXP) return makeNot(nodes, last);
+    if (task.type == SetEXP) return makeSet(nodes, task.variable, last);
+    LangExpression *first = results.back();
+    results.pop_back();
+    if (task.type == LetEXP) return makeLet(nodes, task.variable, last, first);
+    return makeBinary(nodes, task.type, last, first);
+}
+
+LangExpression *makeBool(const NodeSource& nodes, bool value) {
+    if (nodes.factory != nullptr) return nodes.factory->makeBool(value);
+    return newNode<BoolExp>(nodes.arena, value);
+}
+
+LangExpression *makeRef(const NodeSource& nodes, SymbolId symbol) {
+    if (nodes.factory != nullptr) return nodes.factory->makeRef(symbol);
+    return newNode<RefExp>(nodes.arena, symbol);
+}
+
+LangExpression *makeNot(const NodeSource& nodes, LangExpression *operand) {
+    if (nodes.factory != nullptr) return nodes.factory->makeNot(operand);
+    return newNode<NotExp>(nodes.arena, operand);
+}
+
+LangExpression *makeBinary(const NodeSource& nodes, LangExpressionType type,
+                           LangExpression *first, LangExpression *second) {
+    if (nodes.factory != nullptr) return nodes.factory->makeBinary(type, first, second);
+    switch (type) {
+    case AndEXP: return newNode<AndExp>(nodes.arena, first, second);
+    case OrEXP: return newNode<OrExp>(nodes.arena, first, second);
+    case ImpEXP: return newNode<ImpExp>(nodes.arena, first, second);
+    default: return newNode<IffExp>(nodes.arena, first, second);
     }
-    return lexp;
 }
 
-bool operationIsNot(const string& operation) {
-    return operation == "not" ||
-            operation == "N" ||
-            operation == "~" ||
-            operation == "[-]" ||
-            operation == "!";
+LangExpression *makeNary(const NodeSource& nodes, LangExpressionType type,
+                         LangExpression *const operands[], int count) {
+    if (nodes.factory != nullptr) return nodes.factory->makeNary(type, operands, count);
+    return newNode<NaryExp>(nodes.arena, type, operands, count, nodes.arena);
 }
 
-bool operationIsAnd(const string& operation) {
-    return operation == "and" ||
-            operation == "K" ||
-            operation == "&" ||
-            operation == "[*]";
+LangExpression *makeLet(const NodeSource& nodes, SymbolId variable,
+                        LangExpression *binding, LangExpression *body) {
+    if (nodes.factory != nullptr) return nodes.factory->makeLet(variable, binding, body);
+    return newNode<LetExp>(nodes.arena, variable, binding, body);
 }
 
-bool operationIsOr(const string& operation) {
-    return operation == "or" ||
-            operation == "A" ||
-            operation == "||" ||
-            operation == "[+]";
+LangExpression *makeSet(const NodeSource& nodes, SymbolId variable, LangExpression *binding) {
+    if (nodes.factory != nullptr) return nodes.factory->makeSet(variable, binding);
+    return newNode<SetExp>(nodes.arena, variable, binding);
 }
 
-bool operationIsImp(const string& operation) {
-    return operation == "implies" ||
-            operation == "imp" ||
-            operation == "C" ||
-            operation == "=>";
+LangExpression *makeNull(const NodeSource& nodes) {
+    if (nodes.factory != nullptr) return nodes.factory->makeNull();
+    return newNode<NullExp>(nodes.arena);
 }
 
-bool operationIsIff(const string& operation) {
-    return operation == "iff" ||
-            operation == "E" ||
-            operation == "<=>";
+/**
+ * Implementation notes: readOperator
+ * ----------------------------------
+ * Almost every operator is a single symbol, whose SymbolId indexes the
+ * operator table directly. An operator spelled with several tokens, such
+ * as [*] or <=>, is run together and looked up by name first; a name the
+ * symbol table has never seen cannot be an operator. The table is built
+ * before that lookup, since building it is what interns the names of the
+ * built-in operators, and otherwise a multi-token operator would not be
+ * found until some earlier formula had built it.
+ */
+
+const LangOperator *readOperator(SExpression *operatorList) {
+    operatorTable();
+    SymbolId name = kNoSymbol;
+    int components = 0;
+    for (const SExpression *component : SListView(operatorList)) {
+        if (component->getType() != SExpressionType::SYMBOL)
+            error("LangExpression PARSE ERROR >> Invalid operator component");
+        name = component->getSymbolId();
+        components++;
+    }
+    if (components != 1) name = globalSymbols().lookup(operatorName(operatorList));
+    return findLangOperator(name);
+}
+
+string operatorName(SExpression *operatorList) {
+    string name;
+    for (const SExpression *component : SListView(operatorList)) name += component->getSymbolName();
+    return name;
+}
+
+void registerLangOperator(const string& name, LangOperator op) {
+    if (op.type != NotEXP && op.type != SetEXP && op.type != LetEXP && (op.type < AndEXP || op.type > IffEXP))
+        error("registerLangOperator: Illegal operator type.");
+    if (op.type == SetEXP && name != "set")
+        error("registerLangOperator: set cannot be given another name.");
+    addOperator(operatorTable(), name, op);
+}
+
+const LangOperator *findLangOperator(SymbolId name) {
+    const vector<LangOperator>& table = operatorTable();
+    if (name < 0 || name >= static_cast<SymbolId>(table.size()) || table[name].type == NullEXP) return nullptr;
+    return &table[name];
+}
+
+/**
+ * Implementation notes: operatorTable
+ * -----------------------------------
+ * The table has one entry per SymbolId up to the largest operator name,
+ * with NullEXP marking names that are not operators. It is filled with
+ * the built-in operators the first time it is used.
+ */
+
+vector<LangOperator>& operatorTable() {
+    static vector<LangOperator> table = builtinOperatorTable();
+    return table;
 }
 
-bool operationIsSet(const string& operation) {
-    return operation == "set";
+vector<LangOperator> builtinOperatorTable() {
+    vector<LangOperator> table;
+    for (const OperatorName& entry : kBuiltinOperators) addOperator(table, entry.name, entry.op);
+    return table;
 }
 
-bool operationIsLet(const string& operation) {
-    return operation == "let";
+void addOperator(vector<LangOperator>& table, const string& name, LangOperator op) {
+    SymbolId symbol = globalSymbols().intern(name);
+    if (symbol >= static_cast<SymbolId>(table.size())) table.resize(symbol + 1, { NullEXP, false });
+    table[symbol] = op;
 }
@@ -8,6 +8,85 @@
 #pragma once
 #include <string>
 #include "langexpressions.h"
+#include "expression-arena.h"
+#include "langexpression-factory.h"
+#include "symbol-table.h"
 #include "tokenscanner.h"
 
-LangExpression *parseLangExp(SExpression *inputSExp);
+/**
+ * Type: LangOperator
+ * ------------------
+ * What an operator name means to parseLangExp: the type of node it
+ * builds, and whether that node is then negated, which is how nand, nor
+ * and xor are read as the negations of and, or and iff. The type also
+ * fixes how many terms the operation takes: one for NotEXP, two for
+ * ImpEXP and SetEXP, three for LetEXP, and two or more for AndEXP, OrEXP
+ * and IffEXP. With more than two terms these build a single NaryExp over
+ * all of them; a negated iff over more than two terms is their exclusive
+ * or rather than the negation of their biconditional.
+ */
+
+struct LangOperator {
+    LangExpressionType type;
+    bool negated;
+};
+
+/**
+ * Function: parseLangExp
+ * Usage: LangExpression *lexp = parseLangExp(sexp);
+ * -------------------------------------------
+ * Translates a parsed S-expression into a LangExpression. When an arena is
+ * supplied every node is allocated inside it and the result must not be
+ * deleted; otherwise the caller owns the returned tree.
+ */
+
+LangExpression *parseLangExp(SExpression *inputSExp, ExpressionArena *arena = nullptr);
+
+/**
+ * Function: parseLangExp
+ * Usage: LangExpression *lexp = parseLangExp(sexp, factory);
+ * -------------------------------------------
+ * Translates a parsed S-expression into a DAG of hash-consed nodes made by
+ * the factory, sharing every repeated subterm with its other occurrences
+ * in this and earlier results. The factory owns the result.
+ */
+
+LangExpression *parseLangExp(SExpression *inputSExp, LangExpressionFactory& factory);
+
+/**
+ * Function: registerLangOperator
+ * Usage: registerLangOperator("xor", { IffEXP, true });
+ * -------------------------------------------
+ * Makes name an operator for every later call to parseLangExp, replacing
+ * whatever it meant before. An operator written with several tokens, such
+ * as <=>, is registered under the tokens run together. The parser starts
+ * out knowing
+ *
+ *   not      not  N  ~  [-]  !
+ *   and      and  K  &  [*]
+ *   or       or  A  ||  [+]
+ *   imp      implies  imp  C  =>
+ *   iff      iff  E  <=>
+ *   nand     nand  D
+ *   nor      nor
+ *   xor      xor  J
+ *   set      set
+ *   let      let
+ *
+ * set keeps its one name, since batch mode finds the records that bind a
+ * variable by that word without parsing them; registering any other name
+ * for it raises an error. Operators are meant to be registered at
+ * startup; registering one while another thread is parsing is not safe.
+ */
+
+void registerLangOperator(const std::string& name, LangOperator op);
+
+/**
+ * Function: findLangOperator
+ * Usage: const LangOperator *op = findLangOperator(symbol);
+ * -------------------------------------------
+ * Returns what the symbol means as an operator, or nullptr if it is not
+ * one. The lookup is a single index into a table kept by SymbolId.
+ */
+
+const LangOperator *findLangOperator(SymbolId name);
@@ -0,0 +1,521 @@
+/**
+ * File: langexpression-simplifier.cpp
+ * -------------
+ * This file implements the langexpression-simplifier.h interface.
+ */
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "langexpression-simplifier.h"
+#include "error.h"
+using namespace std;
+
+/**
+ * Type: Simplified
+ * ----------------
+ * A simplified subformula, and whether a rewrite may drop it: it must be
+ * free of set and of null expressions, and, when simplifying against a
+ * context, read no variable that might be undefined when it runs.
+ */
+
+struct Simplified {
+    LangExpression *node;
+    bool droppable;
+};
+
+static const int8_t kUnknown = -1;
+
+static unordered_map<const LangExpression *, bool> findAssignments(const LangExpression *lexp);
+static Simplified combine(LangExpressionType type, Simplified first, Simplified second, ExpressionArena *arena);
+static Simplified combineNary(LangExpressionType type, const vector<Simplified>& operands, ExpressionArena *arena);
+static Simplified negateOperand(Simplified operand, ExpressionArena *arena);
+static Simplified makeBool(bool value, ExpressionArena *arena);
+static LangExpression *makeBinary(LangExpressionType type, LangExpression *first, LangExpression *second,
+                                  ExpressionArena *arena);
+static LangExpression *unwrapNot(LangExpression *node, ExpressionArena *arena);
+static void discard(LangExpression *node, ExpressionArena *arena);
+static bool isConstant(const LangExpression *node, bool value);
+static bool isComplement(const LangExpression *first, const LangExpression *second);
+static bool absorbs(const LangExpression *kept, const LangExpression *dropped, LangExpressionType type);
+static bool sameFormula(const LangExpression *first, const LangExpression *second);
+static uint64_t countNodes(const LangExpression *lexp);
+static void collectOperands(const LangExpression *node, vector<const LangExpression *>& operands);
+
+/**
+ * Implementation notes: simplifyLangExp
+ * -------------------------------------
+ * Walks the formula with an explicit stack, as the parser and the
+ * encoders do, so formulas of any depth can be simplified. Each node's
+ * operands are simplified first and then combined by the rewrites for
+ * its connective, which see only operands that are already as simple as
+ * they will get.
+ *
+ * A let whose binding simplifies to a constant records the constant for
+ * its variable while its body is simplified, so references to it fold
+ * like any other constant; a let with any other binding records that the
+ * variable is unknown, which hides an outer constant of the same name.
+ * Whether a body contains set is worked out for the whole formula in one
+ * pass beforehand.
+ *
+ * With a context, a reference is droppable only if an enclosing let binds
+ * its variable or the context already defines it. Nothing a formula does
+ * can undefine a global, since a let puts back whatever it hid, so such a
+ * variable is still defined whenever the reference runs. Any other global
+ * might be undefined then, and dropping a read of it could turn the error
+ * the original stops with into a value.
+ */
+
+LangExpression *simplifyLangExp(const LangExpression *lexp, uint64_t& removedNodes, ExpressionArena *arena,
+                                const LangEvaluationContext *context) {
+    enum Action { VISIT, BUILD, BIND };
+    struct Task {
+        Action action;
+        const LangExpression *node;
+    };
+    unordered_map<const LangExpression *, bool> assigns = findAssignments(lexp);
+    vector<Task> tasks;
+    vector<Simplified> results;
+    vector<int8_t> constants;
+    vector<int> letDepths;
+    vector<int8_t> saved;
+    vector<bool> inlined;
+    uint64_t originalNodes = 0;
+    tasks.push_back({ VISIT, lexp });
+    try {
+        while (!tasks.empty()) {
+            Task task = tasks.back();
+            tasks.pop_back();
+            const LangExpression *node = task.node;
+            if (task.action == VISIT) {
+                originalNodes++;
+                switch (node->getType()) {
+                case RefEXP: {
+                    SymbolId symbol = node->getSymbolId();
+                    if (static_cast<size_t>(symbol) < constants.size() && constants[symbol] != kUnknown) {
+                        results.push_back(makeBool(constants[symbol] != 0, arena));
+                    } else {
+                        bool bound = static_cast<size_t>(symbol) < letDepths.size() && letDepths[symbol] > 0;
+                        bool defined = context == nullptr || bound || context->isDefined(symbol);
+                        results.push_back({ newNode<RefExp>(arena, symbol), defined });
+                    }
+                    break;
+                }
+                case BoolEXP:
+                    results.push_back(makeBool(node->getBoolValue(), arena));
+                    break;
+                case NotEXP:
+                    tasks.push_back({ BUILD, node });
+                    tasks.push_back({ VISIT, node->getOperand() });
+                    break;
+                case AndEXP: case OrEXP: case ImpEXP: case IffEXP:
+                    tasks.push_back({ BUILD, node });
+                    tasks.push_back({ VISIT, node->getSecond() });
+                    tasks.push_back({ VISIT, node->getFirst() });
+                    break;
+                case NaryAndEXP: case NaryOrEXP: case NaryIffEXP: case NaryXorEXP:
+                    tasks.push_back({ BUILD, node });
+                    for (int i = node->getOperandCount() - 1; i >= 0; i--) {
+                        tasks.push_back({ VISIT, node->getOperands()[i] });
+                    }
+                    break;
+                case LetEXP:
+                    tasks.push_back({ BUILD, node });
+                    tasks.push_back({ VISIT, node->getBody() });
+                    tasks.push_back({ BIND, node });
+                    tasks.push_back({ VISIT, node->getBinding() });
+                    break;
+                case SetEXP:
+                    tasks.push_back({ BUILD, node });
+                    tasks.push_back({ VISIT, node->getBinding() });
+                    break;
+                case NullEXP:
+                    results.push_back({ newNode<NullExp>(arena), false });
+                    break;
+                }
+            } else if (task.action == BIND) {
+                SymbolId var = node->getVariableId();
+                if (static_cast<size_t>(var) >= constants.size()) constants.resize(var + 1, kUnknown);
+                if (static_cast<size_t>(var) >= letDepths.size()) letDepths.resize(var + 1, 0);
+                letDepths[var]++;
+                const LangExpression *binding = results.back().node;
+                bool constant = binding->getType() == BoolEXP && !assigns[node->getBody()];
+                saved.push_back(constants[var]);
+                constants[var] = constant ? binding->getBoolValue() : kUnknown;
+                inlined.push_back(constant);
+            } else {
+                switch (node->getType()) {
+                case NotEXP:
+                    results.back() = negateOperand(results.back(), arena);
+                    break;
+                case AndEXP: case OrEXP: case ImpEXP: case IffEXP: {
+                    Simplified second = results.back();
+                    results.pop_back();
+                    results.back() = combine(node->getType(), results.back(), second, arena);
+                    break;
+                }
+                case NaryAndEXP: case NaryOrEXP: case NaryIffEXP: case NaryXorEXP: {
+                    vector<Simplified> operands(results.end() - node->getOperandCount(), results.end());
+                    results.resize(results.size() - operands.size());
+                    results.push_back(combineNary(node->getType(), operands, arena));
+                    break;
+                }
+                case LetEXP: {
+                    Simplified body = results.back();
+                    results.pop_back();
+                    Simplified binding = results.back();
+                    constants[node->getVariableId()] = saved.back();
+                    letDepths[node->getVariableId()]--;
+                    saved.pop_back();
+                    bool constant = inlined.back();
+                    inlined.pop_back();
+                    if (constant || (body.node->getType() == BoolEXP && binding.droppable)) {
+                        discard(binding.node, arena);
+                        results.back() = body;
+                    } else {
+                        results.back() = { newNode<LetExp>(arena, node->getVariableId(), binding.node, body.node),
+                                           binding.droppable && body.droppable };
+                    }
+                    break;
+                }
+                default:
+                    results.back() = { newNode<SetExp>(arena, node->getVariableId(), results.back().node), false };
+                    break;
+                }
+            }
+        }
+    } catch (...) {
+        for (const Simplified& result : results) discard(result.node, arena);
+        throw;
+    }
+    LangExpression *simplified = results.back().node;
+    removedNodes = originalNodes - countNodes(simplified);
+    return simplified;
+}
+
+/**
+ * Implementation notes: findAssignments
+ * -------------------------------------
+ * Maps every node of the formula to whether its subtree contains set,
+ * computing each node's answer from its operands' in a postorder walk.
+ */
+
+unordered_map<const LangExpression *, bool> findAssignments(const LangExpression *lexp) {
+    unordered_map<const LangExpression *, bool> assigns;
+    vector<pair<const LangExpression *, bool>> pending;
+    vector<const LangExpression *> operands;
+    pending.push_back({ lexp, false });
+    while (!pending.empty()) {
+        const LangExpression *node = pending.back().first;
+        bool operandsDone = pending.back().second;
+        pending.pop_back();
+        if (assigns.count(node) != 0) continue;
+        collectOperands(node, operands);
+        if (!operandsDone) {
+            pending.push_back({ node, true });
+            for (const LangExpression *operand : operands) pending.push_back({ operand, false });
+            continue;
+        }
+        bool assigned = node->getType() == SetEXP;
+        for (const LangExpression *operand : operands) assigned |= assigns[operand];
+        assigns[node] = assigned;
+    }
+    return assigns;
+}
+
+/**
+ * Implementation notes: combine
+ * -----------------------------
+ * Tries the rewrites for the connective in turn and builds the node
+ * unchanged if none applies. Only droppable operands are ever dropped;
+ * an operand that is kept is evaluated just as it was, and never moves
+ * ahead of one that came before it.
+ */
+
+Simplified combine(LangExpressionType type, Simplified first, Simplified second, ExpressionArena *arena) {
+    LangExpression *a = first.node;
+    LangExpression *b = second.node;
+    bool both = first.droppable && second.droppable;
+    switch (type) {
+    case AndEXP: case OrEXP: {
+        bool unit = type == AndEXP;
+        LangExpressionType dual = type == AndEXP ? OrEXP : AndEXP;
+        if (isConstant(a, unit)) {
+            discard(a, arena);
+            return second;
+        }
+        if (isConstant(b, unit)) {
+            discard(b, arena);
+            return first;
+        }
+        if ((isConstant(a, !unit) || sameFormula(a, b) || absorbs(a, b, dual)) && second.droppable) {
+            discard(b, arena);
+            return first;
+        }
+        if ((isConstant(b, !unit) || absorbs(b, a, dual)) && first.droppable) {
+            discard(a, arena);
+            return second;
+        }
+        if (isComplement(a, b) && both) {
+            discard(a, arena);
+            discard(b, arena);
+            return makeBool(!unit, arena);
+        }
+        break;
+    }
+    case ImpEXP:
+        if (isConstant(a, true)) {
+            discard(a, arena);
+            return second;
+        }
+        if (isConstant(b, false)) {
+            discard(b, arena);
+            return negateOperand(first, arena);
+        }
+        if ((isConstant(a, false) || isConstant(b, true) || sameFormula(a, b)) && both) {
+            discard(a, arena);
+            discard(b, arena);
+            return makeBool(true, arena);
+        }
+        if (isComplement(a, b) && first.droppable) {
+            discard(a, arena);
+            return second;
+        }
+        break;
+    case IffEXP:
+        if (a->getType() == BoolEXP) {
+            bool value = a->getBoolValue();
+            discard(a, arena);
+            return value ? second : negateOperand(second, arena);
+        }
+        if (b->getType() == BoolEXP) {
+            bool value = b->getBoolValue();
+            discard(b, arena);
+            return value ? first : negateOperand(first, arena);
+        }
+        if ((sameFormula(a, b) || isComplement(a, b)) && both) {
+            bool value = sameFormula(a, b);
+            discard(a, arena);
+            discard(b, arena);
+            return makeBool(value, arena);
+        }
+        break;
+    default:
+        error("SIMPLIFY ERROR >> Not a binary connective");
+    }
+    return { makeBinary(type, a, b, arena), both };
+}
+
+/**
+ * Implementation notes: combineNary
+ * ---------------------------------
+ * Drops the constants that cannot change an n-ary connective's value:
+ * t from an and, f from an or, and every constant from an iff or an xor,
+ * where each f in an iff and each t in an xor negates the rest. An and
+ * that also has an f, or an or that has a t, folds to it when all its
+ * other operands are droppable. Whatever is left is rebuilt, as the
+ * binary connective when only two operands remain, so that the binary
+ * rewrites get their turn, and as a single operand or a constant when
+ * fewer do. Repeated operands are not looked for, since comparing every
+ * pair would cost time quadratic in the width of the connective.
+ */
+
+Simplified combineNary(LangExpressionType type, const vector<Simplified>& operands, ExpressionArena *arena) {
+    bool chained = type == NaryIffEXP || type == NaryXorEXP;
+    bool unit = type == NaryAndEXP || type == NaryIffEXP;
+    bool negated = false;
+    bool decided = false;
+    bool droppable = true;
+    vector<Simplified> kept;
+    for (const Simplified& operand : operands) {
+        if (operand.node->getType() == BoolEXP && (chained || operand.node->getBoolValue() == unit)) {
+            negated ^= operand.node->getBoolValue() != unit;
+            discard(operand.node, arena);
+            continue;
+        }
+        if (operand.node->getType() == BoolEXP) decided = true;
+        else droppable &= operand.droppable;
+        kept.push_back(operand);
+    }
+    if (decided && droppable) {
+        for (const Simplified& operand : kept) discard(operand.node, arena);
+        return makeBool(!unit, arena);
+    }
+    Simplified result;
+    if (kept.empty()) {
+        result = makeBool(unit, arena);
+    } else if (kept.size() == 1) {
+        result = kept[0];
+    } else if (kept.size() == 2) {
+        LangExpressionType binary = type == NaryAndEXP ? AndEXP : type == NaryOrEXP ? OrEXP : IffEXP;
+        negated ^= type == NaryXorEXP;
+        result = combine(binary, kept[0], kept[1], arena);
+    } else {
+        vector<LangExpression *> nodes;
+        for (const Simplified& operand : kept) nodes.push_back(operand.node);
+        result = { newNode<NaryExp>(arena, type, nodes.data(), static_cast<int>(nodes.size()), arena), droppable };
+    }
+    return negated ? negateOperand(result, arena) : result;
+}
+
+Simplified negateOperand(Simplified operand, ExpressionArena *arena) {
+    LangExpression *node = operand.node;
+    if (node->getType() == BoolEXP) {
+        bool value = node->getBoolValue();
+        discard(node, arena);
+        return makeBool(!value, arena);
+    }
+    if (node->getType() == NotEXP) return { unwrapNot(node, arena), operand.droppable };
+    return { newNode<NotExp>(arena, node), operand.droppable };
+}
+
+Simplified makeBool(bool value, ExpressionArena *arena) {
+    return { newNode<BoolExp>(arena, value), true };
+}
+
+LangExpression *makeBinary(LangExpressionType type, LangExpression *first, LangExpression *second,
+                           ExpressionArena *arena) {
+    switch (type) {
+    case AndEXP: return newNode<AndExp>(arena, first, second);
+    case OrEXP: return newNode<OrExp>(arena, first, second);
+    case ImpEXP: return newNode<ImpExp>(arena, first, second);
+    default: return newNode<IffExp>(arena, first, second);
+    }
+}
+
+/**
+ * Implementation notes: unwrapNot
+ * -------------------------------
+ * Returns the operand of a not and frees the not itself, which must first
+ * be told that it no longer owns the operand.
+ */
+
+LangExpression *unwrapNot(LangExpression *node, ExpressionArena *arena) {
+    LangExpression *operand = node->getOperand();
+    if (arena == nullptr) {
+        node->setOwnsChildren(false);
+        delete node;
+    }
+    return operand;
+}
+
+void discard(LangExpression *node, ExpressionArena *arena) {
+    if (arena == nullptr) delete node;
+}
+
+bool isConstant(const LangExpression *node, bool value) {
+    return node->getType() == BoolEXP && node->getBoolValue() == value;
+}
+
+bool isComplement(const LangExpression *first, const LangExpression *second) {
+    if (first->getType() == NotEXP && sameFormula(first->getOperand(), second)) return true;
+    return second->getType() == NotEXP && sameFormula(second->getOperand(), first);
+}
+
+/**
+ * Implementation notes: absorbs
+ * -----------------------------
+ * Returns true if dropped is a connective of the given type with kept as
+ * one of its operands, as in ((and) kept ((or) kept y)), where the whole
+ * formula equals kept.
+ */
+
+bool absorbs(const LangExpression *kept, const LangExpression *dropped, LangExpressionType type) {
+    if (dropped->getType() != type) return false;
+    return sameFormula(kept, dropped->getFirst()) || sameFormula(kept, dropped->getSecond());
+}
+
+/**
+ * Implementation notes: sameFormula
+ * ---------------------------------
+ * Compares two formulas node by node with an explicit stack, stopping at
+ * the first difference, which for unrelated formulas is nearly always at
+ * the roots.
+ */
+
+bool sameFormula(const LangExpression *first, const LangExpression *second) {
+    vector<pair<const LangExpression *, const LangExpression *>> pending;
+    pending.push_back({ first, second });
+    while (!pending.empty()) {
+        const LangExpression *a = pending.back().first;
+        const LangExpression *b = pending.back().second;
+        pending.pop_back();
+        if (a == b) continue;
+        if (a->getType() != b->getType()) return false;
+        switch (a->getType()) {
+        case RefEXP:
+            if (a->getSymbolId() != b->getSymbolId()) return false;
+            break;
+        case BoolEXP:
+            if (a->getBoolValue() != b->getBoolValue()) return false;
+            break;
+        case NotEXP:
+            pending.push_back({ a->getOperand(), b->getOperand() });
+            break;
+        case AndEXP: case OrEXP: case ImpEXP: case IffEXP:
+            pending.push_back({ a->getSecond(), b->getSecond() });
+            pending.push_back({ a->getFirst(), b->getFirst() });
+            break;
+        case NaryAndEXP: case NaryOrEXP: case NaryIffEXP: case NaryXorEXP:
+            if (a->getOperandCount() != b->getOperandCount()) return false;
+            for (int i = a->getOperandCount() - 1; i >= 0; i--) {
+                pending.push_back({ a->getOperands()[i], b->getOperands()[i] });
+            }
+            break;
+        case LetEXP:
+            if (a->getVariableId() != b->getVariableId()) return false;
+            pending.push_back({ a->getBody(), b->getBody() });
+            pending.push_back({ a->getBinding(), b->getBinding() });
+            break;
+        case SetEXP:
+            if (a->getVariableId() != b->getVariableId()) return false;
+            pending.push_back({ a->getBinding(), b->getBinding() });
+            break;
+        case NullEXP:
+            break;
+        }
+    }
+    return true;
+}
+
+uint64_t countNodes(const LangExpression *lexp) {
+    uint64_t count = 0;
+    vector<const LangExpression *> pending;
+    vector<const LangExpression *> operands;
+    pending.push_back(lexp);
+    while (!pending.empty()) {
+        const LangExpression *node = pending.back();
+        pending.pop_back();
+        count++;
+        collectOperands(node, operands);
+        pending.insert(pending.end(), operands.begin(), operands.end());
+    }
+    return count;
+}
+
+/**
+ * Implementation notes: collectOperands
+ * -------------------------------------
+ * Replaces the contents of operands with the node's operands, in order,
+ * so that the walks that treat every operand alike need only one switch.
+ */
+
+void collectOperands(const LangExpression *node, vector<const LangExpression *>& operands) {
+    operands.clear();
+    switch (node->getType()) {
+    case NotEXP: operands.push_back(node->getOperand()); break;
+    case AndEXP: case OrEXP: case ImpEXP: case IffEXP:
+        operands.push_back(node->getFirst());
+        operands.push_back(node->getSecond());
+        break;
+    case NaryAndEXP: case NaryOrEXP: case NaryIffEXP: case NaryXorEXP:
+        operands.assign(node->getOperands(), node->getOperands() + node->getOperandCount());
+        break;
+    case LetEXP:
+        operands.push_back(node->getBinding());
+        operands.push_back(node->getBody());
+        break;
+    case SetEXP: operands.push_back(node->getBinding()); break;
+    default: break;
+    }
+}
@@ -0,0 +1,60 @@
+/**
+ * File: langexpression-simplifier.h
+ * -------------
+ * This interface defines an optimizer pass that runs between parseLangExp
+ * and eval. It folds constants and removes trivial patterns such as
+ * ((and) x t), ((not) ((not) x)) and ((iff) x x), which a generated
+ * formula may be full of and eval would otherwise redo on every run.
+ */
+
+#ifndef LANGEXPRESSION_SIMPLIFIER_H
+#define LANGEXPRESSION_SIMPLIFIER_H
+
+#include <cstdint>
+#include "langexpressions.h"
+#include "expression-arena.h"
+
+/**
+ * Function: simplifyLangExp
+ * Usage: LangExpression *simpler = simplifyLangExp(lexp, removed);
+ * -------------------------------------------
+ * Returns a simplified copy of the formula and sets removedNodes to how
+ * many fewer nodes it has than the original. The rewrites are
+ *
+ *   constant folding         ((and) x f) is f, ((imp) x f) is ((not) x)
+ *   double negation          ((not) ((not) x)) is x
+ *   idempotence              ((and) x x) and ((or) x x) are x
+ *   complements              ((and) x ((not) x)) is f, ((iff) x x) is t
+ *   absorption               ((and) x ((or) x y)) is x, and dually
+ *   constant let bindings    ((let) v t body) is body with v replaced by t
+ *   n-ary constants          ((or) x f y) is ((or) x y), ((and) x f y) is f
+ *
+ * applied bottom-up, so a rewrite that exposes another constant or
+ * pattern above it is followed through to the root.
+ *
+ * A rewrite that would drop a subformula containing set is not made, so
+ * every assignment the original performs is still performed, in the same
+ * order. A let binding is inlined only when its body contains no set at
+ * all. Wherever the original evaluates to a value, the simplified formula
+ * evaluates to the same one, though it skips fewer subtrees because fewer
+ * are left.
+ *
+ * When the formula is about to be evaluated against a context, pass that
+ * context: a rewrite that would drop a read of a variable which neither
+ * an enclosing let nor the context defines is then not made either, so
+ * the simplified formula also stops with the same undefined-variable
+ * error as the original, and a set whose binding would have failed still
+ * fails. Without a context every variable is assumed to be defined, and
+ * the simplified formula may have a value where the original stops with
+ * an error.
+ *
+ * Like parseLangExp, the copy is made inside the arena when one is given
+ * and is otherwise owned by the caller, and the original is left as it
+ * was. A hash-consed DAG is copied as the tree it stands for.
+ */
+
+LangExpression *simplifyLangExp(const LangExpression *lexp, uint64_t& removedNodes,
+                                ExpressionArena *arena = nullptr,
+                                const LangEvaluationContext *context = nullptr);
+
+#endif // LANGEXPRESSION_SIMPLIFIER_H
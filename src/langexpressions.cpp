@@ -4,47 +4,477 @@
  * This file implements the langexpressions.h interface.
  */
 
+#include <atomic>
 #include <string>
+#include <vector>
 #include "langexpressions.h"
 #include "strlib.h"
 #include "error.h"
+#include "pipeline-stats.h"
 using namespace std;
 
+static string printTree(const LangExpression *root);
+static uint64_t nextBindingEpoch();
+
 /**
  * Implementation notes: LangExpression
  * -------------------------------
- * TODO
+ * evalFrames runs the formula on an explicit stack with one frame per operator
+ * whose operands are still being evaluated. It alternates between going
+ * down, pushing a frame per operator until it reaches a leaf, and coming
+ * back up with that leaf's value, completing frames until one of them
+ * needs its second operand (or a let its body) and it goes down again.
+ * An n-ary connective's frame keeps the index of the operand under way
+ * and the value of the ones before it, and foldOperands takes each value
+ * in turn, going on through operands that are leaves, until the result is
+ * decided or an operand needs frames of its own.
+ * Leaves never get a frame, and the first operand's value waits in its
+ * parent's frame, so the value being passed up lives in a local variable.
+ * The stack is kept per thread and reused across calls, so evaluation
+ * allocates nothing once the stack has grown to the formula's depth. If a
+ * leaf raises an error, every let scope opened by this call is popped
+ * before the error propagates.
+ *
+ * Only hash-consed nodes are memoized. A remembered value is stamped with
+ * the binding epoch of the context it was computed in and is reused only
+ * while the context still has that epoch, so a shared subterm is evaluated
+ * once per pass for as long as no let, set or caller changes a binding.
+ * A node whose own evaluation changes a binding, like a set, is never
+ * remembered, since evaluating it again would not be a no-op.
  */
 
-LangExpression::LangExpression() {
-    /* Empty */
+LangExpression::LangExpression(LangExpressionType type) {
+    this->type = type;
+    childrenOwned = true;
+    hashConsed = false;
+    memoValue = false;
+    memoEpoch = 0;
 }
 
 LangExpression::~LangExpression() {
     /* Empty */
 }
 
+LangExpressionType LangExpression::getType() const {
+    return type;
+}
+
+/**
+ * Implementation notes: evalLeaf
+ * ------------------------------
+ * Gives the value of a node that needs no frame, which is any leaf and any
+ * hash-consed node whose remembered value is still current, and returns
+ * false for everything else. Variables and constants are read directly
+ * rather than through evaluate, since they make up half of every formula.
+ */
+
+inline bool LangExpression::evalLeaf(const LangExpression *node, LangEvaluationContext& context, bool& value) {
+    if (node->hashConsed && node->memoEpoch == context.getBindingEpoch()) {
+        value = node->memoValue;
+        return true;
+    }
+    switch (node->type) {
+    case RefEXP: {
+        SymbolId symbol = static_cast<const RefExp *>(node)->symbol;
+        if (!context.isDefined(symbol)) node->evaluate(context);
+        value = context.getValue(symbol);
+        return true;
+    }
+    case BoolEXP:
+        value = static_cast<const BoolExp *>(node)->value;
+        return true;
+    case NullEXP:
+        value = node->evaluate(context);
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Implementation notes: evalNested
+ * --------------------------------
+ * Ordinary formulas are shallow, and for them a plain recursive walk is
+ * the fastest, so eval recurses for up to kMaxEvalRecursion levels and
+ * only then hands the rest of that subtree to evalFrames. The recursion
+ * therefore uses a bounded amount of the machine stack however deep the
+ * formula is. A let pops its own scope if its body raises an error.
+ */
+
+static const int kMaxEvalRecursion = 512;
+
+/* Values of and, or, imp and iff, indexed by 2 * first + second. */
+static const bool kTruthTables[4][4] = {
+    { false, false, false, true },
+    { false, true, true, true },
+    { true, true, false, true },
+    { true, false, false, true }
+};
+
+bool LangExpression::eval(LangEvaluationContext& context) const {
+    STATS_PHASE(EVAL_PHASE);
+    return evalNested(this, context, kMaxEvalRecursion);
+}
+
+bool LangExpression::evalNested(const LangExpression *node, LangEvaluationContext& context, int budget) {
+    bool value;
+    if (evalLeaf(node, context, value)) return value;
+    if (budget == 0) return node->evalFrames(context);
+    uint64_t epoch = context.getBindingEpoch();
+    switch (node->type) {
+    case NotEXP:
+        value = !evalNested(static_cast<const NotExp *>(node)->toNegate, context, budget - 1);
+        break;
+    case LetEXP: {
+        const LetExp *let = static_cast<const LetExp *>(node);
+        context.pushBinding(let->variable, evalNested(let->binding, context, budget - 1));
+        try {
+            value = evalNested(let->body, context, budget - 1);
+        } catch (ErrorException& ex) {
+            context.popBinding();
+            throw;
+        }
+        context.popBinding();
+        break;
+    }
+    case SetEXP: {
+        const SetExp *set = static_cast<const SetExp *>(node);
+        value = evalNested(set->binding, context, budget - 1);
+        context.setValue(set->variable, value);
+        break;
+    }
+    case NaryAndEXP: case NaryOrEXP: {
+        const NaryExp *nary = static_cast<const NaryExp *>(node);
+        bool unit = node->type == NaryAndEXP;
+        value = unit;
+        for (int i = 0; i < nary->count; i++) {
+            if (evalNested(nary->operands[i], context, budget - 1) == unit) continue;
+            value = !unit;
+            if (context.isStrictEvaluation()) continue;
+            if (i + 1 < nary->count) context.countSkippedSubtrees();
+            break;
+        }
+        break;
+    }
+    case NaryIffEXP: case NaryXorEXP: {
+        const NaryExp *nary = static_cast<const NaryExp *>(node);
+        value = evalNested(nary->operands[0], context, budget - 1);
+        for (int i = 1; i < nary->count; i++) {
+            bool operand = evalNested(nary->operands[i], context, budget - 1);
+            value = node->type == NaryIffEXP ? value == operand : value != operand;
+        }
+        break;
+    }
+    default: {
+        const BinaryExp *binary = static_cast<const BinaryExp *>(node);
+        bool first = evalNested(binary->first, context, budget - 1);
+        LangExpressionType type = node->type;
+        if (type != IffEXP && first == (type == OrEXP) && !context.isStrictEvaluation()) {
+            context.countSkippedSubtrees();
+            value = first || type == ImpEXP;
+        } else {
+            bool second = evalNested(binary->second, context, budget - 1);
+            value = kTruthTables[type - AndEXP][2 * first + second];
+        }
+    }
+    }
+    if (node->hashConsed && context.getBindingEpoch() == epoch) {
+        node->memoValue = value;
+        node->memoEpoch = epoch;
+    }
+    return value;
+}
+
+bool LangExpression::evalFrames(LangEvaluationContext& context) const {
+    struct Frame {
+        const LangExpression *node;
+        LangExpressionType type;
+        bool firstDone;
+        bool firstValue;
+        uint64_t epoch;
+        int next;
+    };
+    static thread_local vector<Frame> frameStack;
+    vector<Frame>& frames = frameStack;
+    size_t base = frames.size();
+    int scopeDepth = context.getScopeDepth();
+    bool strict = context.isStrictEvaluation();
+    const LangExpression *node = this;
+    bool value;
+    try {
+        while (true) {
+            while (!evalLeaf(node, context, value)) {
+                LangExpressionType type = node->type;
+                frames.push_back({node, type, false, false, context.getBindingEpoch(), 0});
+                if (type == NotEXP) node = static_cast<const NotExp *>(node)->toNegate;
+                else if (type == LetEXP) node = static_cast<const LetExp *>(node)->binding;
+                else if (type == SetEXP) node = static_cast<const SetExp *>(node)->binding;
+                else if (type >= NaryAndEXP) node = static_cast<const NaryExp *>(node)->operands[0];
+                else node = static_cast<const BinaryExp *>(node)->first;
+            }
+            node = nullptr;
+            while (frames.size() > base) {
+                Frame& frame = frames.back();
+                if (frame.type >= NaryAndEXP) {
+                    node = foldOperands(static_cast<const NaryExp *>(frame.node), frame.next,
+                                        frame.firstValue, value, context);
+                    if (node != nullptr) break;
+                } else {
+                    bool complete = frame.firstDone;
+                    if (!frame.firstDone) {
+                        frame.firstDone = true;
+                        frame.firstValue = value;
+                        const LangExpression *next = nullptr;
+                        switch (frame.type) {
+                        case NotEXP:
+                            value = !value;
+                            break;
+                        case AndEXP: case OrEXP: case ImpEXP:
+                            if ((frame.type == OrEXP ? value : !value) && !strict) {
+                                context.countSkippedSubtrees();
+                                value = frame.type != AndEXP;
+                            } else {
+                                next = static_cast<const BinaryExp *>(frame.node)->second;
+                            }
+                            break;
+                        case IffEXP:
+                            next = static_cast<const BinaryExp *>(frame.node)->second;
+                            break;
+                        case LetEXP: {
+                            const LetExp *let = static_cast<const LetExp *>(frame.node);
+                            context.pushBinding(let->variable, value);
+                            next = let->body;
+                            break;
+                        }
+                        default:
+                            context.setValue(static_cast<const SetExp *>(frame.node)->variable, value);
+                            break;
+                        }
+                        if (next != nullptr) {
+                            if (!evalLeaf(next, context, value)) {
+                                node = next;
+                                break;
+                            }
+                            complete = true;
+                        }
+                    }
+                    if (complete) {
+                        switch (frame.type) {
+                        case AndEXP: value = frame.firstValue && value; break;
+                        case OrEXP: value = frame.firstValue || value; break;
+                        case ImpEXP: value = !frame.firstValue || value; break;
+                        case IffEXP: value = frame.firstValue == value; break;
+                        default: context.popBinding(); break;
+                        }
+                    }
+                }
+                const LangExpression *done = frame.node;
+                if (done->hashConsed && context.getBindingEpoch() == frame.epoch) {
+                    done->memoValue = value;
+                    done->memoEpoch = frame.epoch;
+                }
+                frames.pop_back();
+            }
+            if (node == nullptr) return value;
+        }
+    } catch (ErrorException& ex) {
+        frames.resize(base);
+        while (context.getScopeDepth() > scopeDepth) context.popBinding();
+        throw;
+    }
+}
+
+/**
+ * Implementation notes: foldOperands
+ * ----------------------------------
+ * Folds value, the value of the operand at index next, into what the
+ * operands before it came to, and moves next on. Returns the following
+ * operand if it needs evaluating with frames of its own, and otherwise
+ * nullptr with the connective's value in value, once the last operand has
+ * been folded in or, outside strict evaluation, an operand of an and or
+ * an or has decided the result early.
+ */
+
+const LangExpression *LangExpression::foldOperands(const NaryExp *nary, int& next, bool& folded, bool& value,
+                                                   LangEvaluationContext& context) {
+    LangExpressionType type = nary->type;
+    bool unit = type == NaryAndEXP;
+    while (true) {
+        int index = next++;
+        if (type == NaryAndEXP || type == NaryOrEXP) {
+            if (index == 0) folded = unit;
+            if (value != unit) {
+                folded = !unit;
+                if (!context.isStrictEvaluation()) {
+                    if (next < nary->count) context.countSkippedSubtrees();
+                    value = folded;
+                    return nullptr;
+                }
+            }
+        } else if (index == 0) {
+            folded = value;
+        } else {
+            folded = type == NaryIffEXP ? folded == value : folded != value;
+        }
+        if (next == nary->count) {
+            value = folded;
+            return nullptr;
+        }
+        const LangExpression *operand = nary->operands[next];
+        if (!evalLeaf(operand, context, value)) return operand;
+    }
+}
+
+bool LangExpression::evaluate(LangEvaluationContext& context) const {
+    error("evaluate: Illegal LangExpression type.");
+    return false;
+}
+
+/**
+ * Implementation notes: deleteChildren
+ * ------------------------------------
+ * A destructor that deleted its children directly would recurse once per
+ * level of the tree. Instead, children go onto a per-thread list, and only
+ * the outermost call deletes them, one at a time; the destructors it runs
+ * add their own children to the same list and return at once. The list
+ * grows with the width of the tree and the native stack not at all.
+ */
+
+void LangExpression::deleteChildren(LangExpression *first, LangExpression *second) {
+    static thread_local vector<LangExpression *> pending;
+    static thread_local bool deleting = false;
+    if (first != nullptr) pending.push_back(first);
+    if (second != nullptr) pending.push_back(second);
+    if (deleting) return;
+    deleting = true;
+    while (!pending.empty()) {
+        LangExpression *node = pending.back();
+        pending.pop_back();
+        delete node;
+    }
+    deleting = false;
+}
+
+string LangExpression::getSymbolName() const {
+    error("getSymbolName: Illegal LangExpression type.");
+    return "";
+}
+
+bool LangExpression::getBoolValue() const {
+    error("getBoolValue: Illegal LangExpression type.");
+    return false;
+}
+
+LangExpression *LangExpression::getOperand() const {
+    error("getOperand: Illegal LangExpression type.");
+    return nullptr;
+}
+
+SymbolId LangExpression::getSymbolId() const {
+    error("getSymbolId: Illegal LangExpression type.");
+    return kNoSymbol;
+}
+
+LangExpression *LangExpression::getFirst() const {
+    error("getFirst: Illegal LangExpression type.");
+    return nullptr;
+}
+
+LangExpression *LangExpression::getSecond() const {
+    error("getSecond: Illegal LangExpression type.");
+    return nullptr;
+}
+
+string LangExpression::getVariable() const {
+    error("getVariable: Illegal LangExpression type.");
+    return "";
+}
+
+SymbolId LangExpression::getVariableId() const {
+    error("getVariableId: Illegal LangExpression type.");
+    return kNoSymbol;
+}
+
+LangExpression *LangExpression::getBinding() const {
+    error("getBinding: Illegal LangExpression type.");
+    return nullptr;
+}
+
+LangExpression *LangExpression::getBody() const {
+    error("getBody: Illegal LangExpression type.");
+    return nullptr;
+}
+
+int LangExpression::getOperandCount() const {
+    error("getOperandCount: Illegal LangExpression type.");
+    return 0;
+}
+
+LangExpression *const *LangExpression::getOperands() const {
+    error("getOperands: Illegal LangExpression type.");
+    return nullptr;
+}
+
+bool LangExpression::ownsChildren() const {
+    return childrenOwned;
+}
+
+void LangExpression::setOwnsChildren(bool owns) {
+    childrenOwned = owns;
+}
+
+bool LangExpression::isHashConsed() const {
+    return hashConsed;
+}
+
+void LangExpression::setHashConsed(bool hashConsed) {
+    this->hashConsed = hashConsed;
+}
+
+#ifdef LFL_STATS
+
+void *LangExpression::operator new(size_t size) {
+    void *node = ::operator new(size);
+    STATS_TREE_BYTES(size);
+    return node;
+}
+
+void LangExpression::operator delete(void *node, size_t size) {
+    STATS_TREE_BYTES(-static_cast<int64_t>(size));
+    ::operator delete(node);
+}
+
+#endif
+
 /**
  * Implementation notes: RefExp
  * -------------------------------
  * TODO
  */
 
-RefExp::RefExp(const string& name) {
-    this->name = name;
+RefExp::RefExp(const string& name) : LangExpression(RefEXP) {
+    this->symbol = globalSymbols().intern(name);
+}
+
+RefExp::RefExp(SymbolId symbol) : LangExpression(RefEXP) {
+    this->symbol = symbol;
 }
 
 string RefExp::toString() const {
-    return "RefExp(" + name + ")";
+    return "RefExp(" + getSymbolName() + ")";
+}
+
+bool RefExp::evaluate(LangEvaluationContext& context) const {
+    if (!context.isDefined(symbol)) error("EVALUATION ERROR >> undefined symbol: " + getSymbolName());
+    return context.getValue(symbol);
 }
 
-LangExpressionType RefExp::getType() const {
-    return LangExpressionType::RefEXP;
+string RefExp::getSymbolName() const {
+    return globalSymbols().nameOf(symbol);
 }
 
-bool RefExp::eval(LangEvaluationContext& context) const {
-    if (!context.isDefined(name)) error("EVALUATION ERROR >> undefined symbol: " + name);
-    return context.getValue(name);
+SymbolId RefExp::getSymbolId() const {
+    return symbol;
 }
 
 
@@ -55,7 +485,7 @@ bool RefExp::eval(LangEvaluationContext& context) const {
  * TODO
  */
 
-BoolExp::BoolExp(const bool& value) {
+BoolExp::BoolExp(const bool& value) : LangExpression(BoolEXP) {
     this->value = value;
 }
 
@@ -63,11 +493,11 @@ string BoolExp::toString() const {
     return "BoolExp(" + boolToString(value) + ")";
 }
 
-LangExpressionType BoolExp::getType() const {
-    return LangExpressionType::BoolEXP;
+bool BoolExp::evaluate(LangEvaluationContext& context) const {
+    return value;
 }
 
-bool BoolExp::eval(LangEvaluationContext& context) const {
+bool BoolExp::getBoolValue() const {
     return value;
 }
 
@@ -77,181 +507,188 @@ bool BoolExp::eval(LangEvaluationContext& context) const {
  * TODO
  */
 
-NotExp::NotExp(LangExpression *toNegate) {
+NotExp::NotExp(LangExpression *toNegate) : LangExpression(NotEXP) {
     this->toNegate = toNegate;
 }
 
 NotExp::~NotExp() {
-    delete toNegate;
+    if (!ownsChildren()) return;
+    deleteChildren(toNegate);
 }
 
 string NotExp::toString() const {
-    return "NotExp(" + toNegate->toString() + ")";
-}
-
-LangExpressionType NotExp::getType() const {
-    return LangExpressionType::NotEXP;
+    return printTree(this);
 }
 
-bool NotExp::eval(LangEvaluationContext& context) const {
-    return !(toNegate->eval(context));
+LangExpression *NotExp::getOperand() const {
+    return toNegate;
 }
 
 /**
- * Implementation notes: AndExp
+ * Implementation notes: BinaryExp
  * -------------------------------
- * TODO
+ * The subclasses only choose the type. Everything that tells the
+ * connectives apart lives in eval and printTree, which switch on it.
  */
 
-AndExp::AndExp(LangExpression *first, LangExpression *second) {
+BinaryExp::BinaryExp(LangExpressionType type, LangExpression *first, LangExpression *second)
+        : LangExpression(type) {
     this->first = first;
     this->second = second;
 }
 
-AndExp::~AndExp() {
-    delete first;
-    delete second;
+BinaryExp::~BinaryExp() {
+    if (!ownsChildren()) return;
+    deleteChildren(first, second);
 }
 
-string AndExp::toString() const {
-    return "AndExp(" + first->toString() + ", " + second->toString() + ")";
+string BinaryExp::toString() const {
+    return printTree(this);
 }
 
-LangExpressionType AndExp::getType() const {
-    return LangExpressionType::AndEXP;
+LangExpression *BinaryExp::getFirst() const {
+    return first;
 }
 
-bool AndExp::eval(LangEvaluationContext& context) const {
-    bool firstValue = first->eval(context);
-    bool secondValue = second->eval(context);
-    return firstValue && secondValue;
+LangExpression *BinaryExp::getSecond() const {
+    return second;
 }
 
 /**
- * Implementation notes: OrExp
+ * Implementation notes: AndExp
  * -------------------------------
- * TODO
+ * Unless the context asks for strict evaluation, eval skips the second
+ * operand when the first is false, and counts the skip in the context.
  */
 
-OrExp::OrExp(LangExpression *first, LangExpression *second) {
-    this->first = first;
-    this->second = second;
-}
-
-OrExp::~OrExp() {
-    delete first;
-    delete second;
-}
-
-string OrExp::toString() const {
-    return "OrExp(" + first->toString() + ", " + second->toString() + ")";
+AndExp::AndExp(LangExpression *first, LangExpression *second) : BinaryExp(AndEXP, first, second) {
+    /* Empty */
 }
 
-LangExpressionType OrExp::getType() const {
-    return LangExpressionType::OrEXP;
-}
+/**
+ * Implementation notes: OrExp
+ * -------------------------------
+ * Outside strict evaluation, a true first operand decides the result and
+ * eval skips the second operand.
+ */
 
-bool OrExp::eval(LangEvaluationContext& context) const {
-    bool firstValue = first->eval(context);
-    bool secondValue = second->eval(context);
-    return firstValue || secondValue;
+OrExp::OrExp(LangExpression *first, LangExpression *second) : BinaryExp(OrEXP, first, second) {
+    /* Empty */
 }
 
 /**
  * Implementation notes: ImpExp
  * -------------------------------
- * TODO
+ * Outside strict evaluation, a false antecedent makes the implication true
+ * without evaluating the consequent.
  */
 
-ImpExp::ImpExp(LangExpression *first, LangExpression *second) {
-    this->first = first;
-    this->second = second;
-}
-
-ImpExp::~ImpExp() {
-    delete first;
-    delete second;
-}
-
-string ImpExp::toString() const {
-    return "ImpExp(" + first->toString() + ", " + second->toString() + ")";
+ImpExp::ImpExp(LangExpression *first, LangExpression *second) : BinaryExp(ImpEXP, first, second) {
+    /* Empty */
 }
 
-LangExpressionType ImpExp::getType() const {
-    return LangExpressionType::ImpEXP;
-}
+/**
+ * Implementation notes: IffExp
+ * -------------------------------
+ * TODO
+ */
 
-bool ImpExp::eval(LangEvaluationContext& context) const {
-    bool firstValue = first->eval(context);
-    bool secondValue = second->eval(context);
-    return (!firstValue) || secondValue;
+IffExp::IffExp(LangExpression *first, LangExpression *second) : BinaryExp(IffEXP, first, second) {
+    /* Empty */
 }
 
 /**
- * Implementation notes: IffExp
+ * Implementation notes: NaryExp
  * -------------------------------
- * TODO
+ * The constructor copies the operands into an array of its own, taken
+ * from the arena when the node is made in one, so that the array goes
+ * away with the arena, and from the heap otherwise, in which case the
+ * destructor frees it.
  */
 
-IffExp::IffExp(LangExpression *first, LangExpression *second) {
-    this->first = first;
-    this->second = second;
+NaryExp::NaryExp(LangExpressionType type, LangExpression *const operands[], int count, ExpressionArena *arena)
+        : LangExpression(type) {
+    if (count < 2) error("NaryExp: An n-ary connective needs at least two operands.");
+    size_t bytes = count * sizeof(LangExpression *);
+    if (arena != nullptr) {
+        this->operands = static_cast<LangExpression **>(arena->allocate(bytes, alignof(LangExpression *)));
+    } else {
+        this->operands = new LangExpression *[count];
+        STATS_TREE_BYTES(bytes);
+    }
+    for (int i = 0; i < count; i++) this->operands[i] = operands[i];
+    this->count = count;
+    arrayOnHeap = arena == nullptr;
 }
 
-IffExp::~IffExp() {
-    delete first;
-    delete second;
+NaryExp::~NaryExp() {
+    if (ownsChildren()) {
+        for (int i = 0; i < count; i++) deleteChildren(operands[i]);
+    }
+    if (!arrayOnHeap) return;
+    delete[] operands;
+    STATS_TREE_BYTES(-static_cast<int64_t>(count * sizeof(LangExpression *)));
 }
 
-string IffExp::toString() const {
-    return "IffExp(" + first->toString() + ", " + second->toString() + ")";
+string NaryExp::toString() const {
+    return printTree(this);
 }
 
-LangExpressionType IffExp::getType() const {
-    return LangExpressionType::IffEXP;
+int NaryExp::getOperandCount() const {
+    return count;
 }
 
-bool IffExp::eval(LangEvaluationContext& context) const {
-    bool firstValue = first->eval(context);
-    bool secondValue = second->eval(context);
-    return (firstValue || (!secondValue)) && ((!firstValue) || secondValue);
+LangExpression *const *NaryExp::getOperands() const {
+    return operands;
 }
 
 /**
  * Implementation notes: LetExp
  * -------------------------------
- * TODO
+ * eval evaluates the body inside a scope pushed onto the context, and pops
+ * the scope on the way out even when the body raises an error, so the
+ * variable always gets back whatever binding it had outside the let.
  */
 
 LetExp::LetExp(const string& variable,
                LangExpression * binding,
-               LangExpression *body) {
+               LangExpression *body) : LangExpression(LetEXP) {
+    this->variable = globalSymbols().intern(variable);
+    this->binding = binding;
+    this->body = body;
+}
+
+LetExp::LetExp(SymbolId variable,
+               LangExpression *binding,
+               LangExpression *body) : LangExpression(LetEXP) {
     this->variable = variable;
     this->binding = binding;
     this->body = body;
 }
 
 LetExp::~LetExp() {
-    delete binding;
-    delete body;
+    if (!ownsChildren()) return;
+    deleteChildren(binding, body);
 }
 
 string LetExp::toString() const {
-    return "LetExp((" + variable + " = " +
-            binding->toString() + ") in (" +
-            body->toString() + "))";
+    return printTree(this);
+}
+
+string LetExp::getVariable() const {
+    return globalSymbols().nameOf(variable);
 }
 
-LangExpressionType LetExp::getType() const {
-    return LangExpressionType::LetEXP;
+SymbolId LetExp::getVariableId() const {
+    return variable;
 }
 
-bool LetExp::eval(LangEvaluationContext& context) const {
-    bool bindingValue = binding->eval(context);
-    context.setValue(variable, bindingValue);
-    bool bodyValue = body->eval(context);
-    context.removeValue(variable);
-    return bodyValue;
+LangExpression *LetExp::getBinding() const {
+    return binding;
+}
+
+LangExpression *LetExp::getBody() const {
+    return body;
 }
 
 /**
@@ -260,28 +697,35 @@ bool LetExp::eval(LangEvaluationContext& context) const {
  * TODO
  */
 
-SetExp::SetExp(const std::string& variable, LangExpression *binding) {
+SetExp::SetExp(const std::string& variable, LangExpression *binding) : LangExpression(SetEXP) {
+    this->variable = globalSymbols().intern(variable);
+    this->binding = binding;
+}
+
+SetExp::SetExp(SymbolId variable, LangExpression *binding) : LangExpression(SetEXP) {
     this->variable = variable;
     this->binding = binding;
 }
 
 SetExp::~SetExp() {
-    delete binding;
+    if (!ownsChildren()) return;
+    deleteChildren(binding);
 }
 
 string SetExp::toString() const {
-    return "SetExp(" + variable + " = " +
-            binding->toString() + ")";
+    return printTree(this);
 }
 
-LangExpressionType SetExp::getType() const {
-    return LangExpressionType::SetEXP;
+string SetExp::getVariable() const {
+    return globalSymbols().nameOf(variable);
 }
 
-bool SetExp::eval(LangEvaluationContext& context) const {
-    bool bindingValue = binding->eval(context);
-    context.setValue(variable, bindingValue);
-    return bindingValue;
+SymbolId SetExp::getVariableId() const {
+    return variable;
+}
+
+LangExpression *SetExp::getBinding() const {
+    return binding;
 }
 
 
@@ -291,7 +735,7 @@ bool SetExp::eval(LangEvaluationContext& context) const {
  * TODO
  */
 
-NullExp::NullExp() {
+NullExp::NullExp() : LangExpression(NullEXP) {
     /* Empty */
 }
 
@@ -299,33 +743,210 @@ string NullExp::toString() const {
     return "NullExp()";
 }
 
-LangExpressionType NullExp::getType() const {
-    return LangExpressionType::NullEXP;
-}
-
-bool NullExp::eval(LangEvaluationContext& context) const {
+bool NullExp::evaluate(LangEvaluationContext& context) const {
     error("EVALUATION ERROR >> Attempted null evaluation.");
 }
 
 /**
  * Implementation notes: LangEvaluationContext
  * ---------------------------------------
- * The methods in the LangEvaluationContext class simply call the appropriate
- * method on the map used to represent the symbol table.
+ * Each binding is one byte in an array indexed by SymbolId, so reading or
+ * writing a variable costs one array access once its name is interned.
+ * The array grows on demand to cover the largest id that has been set.
+ * Every change to a binding moves the context to a fresh binding epoch,
+ * drawn from one counter shared by all contexts, so that no two binding
+ * states of any contexts ever carry the same epoch.
  */
 
+LangEvaluationContext::LangEvaluationContext() {
+    strict = false;
+    skippedSubtrees = 0;
+    epoch = nextBindingEpoch();
+}
+
 void LangEvaluationContext::setValue(const string& var, bool value) {
-   symbolTable.put(var, value);
+    setValue(globalSymbols().intern(var), value);
 }
 
 bool LangEvaluationContext::getValue(const string& var) const {
-   return symbolTable.get(var);
+    return getValue(globalSymbols().lookup(var));
 }
 
-void LangEvaluationContext::removeValue(const std::string& var) {
-    symbolTable.remove(var);
+void LangEvaluationContext::removeValue(const string& var) {
+    removeValue(globalSymbols().lookup(var));
 }
 
 bool LangEvaluationContext::isDefined(const string& var) const {
-   return symbolTable.containsKey(var);
+    return isDefined(globalSymbols().lookup(var));
+}
+
+void LangEvaluationContext::setValue(SymbolId var, bool value) {
+    if (static_cast<size_t>(var) >= bindings.size()) bindings.resize(var + 1, UNBOUND);
+    bindings[var] = value ? BOUND_TRUE : BOUND_FALSE;
+    epoch = nextBindingEpoch();
+}
+
+bool LangEvaluationContext::getValue(SymbolId var) const {
+    return isDefined(var) && bindings[var] == BOUND_TRUE;
+}
+
+void LangEvaluationContext::removeValue(SymbolId var) {
+    if (isDefined(var)) bindings[var] = UNBOUND;
+    epoch = nextBindingEpoch();
+}
+
+bool LangEvaluationContext::isDefined(SymbolId var) const {
+    return var >= 0 && static_cast<size_t>(var) < bindings.size() && bindings[var] != UNBOUND;
+}
+
+/**
+ * Implementation notes: pushBinding and popBinding
+ * ------------------------------------------------
+ * Scopes are kept as a stack of saved bindings rather than a chain of
+ * maps. Entering a scope saves the one byte it overwrites and leaving it
+ * writes that byte back, so both are O(1) and a set made inside the scope
+ * to the scoped variable ends with the scope, like the binding itself.
+ * If no binding changed inside the scope, leaving it puts back exactly the
+ * bindings that were there before it, so the epoch from before is restored
+ * as well and values remembered outside the scope stay valid.
+ */
+
+void LangEvaluationContext::pushBinding(SymbolId var, bool value) {
+    if (static_cast<size_t>(var) >= bindings.size()) bindings.resize(var + 1, UNBOUND);
+    SavedBinding saved = { var, bindings[var], epoch, 0 };
+    bindings[var] = value ? BOUND_TRUE : BOUND_FALSE;
+    epoch = nextBindingEpoch();
+    saved.innerEpoch = epoch;
+    scopes.push_back(saved);
+}
+
+void LangEvaluationContext::popBinding() {
+    SavedBinding saved = scopes.back();
+    scopes.pop_back();
+    bindings[saved.var] = saved.binding;
+    epoch = epoch == saved.innerEpoch ? saved.outerEpoch : nextBindingEpoch();
+}
+
+int LangEvaluationContext::getScopeDepth() const {
+    return scopes.size();
+}
+
+uint64_t LangEvaluationContext::getBindingEpoch() const {
+    return epoch;
+}
+
+void LangEvaluationContext::setStrictEvaluation(bool strict) {
+    this->strict = strict;
+}
+
+bool LangEvaluationContext::isStrictEvaluation() const {
+    return strict;
+}
+
+void LangEvaluationContext::countSkippedSubtrees(uint64_t count) {
+    skippedSubtrees += count;
+}
+
+uint64_t LangEvaluationContext::getSkippedSubtrees() const {
+    return skippedSubtrees;
+}
+
+void LangEvaluationContext::resetSkippedSubtrees() {
+    skippedSubtrees = 0;
+}
+
+/**
+ * Implementation notes: nextBindingEpoch
+ * --------------------------------------
+ * Epochs must be unique across every context in the program, including
+ * contexts used by different threads, but taking each one from a shared
+ * atomic counter would make every let contend for one cache line. Each
+ * thread instead reserves a block of epochs at a time and hands them out
+ * locally.
+ */
+
+static const uint64_t kEpochBlockSize = 1024;
+
+uint64_t nextBindingEpoch() {
+    static atomic<uint64_t> reserved(0);
+    static thread_local uint64_t next = 0;
+    static thread_local uint64_t limit = 0;
+    if (next == limit) {
+        next = reserved.fetch_add(kEpochBlockSize, memory_order_relaxed) + 1;
+        limit = next + kEpochBlockSize;
+    }
+    return next++;
+}
+
+/**
+ * Implementation notes: printTree
+ * -------------------------------
+ * Prints the formula in the same format the per-node toString methods
+ * always used, but with an explicit stack. Each entry is either a node
+ * still to print or, when node is nullptr, a piece of punctuation that
+ * closes a node already opened. Entries are pushed in reverse order.
+ */
+
+string printTree(const LangExpression *root) {
+    struct Piece {
+        const LangExpression *node;
+        const char *text;
+    };
+    string result;
+    vector<Piece> pieces;
+    pieces.push_back({root, ""});
+    while (!pieces.empty()) {
+        Piece piece = pieces.back();
+        pieces.pop_back();
+        const LangExpression *node = piece.node;
+        if (node == nullptr) {
+            result += piece.text;
+            continue;
+        }
+        switch (node->getType()) {
+        case NotEXP:
+            result += "NotExp(";
+            pieces.push_back({nullptr, ")"});
+            pieces.push_back({node->getOperand(), ""});
+            break;
+        case AndEXP: case OrEXP: case ImpEXP: case IffEXP:
+            result += node->getType() == AndEXP ? "AndExp("
+                    : node->getType() == OrEXP ? "OrExp("
+                    : node->getType() == ImpEXP ? "ImpExp(" : "IffExp(";
+            pieces.push_back({nullptr, ")"});
+            pieces.push_back({node->getSecond(), ""});
+            pieces.push_back({nullptr, ", "});
+            pieces.push_back({node->getFirst(), ""});
+            break;
+        case NaryAndEXP: case NaryOrEXP: case NaryIffEXP: case NaryXorEXP: {
+            result += node->getType() == NaryAndEXP ? "AndExp("
+                    : node->getType() == NaryOrEXP ? "OrExp("
+                    : node->getType() == NaryIffEXP ? "IffExp(" : "XorExp(";
+            LangExpression *const *operands = node->getOperands();
+            pieces.push_back({nullptr, ")"});
+            for (int i = node->getOperandCount() - 1; i > 0; i--) {
+                pieces.push_back({operands[i], ""});
+                pieces.push_back({nullptr, ", "});
+            }
+            pieces.push_back({operands[0], ""});
+            break;
+        }
+        case LetEXP:
+            result += "LetExp((" + node->getVariable() + " = ";
+            pieces.push_back({nullptr, "))"});
+            pieces.push_back({node->getBody(), ""});
+            pieces.push_back({nullptr, ") in ("});
+            pieces.push_back({node->getBinding(), ""});
+            break;
+        case SetEXP:
+            result += "SetExp(" + node->getVariable() + " = ";
+            pieces.push_back({nullptr, ")"});
+            pieces.push_back({node->getBinding(), ""});
+            break;
+        default:
+            result += node->toString();
+            break;
+        }
+    }
+    return result;
 }
@@ -8,46 +8,113 @@
 #ifndef LANGEXPRESSIONS_H
 #define LANGEXPRESSIONS_H
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 #include "sexpressions.h"
 #include "linkedlist.h"
 #include "vector.h"
 #include "map.h"
+#include "expression-arena.h"
+#include "symbol-table.h"
 
 class LangEvaluationContext;
+class NaryExp;
 
 enum LangExpressionType {
     RefEXP, BoolEXP, NotEXP,
     AndEXP, OrEXP, ImpEXP,
-    IffEXP, LetEXP, SetEXP, NullEXP
+    IffEXP, LetEXP, SetEXP,
+    NaryAndEXP, NaryOrEXP, NaryIffEXP,
+    NaryXorEXP, NullEXP
 };
 
+/**
+ * Class: LangExpression
+ * ---------------------
+ * The base of the expression hierarchy. Callers evaluate an expression
+ * with eval, which recurses only to a fixed depth and continues below it
+ * with an explicit stack, so the depth of a formula is limited only by
+ * memory.
+ * Leaves supply their own value by overriding evaluate. Nodes made by a
+ * LangExpressionFactory are hash-consed: one node may be shared by many
+ * parents, and eval remembers its value for as long as the context it was
+ * computed in keeps the same bindings.
+ */
+
 class LangExpression {
 public:
-    LangExpression();
+    LangExpression(LangExpressionType type);
     virtual ~LangExpression();
     virtual std::string toString() const = 0;
-    virtual LangExpressionType getType() const = 0;
-    virtual bool eval(LangEvaluationContext& context) const = 0;
+    LangExpressionType getType() const;
+    bool eval(LangEvaluationContext& context) const;
+
+    virtual std::string getSymbolName() const;
+    virtual SymbolId getSymbolId() const;
+    virtual bool getBoolValue() const;
+    virtual LangExpression *getOperand() const;
+    virtual LangExpression *getFirst() const;
+    virtual LangExpression *getSecond() const;
+    virtual std::string getVariable() const;
+    virtual SymbolId getVariableId() const;
+    virtual LangExpression *getBinding() const;
+    virtual LangExpression *getBody() const;
+    virtual int getOperandCount() const;
+    virtual LangExpression *const *getOperands() const;
+
+    bool ownsChildren() const;
+    void setOwnsChildren(bool owns);
+    bool isHashConsed() const;
+    void setHashConsed(bool hashConsed);
+
+#ifdef LFL_STATS
+    static void *operator new(std::size_t size);
+    static void operator delete(void *node, std::size_t size);
+#endif
+
+protected:
+    virtual bool evaluate(LangEvaluationContext& context) const;
+    static void deleteChildren(LangExpression *first, LangExpression *second = nullptr);
+
+private:
+    static bool evalLeaf(const LangExpression *node, LangEvaluationContext& context, bool& value);
+    static bool evalNested(const LangExpression *node, LangEvaluationContext& context, int budget);
+    static const LangExpression *foldOperands(const NaryExp *nary, int& next, bool& folded, bool& value,
+                                              LangEvaluationContext& context);
+    bool evalFrames(LangEvaluationContext& context) const;
+
+    LangExpressionType type;
+    bool childrenOwned;
+    bool hashConsed;
+    mutable bool memoValue;
+    mutable uint64_t memoEpoch;
 };
 
 class RefExp : public LangExpression {
 public:
     RefExp(const std::string& name);
+    RefExp(SymbolId symbol);
     virtual std::string toString() const override;
-    virtual LangExpressionType getType() const override;
-    virtual bool eval(LangEvaluationContext& context) const override;
+    virtual std::string getSymbolName() const override;
+    virtual SymbolId getSymbolId() const override;
+protected:
+    virtual bool evaluate(LangEvaluationContext& context) const override;
 private:
-    std::string name;
+    friend class LangExpression;
+    SymbolId symbol;
 };
 
 class BoolExp : public LangExpression {
 public:
     BoolExp(const bool& value);
     virtual std::string toString() const override;
-    virtual LangExpressionType getType() const override;
-    virtual bool eval(LangEvaluationContext& context) const override;
+    virtual bool getBoolValue() const override;
+protected:
+    virtual bool evaluate(LangEvaluationContext& context) const override;
 private:
+    friend class LangExpression;
     bool value;
 };
 
@@ -56,54 +123,77 @@ public:
     NotExp(LangExpression *toNegate);
     virtual ~NotExp() override;
     virtual std::string toString() const override;
-    virtual LangExpressionType getType() const override;
-    virtual bool eval(LangEvaluationContext& context) const override;
+    virtual LangExpression *getOperand() const override;
 private:
+    friend class LangExpression;
     LangExpression *toNegate;
 };
 
-class AndExp : public LangExpression {
+/**
+ * Class: BinaryExp
+ * ----------------
+ * The common base of the four binary connectives, which differ only in
+ * their type and in how eval combines the two operands.
+ */
+
+class BinaryExp : public LangExpression {
 public:
-    AndExp(LangExpression *first, LangExpression *second);
-    virtual ~AndExp() override;
+    BinaryExp(LangExpressionType type, LangExpression *first, LangExpression *second);
+    virtual ~BinaryExp() override;
     virtual std::string toString() const override;
-    virtual LangExpressionType getType() const override;
-    virtual bool eval(LangEvaluationContext& context) const override;
+    virtual LangExpression *getFirst() const override;
+    virtual LangExpression *getSecond() const override;
 private:
+    friend class LangExpression;
     LangExpression *first, *second;
 };
 
-class OrExp : public LangExpression {
+class AndExp : public BinaryExp {
+public:
+    AndExp(LangExpression *first, LangExpression *second);
+};
+
+class OrExp : public BinaryExp {
 public:
     OrExp(LangExpression *first, LangExpression *second);
-    virtual ~OrExp() override;
-    virtual std::string toString() const override;
-    virtual LangExpressionType getType() const override;
-    virtual bool eval(LangEvaluationContext& context) const override;
-private:
-    LangExpression *first, *second;
 };
 
-class ImpExp : public LangExpression {
+class ImpExp : public BinaryExp {
 public:
     ImpExp(LangExpression *first, LangExpression *second);
-    virtual ~ImpExp() override;
-    virtual std::string toString() const override;
-    virtual LangExpressionType getType() const override;
-    virtual bool eval(LangEvaluationContext& context) const override;
-private:
-    LangExpression *first, *second;
 };
 
-class IffExp : public LangExpression {
+class IffExp : public BinaryExp {
 public:
     IffExp(LangExpression *first, LangExpression *second);
-    virtual ~IffExp() override;
+};
+
+/**
+ * Class: NaryExp
+ * --------------
+ * A conjunction, disjunction, biconditional or exclusive or of two or
+ * more operands, kept in one contiguous array rather than as a chain of
+ * binary nodes. The array lives in the same arena as the node, or on the
+ * heap for a heap node. And and or evaluate their operands in order and
+ * stop at the first one that decides the result; iff and xor chain their
+ * operands the way the binary connectives would, so an iff is true when
+ * an even number of its operands are false, and an xor when an odd
+ * number of them are true.
+ */
+
+class NaryExp : public LangExpression {
+public:
+    NaryExp(LangExpressionType type, LangExpression *const operands[], int count,
+            ExpressionArena *arena = nullptr);
+    virtual ~NaryExp() override;
     virtual std::string toString() const override;
-    virtual LangExpressionType getType() const override;
-    virtual bool eval(LangEvaluationContext& context) const override;
+    virtual int getOperandCount() const override;
+    virtual LangExpression *const *getOperands() const override;
 private:
-    LangExpression *first, *second;
+    friend class LangExpression;
+    LangExpression **operands;
+    int count;
+    bool arrayOnHeap;
 };
 
 class LetExp : public LangExpression {
@@ -111,12 +201,18 @@ public:
     LetExp(const std::string& variable,
            LangExpression *binding,
            LangExpression *body);
+    LetExp(SymbolId variable,
+           LangExpression *binding,
+           LangExpression *body);
     virtual ~LetExp() override;
     virtual std::string toString() const override;
-    virtual LangExpressionType getType() const override;
-    virtual bool eval(LangEvaluationContext& context) const override;
+    virtual std::string getVariable() const override;
+    virtual SymbolId getVariableId() const override;
+    virtual LangExpression *getBinding() const override;
+    virtual LangExpression *getBody() const override;
 private:
-    std::string variable;
+    friend class LangExpression;
+    SymbolId variable;
     LangExpression *binding;
     LangExpression *body;
 };
@@ -124,12 +220,15 @@ private:
 class SetExp : public LangExpression {
 public:
     SetExp(const std::string& variable, LangExpression *binding);
+    SetExp(SymbolId variable, LangExpression *binding);
     virtual ~SetExp() override;
     virtual std::string toString() const override;
-    virtual LangExpressionType getType() const override;
-    virtual bool eval(LangEvaluationContext& context) const override;
+    virtual std::string getVariable() const override;
+    virtual SymbolId getVariableId() const override;
+    virtual LangExpression *getBinding() const override;
 private:
-    std::string variable;
+    friend class LangExpression;
+    SymbolId variable;
     LangExpression *binding;
 };
 
@@ -170,18 +269,66 @@ class NullExp : public LangExpression {
 public:
     NullExp();
     virtual std::string toString() const override;
-    virtual LangExpressionType getType() const override;
-    virtual bool eval(LangEvaluationContext& context) const override;
+protected:
+    virtual bool evaluate(LangEvaluationContext& context) const override;
 };
 
+/**
+ * Class: LangEvaluationContext
+ * ----------------------------
+ * The variable bindings visible during evaluation. Bindings are stored in
+ * an array indexed by interned SymbolId; the string methods intern or look
+ * up the name and then use the same array. Scoped bindings made by let are
+ * entered with pushBinding and left with popBinding, which puts back the
+ * binding the variable had before, including an outer binding it shadowed.
+ *
+ * By default and, or and imp stop as soon as their first operand decides
+ * the result, and the context counts how many subtrees were skipped this
+ * way. Strict evaluation always evaluates both operands, for programs that
+ * rely on the side effects of set inside the second one.
+ *
+ * The binding epoch changes whenever any binding does, which is what lets
+ * hash-consed nodes remember their values between changes.
+ */
+
 class LangEvaluationContext {
 public:
+    LangEvaluationContext();
+
     void setValue(const std::string& var, bool value);
     bool getValue(const std::string& var) const;
     void removeValue(const std::string& var);
     bool isDefined(const std::string& var) const;
+
+    void setValue(SymbolId var, bool value);
+    bool getValue(SymbolId var) const;
+    void removeValue(SymbolId var);
+    bool isDefined(SymbolId var) const;
+
+    void pushBinding(SymbolId var, bool value);
+    void popBinding();
+    int getScopeDepth() const;
+    uint64_t getBindingEpoch() const;
+
+    void setStrictEvaluation(bool strict);
+    bool isStrictEvaluation() const;
+    void countSkippedSubtrees(uint64_t count = 1);
+    uint64_t getSkippedSubtrees() const;
+    void resetSkippedSubtrees();
+
 private:
-    Map<std::string, bool> symbolTable;
+    enum Binding : uint8_t { UNBOUND, BOUND_FALSE, BOUND_TRUE };
+    struct SavedBinding {
+        SymbolId var;
+        uint8_t binding;
+        uint64_t outerEpoch;
+        uint64_t innerEpoch;
+    };
+    std::vector<uint8_t> bindings;
+    std::vector<SavedBinding> scopes;
+    bool strict;
+    uint64_t skippedSubtrees;
+    uint64_t epoch;
 };
 
 #endif // LANGEXPRESSIONS_H
@@ -1,41 +1,321 @@
-
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
 #include "console.h"
 #include "error.h"
 #include "sexpressions.h"
 #include "langexpressions.h"
 #include "sexpression-parser.h"
 #include "langexpression-parser.h"
-#include "tokenscanner.h"
+#include "langexpression-simplifier.h"
+#include "langexpression-factory.h"
+#include "expression-arena.h"
+#include "repl-commands.h"
+#include "formula-registry.h"
+#include "batch-runner.h"
+#include "mapped-file.h"
+#include "pipeline-stats.h"
+#include "formula-image.h"
+#include "assignment-batch.h"
+#include "strlib.h"
 
 using namespace std;
 
-int main() {
+static int runBatch(LangEvaluationContext& context, const BatchOptions& options, const string& path,
+                    uint64_t *errors = nullptr);
+static int runBatchInput(BatchRunner& runner, const string& path);
+static int writeImage(LangEvaluationContext& context, BatchOptions& options,
+                      const string& path, const string& imagePath);
+static int runImage(LangEvaluationContext& context, const BatchOptions& options, const string& imagePath);
+static string findImageConflict(const BatchOptions& options, const string& writeImagePath,
+                                const string& assignmentsPath);
+static int writeAssignments(const AssignmentBatch& assignments, const string& path);
+
+int main(int argc, char *argv[]) {
     LangEvaluationContext context;
-    TokenScanner scanner;
+    // Pass --arena to allocate each line's trees in one arena that is released in bulk,
+    // and --strict to evaluate both operands of and, or and imp even when the first decides.
+    // Pass --batch, or the name of a file, to evaluate a whole stream of formulas without
+    // the REPL; --print-sexp and --print-lexp add the parse dumps to the batch output,
+    // and --threads N evaluates it on N threads, or on one per core when N is 0.
+    // Pass --hash-cons to build each formula as a DAG in which every repeated subterm is one
+    // shared node, kept across formulas, in the REPL or in batch mode.
+    // Pass --simplify to fold constants and trivial patterns out of each formula before
+    // evaluating it, and --stats or --stats=json to report on exit where the time and
+    // memory went, in a build with LFL_STATS defined.
+    // Pass --write-image FILE to store the batch input's formulas in a binary image
+    // instead of evaluating them, and --image FILE to evaluate such an image in batch mode;
+    // --image refuses the options that parse, simplify, split up or re-store the input.
+    // Pass --assignments FILE to evaluate each batch formula on every row of a CSV or binary
+    // assignment batch, and with --write-assignments FILE to store that batch in binary instead.
+    bool useArena = false;
+    bool batch = false;
+    BatchOptions options = { false, false, false, false, 1, nullptr, nullptr };
+    string path = "-";
+    string writeImagePath;
+    string imagePath;
+    string assignmentsPath;
+    string writeAssignmentsPath;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--arena") useArena = true;
+        else if (arg == "--strict") context.setStrictEvaluation(true);
+        else if (arg == "--batch") batch = true;
+        else if (arg == "--print-sexp") options.printSExp = true;
+        else if (arg == "--print-lexp") options.printLangExp = true;
+        else if (arg == "--simplify") options.simplify = true;
+        else if (arg == "--hash-cons") options.hashCons = true;
+        else if (arg == "--stats") reportPipelineStatsAtExit(false);
+        else if (arg == "--stats=json") reportPipelineStatsAtExit(true);
+        else if (arg == "--write-image" && i + 1 < argc) writeImagePath = argv[++i];
+        else if (arg == "--image" && i + 1 < argc) imagePath = argv[++i];
+        else if (arg == "--assignments" && i + 1 < argc) assignmentsPath = argv[++i];
+        else if (arg == "--write-assignments" && i + 1 < argc) writeAssignmentsPath = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = stringToInteger(argv[++i]);
+            if (options.threads <= 0) options.threads = max(1u, thread::hardware_concurrency());
+        }
+        else if (arg.substr(0, 2) != "--") {
+            batch = true;
+            path = arg;
+        }
+    }
+    if (!imagePath.empty()) {
+        string conflict = findImageConflict(options, writeImagePath, assignmentsPath);
+        if (!conflict.empty()) {
+            cerr << "Error: --image cannot be combined with " << conflict << endl;
+            return 1;
+        }
+    }
+    if (!writeAssignmentsPath.empty() && assignmentsPath.empty()) {
+        cerr << "Error: --write-assignments needs an assignment batch to write; pass --assignments FILE" << endl;
+        return 1;
+    }
+    AssignmentBatch assignments;
+    if (!assignmentsPath.empty()) {
+        try {
+            assignments.readFile(assignmentsPath);
+        } catch (ErrorException& ex) {
+            cerr << "Error: " << ex.getMessage() << endl;
+            return 1;
+        }
+        if (!writeAssignmentsPath.empty()) return writeAssignments(assignments, writeAssignmentsPath);
+        options.assignments = &assignments;
+        batch = true;
+    }
+    if (!imagePath.empty()) return runImage(context, options, imagePath);
+    if (!writeImagePath.empty()) return writeImage(context, options, path, writeImagePath);
+    if (batch) return runBatch(context, options, path);
+    ExpressionArena arena;
+    ExpressionArena *lineArena = useArena ? &arena : nullptr;
+    LangExpressionFactory factory;
+    FormulaRegistry registry(context);
     SExpression *sexp;
-    scanner.ignoreWhitespace();
+    LangExpression *lexp;
+    bool lexpShared;
     while (true) {
         sexp = nullptr;
+        lexp = nullptr;
+        lexpShared = false;
         try {
             string response;
             cout << endl << "LPL REPL >> ";
             getline(cin, response);
             if (response == "quit") break;
-            scanner.setInput(response);
-            SExpression *sexp = parseOneSExp(scanner);
+            STATS_PHASE(RECORD_PHASE);
+            sexp = parseOneSExp(response, lineArena);
             // Comment out the following line to skip viewing the parsed S-expression
             cout << sexp->toString() << endl;
-            LangExpression *lexp = parseLangExp(sexp);
-            // Comment out the following line to skip viewing the unevaluated logic expression
-            cout << lexp->toString() << endl;
-            bool value = lexp->eval(context);
-            cout << boolToString(value) << endl;
+            if (!runReplCommand(sexp, context, &registry, cout)) {
+                if (options.hashCons) {
+                    lexp = parseLangExp(sexp, factory);
+                    lexpShared = true;
+                } else {
+                    lexp = parseLangExp(sexp, lineArena);
+                }
+                if (options.simplify) {
+                    uint64_t removedNodes;
+                    LangExpression *simplified = simplifyLangExp(lexp, removedNodes, lineArena, &context);
+                    if (!useArena && !lexpShared) delete lexp;
+                    lexp = simplified;
+                    lexpShared = false;
+                    cout << removedNodes << " nodes removed by simplification" << endl;
+                }
+                // Comment out the following line to skip viewing the unevaluated logic expression
+                cout << lexp->toString() << endl;
+                bool value = lexp->eval(context);
+                cout << boolToString(value) << endl;
+            }
         } catch (ErrorException ex) {
             cerr << "Error: " << ex.getMessage() << endl;
         }
-        if (sexp != nullptr) delete sexp;
+        if (useArena) {
+            arena.reset();
+        } else {
+            if (sexp != nullptr) delete sexp;
+            if (lexp != nullptr && !lexpShared) delete lexp;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Function: runBatch
+ * Usage: return runBatch(context, options, path);
+ * -------------------------------------------
+ * Evaluates every formula in the file, or in standard input when the path
+ * is -, and returns the program's exit status. When errors is not null,
+ * it is set to the number of formulas whose result was an error.
+ */
+
+int runBatch(LangEvaluationContext& context, const BatchOptions& options, const string& path,
+             uint64_t *errors) {
+    ios::sync_with_stdio(false);
+    BatchRunner runner(context, cout, options);
+    int status = runBatchInput(runner, path);
+    if (errors != nullptr) *errors = runner.getErrorCount();
+    return status;
+}
+
+/**
+ * Function: runBatchInput
+ * Usage: int status = runBatchInput(runner, path);
+ * -------------------------------------------
+ * Feeds the batch input at path, or standard input for "-", to runner,
+ * and returns the program's exit status. A file is mapped into memory and
+ * lexed in place when possible, and read as a stream when it cannot be
+ * mapped, as with a named pipe.
+ */
+
+int runBatchInput(BatchRunner& runner, const string& path) {
+    if (path == "-") {
+        runner.runStream(cin);
+        return 0;
+    }
+    MappedFile *file = nullptr;
+    try {
+        file = new MappedFile(path);
+    } catch (ErrorException& ex) {
+        file = nullptr;
+    }
+    if (file != nullptr) {
+        runner.runBuffer(file->begin(), file->end());
+        delete file;
+        return 0;
+    }
+    ifstream in(path, ios::binary);
+    if (!in) {
+        cerr << "Error: cannot open " << path << endl;
+        return 1;
+    }
+    runner.runStream(in);
+    return 0;
+}
+
+/**
+ * Function: writeImage
+ * Usage: return writeImage(context, options, path, imagePath);
+ * -------------------------------------------
+ * Reads the batch input as runBatch does, but stores every formula in a
+ * binary image at imagePath instead of evaluating it. Formulas that fail
+ * to parse, and commands, print the usual error lines, and then no image
+ * is written at all: leaving them out would renumber every formula after
+ * them, so that --image would print different numbers for the same input.
+ */
+
+int writeImage(LangEvaluationContext& context, BatchOptions& options,
+               const string& path, const string& imagePath) {
+    FormulaImageWriter writer;
+    options.image = &writer;
+    uint64_t errors;
+    int status = runBatch(context, options, path, &errors);
+    if (status != 0) return status;
+    if (errors != 0) {
+        cerr << "Error: the input has errors, so no image was written to " << imagePath << endl;
+        return 1;
+    }
+    try {
+        writer.writeFile(imagePath);
+    } catch (ErrorException& ex) {
+        cerr << "Error: " << ex.getMessage() << endl;
+        return 1;
+    }
+    cerr << writer.getFormulaCount() << " formulas written to " << imagePath << endl;
+    return 0;
+}
+
+/**
+ * Function: runImage
+ * Usage: return runImage(context, options, imagePath);
+ * -------------------------------------------
+ * Evaluates every formula in a binary image in order, straight from the
+ * mapped file, and prints the same result lines as batch mode.
+ */
+
+int runImage(LangEvaluationContext& context, const BatchOptions& options, const string& imagePath) {
+    ios::sync_with_stdio(false);
+    FormulaImage *image;
+    try {
+        image = new FormulaImage(imagePath);
+    } catch (ErrorException& ex) {
+        cerr << "Error: " << ex.getMessage() << endl;
+        return 1;
+    }
+    for (size_t i = 0; i < image->getFormulaCount(); i++) {
+        try {
+            if (options.printLangExp) {
+                ExpressionArena arena;
+                cout << i + 1 << "\tlexp\t" << image->load(i, &arena)->toString() << '\n';
+            }
+            bool value = image->eval(i, context);
+            cout << i + 1 << '\t' << boolToString(value) << '\n';
+        } catch (ErrorException& ex) {
+            cout << i + 1 << "\terror\t" << ex.getMessage() << '\n';
+        }
+    }
+    delete image;
+    return 0;
+}
+
+/**
+ * Function: findImageConflict
+ * Usage: string conflict = findImageConflict(options, writeImagePath, assignmentsPath);
+ * -------------------------------------------
+ * Returns the first option given with --image that runImage cannot honor,
+ * since an image holds formulas that were parsed and checked when it was
+ * written and is evaluated in order on one thread, or the empty string if
+ * there is none.
+ */
+
+string findImageConflict(const BatchOptions& options, const string& writeImagePath,
+                         const string& assignmentsPath) {
+    if (options.printSExp) return "--print-sexp";
+    if (options.simplify) return "--simplify";
+    if (options.hashCons) return "--hash-cons";
+    if (options.threads != 1) return "--threads";
+    if (!writeImagePath.empty()) return "--write-image";
+    if (!assignmentsPath.empty()) return "--assignments";
+    return "";
+}
+
+/**
+ * Function: writeAssignments
+ * Usage: return writeAssignments(assignments, path);
+ * -------------------------------------------
+ * Stores an assignment batch at path in the binary format, which loads
+ * much faster than CSV, and returns the program's exit status.
+ */
+
+int writeAssignments(const AssignmentBatch& assignments, const string& path) {
+    try {
+        assignments.writeBinaryFile(path);
+    } catch (ErrorException& ex) {
+        cerr << "Error: " << ex.getMessage() << endl;
+        return 1;
     }
+    cerr << assignments.getRowCount() << " rows of " << assignments.getVariableCount()
+         << " variables written to " << path << endl;
     return 0;
 }
@@ -0,0 +1,64 @@
+/**
+ * File: mapped-file.cpp
+ * -------------
+ * This file implements the mapped-file.h interface.
+ */
+
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mapped-file.h"
+#include "error.h"
+using namespace std;
+
+/**
+ * Implementation notes: MappedFile
+ * --------------------------------
+ * The file descriptor is closed as soon as the mapping exists, since the
+ * mapping keeps the file alive by itself. An empty file cannot be mapped
+ * at all and is represented by an empty range instead. The kernel is told
+ * the mapping will be read sequentially, so it reads ahead aggressively
+ * and drops pages behind the reader, which keeps a multi-gigabyte corpus
+ * from crowding everything else out of memory.
+ */
+
+MappedFile::MappedFile(const string& path) {
+    data = nullptr;
+    length = 0;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) error("MAPPING ERROR >> Cannot open " + path);
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        error("MAPPING ERROR >> Not a regular file: " + path);
+    }
+    length = info.st_size;
+    if (length > 0) {
+        void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            error("MAPPING ERROR >> Cannot map " + path);
+        }
+        madvise(mapping, length, MADV_SEQUENTIAL);
+        data = static_cast<const char *>(mapping);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data != nullptr) munmap(const_cast<char *>(data), length);
+}
+
+const char *MappedFile::begin() const {
+    return data;
+}
+
+const char *MappedFile::end() const {
+    return data + length;
+}
+
+size_t MappedFile::size() const {
+    return length;
+}
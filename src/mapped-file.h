@@ -0,0 +1,41 @@
+/**
+ * File: mapped-file.h
+ * -------------
+ * This interface defines a read-only view of a whole file mapped into
+ * memory, so that very large inputs can be lexed in place without being
+ * read into a string first.
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Class: MappedFile
+ * -----------------
+ * Maps a regular file for reading for as long as the object lives. Tokens
+ * and other pointers into the mapping are valid only until it is
+ * destroyed. The constructor raises an error for anything that cannot be
+ * mapped, such as a pipe, so callers can fall back to reading a stream.
+ */
+
+class MappedFile {
+public:
+    MappedFile(const std::string& path);
+    ~MappedFile();
+
+    const char *begin() const;
+    const char *end() const;
+    size_t size() const;
+
+private:
+    const char *data;
+    size_t length;
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,340 @@
+/**
+ * File: pipeline-stats.cpp
+ * -------------
+ * This file implements the pipeline-stats.h interface.
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "pipeline-stats.h"
+#ifdef LFL_STATS
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "sexpressions.h"
+#include "langexpressions.h"
+#endif
+using namespace std;
+
+static bool reportAsJson = false;
+
+static void reportAtExit();
+
+#ifdef LFL_STATS
+
+static const int kSExpTypeCount = NIL + 1;
+static const int kLangExpTypeCount = NullEXP + 1;
+static const int kHistogramBuckets = 48;
+
+static const char *const kSExpTypeNames[kSExpTypeCount] = {
+    "SConstant", "SSymbol", "STrue", "SFalse", "SCons", "SNil"
+};
+static const char *const kLangExpTypeNames[kLangExpTypeCount] = {
+    "RefExp", "BoolExp", "NotExp", "AndExp", "OrExp",
+    "ImpExp", "IffExp", "LetExp", "SetExp", "NaryAndExp",
+    "NaryOrExp", "NaryIffExp", "NaryXorExp", "NullExp"
+};
+static const char *const kPhaseNames[kStatsPhaseCount] = {
+    "parse-sexp", "parse-lexp", "eval", "record"
+};
+
+/**
+ * Type: StatsCounters
+ * -------------------
+ * One thread's counts. Histogram bucket 0 holds runs that took no
+ * measurable time and bucket i runs that took under 2^i nanoseconds but
+ * at least half that.
+ */
+
+struct StatsCounters {
+    atomic<uint64_t> sexpNodes[kSExpTypeCount];
+    atomic<uint64_t> langExpNodes[kLangExpTypeCount];
+    atomic<uint64_t> tokens;
+    atomic<uint64_t> symbolLookups;
+    atomic<uint64_t> phaseRuns[kStatsPhaseCount];
+    atomic<uint64_t> phaseNanoseconds[kStatsPhaseCount];
+    atomic<uint64_t> histogram[kStatsPhaseCount][kHistogramBuckets];
+};
+
+/**
+ * Type: StatsSnapshot
+ * -------------------
+ * The counts of every thread added together, taken for a report.
+ */
+
+struct StatsSnapshot {
+    uint64_t sexpNodes[kSExpTypeCount];
+    uint64_t langExpNodes[kLangExpTypeCount];
+    uint64_t tokens;
+    uint64_t symbolLookups;
+    uint64_t phaseRuns[kStatsPhaseCount];
+    uint64_t phaseNanoseconds[kStatsPhaseCount];
+    uint64_t histogram[kStatsPhaseCount][kHistogramBuckets];
+};
+
+/**
+ * Class: ThreadCounters
+ * ---------------------
+ * The counters of the thread it belongs to, listed where a report can
+ * find them for as long as the thread runs, and added to the counts of
+ * finished threads when it ends.
+ */
+
+class ThreadCounters {
+public:
+    ThreadCounters();
+    ~ThreadCounters();
+    StatsCounters counters;
+};
+
+static mutex& registryLock();
+static vector<ThreadCounters *>& liveCounters();
+static StatsCounters& finishedCounters();
+static StatsCounters& localCounters();
+static void bump(atomic<uint64_t>& counter, uint64_t amount);
+static void addCounters(StatsCounters& into, const StatsCounters& from);
+static void addToSnapshot(StatsSnapshot& snapshot, const StatsCounters& counters);
+static StatsSnapshot takeSnapshot();
+static uint64_t bucketLimit(int bucket);
+static uint64_t percentile(const uint64_t *histogram, uint64_t runs, double fraction);
+static void printTable(ostream& out, const StatsSnapshot& snapshot);
+static void printJson(ostream& out, const StatsSnapshot& snapshot);
+
+static atomic<int64_t> treeBytes(0);
+static atomic<int64_t> peakTreeBytes(0);
+
+/**
+ * Implementation notes: recording
+ * -------------------------------
+ * Every thread counts into its own block, so recording takes no lock and
+ * each counter has a single writer. The counters are atomic only so that
+ * a report taken while other threads are still running reads them
+ * safely; a relaxed load and store costs no more than a plain increment.
+ * Tree memory is shared, since a tree may be freed by another thread than
+ * the one that built it, and its peak is raised with a compare-and-swap
+ * loop.
+ */
+
+void recordNodeAllocation(const SExpression *node) {
+    bump(localCounters().sexpNodes[node->getType()], 1);
+}
+
+void recordNodeAllocation(const LangExpression *node) {
+    bump(localCounters().langExpNodes[node->getType()], 1);
+}
+
+void recordTreeBytes(int64_t delta) {
+    int64_t now = treeBytes.fetch_add(delta, memory_order_relaxed) + delta;
+    int64_t peak = peakTreeBytes.load(memory_order_relaxed);
+    while (now > peak && !peakTreeBytes.compare_exchange_weak(peak, now, memory_order_relaxed)) {
+        /* Empty */
+    }
+}
+
+void recordToken() {
+    bump(localCounters().tokens, 1);
+}
+
+void recordSymbolLookup() {
+    bump(localCounters().symbolLookups, 1);
+}
+
+void recordPhase(StatsPhase phase, uint64_t nanoseconds) {
+    StatsCounters& counters = localCounters();
+    int bucket = 0;
+    while (bucket < kHistogramBuckets - 1 && nanoseconds >= bucketLimit(bucket)) bucket++;
+    bump(counters.phaseRuns[phase], 1);
+    bump(counters.phaseNanoseconds[phase], nanoseconds);
+    bump(counters.histogram[phase][bucket], 1);
+}
+
+void printPipelineStats(ostream& out, bool json) {
+    StatsSnapshot snapshot = takeSnapshot();
+    if (json) printJson(out, snapshot);
+    else printTable(out, snapshot);
+}
+
+/**
+ * Implementation notes: ThreadCounters
+ * ------------------------------------
+ * The list of live blocks and the block of finished threads are made on
+ * first use and never destroyed, so threads that end while the program
+ * is exiting, and the report written at exit, can still reach them.
+ */
+
+ThreadCounters::ThreadCounters() : counters() {
+    lock_guard<mutex> guard(registryLock());
+    liveCounters().push_back(this);
+}
+
+ThreadCounters::~ThreadCounters() {
+    lock_guard<mutex> guard(registryLock());
+    addCounters(finishedCounters(), counters);
+    vector<ThreadCounters *>& live = liveCounters();
+    for (size_t i = 0; i < live.size(); i++) {
+        if (live[i] == this) {
+            live[i] = live.back();
+            live.pop_back();
+            break;
+        }
+    }
+}
+
+mutex& registryLock() {
+    static mutex *lock = new mutex();
+    return *lock;
+}
+
+vector<ThreadCounters *>& liveCounters() {
+    static vector<ThreadCounters *> *live = new vector<ThreadCounters *>();
+    return *live;
+}
+
+StatsCounters& finishedCounters() {
+    static StatsCounters *finished = new StatsCounters();
+    return *finished;
+}
+
+StatsCounters& localCounters() {
+    static thread_local ThreadCounters local;
+    return local.counters;
+}
+
+void bump(atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+void addCounters(StatsCounters& into, const StatsCounters& from) {
+    StatsSnapshot counts = StatsSnapshot();
+    addToSnapshot(counts, from);
+    for (int type = 0; type < kSExpTypeCount; type++) bump(into.sexpNodes[type], counts.sexpNodes[type]);
+    for (int type = 0; type < kLangExpTypeCount; type++) bump(into.langExpNodes[type], counts.langExpNodes[type]);
+    bump(into.tokens, counts.tokens);
+    bump(into.symbolLookups, counts.symbolLookups);
+    for (int phase = 0; phase < kStatsPhaseCount; phase++) {
+        bump(into.phaseRuns[phase], counts.phaseRuns[phase]);
+        bump(into.phaseNanoseconds[phase], counts.phaseNanoseconds[phase]);
+        for (int bucket = 0; bucket < kHistogramBuckets; bucket++)
+            bump(into.histogram[phase][bucket], counts.histogram[phase][bucket]);
+    }
+}
+
+void addToSnapshot(StatsSnapshot& snapshot, const StatsCounters& counters) {
+    for (int type = 0; type < kSExpTypeCount; type++)
+        snapshot.sexpNodes[type] += counters.sexpNodes[type].load(memory_order_relaxed);
+    for (int type = 0; type < kLangExpTypeCount; type++)
+        snapshot.langExpNodes[type] += counters.langExpNodes[type].load(memory_order_relaxed);
+    snapshot.tokens += counters.tokens.load(memory_order_relaxed);
+    snapshot.symbolLookups += counters.symbolLookups.load(memory_order_relaxed);
+    for (int phase = 0; phase < kStatsPhaseCount; phase++) {
+        snapshot.phaseRuns[phase] += counters.phaseRuns[phase].load(memory_order_relaxed);
+        snapshot.phaseNanoseconds[phase] += counters.phaseNanoseconds[phase].load(memory_order_relaxed);
+        for (int bucket = 0; bucket < kHistogramBuckets; bucket++)
+            snapshot.histogram[phase][bucket] += counters.histogram[phase][bucket].load(memory_order_relaxed);
+    }
+}
+
+StatsSnapshot takeSnapshot() {
+    StatsSnapshot snapshot = StatsSnapshot();
+    lock_guard<mutex> guard(registryLock());
+    addToSnapshot(snapshot, finishedCounters());
+    for (ThreadCounters *live : liveCounters()) addToSnapshot(snapshot, live->counters);
+    return snapshot;
+}
+
+uint64_t bucketLimit(int bucket) {
+    return uint64_t(1) << bucket;
+}
+
+/**
+ * Implementation notes: percentile
+ * --------------------------------
+ * Returns the upper bound, in nanoseconds, of the bucket holding the run
+ * at the given fraction of the way through the runs sorted by time.
+ */
+
+uint64_t percentile(const uint64_t *histogram, uint64_t runs, double fraction) {
+    if (runs == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(fraction * (runs - 1));
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < kHistogramBuckets; bucket++) {
+        seen += histogram[bucket];
+        if (seen > rank) return bucketLimit(bucket);
+    }
+    return bucketLimit(kHistogramBuckets - 1);
+}
+
+void printTable(ostream& out, const StatsSnapshot& snapshot) {
+    out << "pipeline statistics" << endl;
+    out << "  tokens scanned       " << snapshot.tokens << endl;
+    out << "  symbol lookups       " << snapshot.symbolLookups << endl;
+    out << "  peak tree memory     " << peakTreeBytes.load() << " bytes, "
+        << treeBytes.load() << " still held" << endl;
+    out << "  s-expression nodes  ";
+    for (int type = 0; type < kSExpTypeCount; type++)
+        out << " " << kSExpTypeNames[type] << " " << snapshot.sexpNodes[type];
+    out << endl << "  logic nodes         ";
+    for (int type = 0; type < kLangExpTypeCount; type++)
+        out << " " << kLangExpTypeNames[type] << " " << snapshot.langExpNodes[type];
+    out << endl;
+    out << "  phase             runs   total ms    mean us   p50 <us   p90 <us   p99 <us" << endl;
+    for (int phase = 0; phase < kStatsPhaseCount; phase++) {
+        uint64_t runs = snapshot.phaseRuns[phase];
+        const uint64_t *histogram = snapshot.histogram[phase];
+        double totalNanoseconds = snapshot.phaseNanoseconds[phase];
+        out << "  " << left << setw(12) << kPhaseNames[phase] << right << setw(10) << runs
+            << fixed << setprecision(3) << setw(11) << totalNanoseconds / 1e6
+            << setw(11) << (runs == 0 ? 0 : totalNanoseconds / runs / 1e3)
+            << setw(10) << percentile(histogram, runs, 0.5) / 1e3
+            << setw(10) << percentile(histogram, runs, 0.9) / 1e3
+            << setw(10) << percentile(histogram, runs, 0.99) / 1e3 << endl;
+    }
+    out.unsetf(ios::floatfield);
+}
+
+void printJson(ostream& out, const StatsSnapshot& snapshot) {
+    out << "{\"enabled\": true, \"tokens\": " << snapshot.tokens
+        << ", \"symbolLookups\": " << snapshot.symbolLookups
+        << ", \"treeBytes\": {\"peak\": " << peakTreeBytes.load() << ", \"held\": " << treeBytes.load() << "}";
+    out << ", \"sexpNodes\": {";
+    for (int type = 0; type < kSExpTypeCount; type++)
+        out << (type == 0 ? "" : ", ") << "\"" << kSExpTypeNames[type] << "\": " << snapshot.sexpNodes[type];
+    out << "}, \"langExpNodes\": {";
+    for (int type = 0; type < kLangExpTypeCount; type++)
+        out << (type == 0 ? "" : ", ") << "\"" << kLangExpTypeNames[type] << "\": " << snapshot.langExpNodes[type];
+    out << "}, \"phases\": {";
+    for (int phase = 0; phase < kStatsPhaseCount; phase++) {
+        out << (phase == 0 ? "" : ", ") << "\"" << kPhaseNames[phase] << "\": {\"runs\": "
+            << snapshot.phaseRuns[phase] << ", \"nanoseconds\": " << snapshot.phaseNanoseconds[phase]
+            << ", \"histogram\": [";
+        bool first = true;
+        for (int bucket = 0; bucket < kHistogramBuckets; bucket++) {
+            if (snapshot.histogram[phase][bucket] == 0) continue;
+            out << (first ? "" : ", ") << "{\"belowNanoseconds\": " << bucketLimit(bucket)
+                << ", \"runs\": " << snapshot.histogram[phase][bucket] << "}";
+            first = false;
+        }
+        out << "]}";
+    }
+    out << "}}" << endl;
+}
+
+#else
+
+void printPipelineStats(ostream& out, bool json) {
+    if (json) out << "{\"enabled\": false}" << endl;
+    else out << "pipeline statistics were not compiled in; build with -DLFL_STATS to record them" << endl;
+}
+
+#endif
+
+void reportPipelineStatsAtExit(bool json) {
+    reportAsJson = json;
+    atexit(reportAtExit);
+}
+
+void reportAtExit() {
+    printPipelineStats(cerr, reportAsJson);
+}
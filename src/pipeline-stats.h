@@ -0,0 +1,150 @@
+/**
+ * File: pipeline-stats.h
+ * -------------
+ * This interface defines the counters and timers that record where the
+ * parse and evaluation pipeline spends its time and memory. They are
+ * compiled in only when LFL_STATS is defined; otherwise every recording
+ * macro below expands to nothing and the hot paths are exactly as they
+ * would be without them.
+ */
+
+#ifndef PIPELINE_STATS_H
+#define PIPELINE_STATS_H
+
+#include <cstdint>
+#include <iostream>
+#ifdef LFL_STATS
+#include <chrono>
+#endif
+
+/**
+ * Type: StatsPhase
+ * ----------------
+ * The phases that are timed: reading an S-expression from text,
+ * translating it into a LangExpression, evaluating one, and handling a
+ * whole REPL line or batch record from start to finish.
+ */
+
+enum StatsPhase {
+    SEXP_PARSE_PHASE, LANGEXP_PARSE_PHASE,
+    EVAL_PHASE, RECORD_PHASE
+};
+
+const int kStatsPhaseCount = RECORD_PHASE + 1;
+
+#ifdef LFL_STATS
+
+class SExpression;
+class LangExpression;
+
+/**
+ * Function: recordNodeAllocation
+ * Usage: recordNodeAllocation(node);
+ * -------------------------------------------
+ * Counts one node of the given node's type, however it was allocated.
+ */
+
+void recordNodeAllocation(const SExpression *node);
+void recordNodeAllocation(const LangExpression *node);
+
+/**
+ * Function: recordTreeBytes
+ * Usage: recordTreeBytes(sizeof(SCons));
+ * -------------------------------------------
+ * Adds to, or with a negative delta takes from, the memory held by
+ * expression trees, whether on the heap or in arenas, and raises the
+ * recorded peak if the total is higher than it has ever been.
+ */
+
+void recordTreeBytes(int64_t delta);
+
+/**
+ * Function: recordToken
+ * Usage: recordToken();
+ * -------------------------------------------
+ * Counts one token scanned by the S-expression lexer.
+ */
+
+void recordToken();
+
+/**
+ * Function: recordSymbolLookup
+ * Usage: recordSymbolLookup();
+ * -------------------------------------------
+ * Counts one lookup in a symbol table, whether or not it interned a name.
+ */
+
+void recordSymbolLookup();
+
+/**
+ * Function: recordPhase
+ * Usage: recordPhase(EVAL_PHASE, nanoseconds);
+ * -------------------------------------------
+ * Adds one run of the phase that took the given time to its histogram.
+ */
+
+void recordPhase(StatsPhase phase, uint64_t nanoseconds);
+
+/**
+ * Class: StatsPhaseTimer
+ * ----------------------
+ * Times the scope it is declared in as one run of a phase, including a
+ * scope left by an exception.
+ */
+
+class StatsPhaseTimer {
+public:
+    StatsPhaseTimer(StatsPhase phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+    ~StatsPhaseTimer() {
+        std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+        recordPhase(phase, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+private:
+    StatsPhase phase;
+    std::chrono::steady_clock::time_point start;
+
+    StatsPhaseTimer(const StatsPhaseTimer&) = delete;
+    StatsPhaseTimer& operator=(const StatsPhaseTimer&) = delete;
+};
+
+#define STATS_NODE(node) recordNodeAllocation(node)
+#define STATS_TREE_BYTES(delta) recordTreeBytes(delta)
+#define STATS_TOKEN() recordToken()
+#define STATS_SYMBOL_LOOKUP() recordSymbolLookup()
+#define STATS_PHASE(phase) StatsPhaseTimer statsPhaseTimer(phase)
+
+#else
+
+#define STATS_NODE(node) ((void) 0)
+#define STATS_TREE_BYTES(delta) ((void) 0)
+#define STATS_TOKEN() ((void) 0)
+#define STATS_SYMBOL_LOOKUP() ((void) 0)
+#define STATS_PHASE(phase) ((void) 0)
+
+#endif
+
+/**
+ * Function: printPipelineStats
+ * Usage: printPipelineStats(cerr, json);
+ * -------------------------------------------
+ * Writes everything recorded so far, by every thread, as a table or as
+ * one JSON object. Phase latencies are kept in power-of-two histograms,
+ * so the percentiles in the table are the upper bounds of the buckets
+ * they fall in. Without LFL_STATS the report only says that nothing was
+ * recorded.
+ */
+
+void printPipelineStats(std::ostream& out, bool json);
+
+/**
+ * Function: reportPipelineStatsAtExit
+ * Usage: reportPipelineStatsAtExit(json);
+ * -------------------------------------------
+ * Arranges for printPipelineStats to write to standard error when the
+ * program exits.
+ */
+
+void reportPipelineStatsAtExit(bool json);
+
+#endif // PIPELINE_STATS_H
@@ -0,0 +1,438 @@
+/**
+ * File: repl-commands.cpp
+ * -------------
+ * This file implements the repl-commands.h interface.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "repl-commands.h"
+#include "bdd.h"
+#include "formula-registry.h"
+#include "langexpression-parser.h"
+#include "langexpression-simplifier.h"
+#include "truth-table.h"
+#include "truth-table-sweep.h"
+#include "tseitin-encoder.h"
+#include "error.h"
+#include "hashmap.h"
+#include "strlib.h"
+#include "vector.h"
+using namespace std;
+
+typedef void (*ReplCommand)(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                            FormulaRegistry *registry, ostream& out);
+
+static const HashMap<string, ReplCommand>& commandTable();
+static HashMap<string, ReplCommand> buildCommandTable();
+static bool readCommandName(SExpression *head, string& name);
+static LangExpression *readFormulaArgument(const string& command, const Vector<SExpression *>& args, int count);
+static void tableCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                         FormulaRegistry *registry, ostream& out);
+static void classifyCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                            FormulaRegistry *registry, ostream& out);
+static void skippedCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                           FormulaRegistry *registry, ostream& out);
+static void tautologyCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                             FormulaRegistry *registry, ostream& out);
+static void satisfiableCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                               FormulaRegistry *registry, ostream& out);
+static void sweepCommand(const string& command, const Vector<SExpression *>& args, ostream& out);
+static void solveCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                         FormulaRegistry *registry, ostream& out);
+static void proveCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                         FormulaRegistry *registry, ostream& out);
+static void printSatAnswer(const SatAnswer& answer, bool value, ostream& out);
+static void equivalentCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                              FormulaRegistry *registry, ostream& out);
+static void countCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                         FormulaRegistry *registry, ostream& out);
+static void modelCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                         FormulaRegistry *registry, ostream& out);
+static void simplifyCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                            FormulaRegistry *registry, ostream& out);
+static void defineCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                          FormulaRegistry *registry, ostream& out);
+static void formulasCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                            FormulaRegistry *registry, ostream& out);
+static FormulaRegistry& checkRegistry(const string& command, FormulaRegistry *registry);
+static void printRegisteredValue(FormulaRegistry& registry, SymbolId name, ostream& out);
+static void bddCommand(const string& command, const Vector<SExpression *>& args, ostream& out);
+static vector<SymbolId> readVariableOrder(const string& command, SExpression *list);
+static void printBddModel(const vector<pair<SymbolId, bool>>& model, ostream& out);
+
+/**
+ * Implementation notes: runReplCommand
+ * ------------------------------------
+ * The operator position is read the same way readLEList reads operators,
+ * by concatenating the symbols in the head list. Commands are looked up in
+ * a table from name to handler, so adding one means writing the handler
+ * and registering it in buildCommandTable. The table is built once, as a
+ * function-local static, so batch workers can look commands up in parallel.
+ */
+
+bool runReplCommand(SExpression *sexp, LangEvaluationContext& context, FormulaRegistry *registry,
+                    ostream& out) {
+    if (!isReplCommand(sexp)) return false;
+    string name;
+    readCommandName(sexp->getCAR(), name);
+    const HashMap<string, ReplCommand>& commands = commandTable();
+    Vector<SExpression *> args;
+    for (SExpression *arg : SListView(sexp->getCDR())) args.add(arg);
+    commands.get(name)(args, context, registry, out);
+    return true;
+}
+
+bool isReplCommand(SExpression *sexp) {
+    if (sexp->getType() != SExpressionType::CONS) return false;
+    string name;
+    if (!readCommandName(sexp->getCAR(), name)) return false;
+    return commandTable().containsKey(name);
+}
+
+const HashMap<string, ReplCommand>& commandTable() {
+    static const HashMap<string, ReplCommand> commands = buildCommandTable();
+    return commands;
+}
+
+HashMap<string, ReplCommand> buildCommandTable() {
+    HashMap<string, ReplCommand> commands;
+    commands.put("table", tableCommand);
+    commands.put("classify", classifyCommand);
+    commands.put("skipped", skippedCommand);
+    commands.put("taut", tautologyCommand);
+    commands.put("sat", satisfiableCommand);
+    commands.put("solve", solveCommand);
+    commands.put("prove", proveCommand);
+    commands.put("equiv", equivalentCommand);
+    commands.put("count", countCommand);
+    commands.put("model", modelCommand);
+    commands.put("simplify", simplifyCommand);
+    commands.put("define", defineCommand);
+    commands.put("formulas", formulasCommand);
+    return commands;
+}
+
+bool readCommandName(SExpression *head, string& name) {
+    if (head->getType() != SExpressionType::CONS) return false;
+    for (SExpression *component : SListView(head)) {
+        if (component->getType() != SExpressionType::SYMBOL) return false;
+        name += component->getSymbolName();
+    }
+    return true;
+}
+
+LangExpression *readFormulaArgument(const string& command, const Vector<SExpression *>& args, int count) {
+    if (args.size() != count)
+        error("COMMAND ERROR >> Incorrect number of terms provided for command " + command);
+    return parseLangExp(args[0]);
+}
+
+void tableCommand(const Vector<SExpression *>& args, LangEvaluationContext&,
+                  FormulaRegistry *, ostream& out) {
+    LangExpression *lexp = readFormulaArgument("table", args, 1);
+    try {
+        TruthTable(lexp).print(out);
+    } catch (ErrorException& ex) {
+        delete lexp;
+        throw;
+    }
+    delete lexp;
+}
+
+void classifyCommand(const Vector<SExpression *>& args, LangEvaluationContext&,
+                     FormulaRegistry *, ostream& out) {
+    LangExpression *lexp = readFormulaArgument("classify", args, 1);
+    try {
+        out << formulaClassToString(TruthTable(lexp).classify()) << endl;
+    } catch (ErrorException& ex) {
+        delete lexp;
+        throw;
+    }
+    delete lexp;
+}
+
+void skippedCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                    FormulaRegistry *, ostream& out) {
+    if (args.size() != 0)
+        error("COMMAND ERROR >> Incorrect number of terms provided for command skipped");
+    out << context.getSkippedSubtrees() << " subtrees skipped by short-circuit evaluation";
+    if (context.isStrictEvaluation()) out << " (strict evaluation is on)";
+    out << endl;
+}
+
+void tautologyCommand(const Vector<SExpression *>& args, LangEvaluationContext&,
+                      FormulaRegistry *, ostream& out) {
+    sweepCommand("taut", args, out);
+}
+
+void satisfiableCommand(const Vector<SExpression *>& args, LangEvaluationContext&,
+                        FormulaRegistry *, ostream& out) {
+    sweepCommand("sat", args, out);
+}
+
+/**
+ * Implementation notes: sweepCommand
+ * ----------------------------------
+ * A tautology check looks for a row in which the formula is false and a
+ * satisfiability check for one in which it is true, so both are the same
+ * parallel sweep with the answer read the other way round. The row found
+ * is printed as an assignment to the free variables, followed by the
+ * sweep's per-thread statistics.
+ */
+
+void sweepCommand(const string& command, const Vector<SExpression *>& args, ostream& out) {
+    LangExpression *lexp = readFormulaArgument(command, args, 1);
+    try {
+        TruthTable table(lexp);
+        bool sat = command == "sat";
+        SweepResult result = findRow(table, sat, defaultSweepThreads());
+        if (sat) out << (result.found ? "satisfiable" : "unsatisfiable");
+        else out << (result.found ? "not a tautology" : "tautology");
+        int variableCount = table.getVariableCount();
+        if (result.found && variableCount > 0) {
+            out << ", " << boolToString(sat) << " when";
+            for (int i = 0; i < variableCount; i++) {
+                bool value = (result.row >> (variableCount - 1 - i)) & 1;
+                out << (i == 0 ? " " : ", ") << table.getVariableName(i) << " = " << boolToString(value);
+            }
+        }
+        out << endl;
+        printSweepStats(result, out);
+    } catch (ErrorException& ex) {
+        delete lexp;
+        throw;
+    }
+    delete lexp;
+}
+
+/**
+ * Implementation notes: solveCommand
+ * ----------------------------------
+ * Unlike sat, which sweeps the truth table, solve hands the formula to
+ * the CDCL solver, so it copes with hundreds of variables. The assignment
+ * it finds is bound in the context, where evaluating the formula then
+ * gives true.
+ */
+
+void solveCommand(const Vector<SExpression *>& args, LangEvaluationContext& context,
+                  FormulaRegistry *, ostream& out) {
+    LangExpression *lexp = readFormulaArgument("solve", args, 1);
+    try {
+        SatAnswer answer = solveFormula(lexp, true);
+        out << (answer.found ? "satisfiable" : "unsatisfiable");
+        printSatAnswer(answer, true, out);
+        assignModel(answer, context);
+    } catch (ErrorException& ex) {
+        delete lexp;
+        throw;
+    }
+    delete lexp;
+}
+
+void proveCommand(const Vector<SExpression *>& args, LangEvaluationContext&,
+                  FormulaRegistry *, ostream& out) {
+    LangExpression *lexp = readFormulaArgument("prove", args, 1);
+    try {
+        SatAnswer answer = solveFormula(lexp, false);
+        out << (answer.found ? "not a tautology" : "tautology");
+        printSatAnswer(answer, false, out);
+    } catch (ErrorException& ex) {
+        delete lexp;
+        throw;
+    }
+    delete lexp;
+}
+
+void printSatAnswer(const SatAnswer& answer, bool value, ostream& out) {
+    if (answer.found && !answer.variables.empty()) {
+        out << ", " << boolToString(value) << " when";
+        for (size_t i = 0; i < answer.variables.size(); i++) {
+            out << (i == 0 ? " " : ", ") << globalSymbols().nameOf(answer.variables[i])
+                << " = " << boolToString(answer.values[i]);
+        }
+    }
+    out << endl;
+    const SatSolverStats& stats = answer.stats;
+    out << stats.decisions << " decisions, " << stats.conflicts << " conflicts, "
+        << stats.propagations << " propagations, " << stats.restarts << " restarts" << endl;
+}
+
+void equivalentCommand(const Vector<SExpression *>& args, LangEvaluationContext&,
+                       FormulaRegistry *, ostream& out) {
+    bddCommand("equiv", args, out);
+}
+
+void countCommand(const Vector<SExpression *>& args, LangEvaluationContext&,
+                  FormulaRegistry *, ostream& out) {
+    bddCommand("count", args, out);
+}
+
+void modelCommand(const Vector<SExpression *>& args, LangEvaluationContext&,
+                  FormulaRegistry *, ostream& out) {
+    bddCommand("model", args, out);
+}
+
+void simplifyCommand(const Vector<SExpression *>& args, LangEvaluationContext&,
+                     FormulaRegistry *, ostream& out) {
+    LangExpression *lexp = readFormulaArgument("simplify", args, 1);
+    LangExpression *simplified = nullptr;
+    try {
+        uint64_t removedNodes;
+        simplified = simplifyLangExp(lexp, removedNodes);
+        out << simplified->toString() << endl;
+        out << removedNodes << " nodes removed" << endl;
+    } catch (ErrorException& ex) {
+        delete lexp;
+        delete simplified;
+        throw;
+    }
+    delete lexp;
+    delete simplified;
+}
+
+/**
+ * Implementation notes: bddCommand
+ * --------------------------------
+ * Each command builds its formulas in a manager of its own, so nothing
+ * carries over between commands and a variable order given to one of them
+ * applies to it alone. Two formulas are equivalent exactly when they
+ * build the same node, and otherwise any model of their exclusive or is
+ * an assignment on which they differ. The manager's memory use and cache
+ * statistics follow the answer.
+ */
+
+void bddCommand(const string& command, const Vector<SExpression *>& args, ostream& out) {
+    int formulaCount = command == "equiv" ? 2 : 1;
+    if (args.size() != formulaCount && args.size() != formulaCount + 1)
+        error("COMMAND ERROR >> Incorrect number of terms provided for command " + command);
+    BddManager bdd;
+    if (args.size() > formulaCount) bdd.setVariableOrder(readVariableOrder(command, args[formulaCount]));
+    Vector<LangExpression *> formulas;
+    try {
+        for (int i = 0; i < formulaCount; i++) formulas.add(parseLangExp(args[i]));
+        BddRef f = bdd.build(formulas[0]);
+        vector<pair<SymbolId, bool>> model;
+        if (command == "equiv") {
+            bdd.protect(f);
+            BddRef g = bdd.build(formulas[1]);
+            if (f == g) {
+                out << "equivalent" << endl;
+            } else {
+                bdd.findModel(bdd.negate(bdd.apply(IffEXP, f, g)), model);
+                out << "not equivalent, they differ when";
+                printBddModel(model, out);
+            }
+        } else if (command == "count") {
+            double count = bdd.countModels(f);
+            if (count < 9007199254740992.0) out << static_cast<uint64_t>(count);
+            else out << count;
+            out << " models over " << bdd.getVariableCount() << " variables" << endl;
+        } else if (!bdd.findModel(f, model)) {
+            out << "unsatisfiable" << endl;
+        } else {
+            out << "satisfiable";
+            if (!model.empty()) {
+                out << ", true when";
+                printBddModel(model, out);
+            } else {
+                out << endl;
+            }
+        }
+        BddStats stats = bdd.getStats();
+        out << "bdd: " << stats.liveNodes << " nodes live, " << stats.peakNodes << " at peak, "
+            << stats.bytesUsed << " bytes, " << stats.cacheHits << " of " << stats.cacheLookups
+            << " cache lookups hit, " << stats.collections << " collections" << endl;
+    } catch (ErrorException& ex) {
+        for (LangExpression *lexp : formulas) delete lexp;
+        throw;
+    }
+    for (LangExpression *lexp : formulas) delete lexp;
+}
+
+vector<SymbolId> readVariableOrder(const string& command, SExpression *list) {
+    vector<SymbolId> order;
+    if (list->getType() == SExpressionType::NIL) return order;
+    if (list->getType() != SExpressionType::CONS)
+        error("COMMAND ERROR >> The variable order for command " + command + " must be a list of variables");
+    for (SExpression *var : SListView(list)) {
+        if (var->getType() != SExpressionType::SYMBOL)
+            error("COMMAND ERROR >> The variable order for command " + command + " must be a list of variables");
+        order.push_back(var->getSymbolId());
+    }
+    return order;
+}
+
+void printBddModel(const vector<pair<SymbolId, bool>>& model, ostream& out) {
+    for (size_t i = 0; i < model.size(); i++) {
+        out << (i == 0 ? " " : ", ") << globalSymbols().nameOf(model[i].first)
+            << " = " << boolToString(model[i].second);
+    }
+    out << endl;
+}
+
+/**
+ * Implementation notes: defineCommand
+ * -----------------------------------
+ * Registers the formula under the name and prints its current value. The
+ * formula is translated into a temporary tree that the registry compiles
+ * into its own graph, so nothing of the parse needs to outlive the
+ * command.
+ */
+
+void defineCommand(const Vector<SExpression *>& args, LangEvaluationContext&,
+                   FormulaRegistry *registry, ostream& out) {
+    if (args.size() != 2 || args[0]->getType() != SExpressionType::SYMBOL)
+        error("COMMAND ERROR >> Command define takes a name and a formula");
+    SymbolId name = args[0]->getSymbolId();
+    LangExpression *lexp = parseLangExp(args[1]);
+    try {
+        FormulaRegistry& names = checkRegistry("define", registry);
+        names.define(name, lexp);
+        printRegisteredValue(names, name, out);
+        out << endl;
+    } catch (ErrorException& ex) {
+        delete lexp;
+        throw;
+    }
+    delete lexp;
+}
+
+/**
+ * Implementation notes: formulasCommand
+ * -------------------------------------
+ * Lists every registered formula with its value, marking the ones that
+ * changed since the last listing, and then how much the refresh that
+ * brought them up to date had to recompute.
+ */
+
+void formulasCommand(const Vector<SExpression *>& args, LangEvaluationContext&,
+                     FormulaRegistry *registry, ostream& out) {
+    if (args.size() != 0)
+        error("COMMAND ERROR >> Incorrect number of terms provided for command formulas");
+    FormulaRegistry& names = checkRegistry("formulas", registry);
+    vector<SymbolId> changed = names.refresh();
+    for (int i = 0; i < names.getFormulaCount(); i++) {
+        SymbolId name = names.getFormulaName(i);
+        printRegisteredValue(names, name, out);
+        if (find(changed.begin(), changed.end(), name) != changed.end()) out << " (changed)";
+        out << endl;
+    }
+    RegistryStats stats = names.getStats();
+    out << stats.formulas << " formulas, " << stats.liveNodes << " live nodes, " << stats.recomputedNodes
+        << " recomputed for " << stats.changedVariables << " changed variables" << endl;
+}
+
+FormulaRegistry& checkRegistry(const string& command, FormulaRegistry *registry) {
+    if (registry == nullptr) error("COMMAND ERROR >> Command " + command + " needs a formula registry");
+    return *registry;
+}
+
+void printRegisteredValue(FormulaRegistry& registry, SymbolId name, ostream& out) {
+    out << globalSymbols().nameOf(name) << " = ";
+    if (registry.isDefined(name)) out << boolToString(registry.getValue(name));
+    else out << "undefined, " << globalSymbols().nameOf(registry.getUndefinedVariable(name)) << " is not set";
+}
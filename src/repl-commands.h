@@ -0,0 +1,74 @@
+/**
+ * File: repl-commands.h
+ * -------------
+ * This interface defines the commands the REPL understands in addition to
+ * plain formulas. A command is written like an operation, with its name in
+ * the operator position, for example ((table) ((and) p q)).
+ */
+
+#ifndef REPL_COMMANDS_H
+#define REPL_COMMANDS_H
+
+#include <iostream>
+#include "sexpressions.h"
+#include "langexpressions.h"
+#include "formula-registry.h"
+
+/**
+ * Function: runReplCommand
+ * Usage: if (runReplCommand(sexp, context, &registry, cout)) continue;
+ * -------------------------------------------
+ * Runs the S-expression as a REPL command if its operator names one, and
+ * returns true. Returns false for anything else, which should then be
+ * evaluated as a formula. The registry holds the named formulas of define
+ * and formulas; it belongs to the caller, must have been made over the
+ * same context, and may be null for a caller that never runs those two,
+ * which then raise a COMMAND ERROR. The commands are:
+ *
+ *   ((table) f)      prints the truth table of f over its free variables
+ *   ((classify) f)   prints whether f is a tautology, contradiction or
+ *                    contingent, without printing the table
+ *   ((skipped))      prints how many subtrees and, or and imp have skipped
+ *                    so far because their first operand decided the result
+ *   ((taut) f)       prints whether f is a tautology and, if not, the first
+ *                    assignment that falsifies it
+ *   ((sat) f)        prints whether f is satisfiable and, if so, the first
+ *                    assignment that satisfies it
+ *   ((solve) f)      like sat, but with the CDCL solver, and binds the
+ *                    satisfying assignment it finds in the context
+ *   ((prove) f)      like taut, but with the CDCL solver
+ *   ((equiv) f g)    prints whether f and g are equivalent and, if not, an
+ *                    assignment on which they differ
+ *   ((count) f)      prints how many assignments satisfy f
+ *   ((model) f)      prints a satisfying assignment of f, if there is one
+ *   ((simplify) f)   prints f as simplifyLangExp rewrites it and how many
+ *                    nodes that removed, without evaluating it
+ *   ((define) n f)   registers f under the name n in the registry,
+ *                    replacing any formula named n, and prints its value
+ *   ((formulas))     prints the current value of every registered formula,
+ *                    marking those changed since the last listing
+ *
+ * taut and sat sweep the truth table on one thread per core, stop as soon
+ * as the answer is known, and print how many rows each thread evaluated.
+ * solve and prove scale to formulas with hundreds of variables, and print
+ * how much searching the solver had to do. formulas recomputes only the
+ * parts of the registered formulas that the sets since the last listing
+ * can have changed. equiv, count and model build a
+ * BDD of each formula and print how much memory it took; each of them takes
+ * an optional list of variables after its formulas, such as (q p), which
+ * puts those variables first in the diagrams, in that order.
+ */
+
+bool runReplCommand(SExpression *sexp, LangEvaluationContext& context, FormulaRegistry *registry,
+                    std::ostream& out);
+
+/**
+ * Function: isReplCommand
+ * Usage: if (isReplCommand(sexp)) ...
+ * -------------------------------------------
+ * Returns true if runReplCommand would run the S-expression as a command.
+ */
+
+bool isReplCommand(SExpression *sexp);
+
+#endif // REPL_COMMANDS_H
@@ -0,0 +1,483 @@
+/**
+ * File: sat-solver.cpp
+ * -------------
+ * This file implements the sat-solver.h interface.
+ */
+
+#include <algorithm>
+#include <vector>
+#include "sat-solver.h"
+#include "error.h"
+using namespace std;
+
+static const int8_t kUnassigned = -1;
+static const int kNoReason = -1;
+static const double kVariableDecay = 0.95;
+static const double kActivityLimit = 1e100;
+static const uint64_t kRestartBase = 100;
+static const size_t kMinLearned = 2000;
+
+static uint64_t luby(uint64_t index);
+
+/**
+ * Implementation notes: SatSolver
+ * -------------------------------
+ * The layout follows MiniSat. Each clause watches its first two literals,
+ * and watches[p] lists the clauses to visit when p becomes true, which
+ * are those watching the negation of p. Each watcher also carries a
+ * blocker, some other literal of the clause; when the blocker is already
+ * true the clause is skipped without being touched. A clause that becomes
+ * unit always has its implied literal in position 0, so it can serve as
+ * the reason for that literal in conflict analysis.
+ *
+ * Variables waiting to be decided sit in a binary max-heap ordered by
+ * activity. An assigned variable may stay in the heap and is simply
+ * skipped when it comes to the top; unassigning a variable puts it back.
+ *
+ * Deleted clauses are only marked as such, and the watchers pointing at
+ * them are dropped the next time propagation comes across them, so no
+ * watch list ever has to be searched.
+ */
+
+SatSolver::SatSolver() {
+    propagated = 0;
+    variableIncrement = 1;
+    learnedCount = 0;
+    maxLearned = kMinLearned;
+    unsatisfiable = false;
+    stats = { 0, 0, 0, 0, 0, 0 };
+}
+
+int SatSolver::newVariable() {
+    int var = values.size();
+    values.push_back(kUnassigned);
+    levels.push_back(0);
+    reasons.push_back(kNoReason);
+    phases.push_back(0);
+    seen.push_back(0);
+    activities.push_back(0);
+    heapPositions.push_back(-1);
+    watches.resize(2 * values.size());
+    heapInsert(var);
+    return var;
+}
+
+int SatSolver::getVariableCount() const {
+    return values.size();
+}
+
+/**
+ * Implementation notes: addClause
+ * -------------------------------
+ * Clauses are simplified against the assignments fixed at level 0 before
+ * they are stored: a clause that is already satisfied or that contains a
+ * literal and its negation is dropped, and literals already false are
+ * left out. Sorting puts duplicates, and each literal next to its
+ * negation, side by side.
+ */
+
+void SatSolver::addClause(const vector<SatLiteral>& literals) {
+    if (unsatisfiable) return;
+    cancelUntil(0);
+    vector<SatLiteral> sorted(literals);
+    sort(sorted.begin(), sorted.end());
+    vector<SatLiteral> kept;
+    for (SatLiteral literal : sorted) {
+        if (literal < 0 || literalVariable(literal) >= getVariableCount())
+            error("SAT ERROR >> Clause refers to an unknown variable");
+        int8_t value = literalValue(literal);
+        if (value == 1) return;
+        if (value == 0) continue;
+        if (!kept.empty() && kept.back() == literal) continue;
+        if (!kept.empty() && kept.back() == negateLiteral(literal)) return;
+        kept.push_back(literal);
+    }
+    if (kept.empty()) {
+        unsatisfiable = true;
+    } else if (kept.size() == 1) {
+        enqueue(kept[0], kNoReason);
+        if (propagate() != kNoReason) unsatisfiable = true;
+    } else {
+        attachClause(kept, false, 0);
+    }
+}
+
+/**
+ * Implementation notes: solve
+ * ---------------------------
+ * Each round propagates, and on a conflict learns a clause, jumps back to
+ * the level at which that clause becomes unit and asserts its first
+ * literal. Without a conflict it may restart, trim the learned clauses,
+ * or make the next decision; running out of variables to decide means
+ * every clause is satisfied. A conflict at level 0 means none of the
+ * decisions could have avoided it, so the clauses are unsatisfiable.
+ */
+
+bool SatSolver::solve() {
+    model.clear();
+    if (unsatisfiable) return false;
+    cancelUntil(0);
+    if (propagate() != kNoReason) {
+        unsatisfiable = true;
+        return false;
+    }
+    maxLearned = max(kMinLearned, clauses.size() / 3);
+    uint64_t restartLimit = kRestartBase * luby(stats.restarts);
+    uint64_t conflictsSinceRestart = 0;
+    vector<SatLiteral> learned;
+    while (true) {
+        int conflict = propagate();
+        if (conflict != kNoReason) {
+            stats.conflicts++;
+            conflictsSinceRestart++;
+            if (decisionLevel() == 0) {
+                unsatisfiable = true;
+                return false;
+            }
+            int level = analyze(conflict, learned);
+            int lbd = countLevels(learned);
+            cancelUntil(level);
+            if (learned.size() == 1) {
+                enqueue(learned[0], kNoReason);
+            } else {
+                int clause = attachClause(learned, true, lbd);
+                learnedCount++;
+                enqueue(learned[0], clause);
+            }
+            stats.learnedClauses++;
+            variableIncrement /= kVariableDecay;
+            continue;
+        }
+        if (conflictsSinceRestart >= restartLimit) {
+            stats.restarts++;
+            conflictsSinceRestart = 0;
+            restartLimit = kRestartBase * luby(stats.restarts);
+            cancelUntil(0);
+            continue;
+        }
+        if (learnedCount >= maxLearned + trail.size()) {
+            reduceLearnedClauses();
+            maxLearned += maxLearned / 10;
+        }
+        int var = pickBranchVariable();
+        if (var < 0) {
+            model.assign(values.begin(), values.end());
+            cancelUntil(0);
+            return true;
+        }
+        stats.decisions++;
+        trailLimits.push_back(trail.size());
+        enqueue(makeLiteral(var, !phases[var]), kNoReason);
+    }
+}
+
+bool SatSolver::getModelValue(int var) const {
+    if (var < 0 || static_cast<size_t>(var) >= model.size())
+        error("SAT ERROR >> No model for this variable");
+    return model[var] == 1;
+}
+
+const SatSolverStats& SatSolver::getStats() const {
+    return stats;
+}
+
+int8_t SatSolver::literalValue(SatLiteral literal) const {
+    int8_t value = values[literalVariable(literal)];
+    return value == kUnassigned ? kUnassigned : value ^ (isNegated(literal) ? 1 : 0);
+}
+
+int SatSolver::decisionLevel() const {
+    return trailLimits.size();
+}
+
+void SatSolver::enqueue(SatLiteral literal, int reason) {
+    int var = literalVariable(literal);
+    values[var] = isNegated(literal) ? 0 : 1;
+    levels[var] = decisionLevel();
+    reasons[var] = reason;
+    trail.push_back(literal);
+}
+
+int SatSolver::attachClause(const vector<SatLiteral>& literals, bool learned, int lbd) {
+    int index = clauses.size();
+    clauses.push_back({ literals, lbd, learned, false });
+    watches[negateLiteral(literals[0])].push_back({ index, literals[1] });
+    watches[negateLiteral(literals[1])].push_back({ index, literals[0] });
+    return index;
+}
+
+/**
+ * Implementation notes: propagate
+ * -------------------------------
+ * Returns the index of a clause that has become false, or kNoReason once
+ * every consequence of the trail has been drawn. The watch list being
+ * scanned is compacted in place: watchers that stay are copied down to
+ * position kept, and the rest are either moved to another literal's list
+ * or dropped because their clause has been deleted.
+ */
+
+int SatSolver::propagate() {
+    int conflict = kNoReason;
+    while (propagated < trail.size() && conflict == kNoReason) {
+        SatLiteral literal = trail[propagated++];
+        SatLiteral falseLiteral = negateLiteral(literal);
+        vector<Watcher>& list = watches[literal];
+        stats.propagations++;
+        size_t kept = 0;
+        size_t next = 0;
+        while (next < list.size()) {
+            Watcher watcher = list[next++];
+            if (literalValue(watcher.blocker) == 1) {
+                list[kept++] = watcher;
+                continue;
+            }
+            Clause& clause = clauses[watcher.clause];
+            if (clause.deleted) continue;
+            vector<SatLiteral>& literals = clause.literals;
+            if (literals[0] == falseLiteral) swap(literals[0], literals[1]);
+            SatLiteral first = literals[0];
+            if (first != watcher.blocker && literalValue(first) == 1) {
+                list[kept++] = { watcher.clause, first };
+                continue;
+            }
+            bool moved = false;
+            for (size_t k = 2; k < literals.size(); k++) {
+                if (literalValue(literals[k]) != 0) {
+                    swap(literals[1], literals[k]);
+                    watches[negateLiteral(literals[1])].push_back({ watcher.clause, first });
+                    moved = true;
+                    break;
+                }
+            }
+            if (moved) continue;
+            list[kept++] = { watcher.clause, first };
+            if (literalValue(first) == 0) {
+                conflict = watcher.clause;
+                while (next < list.size()) list[kept++] = list[next++];
+            } else {
+                enqueue(first, watcher.clause);
+            }
+        }
+        list.resize(kept);
+    }
+    if (conflict != kNoReason) propagated = trail.size();
+    return conflict;
+}
+
+/**
+ * Implementation notes: analyze
+ * -----------------------------
+ * Walks the trail backwards from the conflict, resolving away literals of
+ * the current level until only one is left, the first unique implication
+ * point. Its negation becomes the learned clause's first literal and the
+ * literals from earlier levels make up the rest. A literal is then left
+ * out if everything its reason depends on is already in the clause. The
+ * literal from the highest remaining level is moved to position 1, where
+ * it is watched, and its level is where the search jumps back to.
+ */
+
+int SatSolver::analyze(int conflict, vector<SatLiteral>& learned) {
+    learned.clear();
+    learned.push_back(0);
+    int pathCount = 0;
+    SatLiteral implied = -1;
+    int index = trail.size() - 1;
+    int clause = conflict;
+    do {
+        const vector<SatLiteral>& literals = clauses[clause].literals;
+        for (size_t k = implied == -1 ? 0 : 1; k < literals.size(); k++) {
+            SatLiteral literal = literals[k];
+            int var = literalVariable(literal);
+            if (seen[var] || levels[var] == 0) continue;
+            seen[var] = 1;
+            bumpVariable(var);
+            if (levels[var] >= decisionLevel()) pathCount++;
+            else learned.push_back(literal);
+        }
+        while (!seen[literalVariable(trail[index])]) index--;
+        implied = trail[index--];
+        clause = reasons[literalVariable(implied)];
+        seen[literalVariable(implied)] = 0;
+        pathCount--;
+    } while (pathCount > 0);
+    learned[0] = negateLiteral(implied);
+
+    vector<SatLiteral> analyzed(learned.begin() + 1, learned.end());
+    size_t kept = 1;
+    for (size_t k = 1; k < learned.size(); k++) {
+        if (reasons[literalVariable(learned[k])] == kNoReason || !isRedundant(learned[k]))
+            learned[kept++] = learned[k];
+    }
+    learned.resize(kept);
+    for (SatLiteral literal : analyzed) seen[literalVariable(literal)] = 0;
+
+    if (learned.size() == 1) return 0;
+    size_t highest = 1;
+    for (size_t k = 2; k < learned.size(); k++) {
+        if (levels[literalVariable(learned[k])] > levels[literalVariable(learned[highest])]) highest = k;
+    }
+    swap(learned[1], learned[highest]);
+    return levels[literalVariable(learned[1])];
+}
+
+bool SatSolver::isRedundant(SatLiteral literal) const {
+    const vector<SatLiteral>& literals = clauses[reasons[literalVariable(literal)]].literals;
+    for (size_t k = 1; k < literals.size(); k++) {
+        int var = literalVariable(literals[k]);
+        if (!seen[var] && levels[var] > 0) return false;
+    }
+    return true;
+}
+
+/**
+ * Implementation notes: countLevels
+ * ---------------------------------
+ * Returns the number of distinct decision levels among the literals, the
+ * literal block distance that reduceLearnedClauses ranks clauses by.
+ */
+
+int SatSolver::countLevels(const vector<SatLiteral>& literals) {
+    if (levelMarks.size() <= static_cast<size_t>(decisionLevel())) levelMarks.resize(decisionLevel() + 1);
+    int count = 0;
+    for (SatLiteral literal : literals) {
+        int level = levels[literalVariable(literal)];
+        if (!levelMarks[level]) {
+            levelMarks[level] = 1;
+            count++;
+        }
+    }
+    for (SatLiteral literal : literals) levelMarks[levels[literalVariable(literal)]] = 0;
+    return count;
+}
+
+void SatSolver::cancelUntil(int level) {
+    if (decisionLevel() <= level) return;
+    for (size_t i = trail.size(); i > static_cast<size_t>(trailLimits[level]); i--) {
+        int var = literalVariable(trail[i - 1]);
+        phases[var] = values[var];
+        values[var] = kUnassigned;
+        reasons[var] = kNoReason;
+        if (heapPositions[var] < 0) heapInsert(var);
+    }
+    trail.resize(trailLimits[level]);
+    trailLimits.resize(level);
+    propagated = trail.size();
+}
+
+void SatSolver::bumpVariable(int var) {
+    activities[var] += variableIncrement;
+    if (activities[var] > kActivityLimit) {
+        for (double& activity : activities) activity /= kActivityLimit;
+        variableIncrement /= kActivityLimit;
+    }
+    if (heapPositions[var] >= 0) heapSiftUp(heapPositions[var]);
+}
+
+int SatSolver::pickBranchVariable() {
+    while (!heap.empty()) {
+        int var = heapRemoveMax();
+        if (values[var] == kUnassigned) return var;
+    }
+    return -1;
+}
+
+/**
+ * Implementation notes: reduceLearnedClauses
+ * ------------------------------------------
+ * Ranks the learned clauses by literal block distance, a good predictor
+ * of how useful a clause will be, and deletes the worse half. Binary
+ * clauses, clauses spanning only two levels and clauses that are the
+ * reason for a current assignment are always kept.
+ */
+
+void SatSolver::reduceLearnedClauses() {
+    vector<int> candidates;
+    for (size_t i = 0; i < clauses.size(); i++) {
+        const Clause& clause = clauses[i];
+        if (!clause.learned || clause.deleted || clause.literals.size() <= 2 || clause.lbd <= 2) continue;
+        SatLiteral first = clause.literals[0];
+        if (literalValue(first) == 1 && reasons[literalVariable(first)] == static_cast<int>(i)) continue;
+        candidates.push_back(i);
+    }
+    sort(candidates.begin(), candidates.end(), [this](int a, int b) {
+        if (clauses[a].lbd != clauses[b].lbd) return clauses[a].lbd > clauses[b].lbd;
+        return clauses[a].literals.size() > clauses[b].literals.size();
+    });
+    for (size_t i = 0; i < candidates.size() / 2; i++) {
+        Clause& clause = clauses[candidates[i]];
+        clause.deleted = true;
+        vector<SatLiteral>().swap(clause.literals);
+        learnedCount--;
+        stats.deletedClauses++;
+    }
+}
+
+void SatSolver::heapInsert(int var) {
+    heapPositions[var] = heap.size();
+    heap.push_back(var);
+    heapSiftUp(heap.size() - 1);
+}
+
+int SatSolver::heapRemoveMax() {
+    int top = heap[0];
+    int last = heap.back();
+    heap.pop_back();
+    heapPositions[top] = -1;
+    if (!heap.empty()) {
+        heap[0] = last;
+        heapPositions[last] = 0;
+        heapSiftDown(0);
+    }
+    return top;
+}
+
+void SatSolver::heapSiftUp(int position) {
+    int var = heap[position];
+    while (position > 0) {
+        int parent = (position - 1) / 2;
+        if (activities[heap[parent]] >= activities[var]) break;
+        heap[position] = heap[parent];
+        heapPositions[heap[position]] = position;
+        position = parent;
+    }
+    heap[position] = var;
+    heapPositions[var] = position;
+}
+
+void SatSolver::heapSiftDown(int position) {
+    int var = heap[position];
+    int size = heap.size();
+    while (2 * position + 1 < size) {
+        int child = 2 * position + 1;
+        if (child + 1 < size && activities[heap[child + 1]] > activities[heap[child]]) child++;
+        if (activities[heap[child]] <= activities[var]) break;
+        heap[position] = heap[child];
+        heapPositions[heap[position]] = position;
+        position = child;
+    }
+    heap[position] = var;
+    heapPositions[var] = position;
+}
+
+/**
+ * Implementation notes: luby
+ * --------------------------
+ * Returns element index of the Luby sequence 1 1 2 1 1 2 4 1 1 2 ..., the
+ * restart schedule that is within a constant factor of optimal when
+ * nothing is known about how long runs should be.
+ */
+
+uint64_t luby(uint64_t index) {
+    uint64_t size = 1;
+    int power = 0;
+    while (size < index + 1) {
+        power++;
+        size = 2 * size + 1;
+    }
+    while (size - 1 != index) {
+        size = (size - 1) >> 1;
+        power--;
+        index = index % size;
+    }
+    return uint64_t(1) << power;
+}
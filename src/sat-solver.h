@@ -0,0 +1,134 @@
+/**
+ * File: sat-solver.h
+ * -------------
+ * This interface defines a conflict-driven clause-learning SAT solver for
+ * formulas in conjunctive normal form, for satisfiability questions over
+ * far more variables than any truth table could cover.
+ */
+
+#ifndef SAT_SOLVER_H
+#define SAT_SOLVER_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Type: SatLiteral
+ * ----------------
+ * A variable or its negation, packed as twice the variable's index plus
+ * one when negated, so a literal and its negation differ only in the
+ * lowest bit and literals can index arrays directly.
+ */
+
+typedef int32_t SatLiteral;
+
+inline SatLiteral makeLiteral(int var, bool negated = false) {
+    return 2 * var + (negated ? 1 : 0);
+}
+
+inline SatLiteral negateLiteral(SatLiteral literal) {
+    return literal ^ 1;
+}
+
+inline int literalVariable(SatLiteral literal) {
+    return literal >> 1;
+}
+
+inline bool isNegated(SatLiteral literal) {
+    return literal & 1;
+}
+
+/**
+ * Type: SatSolverStats
+ * --------------------
+ * Counts of the work a solver has done over all its calls to solve.
+ */
+
+struct SatSolverStats {
+    uint64_t decisions;
+    uint64_t propagations;
+    uint64_t conflicts;
+    uint64_t learnedClauses;
+    uint64_t deletedClauses;
+    uint64_t restarts;
+};
+
+/**
+ * Class: SatSolver
+ * ----------------
+ * Decides whether a set of clauses can all be satisfied at once. The
+ * solver keeps two watched literals per clause for unit propagation,
+ * learns a first-UIP clause from every conflict, picks decision variables
+ * by VSIDS activity with saved phases, restarts on the Luby sequence and
+ * periodically forgets the learned clauses that have helped least.
+ *
+ * Clauses may be added before the first call to solve and between calls.
+ * After solve returns true, getModelValue reports the satisfying
+ * assignment it found for every variable.
+ */
+
+class SatSolver {
+public:
+    SatSolver();
+
+    int newVariable();
+    int getVariableCount() const;
+    void addClause(const std::vector<SatLiteral>& literals);
+
+    bool solve();
+    bool getModelValue(int var) const;
+    const SatSolverStats& getStats() const;
+
+private:
+    struct Clause {
+        std::vector<SatLiteral> literals;
+        int lbd;
+        bool learned;
+        bool deleted;
+    };
+    struct Watcher {
+        int clause;
+        SatLiteral blocker;
+    };
+
+    int8_t literalValue(SatLiteral literal) const;
+    int decisionLevel() const;
+    void enqueue(SatLiteral literal, int reason);
+    int attachClause(const std::vector<SatLiteral>& literals, bool learned, int lbd);
+    int propagate();
+    int analyze(int conflict, std::vector<SatLiteral>& learned);
+    bool isRedundant(SatLiteral literal) const;
+    int countLevels(const std::vector<SatLiteral>& literals);
+    void cancelUntil(int level);
+    void bumpVariable(int var);
+    int pickBranchVariable();
+    void reduceLearnedClauses();
+
+    void heapInsert(int var);
+    int heapRemoveMax();
+    void heapSiftUp(int position);
+    void heapSiftDown(int position);
+
+    std::vector<int8_t> values;
+    std::vector<int> levels;
+    std::vector<int> reasons;
+    std::vector<uint8_t> phases;
+    std::vector<uint8_t> seen;
+    std::vector<double> activities;
+    std::vector<int> heap;
+    std::vector<int> heapPositions;
+    std::vector<SatLiteral> trail;
+    std::vector<int> trailLimits;
+    size_t propagated;
+    std::vector<Clause> clauses;
+    std::vector<std::vector<Watcher>> watches;
+    std::vector<uint8_t> levelMarks;
+    std::vector<uint8_t> model;
+    double variableIncrement;
+    size_t learnedCount;
+    size_t maxLearned;
+    bool unsatisfiable;
+    SatSolverStats stats;
+};
+
+#endif // SAT_SOLVER_H
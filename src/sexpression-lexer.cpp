@@ -0,0 +1,108 @@
+/**
+ * File: sexpression-lexer.cpp
+ * -------------
+ * This file implements the sexpression-lexer.h interface.
+ */
+
+#include <cctype>
+#include <string>
+#include "sexpression-lexer.h"
+#include "pipeline-stats.h"
+using namespace std;
+
+static bool isDigit(char ch);
+static bool isWordCharacter(char ch);
+
+string SExpToken::text() const {
+    return string(start, length);
+}
+
+/**
+ * Implementation notes: SExpLexer
+ * -------------------------------
+ * The lexer keeps a raw cursor into the buffer and at most one token of
+ * lookahead, so every character is examined a constant number of times.
+ */
+
+SExpLexer::SExpLexer(const char *begin, const char *end) {
+    this->cursor = begin;
+    this->end = end;
+    this->hasLookahead = false;
+}
+
+SExpLexer::SExpLexer(const string& buffer) {
+    this->cursor = buffer.data();
+    this->end = buffer.data() + buffer.size();
+    this->hasLookahead = false;
+}
+
+SExpToken SExpLexer::nextToken() {
+    if (hasLookahead) {
+        hasLookahead = false;
+        return lookahead;
+    }
+    return scanToken();
+}
+
+const SExpToken& SExpLexer::peekToken() {
+    if (!hasLookahead) {
+        lookahead = scanToken();
+        hasLookahead = true;
+    }
+    return lookahead;
+}
+
+bool SExpLexer::hasMoreTokens() {
+    return peekToken().type != END_TOKEN;
+}
+
+SExpToken SExpLexer::scanToken() {
+    SExpToken token;
+    token.spaceBefore = false;
+    while (cursor < end && isspace(static_cast<unsigned char>(*cursor))) {
+        token.spaceBefore = true;
+        cursor++;
+    }
+    token.start = cursor;
+    if (cursor == end) {
+        token.type = END_TOKEN;
+    } else if (*cursor == '(') {
+        token.type = LPAREN_TOKEN;
+        cursor++;
+    } else if (*cursor == ')') {
+        token.type = RPAREN_TOKEN;
+        cursor++;
+    } else if (isDigit(*cursor)) {
+        token.type = NUMBER_TOKEN;
+        while (cursor < end && isDigit(*cursor)) cursor++;
+        if (cursor + 1 < end && *cursor == '.' && isDigit(cursor[1])) {
+            cursor++;
+            while (cursor < end && isDigit(*cursor)) cursor++;
+        }
+        if (cursor < end && (*cursor == 'e' || *cursor == 'E')) {
+            const char *exponent = cursor + 1;
+            if (exponent < end && (*exponent == '+' || *exponent == '-')) exponent++;
+            if (exponent < end && isDigit(*exponent)) {
+                cursor = exponent;
+                while (cursor < end && isDigit(*cursor)) cursor++;
+            }
+        }
+    } else if (isWordCharacter(*cursor)) {
+        token.type = WORD_TOKEN;
+        while (cursor < end && isWordCharacter(*cursor)) cursor++;
+    } else {
+        token.type = OPERATOR_TOKEN;
+        cursor++;
+    }
+    token.length = cursor - token.start;
+    if (token.type != END_TOKEN) STATS_TOKEN();
+    return token;
+}
+
+bool isDigit(char ch) {
+    return isdigit(static_cast<unsigned char>(ch));
+}
+
+bool isWordCharacter(char ch) {
+    return isalnum(static_cast<unsigned char>(ch));
+}
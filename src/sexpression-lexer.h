@@ -0,0 +1,65 @@
+/**
+ * File: sexpression-lexer.h
+ * -------------
+ * This interface defines a cursor-based lexer that splits a character
+ * buffer into the tokens of the S-expression grammar in a single pass.
+ * Tokens refer back into the buffer instead of copying it, so the buffer
+ * must outlive every token read from it.
+ */
+
+#ifndef SEXPRESSION_LEXER_H
+#define SEXPRESSION_LEXER_H
+
+#include <cstddef>
+#include <string>
+
+enum SExpTokenType {
+    LPAREN_TOKEN, RPAREN_TOKEN, NUMBER_TOKEN,
+    WORD_TOKEN, OPERATOR_TOKEN, END_TOKEN
+};
+
+/**
+ * Type: SExpToken
+ * ---------------
+ * A single token, given by its type and the range of characters it covers.
+ * The spaceBefore flag records whether whitespace separated this token
+ * from the one before it, which the reader needs to glue multi-token atoms.
+ */
+
+struct SExpToken {
+    SExpTokenType type;
+    const char *start;
+    size_t length;
+    bool spaceBefore;
+
+    std::string text() const;
+};
+
+/**
+ * Class: SExpLexer
+ * ----------------
+ * Scans tokens with the same rules the Stanford TokenScanner uses when set
+ * to ignore whitespace and scan numbers: words are runs of letters and
+ * digits, numbers may carry a fraction and an exponent, and every other
+ * character is an operator on its own.
+ */
+
+class SExpLexer {
+public:
+    SExpLexer(const char *begin, const char *end);
+    SExpLexer(const std::string& buffer);
+
+    SExpToken nextToken();
+    const SExpToken& peekToken();
+    bool hasMoreTokens();
+
+private:
+    SExpToken scanToken();
+
+    const char *cursor;
+    const char *end;
+    SExpToken lookahead;
+    bool hasLookahead;
+};
+
+#endif // SEXPRESSION_LEXER_H
@@ -5,132 +5,215 @@
  */
 
 
+#include <cctype>
 #include <iostream>
 #include <string>
+#include <vector>
 #include "error.h"
 #include "sexpressions.h"
+#include "sexpression-lexer.h"
 #include "sexpression-parser.h"
+#include "symbol-table.h"
+#include "pipeline-stats.h"
 #include "strlib.h"
 #include "tokenscanner.h"
 using namespace std;
 
-static bool isBalanced(const string& buffer);
-static bool tokenIsParen(const string& token);
-static bool isProperSyntax(const string& buffer);
-static bool isOnlyOperators(const string& buffer);
-static SExpression *readSE(TokenScanner& scanner);
-static SExpression *readSEList(TokenScanner& scanner);
-static SExpression *readST(const string& multTokenBuffer);
-static SExpression *readST(TokenScanner& scanner, const string& token);
-
-SExpression *parseOneSExp(TokenScanner& scanner) {
-    SExpression *sexp = readSE(scanner);
-    if (scanner.hasMoreTokens()) error("PARSE ERROR >> Unexpected token: \"" + scanner.nextToken() + "\"");
-    return sexp;
+static SExpression *readSE(SExpLexer& lexer, ExpressionArena *arena);
+static SExpression *readSEList(SExpLexer& lexer, ExpressionArena *arena);
+static SExpression *readSEStack(SExpLexer& lexer, bool readWholeList, ExpressionArena *arena);
+static SExpression *readGluedAtom(SExpLexer& lexer, const SExpToken& first, ExpressionArena *arena);
+static SExpression *readST(const SExpToken& token, ExpressionArena *arena);
+static SExpression *buildList(vector<SExpression *>& pending, size_t start, ExpressionArena *arena);
+static void abandon(vector<SExpression *>& pending, const string& message, ExpressionArena *arena);
+static bool isOnlyOperators(const char *start, const char *end);
+static bool isTokenIgnoringCase(const SExpToken& token, const char *word);
+static string trailingTokensMessage(SExpLexer& lexer);
+
+SExpression *parseOneSExp(TokenScanner& scanner, ExpressionArena *arena) {
+    string buffer = scanner.getInput();
+    scanner.setInput("");
+    return parseOneSExp(buffer, arena);
 }
 
-SExpression *parseAllSExp(TokenScanner& scanner) {
-    SExpression *sexp = readSEList(scanner);
-    if (scanner.hasMoreTokens()) error("PARSE ERROR >> Unexpected token: \"" + scanner.nextToken() + "\"");
-    return sexp;
+SExpression *parseAllSExp(TokenScanner& scanner, ExpressionArena *arena) {
+    string buffer = scanner.getInput();
+    scanner.setInput("");
+    return parseAllSExp(buffer, arena);
 }
 
-bool isBalanced(const string& buffer) {
-    int openParenValence = 0;
-    for (const char& ch : buffer) {
-        if (ch == '(') openParenValence++;
-        if (ch == ')') openParenValence--;
+SExpression *parseOneSExp(const string& buffer, ExpressionArena *arena) {
+    STATS_PHASE(SEXP_PARSE_PHASE);
+    SExpLexer lexer(buffer);
+    SExpression *sexp = readSE(lexer, arena);
+    if (lexer.hasMoreTokens()) {
+        if (arena == nullptr) delete sexp;
+        error(trailingTokensMessage(lexer));
     }
-    return openParenValence == 0;
+    return sexp;
 }
 
-bool tokenIsParen(const string& token) {
-    return token == "(" || token == ")";
+SExpression *parseAllSExp(const string& buffer, ExpressionArena *arena) {
+    STATS_PHASE(SEXP_PARSE_PHASE);
+    SExpLexer lexer(buffer);
+    return readSEList(lexer, arena);
 }
 
-bool isProperSyntax(const string& buffer) {
-    // Check if there are parentheses surrounding the list given.
-    for (const char& ch : buffer)
-        if (ch == '(' || ch == ')') return true;
-    // If there aren't, then assert that the buffer only consists of an atom.
-    return !stringContains(buffer, " ");
+SExpression *parseAllSExp(const char *begin, const char *end, ExpressionArena *arena) {
+    STATS_PHASE(SEXP_PARSE_PHASE);
+    SExpLexer lexer(begin, end);
+    return readSEList(lexer, arena);
+}
+
+/**
+ * Implementation notes: trailingTokensMessage
+ * -------------------------------------------
+ * Tokens left over after one whole expression are reported the way the
+ * old reader reported them, which looked at the parentheses of the whole
+ * line. Since the expression already read is balanced, the rest of the
+ * line decides: if its parentheses do not balance, or it has none, the
+ * line counts as unbalanced; otherwise the old list reader would have run
+ * out of tokens inside the extra list.
+ */
+
+string trailingTokensMessage(SExpLexer& lexer) {
+    int depth = 0;
+    bool sawParen = false;
+    while (lexer.hasMoreTokens()) {
+        SExpToken token = lexer.nextToken();
+        if (token.type == LPAREN_TOKEN) depth++;
+        if (token.type == RPAREN_TOKEN) depth--;
+        if (token.type == LPAREN_TOKEN || token.type == RPAREN_TOKEN) sawParen = true;
+    }
+    if (depth == 0 && sawParen) return "SExpression PARSE ERROR >> Unbalanced parentheses.";
+    return "PARSE ERROR >> Unbalanced parentheses.";
+}
+
+/**
+ * Implementation notes: readSE
+ * ----------------------------
+ * A lone atom at the top level may be spelled with several adjacent tokens,
+ * such as foo-bar, in which case the tokens are glued back into a single
+ * symbol. Anything starting with a parenthesis is handed to the stack
+ * reader below.
+ */
+
+SExpression *readSE(SExpLexer& lexer, ExpressionArena *arena) {
+    SExpToken token = lexer.peekToken();
+    if (token.type == END_TOKEN) return newNode<SNil>(arena);
+    if (token.type == LPAREN_TOKEN || token.type == RPAREN_TOKEN) return readSEStack(lexer, false, arena);
+    lexer.nextToken();
+    return readGluedAtom(lexer, token, arena);
 }
 
-bool isOnlyOperators(const string& buffer) {
-    for (const char& ch : buffer)
-        if (isalnum(ch) || tokenIsParen(charToString(ch))) return false;
-    return buffer.size() > 1;
+SExpression *readSEList(SExpLexer& lexer, ExpressionArena *arena) {
+    return readSEStack(lexer, true, arena);
 }
 
-SExpression *readSE(TokenScanner& scanner) {
-    SExpression *sexp = new SNil();
-    if (!scanner.hasMoreTokens()) return sexp;
-    string currentBuffer = scanner.getInput();
-    if (!isProperSyntax(currentBuffer) || isOnlyOperators(currentBuffer))
-        error("PARSE ERROR >> Invalid s-expression syntax.");
-    if (!isBalanced(currentBuffer)) error("PARSE ERROR >> Unbalanced parentheses.");
-    string token = scanner.nextToken();
-    if (!tokenIsParen(token)) {
-        if (!scanner.hasMoreTokens()) return readST(scanner, token);
-        if (scanner.hasMoreTokens() && !stringContains(currentBuffer, " ")) {
-            while (scanner.hasMoreTokens()) scanner.nextToken();
-            return readST(currentBuffer);
+/**
+ * Implementation notes: readSEStack
+ * ---------------------------------
+ * Rather than recursing on every nested list, the reader keeps the finished
+ * elements of all open lists in one pending vector, together with a stack
+ * recording where each open list begins. A closing parenthesis pops the
+ * innermost frame and conses its elements into a list, so each token is
+ * handled once and the C++ call stack stays flat however deep the input
+ * nests. When readWholeList is set the reader behaves as if the input were
+ * wrapped in one more pair of parentheses, which is what parseAllSExp needs.
+ * Both vectors are kept per thread and reused, so reading many small
+ * expressions in a row does not allocate them afresh every time.
+ */
+
+SExpression *readSEStack(SExpLexer& lexer, bool readWholeList, ExpressionArena *arena) {
+    static thread_local vector<SExpression *> pendingStack;
+    static thread_local vector<size_t> frameStack;
+    vector<SExpression *>& pending = pendingStack;
+    vector<size_t>& frames = frameStack;
+    pending.clear();
+    frames.clear();
+    if (readWholeList) frames.push_back(0);
+    do {
+        SExpToken token = lexer.nextToken();
+        if (token.type == END_TOKEN) {
+            if (readWholeList && frames.size() == 1) break;
+            abandon(pending, readWholeList ? "SExpression PARSE ERROR >> Unbalanced parentheses."
+                                           : "PARSE ERROR >> Unbalanced parentheses.", arena);
+        } else if (token.type == LPAREN_TOKEN) {
+            frames.push_back(pending.size());
+        } else if (token.type == RPAREN_TOKEN) {
+            if (frames.size() <= (readWholeList ? 1u : 0u))
+                abandon(pending, "PARSE ERROR >> Unbalanced parentheses.", arena);
+            size_t start = frames.back();
+            frames.pop_back();
+            SExpression *list = buildList(pending, start, arena);
+            pending.push_back(list);
+        } else {
+            pending.push_back(readST(token, arena));
         }
+    } while (!frames.empty());
+    if (readWholeList) return buildList(pending, 0, arena);
+    return pending.back();
+}
+
+SExpression *readGluedAtom(SExpLexer& lexer, const SExpToken& first, ExpressionArena *arena) {
+    const char *atomEnd = first.start + first.length;
+    while (lexer.hasMoreTokens()) {
+        SExpToken next = lexer.peekToken();
+        if (next.type == LPAREN_TOKEN || next.type == RPAREN_TOKEN) break;
+        if (next.spaceBefore) error("PARSE ERROR >> Invalid s-expression syntax.");
+        lexer.nextToken();
+        atomEnd = next.start + next.length;
     }
-    string SExpList;
-    TokenScanner SExpListTokens;
-    SExpListTokens.ignoreWhitespace();
-    SExpListTokens.scanNumbers();
-    while (scanner.hasMoreTokens()) {
-        token = scanner.nextToken();
-        if (token == ")" && !scanner.hasMoreTokens()) break;
-        SExpList += token + " ";
+    if (atomEnd == first.start + first.length) return readST(first, arena);
+    if (isOnlyOperators(first.start, atomEnd)) error("PARSE ERROR >> Invalid s-expression syntax.");
+    return newNode<SSymbol>(arena, globalSymbols().intern(first.start, atomEnd - first.start));
+}
+
+SExpression *readST(const SExpToken& token, ExpressionArena *arena) {
+    if (token.type == NUMBER_TOKEN) return newNode<SConstant>(arena, stringToReal(token.text()));
+    if (token.type == WORD_TOKEN || token.type == OPERATOR_TOKEN) {
+        if (isTokenIgnoringCase(token, "true") || isTokenIgnoringCase(token, "T")) return newNode<STrue>(arena);
+        else if (isTokenIgnoringCase(token, "false") || isTokenIgnoringCase(token, "F")) return newNode<SFalse>(arena);
+        return newNode<SSymbol>(arena, globalSymbols().intern(token.start, token.length));
     }
-    SExpListTokens.setInput(trim(SExpList));
-    return readSEList(SExpListTokens);
+    return newNode<SNil>(arena);
 }
 
-SExpression *readSEList(TokenScanner& scanner) {
-    SExpression *sexp = new SNil();
-    if (scanner.hasMoreTokens()) {
-        TokenScanner CARToken;
-        CARToken.ignoreWhitespace();
-        CARToken.scanNumbers();
-        string token = scanner.nextToken();
-        if (token == "(") {
-            string tokenList;
-            int openInnerParens = 0;
-            token = scanner.nextToken();
-            while (true) {
-                if (token == "(") openInnerParens++;
-                if (token == ")") openInnerParens--;
-                if (openInnerParens < 0) break;
-                if (!scanner.hasMoreTokens()) error("SExpression PARSE ERROR >> Unbalanced parentheses.");
-                tokenList += token + " ";
-                token = scanner.nextToken();
-            }
-            CARToken.setInput(trim(tokenList));
-            sexp = new SCons(readSEList(CARToken), readSEList(scanner));
-        }
-        else {
-            CARToken.setInput(token);
-            sexp = new SCons(readSE(CARToken), readSEList(scanner));
-        }
+SExpression *buildList(vector<SExpression *>& pending, size_t start, ExpressionArena *arena) {
+    SExpression *list = newNode<SNil>(arena);
+    for (size_t i = pending.size(); i > start; i--) list = newNode<SCons>(arena, pending[i - 1], list);
+    pending.resize(start);
+    return list;
+}
+
+void abandon(vector<SExpression *>& pending, const string& message, ExpressionArena *arena) {
+    if (arena == nullptr) {
+        for (SExpression *sexp : pending) delete sexp;
     }
-    return sexp;
+    pending.clear();
+    error(message);
 }
 
-SExpression *readST(const string& multTokenBuffer) {
-    return new SSymbol(multTokenBuffer);
+bool isOnlyOperators(const char *start, const char *end) {
+    for (const char *cursor = start; cursor < end; cursor++)
+        if (isalnum(static_cast<unsigned char>(*cursor))) return false;
+    return end - start > 1;
 }
 
-SExpression *readST(TokenScanner& scanner, const string& token) {
-    TokenScanner::TokenType type = scanner.getTokenType(token);
-    if (type == TokenScanner::NUMBER) return new SConstant(stringToReal(token));
-    if (type == TokenScanner::WORD || type == TokenScanner::OPERATOR) {
-        if (equalsIgnoreCase(token, "true") || equalsIgnoreCase(token, "T")) return new STrue();
-        else if (equalsIgnoreCase(token, "false") || equalsIgnoreCase(token, "F")) return new SFalse();
-        else return new SSymbol(token);
+/**
+ * Implementation notes: isTokenIgnoringCase
+ * -----------------------------------------
+ * Compares the token's characters with the word in place, since almost
+ * every symbol is checked against the boolean literals and building a
+ * string for each comparison would dominate the cost of reading it.
+ */
+
+bool isTokenIgnoringCase(const SExpToken& token, const char *word) {
+    size_t i = 0;
+    for (; i < token.length; i++) {
+        if (word[i] == '\0') return false;
+        if (tolower(static_cast<unsigned char>(token.start[i])) != tolower(static_cast<unsigned char>(word[i])))
+            return false;
     }
-    return new SNil();
+    return word[i] == '\0';
 }
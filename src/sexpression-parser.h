@@ -8,6 +8,7 @@
 #pragma once
 #include <string>
 #include "sexpressions.h"
+#include "expression-arena.h"
 #include "tokenscanner.h"
 
 /**
@@ -16,7 +17,33 @@
  * -------------------------------------------
  * Parses a complete S-expression from the specified TokenScanner object,
  * making sure that there are no tokens left in the scanner at the end.
+ * The whole input buffer of the scanner is read in a single pass, after
+ * which the scanner is left empty. When an arena is supplied every node is
+ * allocated inside it and the result must not be deleted.
  */
 
-SExpression *parseOneSExp(TokenScanner& scanner);
-SExpression *parseAllSExp(TokenScanner& scanner);
+SExpression *parseOneSExp(TokenScanner& scanner, ExpressionArena *arena = nullptr);
+SExpression *parseAllSExp(TokenScanner& scanner, ExpressionArena *arena = nullptr);
+
+/**
+ * Function: parseOneSExp
+ * Usage: SExpression *sexp = parseOneSExp(buffer);
+ * -------------------------------------------
+ * Parses S-expressions directly from a character buffer without going
+ * through a TokenScanner. parseOneSExp reads exactly one expression, while
+ * parseAllSExp reads every expression in the buffer into one list. Both run
+ * in time linear in the length of the buffer, whatever the nesting depth.
+ */
+
+SExpression *parseOneSExp(const std::string& buffer, ExpressionArena *arena = nullptr);
+SExpression *parseAllSExp(const std::string& buffer, ExpressionArena *arena = nullptr);
+
+/**
+ * Function: parseAllSExp
+ * Usage: SExpression *list = parseAllSExp(begin, end);
+ * -------------------------------------------
+ * Reads every expression in the characters from begin up to end, which
+ * lets a caller parse part of a larger buffer without copying it.
+ */
+
+SExpression *parseAllSExp(const char *begin, const char *end, ExpressionArena *arena = nullptr);
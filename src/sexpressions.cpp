@@ -5,13 +5,15 @@
  */
 
 #include <string>
+#include <vector>
 #include "sexpressions.h"
 #include "strlib.h"
 #include "error.h"
+#include "pipeline-stats.h"
 using namespace std;
 
 SExpression::SExpression() {
-    /* Empty */
+    childrenOwned = true;
 }
 
 SExpression::~SExpression() {
@@ -28,6 +30,11 @@ string SExpression::getSymbolName() const {
     return "";
 }
 
+SymbolId SExpression::getSymbolId() const {
+    error("getSymbolId: Illegal S-expression type.");
+    return kNoSymbol;
+}
+
 SExpression *SExpression::getCAR() const {
     error("getCAR: Illegal S-expression type.");
     return nullptr;
@@ -38,6 +45,63 @@ SExpression *SExpression::getCDR() const {
     return nullptr;
 }
 
+bool SExpression::ownsChildren() const {
+    return childrenOwned;
+}
+
+void SExpression::setOwnsChildren(bool owns) {
+    childrenOwned = owns;
+}
+
+#ifdef LFL_STATS
+
+/**
+ * Implementation notes: operator new and operator delete
+ * ------------------------------------------------------
+ * The pair counts the bytes of every node made on the heap, however it is
+ * made. Arena nodes are placed with the global placement new and never
+ * deleted, so neither operator sees them. Since the destructor is virtual
+ * the size passed to delete is that of the node's own class, which is
+ * what new counted when it made the node.
+ */
+
+void *SExpression::operator new(size_t size) {
+    void *node = ::operator new(size);
+    STATS_TREE_BYTES(size);
+    return node;
+}
+
+void SExpression::operator delete(void *node, size_t size) {
+    STATS_TREE_BYTES(-static_cast<int64_t>(size));
+    ::operator delete(node);
+}
+
+#endif
+
+/**
+ * Implementation notes: deleteChildren
+ * ------------------------------------
+ * Deleting a long list or a deeply nested one directly would recurse once
+ * per cell. Instead the children go onto a per-thread list that only the
+ * outermost call drains, so every nested destructor just adds its own
+ * children and returns.
+ */
+
+void SExpression::deleteChildren(SExpression *car, SExpression *cdr) {
+    static thread_local vector<SExpression *> pending;
+    static thread_local bool deleting = false;
+    if (car != nullptr) pending.push_back(car);
+    if (cdr != nullptr) pending.push_back(cdr);
+    if (deleting) return;
+    deleting = true;
+    while (!pending.empty()) {
+        SExpression *sexp = pending.back();
+        pending.pop_back();
+        delete sexp;
+    }
+    deleting = false;
+}
+
 /**
  * Implementation notes: SConstant
  * -------------------------------
@@ -76,11 +140,15 @@ double SConstant::getConstantValue() const {
  */
 
 SSymbol::SSymbol(const string& name) {
-    this->name = name;
+    this->symbol = globalSymbols().intern(name);
+}
+
+SSymbol::SSymbol(SymbolId symbol) {
+    this->symbol = symbol;
 }
 
 string SSymbol::toString() const {
-    return "SSymbol(" + name + ")";
+    return "SSymbol(" + getSymbolName() + ")";
 }
 
 SExpressionType SSymbol::getType() const {
@@ -97,7 +165,11 @@ bool SSymbol::isList() const {
 }
 
 string SSymbol::getSymbolName() const {
-    return name;
+    return globalSymbols().nameOf(symbol);
+}
+
+SymbolId SSymbol::getSymbolId() const {
+    return symbol;
 }
 
 /**
@@ -157,7 +229,12 @@ bool SFalse::isList() const {
 /**
  * Implementation notes: SCons
  * -------------------------------
- * TODO
+ * A list is a chain of cons cells down the cdr, and a nested list hangs
+ * off a car, so both long and deeply nested lists would make recursive
+ * code recurse once per cell. toList follows the cdr chain with an
+ * SListView, and toString prints the whole structure from an explicit
+ * stack whose entries are either an expression still to print or a piece
+ * of punctuation.
  */
 
 SCons::SCons(SExpression *car, SExpression *cdr) {
@@ -166,15 +243,38 @@ SCons::SCons(SExpression *car, SExpression *cdr) {
 }
 
 SCons::~SCons() {
-    delete car;
-    delete cdr;
+    if (!ownsChildren()) return;
+    deleteChildren(car, cdr);
 }
 
 string SCons::toString() const {
-    string stringifiedList;
-    LinkedList<SExpression *> expressionList = toList();
-    for (const SExpression *exp : expressionList) stringifiedList += exp->toString() + " ";
-    return "SCons(" + trimEnd(stringifiedList) + ")";
+    struct Piece {
+        const SExpression *sexp;
+        const char *text;
+    };
+    string result;
+    vector<Piece> pieces;
+    vector<const SExpression *> elements;
+    pieces.push_back({this, ""});
+    while (!pieces.empty()) {
+        Piece piece = pieces.back();
+        pieces.pop_back();
+        if (piece.sexp == nullptr) {
+            result += piece.text;
+        } else if (piece.sexp->getType() != CONS) {
+            result += piece.sexp->toString();
+        } else {
+            elements.clear();
+            for (SExpression *element : SListView(piece.sexp)) elements.push_back(element);
+            result += "SCons(";
+            pieces.push_back({nullptr, ")"});
+            for (size_t i = elements.size(); i-- > 0; ) {
+                pieces.push_back({elements[i], ""});
+                if (i > 0) pieces.push_back({nullptr, " "});
+            }
+        }
+    }
+    return result;
 }
 
 SExpressionType SCons::getType() const {
@@ -183,8 +283,7 @@ SExpressionType SCons::getType() const {
 
 LinkedList<SExpression *> SCons::toList() const {
     LinkedList<SExpression *> returnList;
-    returnList.add(car);
-    returnList.addAll(cdr->toList());
+    for (SExpression *element : SListView(this)) returnList.add(element);
     return returnList;
 }
 
@@ -225,3 +324,54 @@ LinkedList<SExpression *> SNil::toList() const {
 bool SNil::isList() const {
     return true;
 }
+
+/**
+ * Implementation notes: SListIterator
+ * -----------------------------------
+ * The iterator points at the cons cell holding the current element, and
+ * at nullptr once it has passed the last one, so comparing iterators is a
+ * pointer comparison and only advancing looks at the type of a cell.
+ */
+
+SListIterator::SListIterator(const SExpression *list) {
+    cell = nullptr;
+    if (list == nullptr) return;
+    if (list->getType() == CONS) cell = list;
+    else if (list->getType() != NIL) list->toList();
+}
+
+SExpression *SListIterator::operator*() const {
+    return cell->getCAR();
+}
+
+SListIterator& SListIterator::operator++() {
+    const SExpression *next = cell->getCDR();
+    cell = nullptr;
+    if (next->getType() == CONS) cell = next;
+    else if (next->getType() != NIL) next->toList();
+    return *this;
+}
+
+bool SListIterator::operator==(const SListIterator& other) const {
+    return cell == other.cell;
+}
+
+bool SListIterator::operator!=(const SListIterator& other) const {
+    return cell != other.cell;
+}
+
+SListView::SListView(const SExpression *list) {
+    this->list = list;
+}
+
+SListIterator SListView::begin() const {
+    return SListIterator(list);
+}
+
+SListIterator SListView::end() const {
+    return SListIterator(nullptr);
+}
+
+bool SListView::isEmpty() const {
+    return begin() == end();
+}
@@ -7,8 +7,11 @@
 #ifndef SEXP_H
 #define SEXP_H
 
+#include <cstddef>
 #include <string>
 #include "linkedlist.h"
+#include "expression-arena.h"
+#include "symbol-table.h"
 
 enum SExpressionType {
     CONSTANT, SYMBOL, TRUE,
@@ -26,8 +29,23 @@ public:
 
     virtual double getConstantValue() const;
     virtual std::string getSymbolName() const;
+    virtual SymbolId getSymbolId() const;
     virtual SExpression *getCAR() const;
     virtual SExpression *getCDR() const;
+
+    bool ownsChildren() const;
+    void setOwnsChildren(bool owns);
+
+#ifdef LFL_STATS
+    static void *operator new(std::size_t size);
+    static void operator delete(void *node, std::size_t size);
+#endif
+
+protected:
+    static void deleteChildren(SExpression *car, SExpression *cdr);
+
+private:
+    bool childrenOwned;
 };
 
 class SConstant : public SExpression {
@@ -45,13 +63,15 @@ private:
 class SSymbol : public SExpression {
 public:
     SSymbol(const std::string& name);
+    SSymbol(SymbolId symbol);
     virtual std::string toString() const override;
     virtual SExpressionType getType() const override;
     virtual LinkedList<SExpression *> toList() const override;
     virtual bool isList() const override;
     virtual std::string getSymbolName() const override;
+    virtual SymbolId getSymbolId() const override;
 private:
-    std::string name;
+    SymbolId symbol;
 };
 
 class STrue : public SExpression {
@@ -95,4 +115,43 @@ public:
     virtual bool isList() const override;
 };
 
+/**
+ * Class: SListIterator
+ * --------------------
+ * A forward iterator over the elements of a list, reading them straight
+ * off its cons cells. Reaching a tail that is neither a cons cell nor nil
+ * raises the same error as toList.
+ */
+
+class SListIterator {
+public:
+    SListIterator(const SExpression *list);
+    SExpression *operator*() const;
+    SListIterator& operator++();
+    bool operator==(const SListIterator& other) const;
+    bool operator!=(const SListIterator& other) const;
+private:
+    const SExpression *cell;
+};
+
+/**
+ * Class: SListView
+ * ----------------
+ * The elements of a list as a range, without copying them anywhere:
+ *
+ *     for (SExpression *element : SListView(list)) ...
+ *
+ * The view borrows the list, which must outlive it.
+ */
+
+class SListView {
+public:
+    SListView(const SExpression *list);
+    SListIterator begin() const;
+    SListIterator end() const;
+    bool isEmpty() const;
+private:
+    const SExpression *list;
+};
+
 #endif // SEXP_H
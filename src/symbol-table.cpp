@@ -0,0 +1,202 @@
+/**
+ * File: symbol-table.cpp
+ * -------------
+ * This file implements the symbol-table.h interface.
+ */
+
+#include <cstring>
+#include <string>
+#include "symbol-table.h"
+#include "error.h"
+#include "pipeline-stats.h"
+using namespace std;
+
+static const size_t kInitialBuckets = 256;
+static const size_t kFirstSegmentSize = 256;
+
+static uint32_t hashName(const char *start, size_t length);
+static int segmentOf(SymbolId id, size_t& offset);
+static uint64_t bucketWord(uint32_t hash, SymbolId id);
+
+/**
+ * Implementation notes: SymbolTable
+ * ---------------------------------
+ * Readers never take the lock, so everything they look at is either never
+ * changed once they can see it or changed by a single atomic store.
+ *
+ * Each bucket is one 64-bit word holding a name's hash above its id plus
+ * one, or zero for an empty bucket, and buckets are probed linearly. The
+ * hash lets a probe pass over other names without touching them. The
+ * names themselves live in segments that double in size, so an entry
+ * never moves once written, and a reference returned by nameOf stays
+ * valid for the life of the table.
+ *
+ * A writer fills in the new entry before it stores the bucket word or the
+ * new count, with release stores that a reader's acquire loads pair with,
+ * so a reader that finds an id also sees its name. The table doubles
+ * whenever it becomes half full. Growing builds a new bucket array from
+ * the remembered hashes and then swaps it in; the old array is kept until
+ * the table is destroyed, since a reader may still be probing it, and
+ * together the old arrays are never larger than the current one. A reader
+ * probing an old array may miss a name added since, and intern then looks
+ * again under the lock before adding it.
+ */
+
+SymbolTable::SymbolTable() {
+    for (int i = 0; i < kSegmentCount; i++) segments[i].store(nullptr, memory_order_relaxed);
+    count.store(0, memory_order_relaxed);
+    BucketArray *initial = new BucketArray;
+    initial->mask = kInitialBuckets - 1;
+    initial->words = new atomic<uint64_t>[kInitialBuckets];
+    for (size_t i = 0; i < kInitialBuckets; i++) initial->words[i].store(0, memory_order_relaxed);
+    tables.push_back(initial);
+    table.store(initial, memory_order_release);
+}
+
+SymbolTable::~SymbolTable() {
+    for (int i = 0; i < kSegmentCount; i++) delete[] segments[i].load(memory_order_relaxed);
+    for (BucketArray *old : tables) {
+        delete[] old->words;
+        delete old;
+    }
+}
+
+SymbolId SymbolTable::intern(const string& name) {
+    return intern(name.data(), name.size());
+}
+
+SymbolId SymbolTable::intern(const char *start, size_t length) {
+    STATS_SYMBOL_LOOKUP();
+    uint32_t hash = hashName(start, length);
+    SymbolId id;
+    findBucket(table.load(memory_order_acquire), start, length, hash, id);
+    if (id != kNoSymbol) return id;
+    lock_guard<mutex> guard(lock);
+    BucketArray *current = table.load(memory_order_relaxed);
+    size_t bucket = findBucket(current, start, length, hash, id);
+    if (id != kNoSymbol) return id;
+    id = count.load(memory_order_relaxed);
+    add(start, length, hash, id);
+    count.store(id + 1, memory_order_release);
+    if (2 * static_cast<size_t>(id + 1) > current->mask + 1) grow();
+    else current->words[bucket].store(bucketWord(hash, id), memory_order_release);
+    return id;
+}
+
+SymbolId SymbolTable::lookup(const string& name) const {
+    return lookup(name.data(), name.size());
+}
+
+SymbolId SymbolTable::lookup(const char *start, size_t length) const {
+    STATS_SYMBOL_LOOKUP();
+    SymbolId id;
+    findBucket(table.load(memory_order_acquire), start, length, hashName(start, length), id);
+    return id;
+}
+
+const string& SymbolTable::nameOf(SymbolId id) const {
+    if (id < 0 || id >= count.load(memory_order_acquire)) error("nameOf: Illegal symbol id.");
+    return entry(id).name;
+}
+
+int SymbolTable::size() const {
+    return count.load(memory_order_acquire);
+}
+
+const SymbolTable::Entry& SymbolTable::entry(SymbolId id) const {
+    size_t offset;
+    int segment = segmentOf(id, offset);
+    return segments[segment].load(memory_order_acquire)[offset];
+}
+
+/**
+ * Implementation notes: findBucket
+ * --------------------------------
+ * Returns the bucket holding the name, with its id in id, or else the
+ * empty bucket where the name would go, with kNoSymbol in id.
+ */
+
+size_t SymbolTable::findBucket(const BucketArray *buckets, const char *start, size_t length,
+                               uint32_t hash, SymbolId& id) const {
+    for (size_t bucket = hash & buckets->mask; ; bucket = (bucket + 1) & buckets->mask) {
+        uint64_t word = buckets->words[bucket].load(memory_order_acquire);
+        if (word == 0) {
+            id = kNoSymbol;
+            return bucket;
+        }
+        if (static_cast<uint32_t>(word >> 32) != hash) continue;
+        id = static_cast<SymbolId>(static_cast<uint32_t>(word)) - 1;
+        const string& name = entry(id).name;
+        if (name.size() == length && memcmp(name.data(), start, length) == 0) return bucket;
+    }
+}
+
+void SymbolTable::add(const char *start, size_t length, uint32_t hash, SymbolId id) {
+    size_t offset;
+    int segment = segmentOf(id, offset);
+    Entry *entries = segments[segment].load(memory_order_relaxed);
+    if (entries == nullptr) {
+        entries = new Entry[kFirstSegmentSize << segment];
+        segments[segment].store(entries, memory_order_release);
+    }
+    entries[offset].hash = hash;
+    entries[offset].name.assign(start, length);
+}
+
+void SymbolTable::grow() {
+    size_t size = 2 * (table.load(memory_order_relaxed)->mask + 1);
+    BucketArray *bigger = new BucketArray;
+    bigger->mask = size - 1;
+    bigger->words = new atomic<uint64_t>[size];
+    for (size_t i = 0; i < size; i++) bigger->words[i].store(0, memory_order_relaxed);
+    SymbolId ids = count.load(memory_order_relaxed);
+    for (SymbolId id = 0; id < ids; id++) {
+        uint32_t hash = entry(id).hash;
+        size_t bucket = hash & bigger->mask;
+        while (bigger->words[bucket].load(memory_order_relaxed) != 0) bucket = (bucket + 1) & bigger->mask;
+        bigger->words[bucket].store(bucketWord(hash, id), memory_order_relaxed);
+    }
+    tables.push_back(bigger);
+    table.store(bigger, memory_order_release);
+}
+
+SymbolTable& globalSymbols() {
+    static SymbolTable symbols;
+    return symbols;
+}
+
+/**
+ * Implementation notes: hashName
+ * ------------------------------
+ * FNV-1a, which is short, fast on the short names formulas use, and
+ * spreads them well enough for linear probing.
+ */
+
+uint32_t hashName(const char *start, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= static_cast<unsigned char>(start[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Implementation notes: segmentOf
+ * -------------------------------
+ * Segment k holds kFirstSegmentSize << k entries, so it starts at id
+ * kFirstSegmentSize * (2^k - 1), and the segment of an id is the position
+ * of the highest set bit of id / kFirstSegmentSize + 1.
+ */
+
+int segmentOf(SymbolId id, size_t& offset) {
+    size_t blocks = static_cast<size_t>(id) / kFirstSegmentSize + 1;
+    int segment = 0;
+    while (blocks >>= 1) segment++;
+    offset = static_cast<size_t>(id) - kFirstSegmentSize * ((size_t(1) << segment) - 1);
+    return segment;
+}
+
+uint64_t bucketWord(uint32_t hash, SymbolId id) {
+    return (uint64_t(hash) << 32) | static_cast<uint32_t>(id + 1);
+}
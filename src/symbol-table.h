@@ -0,0 +1,87 @@
+/**
+ * File: symbol-table.h
+ * -------------
+ * This interface defines the table that interns symbol names. Every
+ * distinct name is stored once and identified by a small integer, so that
+ * the rest of the interpreter can compare and look up symbols by index
+ * instead of by string.
+ */
+
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+typedef int SymbolId;
+
+const SymbolId kNoSymbol = -1;
+
+/**
+ * Class: SymbolTable
+ * ------------------
+ * An open-addressing hash table from names to dense ids, starting at 0.
+ * Names can be interned straight from a character range, so a lexer can
+ * intern a symbol without first copying it into a std::string. Interned
+ * names are never removed and references to them stay valid.
+ *
+ * One table can be shared by threads parsing and evaluating in parallel.
+ * Looking up a name, interning one that is already there, and nameOf take
+ * no lock, so they scale with the number of threads; only interning a new
+ * name takes the table's lock, which keeps writers apart from each other.
+ */
+
+class SymbolTable {
+public:
+    SymbolTable();
+    ~SymbolTable();
+
+    SymbolId intern(const std::string& name);
+    SymbolId intern(const char *start, size_t length);
+    SymbolId lookup(const std::string& name) const;
+    SymbolId lookup(const char *start, size_t length) const;
+    const std::string& nameOf(SymbolId id) const;
+    int size() const;
+
+private:
+    struct Entry {
+        uint32_t hash;
+        std::string name;
+    };
+    struct BucketArray {
+        size_t mask;
+        std::atomic<uint64_t> *words;
+    };
+
+    static const int kSegmentCount = 32;
+
+    const Entry& entry(SymbolId id) const;
+    size_t findBucket(const BucketArray *buckets, const char *start, size_t length,
+                      uint32_t hash, SymbolId& id) const;
+    void add(const char *start, size_t length, uint32_t hash, SymbolId id);
+    void grow();
+
+    std::atomic<Entry *> segments[kSegmentCount];
+    std::atomic<int> count;
+    std::atomic<BucketArray *> table;
+    std::vector<BucketArray *> tables;
+    std::mutex lock;
+
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+};
+
+/**
+ * Function: globalSymbols
+ * Usage: SymbolId id = globalSymbols().intern(name);
+ * -------------------------------------------
+ * Returns the table shared by the parsers, expressions and contexts.
+ */
+
+SymbolTable& globalSymbols();
+
+#endif // SYMBOL_TABLE_H
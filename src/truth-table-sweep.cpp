@@ -0,0 +1,131 @@
+/**
+ * File: truth-table-sweep.cpp
+ * -------------
+ * This file implements the truth-table-sweep.h interface.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "truth-table-sweep.h"
+#include "error.h"
+using namespace std;
+
+static const uint64_t kBlocksPerClaim = 64;
+
+static double secondsSince(const chrono::steady_clock::time_point& start);
+
+/**
+ * Implementation notes: findRow
+ * -----------------------------
+ * Threads claim runs of blocks from a shared counter, so the runs are
+ * handed out in table order and a thread that draws easy rows simply
+ * claims more of them. The first row found so far is kept in an atomic
+ * that only ever decreases. A thread gives up on a block once it starts
+ * at or after that row. Every block before the first row with the wanted
+ * value was claimed before any block after it and is never given up on,
+ * so the search reports the same row as a sequential one would.
+ *
+ * The calling thread takes part in the sweep. It sweeps the first run of
+ * blocks alone before starting any other thread, so a formula decided in
+ * its first few thousand rows, or too small to share out, never pays for
+ * starting threads. An evaluation error stops every thread and is raised
+ * again once they have all finished.
+ */
+
+SweepResult findRow(const TruthTable& table, bool value, int threadCount) {
+    uint64_t rowCount = table.getRowCount();
+    uint64_t blockCount = table.getBlockCount();
+    uint64_t claims = (blockCount + kBlocksPerClaim - 1) / kBlocksPerClaim;
+    threadCount = static_cast<int>(max<uint64_t>(1, min<uint64_t>(threadCount, claims)));
+    atomic<uint64_t> nextBlock(0);
+    atomic<uint64_t> firstRow(rowCount);
+    atomic<bool> failed(false);
+    mutex failureLock;
+    string failure;
+    SweepResult result;
+    result.threads.assign(threadCount, { 0, 0 });
+    auto start = chrono::steady_clock::now();
+
+    auto sweep = [&](int index, uint64_t maxClaims) {
+        auto threadStart = chrono::steady_clock::now();
+        SweepThreadStats& stats = result.threads[index];
+        try {
+            TruthTable::Workspace workspace = table.newWorkspace();
+            LaneBlock lanes;
+            bool done = false;
+            for (uint64_t claim = 0; claim < maxClaims && !done && !failed; claim++) {
+                uint64_t first = nextBlock.fetch_add(kBlocksPerClaim);
+                uint64_t last = min(blockCount, first + kBlocksPerClaim);
+                if (first >= blockCount) break;
+                for (uint64_t block = first; block < last; block++) {
+                    uint64_t blockRow = block * kLanesPerBlock;
+                    if (blockRow >= firstRow.load(memory_order_relaxed)) {
+                        done = true;
+                        break;
+                    }
+                    table.evaluateBlock(block, lanes, workspace);
+                    stats.rows += min<uint64_t>(kLanesPerBlock, rowCount - blockRow);
+                    uint64_t row;
+                    if (table.findRowInBlock(block, lanes, value, row)) {
+                        uint64_t current = firstRow.load();
+                        while (row < current && !firstRow.compare_exchange_weak(current, row)) {
+                            /* Empty */
+                        }
+                        done = true;
+                        break;
+                    }
+                }
+            }
+        } catch (ErrorException& ex) {
+            lock_guard<mutex> guard(failureLock);
+            if (!failed) failure = ex.getMessage();
+            failed = true;
+        }
+        stats.seconds += secondsSince(threadStart);
+    };
+
+    sweep(0, 1);
+    if (!failed && firstRow == rowCount && nextBlock < blockCount) {
+        vector<thread> threads;
+        for (int i = 1; i < threadCount; i++) threads.emplace_back(sweep, i, UINT64_MAX);
+        sweep(0, UINT64_MAX);
+        for (thread& worker : threads) worker.join();
+    }
+    if (failed) error(failure);
+    result.seconds = secondsSince(start);
+    result.row = firstRow;
+    result.found = result.row < rowCount;
+    return result;
+}
+
+int defaultSweepThreads() {
+    return max(1u, thread::hardware_concurrency());
+}
+
+void printSweepStats(const SweepResult& result, ostream& out) {
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    uint64_t rows = 0;
+    for (const SweepThreadStats& stats : result.threads) rows += stats.rows;
+    out << rows << " rows evaluated on " << result.threads.size() << " threads in "
+        << fixed << setprecision(3) << result.seconds * 1e3 << " ms" << endl;
+    for (size_t i = 0; i < result.threads.size(); i++) {
+        const SweepThreadStats& stats = result.threads[i];
+        double rate = stats.seconds > 0 ? stats.rows / stats.seconds / 1e6 : 0;
+        out << "  thread " << i << ": " << stats.rows << " rows, "
+            << setprecision(2) << rate << " M rows/s" << endl;
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+double secondsSince(const chrono::steady_clock::time_point& start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
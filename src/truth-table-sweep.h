@@ -0,0 +1,78 @@
+/**
+ * File: truth-table-sweep.h
+ * -------------
+ * This interface defines a search through the rows of a truth table that
+ * shares the assignment space out across threads, for deciding whether a
+ * formula is a tautology or satisfiable without waiting for the whole
+ * table when the answer turns up early.
+ */
+
+#ifndef TRUTH_TABLE_SWEEP_H
+#define TRUTH_TABLE_SWEEP_H
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "truth-table.h"
+
+/**
+ * Type: SweepThreadStats
+ * ----------------------
+ * What one thread of a sweep did: how many rows it evaluated and how long
+ * it spent doing so.
+ */
+
+struct SweepThreadStats {
+    uint64_t rows;
+    double seconds;
+};
+
+/**
+ * Type: SweepResult
+ * -----------------
+ * The outcome of findRow. When found is true, row is the first row of the
+ * table with the value that was looked for, numbered as in TruthTable.
+ */
+
+struct SweepResult {
+    bool found;
+    uint64_t row;
+    double seconds;
+    std::vector<SweepThreadStats> threads;
+};
+
+/**
+ * Function: findRow
+ * Usage: SweepResult result = findRow(table, false, threadCount);
+ * -------------------------------------------
+ * Looks for a row in which the formula has the given value, evaluating
+ * blocks of rows on up to threadCount threads, each with its own
+ * workspace. Every thread stops as soon as the rows still left to it come
+ * after a row already found, so a search for a counterexample to a
+ * tautology, or for a model of a satisfiable formula, usually ends long
+ * before the table does. The row reported is always the first such row,
+ * however many threads took part.
+ */
+
+SweepResult findRow(const TruthTable& table, bool value, int threadCount);
+
+/**
+ * Function: defaultSweepThreads
+ * Usage: int threadCount = defaultSweepThreads();
+ * -------------------------------------------
+ * Returns the number of threads a sweep uses when nothing else is asked
+ * for, which is one per core.
+ */
+
+int defaultSweepThreads();
+
+/**
+ * Function: printSweepStats
+ * Usage: printSweepStats(result, out);
+ * -------------------------------------------
+ * Prints the rows evaluated by each thread of a sweep and its throughput.
+ */
+
+void printSweepStats(const SweepResult& result, std::ostream& out);
+
+#endif // TRUTH_TABLE_SWEEP_H
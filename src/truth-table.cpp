@@ -0,0 +1,305 @@
+/**
+ * File: truth-table.cpp
+ * -------------
+ * This file implements the truth-table.h interface.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "truth-table.h"
+#include "error.h"
+#include "strlib.h"
+using namespace std;
+
+static const int kMaxVariables = 40;
+static const int kMaxPrintedVariables = 16;
+static const int kLaneWordBits = kLaneWords == 8 ? 3 : kLaneWords == 4 ? 2 : kLaneWords == 2 ? 1 : 0;
+static const int kLaneBlockBits = 6 + kLaneWordBits;
+
+static void fillLanes(LaneBlock& lanes, uint64_t word);
+static void fillVariable(LaneBlock& lanes, int position, uint64_t block);
+static int popcount(uint64_t word);
+static int countTrailingZeros(uint64_t word);
+
+string formulaClassToString(FormulaClass formulaClass) {
+    switch (formulaClass) {
+    case TAUTOLOGY: return "tautology";
+    case CONTRADICTION: return "contradiction";
+    default: return "contingent";
+    }
+}
+
+/**
+ * Implementation notes: runLanes
+ * ------------------------------
+ * Runs the same instructions as CompiledFormula::run, but every value on
+ * the stack is a LaneBlock holding kLanesPerBlock assignments at once.
+ * A SKIP cannot jump for some lanes and not others, so it does nothing.
+ */
+
+LaneWorkspace newLaneWorkspace(const CompiledFormula& formula) {
+    LaneWorkspace workspace;
+    workspace.values.resize(formula.getSlotCount());
+    workspace.stack.resize(formula.getMaxStackDepth());
+    workspace.saved.resize(formula.getMaxBindingDepth());
+    return workspace;
+}
+
+void runLanes(const CompiledFormula& formula, LaneWorkspace& workspace, LaneBlock& result) {
+    LaneBlock *values = workspace.values.data();
+    LaneBlock *stack = workspace.stack.data();
+    LaneBlock *saved = workspace.saved.data();
+    int top = 0;
+    int savedTop = 0;
+    for (const LangInstruction& instruction : formula.getInstructions()) {
+        int slot = instruction.operand;
+        switch (instruction.opcode) {
+        case PUSH_FALSE:
+            fillLanes(stack[top++], 0);
+            break;
+        case PUSH_TRUE:
+            fillLanes(stack[top++], ~uint64_t(0));
+            break;
+        case LOAD_SLOT:
+            stack[top++] = values[slot];
+            break;
+        case NOT_OP:
+            for (int w = 0; w < kLaneWords; w++) stack[top - 1].words[w] = ~stack[top - 1].words[w];
+            break;
+        case AND_OP:
+            top--;
+            for (int w = 0; w < kLaneWords; w++) stack[top - 1].words[w] &= stack[top].words[w];
+            break;
+        case OR_OP:
+            top--;
+            for (int w = 0; w < kLaneWords; w++) stack[top - 1].words[w] |= stack[top].words[w];
+            break;
+        case IMP_OP:
+            top--;
+            for (int w = 0; w < kLaneWords; w++)
+                stack[top - 1].words[w] = ~stack[top - 1].words[w] | stack[top].words[w];
+            break;
+        case IFF_OP:
+            top--;
+            for (int w = 0; w < kLaneWords; w++)
+                stack[top - 1].words[w] = ~(stack[top - 1].words[w] ^ stack[top].words[w]);
+            break;
+        case BIND_SLOT:
+            saved[savedTop++] = values[slot];
+            values[slot] = stack[--top];
+            break;
+        case UNBIND_SLOT:
+            values[slot] = saved[--savedTop];
+            break;
+        case STORE_SLOT:
+            values[slot] = stack[top - 1];
+            break;
+        case AND_SKIP: case OR_SKIP: case IMP_SKIP:
+            break;
+        case FAIL_OP:
+            error("EVALUATION ERROR >> Attempted null evaluation.");
+        }
+    }
+    result = stack[0];
+}
+
+/**
+ * Implementation notes: findFreeSlots
+ * -----------------------------------
+ * Since runLanes ignores the SKIPs, the instructions run in the order they
+ * are listed, and one pass over them can follow which slots a let binds
+ * and which ones a set has stored. A set inside a let of the same name
+ * stores only into the binding, which the let's UNBIND throws away.
+ */
+
+vector<int> findFreeSlots(const CompiledFormula& formula) {
+    vector<int> bindDepth(formula.getSlotCount(), 0);
+    vector<bool> settled(formula.getSlotCount(), false);
+    vector<int> slots;
+    for (const LangInstruction& instruction : formula.getInstructions()) {
+        int slot = instruction.operand;
+        if (instruction.opcode == BIND_SLOT) bindDepth[slot]++;
+        else if (instruction.opcode == UNBIND_SLOT) bindDepth[slot]--;
+        else if ((instruction.opcode == LOAD_SLOT || instruction.opcode == STORE_SLOT)
+                 && bindDepth[slot] == 0 && !settled[slot]) {
+            settled[slot] = true;
+            if (instruction.opcode == LOAD_SLOT) slots.push_back(slot);
+        }
+    }
+    return slots;
+}
+
+/**
+ * Implementation notes: TruthTable
+ * --------------------------------
+ * The table runs the formula with runLanes, one block of rows at a time.
+ * The free variables are given the bit patterns of the row
+ * index: the six lowest bit positions vary within each word, the next few
+ * vary from word to word inside a block, and the rest are constant across
+ * a whole block.
+ */
+
+TruthTable::TruthTable(const LangExpression *lexp) : formula(lexp) {
+    variableSlots = findFreeSlots(formula);
+    slotPositions.assign(formula.getSlotCount(), -1);
+    if (variableSlots.size() > static_cast<size_t>(kMaxVariables))
+        error("TRUTH TABLE ERROR >> Too many variables: " + integerToString(variableSlots.size()));
+    int variableCount = variableSlots.size();
+    for (int i = 0; i < variableCount; i++) slotPositions[variableSlots[i]] = variableCount - 1 - i;
+}
+
+int TruthTable::getVariableCount() const {
+    return variableSlots.size();
+}
+
+string TruthTable::getVariableName(int index) const {
+    return formula.getSlotName(variableSlots[index]);
+}
+
+uint64_t TruthTable::getRowCount() const {
+    return uint64_t(1) << variableSlots.size();
+}
+
+uint64_t TruthTable::getBlockCount() const {
+    return (getRowCount() + kLanesPerBlock - 1) / kLanesPerBlock;
+}
+
+TruthTable::Workspace TruthTable::newWorkspace() const {
+    return newLaneWorkspace(formula);
+}
+
+void TruthTable::evaluateBlock(uint64_t block, LaneBlock& result, Workspace& workspace) const {
+    for (int slot : variableSlots) fillVariable(workspace.values[slot], slotPositions[slot], block);
+    runLanes(formula, workspace, result);
+}
+
+/**
+ * Implementation notes: countTrueRows
+ * -----------------------------------
+ * Only a table with fewer rows than one block has lanes that do not
+ * correspond to any row, and those are masked off before counting. The
+ * same goes for findRowInBlock, which must not report a row that is not
+ * in the table.
+ */
+
+uint64_t TruthTable::countTrueRows(uint64_t block, const LaneBlock& result) const {
+    uint64_t rowCount = getRowCount();
+    uint64_t firstRow = block * kLanesPerBlock;
+    uint64_t count = 0;
+    for (int w = 0; w < kLaneWords; w++) {
+        uint64_t wordRow = firstRow + 64 * w;
+        if (wordRow >= rowCount) break;
+        uint64_t word = result.words[w];
+        if (rowCount - wordRow < 64) word &= (uint64_t(1) << (rowCount - wordRow)) - 1;
+        count += popcount(word);
+    }
+    return count;
+}
+
+bool TruthTable::findRowInBlock(uint64_t block, const LaneBlock& result, bool value, uint64_t& row) const {
+    uint64_t rowCount = getRowCount();
+    uint64_t firstRow = block * kLanesPerBlock;
+    for (int w = 0; w < kLaneWords; w++) {
+        uint64_t wordRow = firstRow + 64 * w;
+        if (wordRow >= rowCount) break;
+        uint64_t word = value ? result.words[w] : ~result.words[w];
+        if (rowCount - wordRow < 64) word &= (uint64_t(1) << (rowCount - wordRow)) - 1;
+        if (word != 0) {
+            row = wordRow + countTrailingZeros(word);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t TruthTable::countModels() const {
+    Workspace workspace = newWorkspace();
+    LaneBlock result;
+    uint64_t models = 0;
+    for (uint64_t block = 0; block < getBlockCount(); block++) {
+        evaluateBlock(block, result, workspace);
+        models += countTrueRows(block, result);
+    }
+    return models;
+}
+
+FormulaClass TruthTable::classify() const {
+    Workspace workspace = newWorkspace();
+    LaneBlock result;
+    uint64_t rowsSeen = 0;
+    uint64_t models = 0;
+    for (uint64_t block = 0; block < getBlockCount(); block++) {
+        evaluateBlock(block, result, workspace);
+        models += countTrueRows(block, result);
+        rowsSeen = min(getRowCount(), rowsSeen + kLanesPerBlock);
+        if (models != 0 && models != rowsSeen) return CONTINGENT;
+    }
+    return models == 0 ? CONTRADICTION : TAUTOLOGY;
+}
+
+void TruthTable::print(ostream& out) const {
+    int variableCount = getVariableCount();
+    if (variableCount > kMaxPrintedVariables)
+        error("TRUTH TABLE ERROR >> Too many variables to print a table: " + integerToString(variableCount));
+    vector<string> names;
+    for (int i = 0; i < variableCount; i++) {
+        names.push_back(getVariableName(i));
+        out << names[i] << " ";
+    }
+    out << "| value" << endl;
+    Workspace workspace = newWorkspace();
+    LaneBlock result;
+    for (uint64_t block = 0; block < getBlockCount(); block++) {
+        evaluateBlock(block, result, workspace);
+        for (int lane = 0; lane < kLanesPerBlock; lane++) {
+            uint64_t row = block * kLanesPerBlock + lane;
+            if (row >= getRowCount()) break;
+            for (int i = 0; i < variableCount; i++) {
+                bool value = (row >> (variableCount - 1 - i)) & 1;
+                out << (value ? "T" : "F") << string(names[i].size(), ' ');
+            }
+            bool value = (result.words[lane / 64] >> (lane % 64)) & 1;
+            out << "| " << (value ? "T" : "F") << endl;
+        }
+    }
+}
+
+void fillLanes(LaneBlock& lanes, uint64_t word) {
+    for (int w = 0; w < kLaneWords; w++) lanes.words[w] = word;
+}
+
+void fillVariable(LaneBlock& lanes, int position, uint64_t block) {
+    static const uint64_t kWordPatterns[] = {
+        0xAAAAAAAAAAAAAAAAULL, 0xCCCCCCCCCCCCCCCCULL, 0xF0F0F0F0F0F0F0F0ULL,
+        0xFF00FF00FF00FF00ULL, 0xFFFF0000FFFF0000ULL, 0xFFFFFFFF00000000ULL
+    };
+    if (position < 6) {
+        fillLanes(lanes, kWordPatterns[position]);
+    } else if (position < kLaneBlockBits) {
+        for (int w = 0; w < kLaneWords; w++)
+            lanes.words[w] = ((w >> (position - 6)) & 1) ? ~uint64_t(0) : 0;
+    } else {
+        fillLanes(lanes, ((block >> (position - kLaneBlockBits)) & 1) ? ~uint64_t(0) : 0);
+    }
+}
+
+int popcount(uint64_t word) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(word);
+#else
+    int count = 0;
+    for (; word != 0; word &= word - 1) count++;
+    return count;
+#endif
+}
+
+int countTrailingZeros(uint64_t word) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    int count = 0;
+    for (; (word & 1) == 0; word >>= 1) count++;
+    return count;
+#endif
+}
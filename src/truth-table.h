@@ -0,0 +1,133 @@
+/**
+ * File: truth-table.h
+ * -------------
+ * This interface defines a bit-parallel truth-table engine. Instead of
+ * evaluating a formula once per assignment, it packs consecutive rows of
+ * the table into the bits of machine words and runs every connective as a
+ * bitwise operation, covering 64 rows per word and several words per
+ * instruction on machines with wide vector registers.
+ */
+
+#ifndef TRUTH_TABLE_H
+#define TRUTH_TABLE_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "langexpressions.h"
+#include "langexpression-compiler.h"
+
+/**
+ * Constant: kLaneWords
+ * --------------------
+ * The number of 64-bit words processed together by each instruction. The
+ * fixed-size loops over a LaneBlock are written so that the compiler turns
+ * them into single AVX-512 or AVX2 operations when built for those targets.
+ */
+
+#if defined(__AVX512F__)
+const int kLaneWords = 8;
+#elif defined(__AVX2__)
+const int kLaneWords = 4;
+#else
+const int kLaneWords = 2;
+#endif
+
+const int kLanesPerBlock = 64 * kLaneWords;
+
+struct LaneBlock {
+    uint64_t words[kLaneWords];
+};
+
+/**
+ * Type: LaneWorkspace
+ * -------------------
+ * The lanes of every slot of one compiled formula, and the scratch stacks
+ * runLanes needs to run it, as sized by newLaneWorkspace.
+ */
+
+struct LaneWorkspace {
+    std::vector<LaneBlock> values;
+    std::vector<LaneBlock> stack;
+    std::vector<LaneBlock> saved;
+};
+
+/**
+ * Function: newLaneWorkspace
+ * Usage: LaneWorkspace workspace = newLaneWorkspace(formula);
+ * -------------------------------------------
+ * Returns a workspace large enough to run the given formula.
+ */
+
+LaneWorkspace newLaneWorkspace(const CompiledFormula& formula);
+
+/**
+ * Function: runLanes
+ * Usage: runLanes(formula, workspace, result);
+ * -------------------------------------------
+ * Runs a compiled formula on kLanesPerBlock assignments at once, one per
+ * lane, and stores the formula's value in each lane of result. The caller
+ * fills in the lanes of every slot the formula reads before binding it.
+ * Every operand is evaluated, as under strict evaluation, and a set or a
+ * let changes only the lanes in the workspace.
+ */
+
+void runLanes(const CompiledFormula& formula, LaneWorkspace& workspace, LaneBlock& result);
+
+/**
+ * Function: findFreeSlots
+ * Usage: vector<int> slots = findFreeSlots(formula);
+ * -------------------------------------------
+ * Returns the slots whose value runLanes takes from outside the formula,
+ * in order of first use: those read while no let binds them and before
+ * a set outside every let of the same name has stored them. These are the
+ * only slots a caller has to fill in.
+ */
+
+std::vector<int> findFreeSlots(const CompiledFormula& formula);
+
+enum FormulaClass {
+    TAUTOLOGY, CONTRADICTION, CONTINGENT
+};
+
+std::string formulaClassToString(FormulaClass formulaClass);
+
+/**
+ * Class: TruthTable
+ * -----------------
+ * The truth table of one formula over its free variables, listed in order
+ * of first appearance, as found by findFreeSlots, so a variable that a set
+ * assigns before it is ever read is not one of them. Row r assigns the
+ * first variable the most significant bit of r, so rows run from
+ * all-false to all-true. Formulas containing set are evaluated strictly
+ * in every row and never touch a global context.
+ */
+
+class TruthTable {
+public:
+    typedef LaneWorkspace Workspace;
+
+    TruthTable(const LangExpression *lexp);
+
+    int getVariableCount() const;
+    std::string getVariableName(int index) const;
+    uint64_t getRowCount() const;
+    uint64_t getBlockCount() const;
+
+    Workspace newWorkspace() const;
+    void evaluateBlock(uint64_t block, LaneBlock& result, Workspace& workspace) const;
+    uint64_t countTrueRows(uint64_t block, const LaneBlock& result) const;
+    bool findRowInBlock(uint64_t block, const LaneBlock& result, bool value, uint64_t& row) const;
+
+    uint64_t countModels() const;
+    FormulaClass classify() const;
+    void print(std::ostream& out) const;
+
+private:
+    CompiledFormula formula;
+    std::vector<int> variableSlots;
+    std::vector<int> slotPositions;
+};
+
+#endif // TRUTH_TABLE_H
@@ -0,0 +1,317 @@
+/**
+ * File: tseitin-encoder.cpp
+ * -------------
+ * This file implements the tseitin-encoder.h interface.
+ */
+
+#include <vector>
+#include "tseitin-encoder.h"
+#include "error.h"
+using namespace std;
+
+static const SatLiteral kNoLiteral = -1;
+
+/**
+ * Implementation notes: TseitinEncoder
+ * ------------------------------------
+ * Constants are one solver variable forced true by a unit clause and its
+ * negation. The gates fold away constant operands and operands that are
+ * equal or opposite, which costs nothing and keeps formulas full of
+ * constants from producing clauses at all.
+ */
+
+TseitinEncoder::TseitinEncoder(SatSolver& solver) : solver(solver) {
+    trueLiteral = makeLiteral(solver.newVariable());
+    solver.addClause({ trueLiteral });
+    version = 0;
+}
+
+/**
+ * Implementation notes: encode
+ * ----------------------------
+ * Walks the formula with an explicit stack, in the same order as the
+ * compiler, so formulas of any depth can be encoded and a set in a first
+ * operand is seen by the second. Operand literals pile up on a stack of
+ * their own and each connective's task combines the top two; an n-ary
+ * connective gets one such task after each operand but the first, so it
+ * is encoded as a chain of binary gates. A let binds
+ * its variable to the binding's literal for the length of its body and
+ * then puts back whatever the variable stood for before, and a set
+ * rebinds it for the rest of the enclosing scope.
+ *
+ * Every change of binding bumps a version number. A node's literal is
+ * remembered together with the version it was encoded under, provided
+ * its own subtree changed no binding, and is reused only while the
+ * version is still the same.
+ */
+
+SatLiteral TseitinEncoder::encode(const LangExpression *lexp) {
+    enum Action { VISIT, COMBINE, NEGATE, BIND, UNBIND, STORE, REMEMBER };
+    struct Task {
+        Action action;
+        const LangExpression *node;
+        uint64_t version;
+    };
+    vector<Task> tasks;
+    vector<SatLiteral> literals;
+    vector<SatLiteral> saved;
+    tasks.push_back({ VISIT, lexp, 0 });
+    while (!tasks.empty()) {
+        Task task = tasks.back();
+        tasks.pop_back();
+        const LangExpression *node = task.node;
+        switch (task.action) {
+        case VISIT: {
+            auto found = encoded.find(node);
+            if (found != encoded.end() && found->second.version == version) {
+                literals.push_back(found->second.literal);
+                break;
+            }
+            switch (node->getType()) {
+            case RefEXP:
+                literals.push_back(lookup(node->getSymbolId()));
+                break;
+            case BoolEXP:
+                literals.push_back(node->getBoolValue() ? trueLiteral : negateLiteral(trueLiteral));
+                break;
+            case NotEXP:
+                tasks.push_back({ NEGATE, node, 0 });
+                tasks.push_back({ VISIT, node->getOperand(), 0 });
+                break;
+            case AndEXP: case OrEXP: case ImpEXP: case IffEXP:
+                tasks.push_back({ REMEMBER, node, version });
+                tasks.push_back({ COMBINE, node, 0 });
+                tasks.push_back({ VISIT, node->getSecond(), 0 });
+                tasks.push_back({ VISIT, node->getFirst(), 0 });
+                break;
+            case NaryAndEXP: case NaryOrEXP: case NaryIffEXP: case NaryXorEXP:
+                tasks.push_back({ REMEMBER, node, version });
+                for (int i = node->getOperandCount() - 1; i > 0; i--) {
+                    tasks.push_back({ COMBINE, node, 0 });
+                    tasks.push_back({ VISIT, node->getOperands()[i], 0 });
+                }
+                tasks.push_back({ VISIT, node->getOperands()[0], 0 });
+                break;
+            case LetEXP:
+                tasks.push_back({ UNBIND, node, 0 });
+                tasks.push_back({ VISIT, node->getBody(), 0 });
+                tasks.push_back({ BIND, node, 0 });
+                tasks.push_back({ VISIT, node->getBinding(), 0 });
+                break;
+            case SetEXP:
+                tasks.push_back({ STORE, node, 0 });
+                tasks.push_back({ VISIT, node->getBinding(), 0 });
+                break;
+            case NullEXP:
+                error("EVALUATION ERROR >> Attempted null evaluation.");
+            }
+            break;
+        }
+        case COMBINE: {
+            SatLiteral second = literals.back();
+            literals.pop_back();
+            literals.back() = combine(node->getType(), literals.back(), second);
+            break;
+        }
+        case NEGATE:
+            literals.back() = negateLiteral(literals.back());
+            break;
+        case BIND: {
+            SymbolId var = node->getVariableId();
+            reserveBinding(var);
+            saved.push_back(bindings[var]);
+            bindings[var] = literals.back();
+            literals.pop_back();
+            version++;
+            break;
+        }
+        case UNBIND:
+            bindings[node->getVariableId()] = saved.back();
+            saved.pop_back();
+            version++;
+            break;
+        case STORE: {
+            SymbolId var = node->getVariableId();
+            reserveBinding(var);
+            bindings[var] = literals.back();
+            version++;
+            break;
+        }
+        case REMEMBER:
+            if (task.version == version) encoded[node] = { literals.back(), version };
+            break;
+        }
+    }
+    return literals.back();
+}
+
+/**
+ * Implementation notes: require
+ * -----------------------------
+ * Requiring and to be true, or or to be false, or imp to be false, means
+ * requiring something of each operand, however many an and or an or has;
+ * not just flips what is required.
+ * Anything else becomes one clause. Operands are handled first to second,
+ * the order in which encode would have visited them.
+ */
+
+void TseitinEncoder::require(const LangExpression *lexp, bool value) {
+    struct Requirement {
+        const LangExpression *node;
+        bool value;
+    };
+    vector<Requirement> pending;
+    pending.push_back({ lexp, value });
+    while (!pending.empty()) {
+        Requirement requirement = pending.back();
+        pending.pop_back();
+        const LangExpression *node = requirement.node;
+        LangExpressionType type = node->getType();
+        if (type == NotEXP) {
+            pending.push_back({ node->getOperand(), !requirement.value });
+        } else if (type == AndEXP && requirement.value) {
+            pending.push_back({ node->getSecond(), true });
+            pending.push_back({ node->getFirst(), true });
+        } else if ((type == OrEXP || type == ImpEXP) && !requirement.value) {
+            pending.push_back({ node->getSecond(), false });
+            pending.push_back({ node->getFirst(), type == ImpEXP });
+        } else if ((type == NaryAndEXP && requirement.value) || (type == NaryOrEXP && !requirement.value)) {
+            for (int i = node->getOperandCount() - 1; i >= 0; i--) {
+                pending.push_back({ node->getOperands()[i], requirement.value });
+            }
+        } else {
+            requireClause(node, requirement.value);
+        }
+    }
+}
+
+/**
+ * Implementation notes: requireClause
+ * -----------------------------------
+ * Collects the disjuncts of the formula, looking through or, imp, and and
+ * under not, whether binary or n-ary, and adds one clause with a literal
+ * for each of them.
+ */
+
+void TseitinEncoder::requireClause(const LangExpression *lexp, bool value) {
+    struct Disjunct {
+        const LangExpression *node;
+        bool value;
+    };
+    vector<Disjunct> pending;
+    vector<SatLiteral> clause;
+    pending.push_back({ lexp, value });
+    while (!pending.empty()) {
+        Disjunct disjunct = pending.back();
+        pending.pop_back();
+        const LangExpression *node = disjunct.node;
+        LangExpressionType type = node->getType();
+        if (type == NotEXP) {
+            pending.push_back({ node->getOperand(), !disjunct.value });
+        } else if ((type == OrEXP || type == ImpEXP) && disjunct.value) {
+            pending.push_back({ node->getSecond(), true });
+            pending.push_back({ node->getFirst(), type == OrEXP });
+        } else if (type == AndEXP && !disjunct.value) {
+            pending.push_back({ node->getSecond(), false });
+            pending.push_back({ node->getFirst(), false });
+        } else if ((type == NaryOrEXP && disjunct.value) || (type == NaryAndEXP && !disjunct.value)) {
+            for (int i = node->getOperandCount() - 1; i >= 0; i--) {
+                pending.push_back({ node->getOperands()[i], disjunct.value });
+            }
+        } else {
+            SatLiteral literal = encode(node);
+            clause.push_back(disjunct.value ? literal : negateLiteral(literal));
+        }
+    }
+    solver.addClause(clause);
+}
+
+int TseitinEncoder::getFreeVariableCount() const {
+    return freeVariables.size();
+}
+
+SymbolId TseitinEncoder::getFreeVariable(int index) const {
+    return freeVariables[index];
+}
+
+SatLiteral TseitinEncoder::getFreeVariableLiteral(int index) const {
+    return freeLiterals[index];
+}
+
+/**
+ * Implementation notes: lookup
+ * ----------------------------
+ * A variable read before anything binds it is free, and gets a solver
+ * variable of its own. A let or set that comes first stands it for the
+ * binding's literal instead, so it never becomes free at all.
+ */
+
+SatLiteral TseitinEncoder::lookup(SymbolId symbol) {
+    reserveBinding(symbol);
+    if (bindings[symbol] == kNoLiteral) {
+        bindings[symbol] = makeLiteral(solver.newVariable());
+        freeVariables.push_back(symbol);
+        freeLiterals.push_back(bindings[symbol]);
+    }
+    return bindings[symbol];
+}
+
+void TseitinEncoder::reserveBinding(SymbolId symbol) {
+    if (static_cast<size_t>(symbol) >= bindings.size()) bindings.resize(symbol + 1, kNoLiteral);
+}
+
+SatLiteral TseitinEncoder::combine(LangExpressionType type, SatLiteral first, SatLiteral second) {
+    switch (type) {
+    case AndEXP: case NaryAndEXP: return andGate(first, second);
+    case OrEXP: case NaryOrEXP: return negateLiteral(andGate(negateLiteral(first), negateLiteral(second)));
+    case ImpEXP: return negateLiteral(andGate(first, negateLiteral(second)));
+    case NaryXorEXP: return negateLiteral(iffGate(first, second));
+    default: return iffGate(first, second);
+    }
+}
+
+SatLiteral TseitinEncoder::andGate(SatLiteral first, SatLiteral second) {
+    SatLiteral falseLiteral = negateLiteral(trueLiteral);
+    if (first == falseLiteral || second == falseLiteral || first == negateLiteral(second)) return falseLiteral;
+    if (first == trueLiteral || first == second) return second;
+    if (second == trueLiteral) return first;
+    SatLiteral gate = makeLiteral(solver.newVariable());
+    solver.addClause({ negateLiteral(gate), first });
+    solver.addClause({ negateLiteral(gate), second });
+    solver.addClause({ gate, negateLiteral(first), negateLiteral(second) });
+    return gate;
+}
+
+SatLiteral TseitinEncoder::iffGate(SatLiteral first, SatLiteral second) {
+    if (first == second) return trueLiteral;
+    if (first == negateLiteral(second)) return negateLiteral(trueLiteral);
+    if (first == trueLiteral) return second;
+    if (second == trueLiteral) return first;
+    if (first == negateLiteral(trueLiteral)) return negateLiteral(second);
+    if (second == negateLiteral(trueLiteral)) return negateLiteral(first);
+    SatLiteral gate = makeLiteral(solver.newVariable());
+    solver.addClause({ negateLiteral(gate), negateLiteral(first), second });
+    solver.addClause({ negateLiteral(gate), first, negateLiteral(second) });
+    solver.addClause({ gate, first, second });
+    solver.addClause({ gate, negateLiteral(first), negateLiteral(second) });
+    return gate;
+}
+
+SatAnswer solveFormula(const LangExpression *lexp, bool value) {
+    SatSolver solver;
+    TseitinEncoder encoder(solver);
+    encoder.require(lexp, value);
+    SatAnswer answer;
+    answer.found = solver.solve();
+    for (int i = 0; i < encoder.getFreeVariableCount(); i++) {
+        answer.variables.push_back(encoder.getFreeVariable(i));
+        if (answer.found) answer.values.push_back(solver.getModelValue(literalVariable(encoder.getFreeVariableLiteral(i))));
+    }
+    answer.stats = solver.getStats();
+    return answer;
+}
+
+void assignModel(const SatAnswer& answer, LangEvaluationContext& context) {
+    if (!answer.found) return;
+    for (size_t i = 0; i < answer.variables.size(); i++) context.setValue(answer.variables[i], answer.values[i]);
+}
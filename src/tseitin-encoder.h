@@ -0,0 +1,111 @@
+/**
+ * File: tseitin-encoder.h
+ * -------------
+ * This interface defines the translation of LangExpressions into clauses
+ * for the SAT solver, and satisfiability queries built on the two.
+ */
+
+#ifndef TSEITIN_ENCODER_H
+#define TSEITIN_ENCODER_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "langexpressions.h"
+#include "sat-solver.h"
+#include "symbol-table.h"
+
+/**
+ * Class: TseitinEncoder
+ * ---------------------
+ * Adds clauses to a solver that define a literal equivalent to a formula.
+ * Each connective gets a fresh variable tied to its operands by a few
+ * clauses, so the clauses grow linearly with the formula rather than
+ * exponentially as a direct conversion to CNF would. A not is just the
+ * negated literal, and a let or set is inlined by having the variable
+ * stand for its binding's literal wherever the binding is in scope, just
+ * as the truth-table engine treats them. Free variables get a solver
+ * variable of their own, in order of first appearance.
+ *
+ * require adds clauses that force a formula to have a value outright. It
+ * splits conjunctions into separate requirements and turns disjunctions
+ * of any width into single clauses, so a formula already in conjunctive
+ * normal form gets its own clauses back without any gate variables, and
+ * encode is left only for the subformulas in between.
+ *
+ * Nodes shared within a hash-consed DAG are encoded once, as long as no
+ * binding has changed in between.
+ */
+
+class TseitinEncoder {
+public:
+    TseitinEncoder(SatSolver& solver);
+
+    SatLiteral encode(const LangExpression *lexp);
+    void require(const LangExpression *lexp, bool value);
+
+    int getFreeVariableCount() const;
+    SymbolId getFreeVariable(int index) const;
+    SatLiteral getFreeVariableLiteral(int index) const;
+
+private:
+    struct Encoded {
+        SatLiteral literal;
+        uint64_t version;
+    };
+
+    void requireClause(const LangExpression *lexp, bool value);
+    SatLiteral lookup(SymbolId symbol);
+    void reserveBinding(SymbolId symbol);
+    SatLiteral combine(LangExpressionType type, SatLiteral first, SatLiteral second);
+    SatLiteral andGate(SatLiteral first, SatLiteral second);
+    SatLiteral iffGate(SatLiteral first, SatLiteral second);
+
+    SatSolver& solver;
+    SatLiteral trueLiteral;
+    std::vector<SatLiteral> bindings;
+    std::vector<SymbolId> freeVariables;
+    std::vector<SatLiteral> freeLiterals;
+    std::unordered_map<const LangExpression *, Encoded> encoded;
+    uint64_t version;
+
+    TseitinEncoder(const TseitinEncoder&) = delete;
+    TseitinEncoder& operator=(const TseitinEncoder&) = delete;
+};
+
+/**
+ * Type: SatAnswer
+ * ---------------
+ * The outcome of solveFormula. When found is true, values holds the
+ * assignment found for each free variable listed in variables.
+ */
+
+struct SatAnswer {
+    bool found;
+    std::vector<SymbolId> variables;
+    std::vector<bool> values;
+    SatSolverStats stats;
+};
+
+/**
+ * Function: solveFormula
+ * Usage: SatAnswer answer = solveFormula(lexp, true);
+ * -------------------------------------------
+ * Looks for an assignment to the free variables of the formula under
+ * which it has the given value: true to test satisfiability, false to
+ * look for a counterexample to a tautology.
+ */
+
+SatAnswer solveFormula(const LangExpression *lexp, bool value);
+
+/**
+ * Function: assignModel
+ * Usage: assignModel(answer, context);
+ * -------------------------------------------
+ * Binds every variable of a found assignment in the context, after which
+ * evaluating a formula without set there gives the value asked for.
+ */
+
+void assignModel(const SatAnswer& answer, LangEvaluationContext& context);
+
+#endif // TSEITIN_ENCODER_H
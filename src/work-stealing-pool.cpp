@@ -0,0 +1,106 @@
+/**
+ * File: work-stealing-pool.cpp
+ * -------------
+ * This file implements the work-stealing-pool.h interface.
+ */
+
+#include "work-stealing-pool.h"
+using namespace std;
+
+/**
+ * Implementation notes: WorkStealingPool
+ * --------------------------------------
+ * Each queue has its own lock, so a worker taking from its own queue only
+ * contends with the submitter and with the occasional thief. The shared
+ * state lock guards the count of unfinished tasks and the stopping flag,
+ * and is what idle workers and wait() sleep on. The count of queued tasks
+ * is raised under that lock before the task is queued and anyone is woken,
+ * so an idle worker can never miss a submission between checking for work
+ * and going to sleep, and the count never drops below the true number.
+ */
+
+WorkStealingPool::WorkStealingPool(int threadCount) : queued(0), steals(0) {
+    unfinished = 0;
+    nextQueue = 0;
+    stopping = false;
+    if (threadCount < 1) threadCount = 1;
+    for (int i = 0; i < threadCount; i++) queues.emplace_back(new Queue);
+    for (int i = 0; i < threadCount; i++) threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        lock_guard<mutex> guard(stateLock);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (thread& worker : threads) worker.join();
+}
+
+int WorkStealingPool::getThreadCount() const {
+    return threads.size();
+}
+
+void WorkStealingPool::submit(const Task& task) {
+    Queue& queue = *queues[nextQueue];
+    nextQueue = (nextQueue + 1) % queues.size();
+    {
+        lock_guard<mutex> guard(stateLock);
+        unfinished++;
+        queued++;
+    }
+    {
+        lock_guard<mutex> guard(queue.lock);
+        queue.tasks.push_back(task);
+    }
+    workAvailable.notify_one();
+}
+
+void WorkStealingPool::wait() {
+    unique_lock<mutex> guard(stateLock);
+    allDone.wait(guard, [this] { return unfinished == 0; });
+}
+
+uint64_t WorkStealingPool::getStealCount() const {
+    return steals;
+}
+
+void WorkStealingPool::workerLoop(int worker) {
+    while (true) {
+        Task task;
+        if (takeTask(worker, task)) {
+            task(worker);
+            lock_guard<mutex> guard(stateLock);
+            if (--unfinished == 0) allDone.notify_all();
+            continue;
+        }
+        unique_lock<mutex> guard(stateLock);
+        workAvailable.wait(guard, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) return;
+    }
+}
+
+bool WorkStealingPool::takeTask(int worker, Task& task) {
+    {
+        Queue& own = *queues[worker];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = move(own.tasks.back());
+            own.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < queues.size(); offset++) {
+        Queue& victim = *queues[(worker + offset) % queues.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued--;
+            steals++;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,68 @@
+/**
+ * File: work-stealing-pool.h
+ * -------------
+ * This interface defines a fixed pool of worker threads that share out
+ * submitted tasks by work stealing.
+ */
+
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Class: WorkStealingPool
+ * -----------------------
+ * Every worker owns a queue of tasks. Submitted tasks are dealt out to the
+ * queues in turn; a worker runs the newest task in its own queue and,
+ * when that is empty, steals the oldest task from another worker's queue.
+ * Each task is told the index of the worker running it, from 0 up to
+ * getThreadCount() - 1, so callers can keep per-worker state without any
+ * locking of their own. Tasks must not throw.
+ */
+
+class WorkStealingPool {
+public:
+    typedef std::function<void(int worker)> Task;
+
+    WorkStealingPool(int threadCount);
+    ~WorkStealingPool();
+
+    int getThreadCount() const;
+    void submit(const Task& task);
+    void wait();
+    uint64_t getStealCount() const;
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(int worker);
+    bool takeTask(int worker, Task& task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex stateLock;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+    std::atomic<size_t> queued;
+    size_t unfinished;
+    size_t nextQueue;
+    bool stopping;
+    std::atomic<uint64_t> steals;
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+};
+
+#endif // WORK_STEALING_POOL_H
@@ -0,0 +1,100 @@
+/**
+ * File: operator-alias-test.cpp
+ * -------------
+ * This program checks that the built-in operators spelled with several
+ * tokens, such as <=> and [+], parse from the very first formula of a
+ * process, before anything else has used the operator table, and that
+ * set cannot be given another name. It is built like the benchmark, from
+ * the sources in src/ with its own main in place of
+ * lisp-flavored-logic-main.cpp:
+ *
+ *   g++ -std=c++11 -O2 -pthread -I"$SPL_INCLUDE" -Isrc tests/operator-alias-test.cpp \
+ *       $(find src -name '*.cpp' ! -name lisp-flavored-logic-main.cpp) $SPL_SOURCES -o operator-alias-test
+ *
+ * It prints one line per failed check and exits with status 1 if there
+ * was any, and 0 otherwise.
+ */
+
+#include <iostream>
+#include <string>
+#include "sexpressions.h"
+#include "sexpression-parser.h"
+#include "langexpressions.h"
+#include "langexpression-parser.h"
+#include "error.h"
+#include "strlib.h"
+using namespace std;
+
+/* Function prototypes */
+
+static bool checkValue(const string& formula, bool expected);
+static bool checkSetAliasRefused();
+
+/* Formulas with multi-token operators, and their values */
+
+struct AliasCase {
+    const char *formula;
+    bool value;
+};
+
+static const AliasCase kAliasCases[] = {
+    { "((<=>) t f)", false },
+    { "((<=>) f f)", true },
+    { "((=>) t f)", false },
+    { "((||) f t)", true },
+    { "((||) f f)", false },
+    { "(([+]) f t)", true },
+    { "(([*]) t f)", false },
+    { "(([-]) f)", true }
+};
+
+int main() {
+    int failures = 0;
+    for (const AliasCase& entry : kAliasCases) {
+        if (!checkValue(entry.formula, entry.value)) failures++;
+    }
+    if (!checkSetAliasRefused()) failures++;
+    return failures == 0 ? 0 : 1;
+}
+
+/**
+ * Function: checkValue
+ * Usage: if (!checkValue(formula, expected)) failures++;
+ * -------------------------------------------
+ * Parses and evaluates formula, and reports it unless it parses and has
+ * the expected value. Returns whether it did.
+ */
+
+bool checkValue(const string& formula, bool expected) {
+    try {
+        SExpression *sexp = parseOneSExp(formula);
+        LangExpression *lexp = parseLangExp(sexp);
+        delete sexp;
+        LangEvaluationContext context;
+        bool value = lexp->eval(context);
+        delete lexp;
+        if (value == expected) return true;
+        cout << formula << ": expected " << boolToString(expected) << ", got " << boolToString(value) << endl;
+    } catch (ErrorException& ex) {
+        cout << formula << ": " << ex.getMessage() << endl;
+    }
+    return false;
+}
+
+/**
+ * Function: checkSetAliasRefused
+ * Usage: if (!checkSetAliasRefused()) failures++;
+ * -------------------------------------------
+ * Reports registering a second name for set unless it raises an error,
+ * and returns whether it did.
+ */
+
+bool checkSetAliasRefused() {
+    try {
+        registerLangOperator("assign", { SetEXP, false });
+    } catch (ErrorException& ex) {
+        return true;
+    }
+    cout << "registerLangOperator accepted another name for set" << endl;
+    return false;
+}